@@ -32,6 +32,7 @@ SRC_DIRS = \
 SRC_FILES = \
         $(DEVICE_CLOUD_LIB_DIR)/src/api/iot_action.c \
         $(DEVICE_CLOUD_LIB_DIR)/src/api/iot_alarm.c \
+        $(DEVICE_CLOUD_LIB_DIR)/src/api/iot_archive.c \
         $(DEVICE_CLOUD_LIB_DIR)/src/api/iot_attribute.c \
         $(DEVICE_CLOUD_LIB_DIR)/src/api/iot_base64.c \
         $(DEVICE_CLOUD_LIB_DIR)/src/api/iot_base.c \
@@ -49,6 +50,8 @@ SRC_FILES = \
         $(DEVICE_CLOUD_LIB_DIR)/src/api/json/iot_json_schema.c \
         $(DEVICE_CLOUD_LIB_DIR)/src/api/checksum/iot_checksum.c \
         $(DEVICE_CLOUD_LIB_DIR)/src/api/checksum/iot_checksum_crc32.c \
+        $(DEVICE_CLOUD_LIB_DIR)/src/api/checksum/iot_checksum_md5.c \
+        $(DEVICE_CLOUD_LIB_DIR)/src/api/checksum/iot_checksum_sha256.c \
         $(DEVICE_CLOUD_LIB_DIR)/src/api/plugin/iot_plugin_builtin.c \
         $(DEVICE_CLOUD_LIB_DIR)/src/api/plugin/tr50/tr50.c \
         $(DEVICE_CLOUD_LIB_DIR)/src/utilities/app_arg.c \
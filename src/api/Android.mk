@@ -37,7 +37,7 @@ LOCAL_STATIC_LIBRARIES := libosal libandroidifaddrs
 include $(BUILD_STATIC_LIBRARY)
 endef
 
-$(eval $(call build_plugin_util, libtr50, ./plugin/tr50/tr50.c ) )
+$(eval $(call build_plugin_util, libtr50, ./plugin/tr50/tr50.c ./plugin/tr50/tr50_hub.c ./plugin/tr50/tr50_transfer.c ) )
 
 # build libiot
 include $(CLEAR_VARS)
@@ -51,6 +51,7 @@ LOCAL_MODULE := libiot
 LOCAL_SRC_FILES := \
 	./iot_action.c \
 	./iot_alarm.c \
+	./iot_archive.c \
 	./iot_attribute.c \
 	./iot_base.c \
 	./iot_base64.c \
@@ -64,6 +65,8 @@ LOCAL_SRC_FILES := \
 	./iot_telemetry.c \
 	./checksum/iot_checksum.c \
 	./checksum/iot_checksum_crc32.c \
+	./checksum/iot_checksum_md5.c \
+	./checksum/iot_checksum_sha256.c \
 	./json/iot_json_decode.c \
 	./json/iot_json_encode.c \
 	./json/iot_json_schema.c \
@@ -17,6 +17,94 @@
 
 #include "iot_checksum.h"
 #include "iot_checksum_crc32.h"
+#include "iot_checksum_md5.h"
+#include "iot_checksum_sha256.h"
+
+/** @brief Size of the blocks processed by MD5 & SHA256, in bytes */
+#define IOT_CHECKSUM_BLOCK_SIZE        64u
+/** @brief Offset of the message length in the last block (MD5 & SHA256) */
+#define IOT_CHECKSUM_LENGTH_OFFSET     56u
+/** @brief Size of the reads when checksumming a file */
+#define IOT_CHECKSUM_READ_SIZE         65536u
+
+/**
+ * @brief processes blocks of data into the state of a MD5 or SHA256 checksum
+ *
+ * @param[in,out]  ctx                 checksum being calculated
+ * @param[in]      data                data to process
+ * @param[in]      blocks              number of blocks in @p data
+ */
+static void iot_checksum_blocks(
+	iot_checksum_ctx_t *ctx,
+	const unsigned char *data,
+	size_t blocks );
+
+/**
+ * @brief writes 32-bit words to a buffer, in a given byte order
+ *
+ * @param[out]     dest                buffer to write to
+ * @param[in]      words               words to write
+ * @param[in]      count               number of words to write
+ * @param[in]      big_endian          whether to write the most significant
+ *                                     byte first
+ */
+static void iot_checksum_words_store(
+	unsigned char *dest,
+	const iot_uint32_t *words,
+	size_t count,
+	iot_bool_t big_endian );
+
+void iot_checksum_blocks(
+	iot_checksum_ctx_t *ctx,
+	const unsigned char *data,
+	size_t blocks )
+{
+	if ( ctx->type == IOT_CHECKSUM_TYPE_MD5 )
+		iot_checksum_md5_blocks( ctx->state, data, blocks );
+	else
+		iot_checksum_sha256_blocks( ctx->state, data, blocks );
+}
+
+iot_status_t iot_checksum_file_digest(
+	iot_t *lib,
+	os_file_t file,
+	iot_checksum_type_t type,
+	void *checksum,
+	size_t checksum_len )
+{
+	iot_checksum_ctx_t ctx;
+	iot_status_t result = iot_checksum_initialize( &ctx, type );
+	if ( result == IOT_STATUS_SUCCESS && file && checksum &&
+		checksum_len >= iot_checksum_size( type ) )
+	{
+		unsigned char *const data = (unsigned char *)os_malloc(
+			IOT_CHECKSUM_READ_SIZE );
+
+		result = IOT_STATUS_NO_MEMORY;
+		if ( data )
+		{
+			size_t bytes;
+			while ( ( bytes = os_file_read( data, 1u,
+				IOT_CHECKSUM_READ_SIZE, file ) ) != 0u )
+				iot_checksum_update( &ctx, data, bytes );
+			os_free( data );
+
+			result = IOT_STATUS_FAILURE;
+			if ( os_file_eof( file ) )
+				result = iot_checksum_final( &ctx, checksum,
+					checksum_len );
+			else
+				IOT_LOG( lib, IOT_LOG_ERROR, "%s",
+					"Failed to read file to checksum" );
+		}
+	}
+	else if ( result == IOT_STATUS_SUCCESS )
+		result = IOT_STATUS_BAD_PARAMETER;
+	else
+		IOT_LOG( lib, IOT_LOG_ERROR, "%s",
+			"Checksum algorithm not support" );
+	return result;
+}
 
 iot_status_t iot_checksum_file_get(
 	iot_t *lib,
@@ -34,6 +122,11 @@ iot_status_t iot_checksum_file_get(
 			break;
 		case IOT_CHECKSUM_TYPE_MD5:
 		case IOT_CHECKSUM_TYPE_SHA256:
+			IOT_LOG( lib, IOT_LOG_ERROR, "%s",
+				"Checksum algorithm does not fit in 64 bits, "
+				"use iot_checksum_file_digest" );
+			result = IOT_STATUS_NOT_SUPPORTED;
+			break;
 		default:
 			IOT_LOG( lib, IOT_LOG_ERROR, "%s",
 				"Checksum algorithm not support" );
@@ -42,3 +135,171 @@ iot_status_t iot_checksum_file_get(
 	}
 	return result;
 }
+
+iot_status_t iot_checksum_final(
+	iot_checksum_ctx_t *ctx,
+	void *checksum,
+	size_t checksum_len )
+{
+	iot_status_t result = IOT_STATUS_BAD_PARAMETER;
+	if ( ctx && checksum && iot_checksum_size( ctx->type ) > 0u &&
+		checksum_len >= iot_checksum_size( ctx->type ) )
+	{
+		unsigned char *const out = (unsigned char *)checksum;
+		if ( ctx->type == IOT_CHECKSUM_TYPE_CRC32 )
+			iot_checksum_words_store( out, ctx->state, 1u,
+				IOT_TRUE );
+		else
+		{
+			const iot_bool_t big_endian =
+				( ctx->type == IOT_CHECKSUM_TYPE_SHA256 );
+			const iot_uint64_t bits = ctx->length * 8u;
+			size_t fill = (size_t)( ctx->length %
+				IOT_CHECKSUM_BLOCK_SIZE );
+			iot_uint32_t words[2u];
+
+			/* padding: a one bit, zeros & the length in bits */
+			ctx->block[fill++] = 0x80u;
+			if ( fill > IOT_CHECKSUM_LENGTH_OFFSET )
+			{
+				os_memzero( &ctx->block[fill],
+					IOT_CHECKSUM_BLOCK_SIZE - fill );
+				iot_checksum_blocks( ctx, ctx->block, 1u );
+				fill = 0u;
+			}
+			os_memzero( &ctx->block[fill],
+				IOT_CHECKSUM_LENGTH_OFFSET - fill );
+			if ( big_endian != IOT_FALSE )
+			{
+				words[0] = (iot_uint32_t)( bits >> 32 );
+				words[1] = (iot_uint32_t)bits;
+			}
+			else
+			{
+				words[0] = (iot_uint32_t)bits;
+				words[1] = (iot_uint32_t)( bits >> 32 );
+			}
+			iot_checksum_words_store(
+				&ctx->block[IOT_CHECKSUM_LENGTH_OFFSET],
+				words, 2u, big_endian );
+			iot_checksum_blocks( ctx, ctx->block, 1u );
+
+			iot_checksum_words_store( out, ctx->state,
+				iot_checksum_size( ctx->type ) /
+				sizeof( iot_uint32_t ), big_endian );
+		}
+		result = IOT_STATUS_SUCCESS;
+	}
+	return result;
+}
+
+iot_status_t iot_checksum_initialize(
+	iot_checksum_ctx_t *ctx,
+	iot_checksum_type_t type )
+{
+	iot_status_t result = IOT_STATUS_BAD_PARAMETER;
+	if ( ctx && iot_checksum_size( type ) > 0u )
+	{
+		os_memzero( ctx, sizeof( iot_checksum_ctx_t ) );
+		ctx->type = type;
+		if ( type == IOT_CHECKSUM_TYPE_MD5 )
+			iot_checksum_md5_initialize( ctx->state );
+		else if ( type == IOT_CHECKSUM_TYPE_SHA256 )
+			iot_checksum_sha256_initialize( ctx->state );
+		result = IOT_STATUS_SUCCESS;
+	}
+	return result;
+}
+
+size_t iot_checksum_size(
+	iot_checksum_type_t type )
+{
+	size_t result = 0u;
+	switch ( type )
+	{
+	case IOT_CHECKSUM_TYPE_CRC32:
+		result = IOT_CHECKSUM_CRC32_SIZE;
+		break;
+	case IOT_CHECKSUM_TYPE_MD5:
+		result = IOT_CHECKSUM_MD5_SIZE;
+		break;
+	case IOT_CHECKSUM_TYPE_SHA256:
+		result = IOT_CHECKSUM_SHA256_SIZE;
+		break;
+	default:
+		break;
+	}
+	return result;
+}
+
+iot_status_t iot_checksum_update(
+	iot_checksum_ctx_t *ctx,
+	const void *data,
+	size_t len )
+{
+	iot_status_t result = IOT_STATUS_BAD_PARAMETER;
+	if ( ctx && ( data || len == 0u ) )
+	{
+		const unsigned char *in = (const unsigned char *)data;
+		if ( ctx->type == IOT_CHECKSUM_TYPE_CRC32 )
+			ctx->state[0] = iot_checksum_crc32_update(
+				ctx->state[0], in, len );
+		else
+		{
+			size_t fill = (size_t)( ctx->length %
+				IOT_CHECKSUM_BLOCK_SIZE );
+
+			/* complete a block started by an earlier call */
+			if ( fill > 0u && len > 0u )
+			{
+				size_t take = IOT_CHECKSUM_BLOCK_SIZE - fill;
+				if ( take > len )
+					take = len;
+				os_memcpy( &ctx->block[fill], in, take );
+				fill += take;
+				in += take;
+				len -= take;
+				ctx->length += take;
+				if ( fill == IOT_CHECKSUM_BLOCK_SIZE )
+					iot_checksum_blocks( ctx, ctx->block,
+						1u );
+			}
+
+			/* full blocks are processed where they are */
+			if ( len >= IOT_CHECKSUM_BLOCK_SIZE )
+			{
+				const size_t blocks =
+					len / IOT_CHECKSUM_BLOCK_SIZE;
+				iot_checksum_blocks( ctx, in, blocks );
+				in += blocks * IOT_CHECKSUM_BLOCK_SIZE;
+				len -= blocks * IOT_CHECKSUM_BLOCK_SIZE;
+				ctx->length += blocks * IOT_CHECKSUM_BLOCK_SIZE;
+			}
+
+			if ( len > 0u )
+				os_memcpy( ctx->block, in, len );
+		}
+		ctx->length += len;
+		result = IOT_STATUS_SUCCESS;
+	}
+	return result;
+}
+
+void iot_checksum_words_store(
+	unsigned char *dest,
+	const iot_uint32_t *words,
+	size_t count,
+	iot_bool_t big_endian )
+{
+	size_t i;
+	for ( i = 0u; i < count; ++i )
+	{
+		unsigned int j;
+		for ( j = 0u; j < 4u; ++j )
+		{
+			const unsigned int shift = ( big_endian != IOT_FALSE ) ?
+				( 3u - j ) * 8u : j * 8u;
+			*dest++ = (unsigned char)( words[i] >> shift );
+		}
+	}
+}
@@ -0,0 +1,173 @@
+/**
+ * @file
+ * @brief source file for calculating MD5 checksums
+ *
+ * Implementation of the RSA Data Security, Inc. MD5 Message-Digest Algorithm
+ * (RFC 1321).
+ *
+ * Each step of MD5 depends on the result of the previous one, so there is no
+ * gain to be had from vector instructions; the steps are unrolled instead,
+ * with the message words loaded once per block.
+ *
+ * @copyright Copyright (C) 2018 Wind River Systems, Inc. All Rights Reserved.
+ *
+ * @license Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied."
+ */
+
+#include "iot_checksum_md5.h"
+
+/** @brief MD5 auxiliary function F (optimized form of (x&y)|(~x&z)) */
+#define IOT_CHECKSUM_MD5_FUNC_F( x, y, z ) ( (z) ^ ( (x) & ( (y) ^ (z) ) ) )
+/** @brief MD5 auxiliary function G (optimized form of (x&z)|(y&~z)) */
+#define IOT_CHECKSUM_MD5_FUNC_G( x, y, z ) ( (y) ^ ( (z) & ( (x) ^ (y) ) ) )
+/** @brief MD5 auxiliary function H */
+#define IOT_CHECKSUM_MD5_FUNC_H( x, y, z ) ( (x) ^ (y) ^ (z) )
+/** @brief MD5 auxiliary function I */
+#define IOT_CHECKSUM_MD5_FUNC_I( x, y, z ) ( (y) ^ ( (x) | ~(z) ) )
+
+/** @brief one step of MD5 */
+#define IOT_CHECKSUM_MD5_STEP( f, a, b, c, d, x, t, s ) \
+	(a) += f( (b), (c), (d) ) + (x) + (t); \
+	(a) = ( (a) << (s) ) | ( (a) >> ( 32 - (s) ) ); \
+	(a) += (b);
+/** @brief one step of the first round of MD5 */
+#define IOT_CHECKSUM_MD5_ROUND1( a, b, c, d, x, t, s ) \
+	IOT_CHECKSUM_MD5_STEP( IOT_CHECKSUM_MD5_FUNC_F, a, b, c, d, x, t, s )
+/** @brief one step of the second round of MD5 */
+#define IOT_CHECKSUM_MD5_ROUND2( a, b, c, d, x, t, s ) \
+	IOT_CHECKSUM_MD5_STEP( IOT_CHECKSUM_MD5_FUNC_G, a, b, c, d, x, t, s )
+/** @brief one step of the third round of MD5 */
+#define IOT_CHECKSUM_MD5_ROUND3( a, b, c, d, x, t, s ) \
+	IOT_CHECKSUM_MD5_STEP( IOT_CHECKSUM_MD5_FUNC_H, a, b, c, d, x, t, s )
+/** @brief one step of the fourth round of MD5 */
+#define IOT_CHECKSUM_MD5_ROUND4( a, b, c, d, x, t, s ) \
+	IOT_CHECKSUM_MD5_STEP( IOT_CHECKSUM_MD5_FUNC_I, a, b, c, d, x, t, s )
+
+void iot_checksum_md5_blocks(
+	iot_uint32_t *state,
+	const unsigned char *data,
+	size_t blocks )
+{
+	iot_uint32_t a = state[0];
+	iot_uint32_t b = state[1];
+	iot_uint32_t c = state[2];
+	iot_uint32_t d = state[3];
+
+	while ( blocks > 0u )
+	{
+		const iot_uint32_t saved_a = a;
+		const iot_uint32_t saved_b = b;
+		const iot_uint32_t saved_c = c;
+		const iot_uint32_t saved_d = d;
+		iot_uint32_t x[16u];
+		unsigned int i;
+
+		/* message words are little-endian */
+		for ( i = 0u; i < 16u; ++i )
+			x[i] = (iot_uint32_t)data[i * 4u] |
+				(iot_uint32_t)data[i * 4u + 1u] << 8 |
+				(iot_uint32_t)data[i * 4u + 2u] << 16 |
+				(iot_uint32_t)data[i * 4u + 3u] << 24;
+
+		/* round 1 */
+		IOT_CHECKSUM_MD5_ROUND1( a, b, c, d, x[ 0], 0xd76aa478u,  7 )
+		IOT_CHECKSUM_MD5_ROUND1( d, a, b, c, x[ 1], 0xe8c7b756u, 12 )
+		IOT_CHECKSUM_MD5_ROUND1( c, d, a, b, x[ 2], 0x242070dbu, 17 )
+		IOT_CHECKSUM_MD5_ROUND1( b, c, d, a, x[ 3], 0xc1bdceeeu, 22 )
+		IOT_CHECKSUM_MD5_ROUND1( a, b, c, d, x[ 4], 0xf57c0fafu,  7 )
+		IOT_CHECKSUM_MD5_ROUND1( d, a, b, c, x[ 5], 0x4787c62au, 12 )
+		IOT_CHECKSUM_MD5_ROUND1( c, d, a, b, x[ 6], 0xa8304613u, 17 )
+		IOT_CHECKSUM_MD5_ROUND1( b, c, d, a, x[ 7], 0xfd469501u, 22 )
+		IOT_CHECKSUM_MD5_ROUND1( a, b, c, d, x[ 8], 0x698098d8u,  7 )
+		IOT_CHECKSUM_MD5_ROUND1( d, a, b, c, x[ 9], 0x8b44f7afu, 12 )
+		IOT_CHECKSUM_MD5_ROUND1( c, d, a, b, x[10], 0xffff5bb1u, 17 )
+		IOT_CHECKSUM_MD5_ROUND1( b, c, d, a, x[11], 0x895cd7beu, 22 )
+		IOT_CHECKSUM_MD5_ROUND1( a, b, c, d, x[12], 0x6b901122u,  7 )
+		IOT_CHECKSUM_MD5_ROUND1( d, a, b, c, x[13], 0xfd987193u, 12 )
+		IOT_CHECKSUM_MD5_ROUND1( c, d, a, b, x[14], 0xa679438eu, 17 )
+		IOT_CHECKSUM_MD5_ROUND1( b, c, d, a, x[15], 0x49b40821u, 22 )
+
+		/* round 2 */
+		IOT_CHECKSUM_MD5_ROUND2( a, b, c, d, x[ 1], 0xf61e2562u,  5 )
+		IOT_CHECKSUM_MD5_ROUND2( d, a, b, c, x[ 6], 0xc040b340u,  9 )
+		IOT_CHECKSUM_MD5_ROUND2( c, d, a, b, x[11], 0x265e5a51u, 14 )
+		IOT_CHECKSUM_MD5_ROUND2( b, c, d, a, x[ 0], 0xe9b6c7aau, 20 )
+		IOT_CHECKSUM_MD5_ROUND2( a, b, c, d, x[ 5], 0xd62f105du,  5 )
+		IOT_CHECKSUM_MD5_ROUND2( d, a, b, c, x[10], 0x02441453u,  9 )
+		IOT_CHECKSUM_MD5_ROUND2( c, d, a, b, x[15], 0xd8a1e681u, 14 )
+		IOT_CHECKSUM_MD5_ROUND2( b, c, d, a, x[ 4], 0xe7d3fbc8u, 20 )
+		IOT_CHECKSUM_MD5_ROUND2( a, b, c, d, x[ 9], 0x21e1cde6u,  5 )
+		IOT_CHECKSUM_MD5_ROUND2( d, a, b, c, x[14], 0xc33707d6u,  9 )
+		IOT_CHECKSUM_MD5_ROUND2( c, d, a, b, x[ 3], 0xf4d50d87u, 14 )
+		IOT_CHECKSUM_MD5_ROUND2( b, c, d, a, x[ 8], 0x455a14edu, 20 )
+		IOT_CHECKSUM_MD5_ROUND2( a, b, c, d, x[13], 0xa9e3e905u,  5 )
+		IOT_CHECKSUM_MD5_ROUND2( d, a, b, c, x[ 2], 0xfcefa3f8u,  9 )
+		IOT_CHECKSUM_MD5_ROUND2( c, d, a, b, x[ 7], 0x676f02d9u, 14 )
+		IOT_CHECKSUM_MD5_ROUND2( b, c, d, a, x[12], 0x8d2a4c8au, 20 )
+
+		/* round 3 */
+		IOT_CHECKSUM_MD5_ROUND3( a, b, c, d, x[ 5], 0xfffa3942u,  4 )
+		IOT_CHECKSUM_MD5_ROUND3( d, a, b, c, x[ 8], 0x8771f681u, 11 )
+		IOT_CHECKSUM_MD5_ROUND3( c, d, a, b, x[11], 0x6d9d6122u, 16 )
+		IOT_CHECKSUM_MD5_ROUND3( b, c, d, a, x[14], 0xfde5380cu, 23 )
+		IOT_CHECKSUM_MD5_ROUND3( a, b, c, d, x[ 1], 0xa4beea44u,  4 )
+		IOT_CHECKSUM_MD5_ROUND3( d, a, b, c, x[ 4], 0x4bdecfa9u, 11 )
+		IOT_CHECKSUM_MD5_ROUND3( c, d, a, b, x[ 7], 0xf6bb4b60u, 16 )
+		IOT_CHECKSUM_MD5_ROUND3( b, c, d, a, x[10], 0xbebfbc70u, 23 )
+		IOT_CHECKSUM_MD5_ROUND3( a, b, c, d, x[13], 0x289b7ec6u,  4 )
+		IOT_CHECKSUM_MD5_ROUND3( d, a, b, c, x[ 0], 0xeaa127fau, 11 )
+		IOT_CHECKSUM_MD5_ROUND3( c, d, a, b, x[ 3], 0xd4ef3085u, 16 )
+		IOT_CHECKSUM_MD5_ROUND3( b, c, d, a, x[ 6], 0x04881d05u, 23 )
+		IOT_CHECKSUM_MD5_ROUND3( a, b, c, d, x[ 9], 0xd9d4d039u,  4 )
+		IOT_CHECKSUM_MD5_ROUND3( d, a, b, c, x[12], 0xe6db99e5u, 11 )
+		IOT_CHECKSUM_MD5_ROUND3( c, d, a, b, x[15], 0x1fa27cf8u, 16 )
+		IOT_CHECKSUM_MD5_ROUND3( b, c, d, a, x[ 2], 0xc4ac5665u, 23 )
+
+		/* round 4 */
+		IOT_CHECKSUM_MD5_ROUND4( a, b, c, d, x[ 0], 0xf4292244u,  6 )
+		IOT_CHECKSUM_MD5_ROUND4( d, a, b, c, x[ 7], 0x432aff97u, 10 )
+		IOT_CHECKSUM_MD5_ROUND4( c, d, a, b, x[14], 0xab9423a7u, 15 )
+		IOT_CHECKSUM_MD5_ROUND4( b, c, d, a, x[ 5], 0xfc93a039u, 21 )
+		IOT_CHECKSUM_MD5_ROUND4( a, b, c, d, x[12], 0x655b59c3u,  6 )
+		IOT_CHECKSUM_MD5_ROUND4( d, a, b, c, x[ 3], 0x8f0ccc92u, 10 )
+		IOT_CHECKSUM_MD5_ROUND4( c, d, a, b, x[10], 0xffeff47du, 15 )
+		IOT_CHECKSUM_MD5_ROUND4( b, c, d, a, x[ 1], 0x85845dd1u, 21 )
+		IOT_CHECKSUM_MD5_ROUND4( a, b, c, d, x[ 8], 0x6fa87e4fu,  6 )
+		IOT_CHECKSUM_MD5_ROUND4( d, a, b, c, x[15], 0xfe2ce6e0u, 10 )
+		IOT_CHECKSUM_MD5_ROUND4( c, d, a, b, x[ 6], 0xa3014314u, 15 )
+		IOT_CHECKSUM_MD5_ROUND4( b, c, d, a, x[13], 0x4e0811a1u, 21 )
+		IOT_CHECKSUM_MD5_ROUND4( a, b, c, d, x[ 4], 0xf7537e82u,  6 )
+		IOT_CHECKSUM_MD5_ROUND4( d, a, b, c, x[11], 0xbd3af235u, 10 )
+		IOT_CHECKSUM_MD5_ROUND4( c, d, a, b, x[ 2], 0x2ad7d2bbu, 15 )
+		IOT_CHECKSUM_MD5_ROUND4( b, c, d, a, x[ 9], 0xeb86d391u, 21 )
+
+		a += saved_a;
+		b += saved_b;
+		c += saved_c;
+		d += saved_d;
+		data += IOT_CHECKSUM_MD5_BLOCK_SIZE;
+		--blocks;
+	}
+
+	state[0] = a;
+	state[1] = b;
+	state[2] = c;
+	state[3] = d;
+}
+
+void iot_checksum_md5_initialize(
+	iot_uint32_t *state )
+{
+	state[0] = 0x67452301u;
+	state[1] = 0xefcdab89u;
+	state[2] = 0x98badcfeu;
+	state[3] = 0x10325476u;
+}
@@ -0,0 +1,355 @@
+/**
+ * @file
+ * @brief source file for calculating SHA256 checksums
+ *
+ * Implementation of the SHA-256 secure hash algorithm (FIPS 180-4), using the
+ * SHA extensions of the processor when available: SHA-NI on x86 (detected at
+ * run time) and the ARMv8 cryptography extensions (enabled at compile time).
+ *
+ * @copyright Copyright (C) 2018 Wind River Systems, Inc. All Rights Reserved.
+ *
+ * @license Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied."
+ */
+
+#include "iot_checksum_sha256.h"
+
+#if defined( __GNUC__ ) && ( defined( __x86_64__ ) || defined( __i386__ ) )
+/** @brief SHA extensions (SHA-NI) support, detected at run time */
+#	define IOT_CHECKSUM_SHA256_SHANI
+#	include <cpuid.h>
+#	include <immintrin.h>
+#	ifndef bit_SHA
+/** @brief SHA extensions flag, in ebx of cpuid leaf 7 */
+#		define bit_SHA ( 1 << 29 )
+#	endif /* ifndef bit_SHA */
+#endif /* if defined( __GNUC__ ) && ( defined( __x86_64__ ) || defined( __i386__ ) ) */
+
+#if defined( __aarch64__ ) && \
+	( defined( __ARM_FEATURE_SHA2 ) || defined( __ARM_FEATURE_CRYPTO ) ) && \
+	defined( __BYTE_ORDER__ ) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+/** @brief ARMv8 SHA256 instructions support (enabled at compile time) */
+#	define IOT_CHECKSUM_SHA256_ARMV8
+#	include <arm_neon.h>
+#endif /* if defined( __aarch64__ ) && ... */
+
+/** @brief rotates a 32-bit value right */
+#define IOT_CHECKSUM_SHA256_ROTR( x, n ) \
+	( ( (x) >> (n) ) | ( (x) << ( 32 - (n) ) ) )
+
+/**
+ * @brief function processing blocks of data into a SHA256 state
+ *
+ * @param[in,out]  state               SHA256 state (intermediate hash value)
+ * @param[in]      data                data to process
+ * @param[in]      blocks              number of 64 byte blocks in @p data
+ */
+typedef void (*iot_checksum_sha256_func_t)(
+	iot_uint32_t *state, const unsigned char *data, size_t blocks );
+
+/** @brief SHA256 round constants */
+static const iot_uint32_t iot_checksum_sha256_k[64u] = {
+	0x428a2f98u, 0x71374491u, 0xb5c0fbcfu, 0xe9b5dba5u, 0x3956c25bu, 0x59f111f1u,
+	0x923f82a4u, 0xab1c5ed5u, 0xd807aa98u, 0x12835b01u, 0x243185beu, 0x550c7dc3u,
+	0x72be5d74u, 0x80deb1feu, 0x9bdc06a7u, 0xc19bf174u, 0xe49b69c1u, 0xefbe4786u,
+	0x0fc19dc6u, 0x240ca1ccu, 0x2de92c6fu, 0x4a7484aau, 0x5cb0a9dcu, 0x76f988dau,
+	0x983e5152u, 0xa831c66du, 0xb00327c8u, 0xbf597fc7u, 0xc6e00bf3u, 0xd5a79147u,
+	0x06ca6351u, 0x14292967u, 0x27b70a85u, 0x2e1b2138u, 0x4d2c6dfcu, 0x53380d13u,
+	0x650a7354u, 0x766a0abbu, 0x81c2c92eu, 0x92722c85u, 0xa2bfe8a1u, 0xa81a664bu,
+	0xc24b8b70u, 0xc76c51a3u, 0xd192e819u, 0xd6990624u, 0xf40e3585u, 0x106aa070u,
+	0x19a4c116u, 0x1e376c08u, 0x2748774cu, 0x34b0bcb5u, 0x391c0cb3u, 0x4ed8aa4au,
+	0x5b9cca4fu, 0x682e6ff3u, 0x748f82eeu, 0x78a5636fu, 0x84c87814u, 0x8cc70208u,
+	0x90befffau, 0xa4506cebu, 0xbef9a3f7u, 0xc67178f2u
+};
+
+#ifdef IOT_CHECKSUM_SHA256_ARMV8
+/**
+ * @brief processes blocks of data with the ARMv8 SHA256 instructions
+ *
+ * @param[in,out]  state               SHA256 state (intermediate hash value)
+ * @param[in]      data                data to process
+ * @param[in]      blocks              number of 64 byte blocks in @p data
+ */
+static void iot_checksum_sha256_armv8(
+	iot_uint32_t *state, const unsigned char *data, size_t blocks );
+#endif /* ifdef IOT_CHECKSUM_SHA256_ARMV8 */
+
+/**
+ * @brief selects the fastest implementation supported by the processor, then
+ *        processes blocks of data with it
+ *
+ * @param[in,out]  state               SHA256 state (intermediate hash value)
+ * @param[in]      data                data to process
+ * @param[in]      blocks              number of 64 byte blocks in @p data
+ */
+static void iot_checksum_sha256_detect(
+	iot_uint32_t *state, const unsigned char *data, size_t blocks );
+
+/**
+ * @brief processes blocks of data, one round at a time
+ *
+ * @param[in,out]  state               SHA256 state (intermediate hash value)
+ * @param[in]      data                data to process
+ * @param[in]      blocks              number of 64 byte blocks in @p data
+ */
+static void iot_checksum_sha256_portable(
+	iot_uint32_t *state, const unsigned char *data, size_t blocks );
+
+#ifdef IOT_CHECKSUM_SHA256_SHANI
+/**
+ * @brief processes blocks of data with the SHA extensions (SHA-NI), four
+ *        rounds at a time
+ *
+ * Based on the sample code of "Intel SHA Extensions" (Intel).
+ *
+ * @param[in,out]  state               SHA256 state (intermediate hash value)
+ * @param[in]      data                data to process
+ * @param[in]      blocks              number of 64 byte blocks in @p data
+ */
+static void iot_checksum_sha256_shani(
+	iot_uint32_t *state, const unsigned char *data, size_t blocks )
+	__attribute__(( target( "sha,sse4.1,ssse3" ) ));
+#endif /* ifdef IOT_CHECKSUM_SHA256_SHANI */
+
+/** @brief implementation used to calculate SHA256s (selected on first use) */
+static iot_checksum_sha256_func_t iot_checksum_sha256_func =
+	iot_checksum_sha256_detect;
+
+#ifdef IOT_CHECKSUM_SHA256_ARMV8
+void iot_checksum_sha256_armv8(
+	iot_uint32_t *state, const unsigned char *data, size_t blocks )
+{
+	uint32x4_t state0 = vld1q_u32( &state[0] );
+	uint32x4_t state1 = vld1q_u32( &state[4] );
+
+	while ( blocks > 0u )
+	{
+		const uint32x4_t saved0 = state0;
+		const uint32x4_t saved1 = state1;
+		uint32x4_t msg[4u];
+		unsigned int i;
+
+		/* message words are big-endian */
+		for ( i = 0u; i < 4u; ++i )
+			msg[i] = vreinterpretq_u32_u8( vrev32q_u8(
+				vld1q_u8( data + i * 16u ) ) );
+
+		for ( i = 0u; i < 16u; ++i )
+		{
+			const uint32x4_t wk = vaddq_u32( msg[i % 4u],
+				vld1q_u32( &iot_checksum_sha256_k[i * 4u] ) );
+			const uint32x4_t prev0 = state0;
+
+			/* schedule the words of four rounds later */
+			if ( i < 12u )
+				msg[i % 4u] = vsha256su1q_u32(
+					vsha256su0q_u32( msg[i % 4u],
+						msg[( i + 1u ) % 4u] ),
+					msg[( i + 2u ) % 4u],
+					msg[( i + 3u ) % 4u] );
+
+			state0 = vsha256hq_u32( state0, state1, wk );
+			state1 = vsha256h2q_u32( state1, prev0, wk );
+		}
+
+		state0 = vaddq_u32( state0, saved0 );
+		state1 = vaddq_u32( state1, saved1 );
+		data += IOT_CHECKSUM_SHA256_BLOCK_SIZE;
+		--blocks;
+	}
+
+	vst1q_u32( &state[0], state0 );
+	vst1q_u32( &state[4], state1 );
+}
+#endif /* ifdef IOT_CHECKSUM_SHA256_ARMV8 */
+
+void iot_checksum_sha256_blocks(
+	iot_uint32_t *state,
+	const unsigned char *data,
+	size_t blocks )
+{
+	if ( blocks > 0u )
+		iot_checksum_sha256_func( state, data, blocks );
+}
+
+void iot_checksum_sha256_detect(
+	iot_uint32_t *state, const unsigned char *data, size_t blocks )
+{
+	iot_checksum_sha256_func_t func = iot_checksum_sha256_portable;
+#if defined( IOT_CHECKSUM_SHA256_ARMV8 )
+	func = iot_checksum_sha256_armv8;
+#elif defined( IOT_CHECKSUM_SHA256_SHANI )
+	unsigned int eax = 0u, ebx = 0u, ecx = 0u, edx = 0u;
+	if ( __get_cpuid( 1u, &eax, &ebx, &ecx, &edx ) &&
+		( ecx & bit_SSSE3 ) && ( ecx & bit_SSE4_1 ) &&
+		__get_cpuid_max( 0u, NULL ) >= 7u )
+	{
+		__cpuid_count( 7u, 0u, eax, ebx, ecx, edx );
+		if ( ebx & bit_SHA )
+			func = iot_checksum_sha256_shani;
+	}
+#endif /* elif defined( IOT_CHECKSUM_SHA256_SHANI ) */
+	/* every thread selects the same implementation */
+	iot_checksum_sha256_func = func;
+	func( state, data, blocks );
+}
+
+void iot_checksum_sha256_initialize(
+	iot_uint32_t *state )
+{
+	state[0] = 0x6a09e667u;
+	state[1] = 0xbb67ae85u;
+	state[2] = 0x3c6ef372u;
+	state[3] = 0xa54ff53au;
+	state[4] = 0x510e527fu;
+	state[5] = 0x9b05688cu;
+	state[6] = 0x1f83d9abu;
+	state[7] = 0x5be0cd19u;
+}
+
+void iot_checksum_sha256_portable(
+	iot_uint32_t *state, const unsigned char *data, size_t blocks )
+{
+	while ( blocks > 0u )
+	{
+		iot_uint32_t w[64u];
+		iot_uint32_t a = state[0];
+		iot_uint32_t b = state[1];
+		iot_uint32_t c = state[2];
+		iot_uint32_t d = state[3];
+		iot_uint32_t e = state[4];
+		iot_uint32_t f = state[5];
+		iot_uint32_t g = state[6];
+		iot_uint32_t h = state[7];
+		unsigned int i;
+
+		/* message words are big-endian */
+		for ( i = 0u; i < 16u; ++i )
+			w[i] = (iot_uint32_t)data[i * 4u] << 24 |
+				(iot_uint32_t)data[i * 4u + 1u] << 16 |
+				(iot_uint32_t)data[i * 4u + 2u] << 8 |
+				(iot_uint32_t)data[i * 4u + 3u];
+		for ( i = 16u; i < 64u; ++i )
+		{
+			const iot_uint32_t s0 =
+				IOT_CHECKSUM_SHA256_ROTR( w[i - 15u], 7 ) ^
+				IOT_CHECKSUM_SHA256_ROTR( w[i - 15u], 18 ) ^
+				( w[i - 15u] >> 3 );
+			const iot_uint32_t s1 =
+				IOT_CHECKSUM_SHA256_ROTR( w[i - 2u], 17 ) ^
+				IOT_CHECKSUM_SHA256_ROTR( w[i - 2u], 19 ) ^
+				( w[i - 2u] >> 10 );
+			w[i] = w[i - 16u] + s0 + w[i - 7u] + s1;
+		}
+
+		for ( i = 0u; i < 64u; ++i )
+		{
+			const iot_uint32_t t1 = h +
+				( IOT_CHECKSUM_SHA256_ROTR( e, 6 ) ^
+				  IOT_CHECKSUM_SHA256_ROTR( e, 11 ) ^
+				  IOT_CHECKSUM_SHA256_ROTR( e, 25 ) ) +
+				( g ^ ( e & ( f ^ g ) ) ) +
+				iot_checksum_sha256_k[i] + w[i];
+			const iot_uint32_t t2 =
+				( IOT_CHECKSUM_SHA256_ROTR( a, 2 ) ^
+				  IOT_CHECKSUM_SHA256_ROTR( a, 13 ) ^
+				  IOT_CHECKSUM_SHA256_ROTR( a, 22 ) ) +
+				( ( a & b ) | ( c & ( a | b ) ) );
+			h = g;
+			g = f;
+			f = e;
+			e = d + t1;
+			d = c;
+			c = b;
+			b = a;
+			a = t1 + t2;
+		}
+
+		state[0] += a;
+		state[1] += b;
+		state[2] += c;
+		state[3] += d;
+		state[4] += e;
+		state[5] += f;
+		state[6] += g;
+		state[7] += h;
+		data += IOT_CHECKSUM_SHA256_BLOCK_SIZE;
+		--blocks;
+	}
+}
+
+#ifdef IOT_CHECKSUM_SHA256_SHANI
+void iot_checksum_sha256_shani(
+	iot_uint32_t *state, const unsigned char *data, size_t blocks )
+{
+	const __m128i mask = _mm_set_epi64x(
+		0x0c0d0e0f08090a0bLL, 0x0405060700010203LL );
+	__m128i state0;
+	__m128i state1;
+	__m128i tmp;
+
+	/* instructions work on the state as ABEF & CDGH */
+	tmp = _mm_shuffle_epi32(
+		_mm_loadu_si128( (const __m128i *)&state[0] ), 0xB1 );
+	state1 = _mm_shuffle_epi32(
+		_mm_loadu_si128( (const __m128i *)&state[4] ), 0x1B );
+	state0 = _mm_alignr_epi8( tmp, state1, 8 );
+	state1 = _mm_blend_epi16( state1, tmp, 0xF0 );
+
+	while ( blocks > 0u )
+	{
+		const __m128i saved0 = state0;
+		const __m128i saved1 = state1;
+		__m128i msg[4u];
+		unsigned int i;
+
+		/* message words are big-endian */
+		for ( i = 0u; i < 4u; ++i )
+			msg[i] = _mm_shuffle_epi8( _mm_loadu_si128(
+				(const __m128i *)( data + i * 16u ) ), mask );
+
+		for ( i = 0u; i < 16u; ++i )
+		{
+			__m128i wk;
+
+			/* schedule the words of this group of rounds */
+			if ( i >= 4u )
+				msg[i % 4u] = _mm_sha256msg2_epu32(
+					_mm_add_epi32(
+						_mm_sha256msg1_epu32(
+							msg[i % 4u],
+							msg[( i + 1u ) % 4u] ),
+						_mm_alignr_epi8(
+							msg[( i + 3u ) % 4u],
+							msg[( i + 2u ) % 4u], 4 ) ),
+					msg[( i + 3u ) % 4u] );
+
+			wk = _mm_add_epi32( msg[i % 4u], _mm_loadu_si128(
+				(const __m128i *)&iot_checksum_sha256_k[i * 4u] ) );
+			state1 = _mm_sha256rnds2_epu32( state1, state0, wk );
+			wk = _mm_shuffle_epi32( wk, 0x0E );
+			state0 = _mm_sha256rnds2_epu32( state0, state1, wk );
+		}
+
+		state0 = _mm_add_epi32( state0, saved0 );
+		state1 = _mm_add_epi32( state1, saved1 );
+		data += IOT_CHECKSUM_SHA256_BLOCK_SIZE;
+		--blocks;
+	}
+
+	/* back to ABCD & EFGH */
+	tmp = _mm_shuffle_epi32( state0, 0x1B );
+	state1 = _mm_shuffle_epi32( state1, 0xB1 );
+	state0 = _mm_blend_epi16( tmp, state1, 0xF0 );
+	state1 = _mm_alignr_epi8( state1, tmp, 8 );
+	_mm_storeu_si128( (__m128i *)&state[0], state0 );
+	_mm_storeu_si128( (__m128i *)&state[4], state1 );
+}
+#endif /* ifdef IOT_CHECKSUM_SHA256_SHANI */
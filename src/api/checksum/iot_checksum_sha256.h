@@ -0,0 +1,49 @@
+/**
+ * @file
+ * @brief header file for calculating SHA256 checksums
+ *
+ * @copyright Copyright (C) 2018 Wind River Systems, Inc. All Rights Reserved.
+ *
+ * @license Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied."
+ */
+
+#ifndef IOT_CHECKSUM_SHA256_H
+#define IOT_CHECKSUM_SHA256_H
+
+#include <iot.h>
+#include <os.h>
+
+/** @brief Size of the blocks processed by SHA256, in bytes */
+#define IOT_CHECKSUM_SHA256_BLOCK_SIZE       64u
+
+/**
+ * @brief processes blocks of data into a SHA256 state
+ *
+ * @param[in,out]  state               SHA256 state (intermediate hash value)
+ * @param[in]      data                data to process
+ * @param[in]      blocks              number of blocks in @p data
+ *
+ * @see IOT_CHECKSUM_SHA256_BLOCK_SIZE
+ */
+void iot_checksum_sha256_blocks(
+	iot_uint32_t *state,
+	const unsigned char *data,
+	size_t blocks );
+
+/**
+ * @brief sets a SHA256 state to its initial value
+ *
+ * @param[out]     state               SHA256 state (intermediate hash value)
+ */
+void iot_checksum_sha256_initialize(
+	iot_uint32_t *state );
+
+#endif /* IOT_CHECKSUM_SHA256_H */
@@ -1797,6 +1797,12 @@ iot_status_t iot_action_request_execute(
 					&lib->worker_mutex );
 			}
 #endif /* ifdef IOT_THREAD_SUPPORT */
+
+			/* without worker threads, the request is processed by
+			 * the application's loop, which may be waiting */
+			if ( result == IOT_STATUS_SUCCESS &&
+				( lib->flags & IOT_FLAG_SINGLE_THREAD ) )
+				iot_loop_wakeup( lib );
 		}
 	}
 	return result;
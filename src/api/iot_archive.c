@@ -0,0 +1,819 @@
+/**
+ * @file
+ * @brief source file for building archives from directories
+ *
+ * @copyright Copyright (C) 2018 Wind River Systems, Inc. All Rights Reserved.
+ *
+ * @license Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied."
+ */
+
+#include "shared/iot_archive.h"
+
+#include "shared/iot_defs.h"       /* for UNUSED */
+
+#include <os.h>                    /* operating system abstraction */
+#include <archive.h>               /* for archiving functions */
+#include <archive_entry.h>         /* for adding files to an archive */
+
+/** @brief Size of the blocks the files archived are read in */
+#define IOT_ARCHIVE_BLOCK_SIZE         16384u
+
+#ifdef IOT_THREAD_SUPPORT
+/** @brief Size of the blocks of an archive compressed in parallel */
+#define IOT_ARCHIVE_JOB_SIZE           524288u
+/** @brief Number of blocks & threads compressing them at the same time */
+#define IOT_ARCHIVE_JOBS               IOT_WORKER_THREADS
+
+/** @brief block of an archive compressed by one of the workers */
+struct iot_archive_job
+{
+	/** @brief compression used */
+	iot_archive_compression_t compression;
+	/** @brief data to compress */
+	iot_uint8_t *in;
+	/** @brief bytes in @p in */
+	size_t in_len;
+	/** @brief compressed data */
+	iot_uint8_t *out;
+	/** @brief bytes in @p out */
+	size_t out_len;
+	/** @brief size allocated for @p out */
+	size_t out_size;
+	/** @brief result of the compression */
+	iot_status_t result;
+	/** @brief block is waiting for a worker to compress it */
+	iot_bool_t queued;
+	/** @brief block is compressed, @p out & @p result are set */
+	iot_bool_t done;
+};
+#endif /* ifdef IOT_THREAD_SUPPORT */
+
+/** @brief archive of a directory, built a block at a time */
+struct iot_archive_stream
+{
+	/** @brief libarchive handle */
+	struct archive *archive;
+	/** @brief buffer the files are read in */
+	iot_uint8_t *block;
+#ifdef IOT_THREAD_SUPPORT
+	/** @brief compression done by the jobs (none: done by libarchive) */
+	iot_archive_compression_t compression;
+#endif /* ifdef IOT_THREAD_SUPPORT */
+	/** @brief directory being archived */
+	os_dir_t *dir;
+	/** @brief all files are added & the archive is closed */
+	iot_bool_t done;
+	/** @brief file being added (NULL between files) */
+	os_file_t file;
+	/** @brief bytes of the file being added still to add */
+	iot_uint64_t file_left;
+#ifdef IOT_THREAD_SUPPORT
+	/** @brief blocks being compressed, in the order of the archive */
+	struct iot_archive_job job[IOT_ARCHIVE_JOBS];
+	/** @brief number of blocks being compressed */
+	size_t job_count;
+	/** @brief oldest block being compressed */
+	size_t job_first;
+	/** @brief lock protecting the blocks being compressed */
+	os_thread_mutex_t job_lock;
+	/** @brief signalled when a block is waiting for a worker */
+	os_thread_condition_t job_queued;
+	/** @brief signalled when a block is compressed */
+	os_thread_condition_t job_done;
+	/** @brief threads compressing the blocks */
+	os_thread_t worker[IOT_ARCHIVE_JOBS];
+	/** @brief number of threads in @p worker */
+	size_t worker_count;
+	/** @brief flag to stop the workers */
+	iot_bool_t to_quit;
+#endif /* ifdef IOT_THREAD_SUPPORT */
+	/** @brief output of the archive not read yet (streamed archives) */
+	iot_uint8_t *pipe;
+	/** @brief bytes in @p pipe */
+	size_t pipe_len;
+	/** @brief bytes of @p pipe already read */
+	size_t pipe_pos;
+	/** @brief size allocated for @p pipe */
+	size_t pipe_size;
+};
+
+/**
+ * @brief Append data to a buffer, growing it as needed
+ *
+ * @param[in,out]  buf                 buffer to append to
+ * @param[in,out]  buf_len             bytes in the buffer
+ * @param[in,out]  buf_size            size allocated for the buffer
+ * @param[in]      data                data to append
+ * @param[in]      length              size of the data
+ *
+ * @retval IOT_STATUS_NO_MEMORY        not enough memory to grow the buffer
+ * @retval IOT_STATUS_SUCCESS          operation successful
+ */
+static IOT_SECTION iot_status_t iot_archive_buffer_add(
+	iot_uint8_t **buf,
+	size_t *buf_len,
+	size_t *buf_size,
+	const void *data,
+	size_t length );
+
+/**
+ * @brief Prepare an archive of a directory, before its output is opened
+ *
+ * @param[in]      path                path to the directory to archive
+ * @param[in]      compression         compression of the archive
+ * @param[out]     stream              archive prepared
+ *
+ * @retval IOT_STATUS_FAILURE          failed to open the directory
+ * @retval IOT_STATUS_NO_MEMORY        not enough memory to build the archive
+ * @retval IOT_STATUS_NOT_SUPPORTED    compression not supported
+ * @retval IOT_STATUS_SUCCESS          operation successful
+ */
+static IOT_SECTION iot_status_t iot_archive_create(
+	const char *path,
+	iot_archive_compression_t compression,
+	iot_archive_stream_t **stream );
+
+/**
+ * @brief Add a compression filter to a libarchive handle
+ *
+ * @param[in,out]  archive             libarchive handle
+ * @param[in]      compression         compression of the archive
+ *
+ * @return libarchive status, ARCHIVE_FATAL if the compression isn't supported
+ */
+static IOT_SECTION int iot_archive_filter_add(
+	struct archive *archive,
+	iot_archive_compression_t compression );
+
+#ifdef IOT_THREAD_SUPPORT
+/**
+ * @brief Compress a block of an archive
+ *
+ * Each block is compressed to a complete gzip member or zstd frame, so the
+ * blocks compressed one after the other decompress as a single stream.
+ *
+ * @param[in,out]  job                 block to compress
+ */
+static IOT_SECTION void iot_archive_job_compress(
+	struct iot_archive_job *job );
+
+/**
+ * @brief Wait for the oldest block being compressed, and add its output to
+ *        the output of the archive
+ *
+ * @param[in,out]  stream              archive being built
+ *
+ * @retval IOT_STATUS_FAILURE          failed to compress the block
+ * @retval IOT_STATUS_NO_MEMORY        not enough memory for the output
+ * @retval IOT_STATUS_SUCCESS          operation successful
+ */
+static IOT_SECTION iot_status_t iot_archive_job_finish(
+	iot_archive_stream_t *stream );
+
+/**
+ * @brief Queue the block being filled for the workers, and make sure there
+ *        is a block free to fill next
+ *
+ * @param[in,out]  stream              archive being built
+ *
+ * @retval IOT_STATUS_FAILURE          failed to compress a block
+ * @retval IOT_STATUS_NO_MEMORY        not enough memory for the output
+ * @retval IOT_STATUS_SUCCESS          operation successful
+ */
+static IOT_SECTION iot_status_t iot_archive_job_start(
+	iot_archive_stream_t *stream );
+
+/**
+ * @brief Receive the compressed output of a block (libarchive callback)
+ *
+ * @param[in]      archive             libarchive handle
+ * @param[in,out]  client_data         block being compressed
+ * @param[in]      buffer              compressed output
+ * @param[in]      length              size of the output
+ *
+ * @return amount of the output kept, -1 on failure
+ */
+static IOT_SECTION la_ssize_t iot_archive_job_write(
+	struct archive *archive,
+	void *client_data,
+	const void *buffer,
+	size_t length );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+
+/**
+ * @brief Add the next block to an archive: the header of the next file, a
+ *        block of the file being added or the end of the archive
+ *
+ * @param[in,out]  stream              archive being built
+ *
+ * @retval IOT_STATUS_FAILURE          failed to add to the archive
+ * @retval IOT_STATUS_SUCCESS          operation successful
+ */
+static IOT_SECTION iot_status_t iot_archive_step(
+	iot_archive_stream_t *stream );
+
+/**
+ * @brief Receive the output of a streamed archive (libarchive callback)
+ *
+ * @param[in]      archive             libarchive handle
+ * @param[in,out]  client_data         archive being built
+ * @param[in]      buffer              output of the archive
+ * @param[in]      length              size of the output
+ *
+ * @return amount of the output kept, -1 on failure
+ */
+static IOT_SECTION la_ssize_t iot_archive_stream_write(
+	struct archive *archive,
+	void *client_data,
+	const void *buffer,
+	size_t length );
+
+#ifdef IOT_THREAD_SUPPORT
+/**
+ * @brief Compress the blocks of an archive as they are queued (thread main)
+ *
+ * @param[in,out]  arg                 archive being built
+ *
+ * @return 0
+ */
+static OS_THREAD_DECL iot_archive_worker( void *arg );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+
+iot_status_t iot_archive_buffer_add(
+	iot_uint8_t **buf,
+	size_t *buf_len,
+	size_t *buf_size,
+	const void *data,
+	size_t length )
+{
+	iot_status_t result = IOT_STATUS_SUCCESS;
+	if ( *buf_len + length > *buf_size )
+	{
+		/* grown by doubling, as output arrives in small pieces */
+		size_t size = *buf_size * 2u;
+		iot_uint8_t *new_buf;
+		if ( size < *buf_len + length )
+			size = *buf_len + length;
+		new_buf = (iot_uint8_t *)os_realloc( *buf, size );
+		if ( new_buf )
+		{
+			*buf = new_buf;
+			*buf_size = size;
+		}
+		else
+			result = IOT_STATUS_NO_MEMORY;
+	}
+	if ( result == IOT_STATUS_SUCCESS && length > 0u )
+	{
+		os_memcpy( &(*buf)[*buf_len], data, length );
+		*buf_len += length;
+	}
+	return result;
+}
+
+iot_status_t iot_archive_create(
+	const char *path,
+	iot_archive_compression_t compression,
+	iot_archive_stream_t **stream )
+{
+	iot_status_t result = IOT_STATUS_NO_MEMORY;
+	iot_archive_stream_t *const s = (iot_archive_stream_t *)os_malloc(
+		sizeof( struct iot_archive_stream ) );
+	*stream = NULL;
+	if ( s )
+	{
+		os_memzero( s, sizeof( struct iot_archive_stream ) );
+		s->block = (iot_uint8_t *)os_malloc( IOT_ARCHIVE_BLOCK_SIZE );
+		s->archive = archive_write_new();
+		if ( s->block && s->archive )
+		{
+			iot_archive_compression_t filter = compression;
+			int status = ARCHIVE_OK;
+#ifdef IOT_THREAD_SUPPORT
+			/* the archive is compressed a block at a time by the
+			 * jobs, only check the compression is supported */
+			if ( compression != IOT_ARCHIVE_COMPRESSION_NONE )
+			{
+				struct archive *const probe =
+					archive_write_new();
+				status = ARCHIVE_FATAL;
+				if ( probe )
+				{
+					status = iot_archive_filter_add( probe,
+						compression );
+					archive_write_free( probe );
+				}
+				s->compression = compression;
+				filter = IOT_ARCHIVE_COMPRESSION_NONE;
+
+				/* workers are started once, the blocks are
+				 * compressed here if none could be */
+				os_thread_mutex_create( &s->job_lock );
+				os_thread_condition_create( &s->job_queued );
+				os_thread_condition_create( &s->job_done );
+				if ( status == ARCHIVE_OK ||
+					status == ARCHIVE_WARN )
+				{
+					size_t stack_size = 0u;
+#if defined( __VXWORKS__ )
+					stack_size = deviceCloudStackSizeGet();
+#endif /* if defined( __VXWORKS__ ) */
+					while ( s->worker_count <
+						IOT_ARCHIVE_JOBS &&
+						os_thread_create(
+						&s->worker[s->worker_count],
+						iot_archive_worker, s,
+						stack_size ) ==
+						OS_STATUS_SUCCESS )
+						++s->worker_count;
+				}
+			}
+#endif /* ifdef IOT_THREAD_SUPPORT */
+
+			/* a warning is returned if an external program is
+			 * used for the compression */
+			if ( status == ARCHIVE_OK || status == ARCHIVE_WARN )
+				status = iot_archive_filter_add( s->archive,
+					filter );
+			result = IOT_STATUS_NOT_SUPPORTED;
+			if ( status == ARCHIVE_OK || status == ARCHIVE_WARN )
+			{
+				result = IOT_STATUS_FAILURE;
+				archive_write_set_format_pax_restricted(
+					s->archive );
+
+				/* output is passed on as it is produced, not
+				 * in blocks */
+				archive_write_set_bytes_per_block( s->archive,
+					0 );
+				s->dir = os_directory_open( path );
+				if ( s->dir && archive_write_open( s->archive,
+					s, NULL, iot_archive_stream_write,
+					NULL ) == ARCHIVE_OK )
+					result = IOT_STATUS_SUCCESS;
+			}
+		}
+
+		if ( result == IOT_STATUS_SUCCESS )
+			*stream = s;
+		else
+			iot_archive_stream_close( s );
+	}
+	return result;
+}
+
+iot_status_t iot_archive_directory(
+	const char *archive_path,
+	const char *path,
+	iot_archive_compression_t compression )
+{
+	iot_status_t result = IOT_STATUS_BAD_PARAMETER;
+	if ( archive_path && path )
+	{
+		iot_archive_stream_t *stream = NULL;
+		os_file_t file = NULL;
+		result = iot_archive_create( path, compression, &stream );
+		if ( result == IOT_STATUS_SUCCESS )
+		{
+			file = os_file_open( archive_path,
+				OS_WRITE | OS_CREATE );
+			if ( !file )
+				result = IOT_STATUS_FAILURE;
+		}
+
+		while ( result == IOT_STATUS_SUCCESS &&
+			stream->done == IOT_FALSE )
+		{
+			result = iot_archive_step( stream );
+			if ( result == IOT_STATUS_SUCCESS &&
+				stream->pipe_len > 0u &&
+				os_file_write( stream->pipe, 1u,
+					stream->pipe_len, file ) !=
+					stream->pipe_len )
+				result = IOT_STATUS_FAILURE;
+			stream->pipe_len = 0u;
+		}
+
+		if ( file )
+			os_file_close( file );
+		if ( stream )
+			iot_archive_stream_close( stream );
+	}
+	return result;
+}
+
+const char *iot_archive_extension(
+	iot_archive_compression_t compression )
+{
+	const char *result = ".tar";
+	if ( compression == IOT_ARCHIVE_COMPRESSION_GZIP )
+		result = ".tar.gz";
+	else if ( compression == IOT_ARCHIVE_COMPRESSION_ZSTD )
+		result = ".tar.zst";
+	return result;
+}
+
+int iot_archive_filter_add(
+	struct archive *archive,
+	iot_archive_compression_t compression )
+{
+	int result = ARCHIVE_FATAL;
+	if ( compression == IOT_ARCHIVE_COMPRESSION_GZIP )
+		result = archive_write_add_filter_gzip( archive );
+#if ARCHIVE_VERSION_NUMBER >= 3003003
+	else if ( compression == IOT_ARCHIVE_COMPRESSION_ZSTD )
+		result = archive_write_add_filter_zstd( archive );
+#endif /* if ARCHIVE_VERSION_NUMBER >= 3003003 */
+	else if ( compression == IOT_ARCHIVE_COMPRESSION_NONE )
+		result = archive_write_add_filter_none( archive );
+	return result;
+}
+
+#ifdef IOT_THREAD_SUPPORT
+void iot_archive_job_compress(
+	struct iot_archive_job *job )
+{
+	struct archive *const archive = archive_write_new();
+	job->result = IOT_STATUS_FAILURE;
+	if ( archive )
+	{
+		struct archive_entry *const entry = archive_entry_new();
+		const int status = iot_archive_filter_add( archive,
+			job->compression );
+
+		/* the block is the only "file" of a raw archive: only the
+		 * compression is applied to it */
+		if ( entry &&
+			( status == ARCHIVE_OK || status == ARCHIVE_WARN ) &&
+			archive_write_set_format_raw( archive ) == ARCHIVE_OK &&
+			archive_write_set_bytes_per_block( archive, 0 ) ==
+				ARCHIVE_OK &&
+			archive_write_open( archive, job, NULL,
+				iot_archive_job_write, NULL ) == ARCHIVE_OK )
+		{
+			archive_entry_set_filetype( entry, AE_IFREG );
+			if ( archive_write_header( archive, entry ) ==
+					ARCHIVE_OK &&
+				archive_write_data( archive, job->in,
+					job->in_len ) == (la_ssize_t)job->in_len &&
+				archive_write_close( archive ) == ARCHIVE_OK )
+				job->result = IOT_STATUS_SUCCESS;
+		}
+		if ( entry )
+			archive_entry_free( entry );
+		archive_write_free( archive );
+	}
+}
+
+iot_status_t iot_archive_job_finish(
+	iot_archive_stream_t *stream )
+{
+	iot_status_t result;
+	struct iot_archive_job *const job =
+		&stream->job[stream->job_first];
+	os_thread_mutex_lock( &stream->job_lock );
+	while ( job->done == IOT_FALSE )
+		os_thread_condition_wait( &stream->job_done,
+			&stream->job_lock );
+	job->done = IOT_FALSE;
+	stream->job_first = ( stream->job_first + 1u ) % IOT_ARCHIVE_JOBS;
+	--stream->job_count;
+	os_thread_mutex_unlock( &stream->job_lock );
+
+	/* the block is no longer seen by the workers */
+	result = job->result;
+	if ( result == IOT_STATUS_SUCCESS )
+		result = iot_archive_buffer_add( &stream->pipe,
+			&stream->pipe_len, &stream->pipe_size, job->out,
+			job->out_len );
+	job->in_len = 0u;
+	return result;
+}
+
+iot_status_t iot_archive_job_start(
+	iot_archive_stream_t *stream )
+{
+	iot_status_t result = IOT_STATUS_SUCCESS;
+	struct iot_archive_job *const job = &stream->job[
+		( stream->job_first + stream->job_count ) % IOT_ARCHIVE_JOBS];
+	job->compression = stream->compression;
+	job->out_len = 0u;
+	if ( stream->worker_count == 0u )
+	{
+		iot_archive_job_compress( job ); /* compress it here instead */
+		job->done = IOT_TRUE;
+	}
+	else
+		job->queued = IOT_TRUE;
+	os_thread_mutex_lock( &stream->job_lock );
+	++stream->job_count;
+	if ( job->queued != IOT_FALSE )
+		os_thread_condition_signal( &stream->job_queued,
+			&stream->job_lock );
+	os_thread_mutex_unlock( &stream->job_lock );
+
+	/* when all blocks are being compressed, wait for the oldest one
+	 * (its output is the next of the archive) to have one to fill */
+	if ( stream->job_count == IOT_ARCHIVE_JOBS )
+		result = iot_archive_job_finish( stream );
+	return result;
+}
+
+la_ssize_t iot_archive_job_write(
+	struct archive *UNUSED(archive),
+	void *client_data,
+	const void *buffer,
+	size_t length )
+{
+	la_ssize_t result = -1;
+	struct iot_archive_job *const job =
+		(struct iot_archive_job *)client_data;
+	if ( iot_archive_buffer_add( &job->out, &job->out_len,
+		&job->out_size, buffer, length ) == IOT_STATUS_SUCCESS )
+		result = (la_ssize_t)length;
+	return result;
+}
+#endif /* ifdef IOT_THREAD_SUPPORT */
+
+iot_status_t iot_archive_step(
+	iot_archive_stream_t *stream )
+{
+	iot_status_t result = IOT_STATUS_SUCCESS;
+	if ( stream->file == NULL )
+	{
+		char file_name[ PATH_MAX + 1u ];
+		if ( os_directory_next( stream->dir, IOT_TRUE, file_name,
+			PATH_MAX ) == OS_STATUS_SUCCESS )
+		{
+			struct stat file_stat;
+
+			file_name[ PATH_MAX ] = '\0';
+			if ( stat( file_name, &file_stat ) == 0 )
+				stream->file = os_file_open( file_name,
+					OS_READ );
+
+			/* files that can't be read are skipped */
+			if ( stream->file )
+			{
+				struct archive_entry *const entry =
+					archive_entry_new();
+
+				/* Note: set the file details individually.  Calling archive_entry_copy_stat(
+				 * entry, &file_stat ) is easier but it corrupts archives on 32b architectures,
+				 * e.g. quark. */
+				archive_entry_set_size( entry, file_stat.st_size );
+				archive_entry_set_filetype( entry, AE_IFREG );
+				archive_entry_set_perm( entry, 0644 );
+				archive_entry_set_pathname( entry, file_name );
+
+				/* stat struct does not store
+				 * the birthtime.  That is part of the file system */
+				archive_entry_set_atime( entry, file_stat.st_atime, 0 );
+				archive_entry_set_birthtime( entry, file_stat.st_ctime, 0 );
+				archive_entry_set_ctime( entry, file_stat.st_ctime, 0 );
+				archive_entry_set_mtime( entry, file_stat.st_mtime, 0 );
+
+				if ( archive_write_header( stream->archive,
+					entry ) != ARCHIVE_OK )
+					result = IOT_STATUS_FAILURE;
+				archive_entry_free( entry );
+				stream->file_left =
+					(iot_uint64_t)file_stat.st_size;
+			}
+		}
+		else
+		{
+			/* all files are added, flush the compression */
+			if ( archive_write_close( stream->archive ) !=
+				ARCHIVE_OK )
+				result = IOT_STATUS_FAILURE;
+#ifdef IOT_THREAD_SUPPORT
+			/* the last block, partly filled, & the blocks still
+			 * being compressed */
+			if ( result == IOT_STATUS_SUCCESS &&
+				stream->job[( stream->job_first +
+				stream->job_count ) % IOT_ARCHIVE_JOBS].in_len > 0u )
+				result = iot_archive_job_start( stream );
+			while ( result == IOT_STATUS_SUCCESS &&
+				stream->job_count > 0u )
+				result = iot_archive_job_finish( stream );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+			stream->done = IOT_TRUE;
+		}
+	}
+	else
+	{
+		size_t len = IOT_ARCHIVE_BLOCK_SIZE;
+		if ( (iot_uint64_t)len > stream->file_left )
+			len = (size_t)stream->file_left;
+		if ( len > 0u )
+			len = os_file_read( stream->block, 1u, len,
+				stream->file );
+		if ( len > 0u && archive_write_data( stream->archive,
+			stream->block, len ) != (la_ssize_t)len )
+			result = IOT_STATUS_FAILURE;
+		stream->file_left -= len;
+
+		/* a file shrinking while it is added is padded by
+		 * libarchive, to the size in its header */
+		if ( len == 0u || stream->file_left == 0u )
+		{
+			os_file_close( stream->file );
+			stream->file = NULL;
+		}
+	}
+	return result;
+}
+
+iot_status_t iot_archive_stream_close(
+	iot_archive_stream_t *stream )
+{
+	iot_status_t result = IOT_STATUS_BAD_PARAMETER;
+	if ( stream )
+	{
+#ifdef IOT_THREAD_SUPPORT
+		size_t i;
+#endif /* ifdef IOT_THREAD_SUPPORT */
+		if ( stream->archive )
+			archive_write_free( stream->archive );
+#ifdef IOT_THREAD_SUPPORT
+		/* after freeing the archive, which may still write to the
+		 * blocks */
+		if ( stream->compression != IOT_ARCHIVE_COMPRESSION_NONE )
+		{
+			os_thread_mutex_lock( &stream->job_lock );
+			stream->to_quit = IOT_TRUE;
+			os_thread_condition_broadcast( &stream->job_queued );
+			os_thread_mutex_unlock( &stream->job_lock );
+			for ( i = 0u; i < stream->worker_count; ++i )
+				os_thread_wait( &stream->worker[i] );
+			os_thread_condition_destroy( &stream->job_done );
+			os_thread_condition_destroy( &stream->job_queued );
+			os_thread_mutex_destroy( &stream->job_lock );
+		}
+		for ( i = 0u; i < IOT_ARCHIVE_JOBS; ++i )
+		{
+			os_free_null( (void **)&stream->job[i].in );
+			os_free_null( (void **)&stream->job[i].out );
+		}
+#endif /* ifdef IOT_THREAD_SUPPORT */
+		if ( stream->file )
+			os_file_close( stream->file );
+		if ( stream->dir )
+			os_directory_close( stream->dir );
+		os_free_null( (void **)&stream->block );
+		os_free_null( (void **)&stream->pipe );
+		os_free( stream );
+		result = IOT_STATUS_SUCCESS;
+	}
+	return result;
+}
+
+iot_archive_stream_t *iot_archive_stream_open(
+	const char *path,
+	iot_archive_compression_t compression )
+{
+	iot_archive_stream_t *result = NULL;
+	if ( path )
+		iot_archive_create( path, compression, &result );
+	return result;
+}
+
+iot_status_t iot_archive_stream_read(
+	iot_archive_stream_t *stream,
+	void *buf,
+	size_t len,
+	size_t *read_len )
+{
+	iot_status_t result = IOT_STATUS_BAD_PARAMETER;
+	if ( stream && buf && read_len )
+	{
+		iot_uint8_t *const out = (iot_uint8_t *)buf;
+		size_t out_len = 0u;
+
+		/* the archive is built as it is read: the next block is only
+		 * added once the output of the previous one is read, so the
+		 * output kept is bounded by what one block produces */
+		result = IOT_STATUS_SUCCESS;
+		while ( result == IOT_STATUS_SUCCESS && out_len < len &&
+			( stream->pipe_pos < stream->pipe_len ||
+			  stream->done == IOT_FALSE ) )
+		{
+			if ( stream->pipe_pos < stream->pipe_len )
+			{
+				size_t copy = stream->pipe_len -
+					stream->pipe_pos;
+				if ( copy > len - out_len )
+					copy = len - out_len;
+				os_memcpy( &out[out_len],
+					&stream->pipe[stream->pipe_pos], copy );
+				stream->pipe_pos += copy;
+				out_len += copy;
+			}
+			else
+			{
+				stream->pipe_pos = stream->pipe_len = 0u;
+				result = iot_archive_step( stream );
+			}
+		}
+		*read_len = out_len;
+	}
+	return result;
+}
+
+la_ssize_t iot_archive_stream_write(
+	struct archive *UNUSED(archive),
+	void *client_data,
+	const void *buffer,
+	size_t length )
+{
+	la_ssize_t result = -1;
+	iot_archive_stream_t *const stream =
+		(iot_archive_stream_t *)client_data;
+	iot_status_t status;
+#ifdef IOT_THREAD_SUPPORT
+	if ( stream->compression != IOT_ARCHIVE_COMPRESSION_NONE )
+	{
+		const iot_uint8_t *data = (const iot_uint8_t *)buffer;
+		size_t left = length;
+
+		/* the archive is cut in blocks, compressed in parallel */
+		status = IOT_STATUS_SUCCESS;
+		while ( status == IOT_STATUS_SUCCESS && left > 0u )
+		{
+			struct iot_archive_job *const job = &stream->job[
+				( stream->job_first + stream->job_count ) %
+				IOT_ARCHIVE_JOBS];
+			if ( !job->in )
+				job->in = (iot_uint8_t *)os_malloc(
+					IOT_ARCHIVE_JOB_SIZE );
+			if ( job->in )
+			{
+				size_t copy = IOT_ARCHIVE_JOB_SIZE - job->in_len;
+				if ( copy > left )
+					copy = left;
+				os_memcpy( &job->in[job->in_len], data, copy );
+				job->in_len += copy;
+				data += copy;
+				left -= copy;
+				if ( job->in_len == IOT_ARCHIVE_JOB_SIZE )
+					status = iot_archive_job_start( stream );
+			}
+			else
+				status = IOT_STATUS_NO_MEMORY;
+		}
+	}
+	else
+#endif /* ifdef IOT_THREAD_SUPPORT */
+		status = iot_archive_buffer_add( &stream->pipe,
+			&stream->pipe_len, &stream->pipe_size, buffer, length );
+	if ( status == IOT_STATUS_SUCCESS )
+		result = (la_ssize_t)length;
+	return result;
+}
+
+#ifdef IOT_THREAD_SUPPORT
+OS_THREAD_DECL iot_archive_worker( void *arg )
+{
+	iot_archive_stream_t *const stream = (iot_archive_stream_t *)arg;
+	os_thread_mutex_lock( &stream->job_lock );
+	while ( stream->to_quit == IOT_FALSE )
+	{
+		struct iot_archive_job *job = NULL;
+		size_t i;
+
+		/* oldest block waiting, its output is needed first */
+		for ( i = 0u; !job && i < stream->job_count; ++i )
+		{
+			struct iot_archive_job *const queued = &stream->job[
+				( stream->job_first + i ) % IOT_ARCHIVE_JOBS];
+			if ( queued->queued != IOT_FALSE )
+				job = queued;
+		}
+
+		if ( job )
+		{
+			job->queued = IOT_FALSE;
+			os_thread_mutex_unlock( &stream->job_lock );
+			iot_archive_job_compress( job );
+			os_thread_mutex_lock( &stream->job_lock );
+			job->done = IOT_TRUE;
+			os_thread_condition_signal( &stream->job_done,
+				&stream->job_lock );
+		}
+		else
+			os_thread_condition_wait( &stream->job_queued,
+				&stream->job_lock );
+	}
+	os_thread_mutex_unlock( &stream->job_lock );
+	return (OS_THREAD_RETURN)0;
+}
+#endif /* ifdef IOT_THREAD_SUPPORT */
@@ -23,6 +23,10 @@
 
 #include <os.h>
 #include <stdarg.h> /* for va_arg */
+#ifdef IOT_LOOP_WAKEUP_SUPPORT
+#include <fcntl.h>  /* for fcntl */
+#include <unistd.h> /* for pipe, read, write */
+#endif /* ifdef IOT_LOOP_WAKEUP_SUPPORT */
 
 /** @brief Maximum log message line length */
 #define IOT_LOG_MSG_MAX 16384u
@@ -936,6 +940,10 @@ iot_t *iot_initialize(
 		{
 			unsigned int i;
 			os_memzero( result, sizeof( struct iot ) );
+#ifdef IOT_LOOP_WAKEUP_SUPPORT
+			result->loop_wakeup[0] = -1;
+			result->loop_wakeup[1] = -1;
+#endif /* ifdef IOT_LOOP_WAKEUP_SUPPORT */
 
 			for ( i = 0u; i < IOT_PLUGIN_MAX; ++i )
 				result->plugin_ptr[i] = &result->plugin[i];
@@ -1119,6 +1127,125 @@ iot_status_t iot_log_level_set_string(
 	return result;
 }
 
+iot_status_t iot_loop_dispatch(
+	iot_t *lib,
+	const iot_loop_fd_t *ready,
+	size_t ready_count )
+{
+	iot_status_t result = IOT_STATUS_BAD_PARAMETER;
+	if ( lib && ( ready || ready_count == 0u ) )
+	{
+		result = IOT_STATUS_NOT_SUPPORTED;
+		if ( lib->flags & IOT_FLAG_SINGLE_THREAD )
+		{
+			iot_millisecond_t max_time_out =
+				IOT_MILLISECONDS_IN_SECOND;
+			struct iot_loop_poll poll;
+			size_t i;
+
+#ifdef IOT_LOOP_WAKEUP_SUPPORT
+			/* consume any pending wake ups */
+			for ( i = 0u; i < ready_count; ++i )
+			{
+				if ( lib->loop_wakeup[0] >= 0 &&
+					ready[i].fd == lib->loop_wakeup[0] &&
+					( ready[i].events & IOT_LOOP_EVENT_READ ) )
+				{
+					char buf[64u];
+					while ( read( lib->loop_wakeup[0], buf,
+						sizeof( buf ) ) > 0 );
+				}
+			}
+#endif /* ifdef IOT_LOOP_WAKEUP_SUPPORT */
+
+			os_memzero( &poll, sizeof( struct iot_loop_poll ) );
+			poll.ready = ready;
+			poll.ready_count = ready_count;
+			result = iot_plugin_perform( lib, NULL, &max_time_out,
+				IOT_OPERATION_LOOP_DISPATCH, NULL, &poll, NULL );
+
+			/* no worker threads, so process queued action requests
+			 * here, without waiting for any new ones */
+			for ( i = 0u; result == IOT_STATUS_SUCCESS &&
+				lib->request_queue_wait_count > 0u &&
+				i < IOT_ACTION_QUEUE_MAX; ++i )
+				iot_action_process( lib, max_time_out );
+		}
+	}
+	return result;
+}
+
+iot_status_t iot_loop_fd(
+	iot_t *lib,
+	iot_loop_fd_t *fds,
+	size_t fds_max,
+	size_t *fds_count )
+{
+	iot_status_t result = IOT_STATUS_BAD_PARAMETER;
+	if ( lib && ( fds || fds_max == 0u ) && fds_count )
+	{
+		*fds_count = 0u;
+		result = IOT_STATUS_NOT_SUPPORTED;
+		if ( lib->flags & IOT_FLAG_SINGLE_THREAD )
+		{
+			struct iot_loop_poll poll;
+
+			os_memzero( &poll, sizeof( struct iot_loop_poll ) );
+			poll.fds = fds;
+			poll.fds_max = fds_max;
+			result = IOT_STATUS_SUCCESS;
+#ifdef IOT_LOOP_WAKEUP_SUPPORT
+			/* created on first use, only applications driving
+			 * the loop themselves need to be woken */
+			if ( lib->loop_wakeup[0] < 0 )
+			{
+				if ( pipe( lib->loop_wakeup ) == 0 )
+				{
+					fcntl( lib->loop_wakeup[0], F_SETFL,
+						O_NONBLOCK );
+					fcntl( lib->loop_wakeup[1], F_SETFL,
+						O_NONBLOCK );
+				}
+				else
+				{
+					IOT_LOG( lib, IOT_LOG_ERROR, "%s",
+						"Failed to create loop wake up" );
+					lib->loop_wakeup[0] = -1;
+					lib->loop_wakeup[1] = -1;
+					result = IOT_STATUS_FAILURE;
+				}
+			}
+
+			if ( lib->loop_wakeup[0] >= 0 )
+			{
+				if ( poll.fds_count < poll.fds_max )
+				{
+					fds[poll.fds_count].fd =
+						lib->loop_wakeup[0];
+					fds[poll.fds_count].events =
+						IOT_LOOP_EVENT_READ;
+				}
+				++poll.fds_count;
+			}
+#endif /* ifdef IOT_LOOP_WAKEUP_SUPPORT */
+
+			if ( result == IOT_STATUS_SUCCESS )
+				result = iot_plugin_perform( lib, NULL, NULL,
+					IOT_OPERATION_LOOP_POLL, NULL, &poll,
+					NULL );
+
+			*fds_count = poll.fds_count;
+			if ( poll.fds_count > fds_max )
+			{
+				*fds_count = fds_max;
+				if ( result == IOT_STATUS_SUCCESS )
+					result = IOT_STATUS_FULL;
+			}
+		}
+	}
+	return result;
+}
+
 iot_status_t iot_loop_forever( iot_t *lib )
 {
 	iot_status_t result = IOT_STATUS_BAD_PARAMETER;
@@ -1163,6 +1290,32 @@ iot_status_t iot_loop_iteration( iot_t *lib, iot_millisecond_t max_time_out )
 	return result;
 }
 
+iot_status_t iot_loop_next_deadline(
+	iot_t *lib,
+	iot_millisecond_t *time_out )
+{
+	iot_status_t result = IOT_STATUS_BAD_PARAMETER;
+	if ( lib && time_out )
+	{
+		*time_out = 0u;
+		result = IOT_STATUS_NOT_SUPPORTED;
+		if ( lib->flags & IOT_FLAG_SINGLE_THREAD )
+		{
+			struct iot_loop_poll poll;
+
+			os_memzero( &poll, sizeof( struct iot_loop_poll ) );
+			result = iot_plugin_perform( lib, NULL, NULL,
+				IOT_OPERATION_LOOP_POLL, NULL, &poll, NULL );
+
+			/* requests still waiting are processed right away */
+			if ( lib->request_queue_wait_count > 0u )
+				poll.time_out = 1u;
+			*time_out = poll.time_out;
+		}
+	}
+	return result;
+}
+
 iot_status_t iot_loop_start( iot_t *lib )
 {
 	iot_status_t result = IOT_STATUS_BAD_PARAMETER;
@@ -1256,6 +1409,23 @@ iot_status_t iot_loop_stop( iot_t *lib, iot_bool_t force )
 	return result;
 }
 
+void iot_loop_wakeup(
+	iot_t *lib )
+{
+#ifdef IOT_LOOP_WAKEUP_SUPPORT
+	if ( lib && lib->loop_wakeup[1] >= 0 )
+	{
+		const char signal = 1;
+		/* pipe is non-blocking, if it is full a wake up is pending */
+		if ( write( lib->loop_wakeup[1], &signal, 1u ) < 0 )
+			IOT_LOG( lib, IOT_LOG_TRACE, "%s",
+				"Loop wake up already pending" );
+	}
+#else /* ifdef IOT_LOOP_WAKEUP_SUPPORT */
+	(void)lib;
+#endif /* else ifdef IOT_LOOP_WAKEUP_SUPPORT */
+}
+
 iot_status_t iot_terminate(
 	iot_t *lib,
 	iot_millisecond_t max_time_out )
@@ -1334,6 +1504,16 @@ iot_status_t iot_terminate(
 			iot_plugin_terminate( lib, &lib->plugin[i - 1u] );
 		result = IOT_STATUS_SUCCESS;
 
+#ifdef IOT_LOOP_WAKEUP_SUPPORT
+		if ( lib->loop_wakeup[0] >= 0 )
+		{
+			close( lib->loop_wakeup[0] );
+			close( lib->loop_wakeup[1] );
+			lib->loop_wakeup[0] = -1;
+			lib->loop_wakeup[1] = -1;
+		}
+#endif /* ifdef IOT_LOOP_WAKEUP_SUPPORT */
+
 #ifdef IOT_THREAD_SUPPORT
 		os_thread_mutex_destroy( &lib->log_mutex );
 		os_thread_mutex_destroy( &lib->telemetry_mutex );
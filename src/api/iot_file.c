@@ -21,11 +21,10 @@
 #include "iot_common.h"            /* for iot_common_arg_set */
 #include "iot_plugin.h"            /* for plug-in support */
 
+#include "shared/iot_archive.h"    /* for archiving directories */
 #include "shared/iot_types.h"      /* for struct iot */
 
 #include <os.h>                    /* operating system abstraction */
-#include <archive.h>               /* for archiving functions */
-#include <archive_entry.h>         /* for adding files to an archive */
 
 /**
  * @brief Default download subdirectory
@@ -53,7 +52,8 @@
  *                                     be relative to default directory.
  *                                     if it is a directory instead of a file,
  *                                     all files within that directory will be
- *                                     bundled together.
+ *                                     bundled together (as it is sent, if a
+ *                                     "compression" option is given).
  * @param[in]      func                callback function to give
  *                                     progress update (optional)
  *                                     if none is given, progress will
@@ -76,98 +76,6 @@ static iot_status_t iot_file_transfer(
 	iot_file_progress_callback_t *func,
 	void *user_data );
 
-/**
- * @brief Build an archive from a directory for the cloud
- *
- * @param[in]      archive_path        name of the archive file to produce
- * @param[in]      path                path to the directory to archive
- *
- * @retval IOT_STATUS_BAD_PARAMETER    invalid parameter passed
- * @retval IOT_STATUS_FAILURE          internal system failure
- * @retval IOT_STATUS_SUCCESS          operation successful
- */
-static iot_status_t iot_file_archive_directory(
-	const char *archive_path,
-	const char *path );
-
-
-iot_status_t iot_file_archive_directory(
-	const char *archive_path,
-	const char *path )
-{
-	iot_status_t result = IOT_STATUS_BAD_PARAMETER;
-	if ( archive_path && path )
-	{
-		os_dir_t *dir = NULL;
-		struct archive *archive;
-
-		/* compress all files in upload directories */
-		archive = archive_write_new();
-		archive_write_add_filter_none( archive );
-		archive_write_set_format_pax_restricted( archive );
-		archive_write_open_filename( archive, archive_path );
-
-		if ( ( dir = os_directory_open( path ) ) != NULL )
-		{
-			char file_name[ PATH_MAX + 1u ];
-			iot_bool_t walk_directory = IOT_TRUE;
-
-			while ( walk_directory )
-			{
-				char file_path[ PATH_MAX + 1u ];
-				os_file_t input_file;
-				struct stat file_stat;
-
-				os_directory_next( dir, IOT_TRUE, file_name, PATH_MAX );
-
-				os_snprintf( file_path, PATH_MAX, "%s%c%s", path, OS_DIR_SEP, file_name );
-
-				stat( file_name, &file_stat );
-				input_file = os_file_open( file_name, OS_READ );
-				if ( input_file )
-				{
-					/* create an archive of all files */
-					char buff[1024];
-					size_t buff_len;
-					struct archive_entry *entry;
-
-					entry = archive_entry_new();
-
-					/* Note: set the file details individually.  Calling archive_entry_copy_stat(
-					 * entry, &file_stat ) is easier but it corrupts archives on 32b architectures,
-					 * e.g. quark. */
-					archive_entry_set_size(entry, file_stat.st_size );
-					archive_entry_set_filetype(entry, AE_IFREG );
-					archive_entry_set_perm(entry, 0644 );
-					archive_entry_set_pathname( entry, file_name );
-
-					/* stat struct does not store
-					 * the birthtime.  That is part of the file system */
-					archive_entry_set_atime( entry, file_stat.st_atime, 0 );
-					archive_entry_set_birthtime( entry, file_stat.st_ctime, 0 );
-					archive_entry_set_ctime( entry, file_stat.st_ctime, 0 );
-					archive_entry_set_mtime( entry, file_stat.st_mtime, 0 );
-
-					archive_write_header( archive, entry );
-					while ( ( buff_len = os_file_read( buff, 1, sizeof( buff ), input_file ) ) )
-						archive_write_data( archive, buff, buff_len );
-
-					archive_entry_free( entry );
-					os_file_close( input_file );
-					result = IOT_STATUS_SUCCESS;
-				}
-				else
-					walk_directory = IOT_FALSE;
-			}
-			os_directory_close( dir );
-		}
-
-		archive_write_close( archive );
-		archive_write_free( archive );
-	}
-	return result;
-}
-
 iot_status_t iot_file_download(
 	iot_t *lib,
 	iot_transaction_t *txn,
@@ -202,6 +110,7 @@ iot_status_t iot_file_transfer(
 	{
 		char *heap_name = NULL;
 		char *heap_path = NULL;
+		const char *compression = NULL;
 		iot_file_transfer_t transfer;
 
 		result = IOT_STATUS_FAILURE;
@@ -248,6 +157,27 @@ iot_status_t iot_file_transfer(
 			}
 		}
 
+		/* a directory uploaded with a compression is archived as it
+		 * is sent, instead of to a temporary file first */
+		if ( op == IOT_OPERATION_FILE_UPLOAD && transfer.path &&
+			os_directory_exists( transfer.path ) &&
+			iot_options_get_string( options, "compression",
+				IOT_FALSE, &compression ) == IOT_STATUS_SUCCESS &&
+			compression )
+		{
+			transfer.archive = IOT_TRUE;
+			if ( os_strcmp( compression, "gzip" ) == 0 )
+				transfer.compression =
+					IOT_ARCHIVE_COMPRESSION_GZIP;
+			else if ( os_strcmp( compression, "zstd" ) == 0 )
+				transfer.compression =
+					IOT_ARCHIVE_COMPRESSION_ZSTD;
+			else if ( os_strcmp( compression, "none" ) != 0 )
+				transfer.archive = IOT_FALSE;
+		}
+		else
+			compression = NULL;
+
 		/* Use the file_name to rename it on the cloud */
 		if ( file_name && file_name[0] != '\0' )
 			transfer.name = file_name;
@@ -257,7 +187,8 @@ iot_status_t iot_file_transfer(
 			 * with dashes and tar extension */
 			if ( os_directory_exists( transfer.path ) )
 			{
-				const char *const ext = ".tar";
+				const char *const ext = iot_archive_extension(
+					transfer.compression );
 				size_t path_len = os_strlen(
 					transfer.path );
 				const size_t heap_len = path_len +
@@ -312,7 +243,16 @@ iot_status_t iot_file_transfer(
 		}
 		if ( op == IOT_OPERATION_FILE_UPLOAD )
 		{
-			if ( os_directory_exists( transfer.path ) )
+			if ( transfer.archive != IOT_FALSE )
+				result = IOT_STATUS_SUCCESS;
+			else if ( compression )
+			{
+				IOT_LOG( lib, IOT_LOG_ERROR,
+					"Unsupported compression: %s",
+					compression );
+				result = IOT_STATUS_BAD_PARAMETER;
+			}
+			else if ( os_directory_exists( transfer.path ) )
 			{
 				size_t archive_len = 0u;
 				char *archive_path = NULL;
@@ -347,8 +287,9 @@ iot_status_t iot_file_transfer(
 					os_file_temp( archive_path,
 						os_strlen(ext) );
 
-					result = iot_file_archive_directory(
-						archive_path, transfer.path );
+					result = iot_archive_directory(
+						archive_path, transfer.path,
+						IOT_ARCHIVE_COMPRESSION_NONE );
 					if ( result == IOT_STATUS_SUCCESS )
 					{
 						transfer.path = archive_path;
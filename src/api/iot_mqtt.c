@@ -30,6 +30,23 @@
 #	endif /* else ifdef IOT_THREAD_SUPPORT */
 #endif /* else ifdef IOT_MQTT_MOSQUITTO */
 
+#if defined( IOT_MQTT_MOSQUITTO ) && defined( MQTT_PROTOCOL_V5 )
+/** @brief client library is able to connect using MQTT version 5 */
+#	define IOT_MQTT_V5_SUPPORT
+#elif !defined( IOT_MQTT_MOSQUITTO ) && defined( MQTTVERSION_5 )
+/** @brief client library is able to connect using MQTT version 5 */
+#	define IOT_MQTT_V5_SUPPORT
+/** @brief client library supports MQTT version 5 properties */
+#	define IOT_MQTT_V5_PROPERTIES
+#endif
+
+#if defined( IOT_MQTT_MOSQUITTO ) && \
+	defined( LIBMOSQUITTO_VERSION_NUMBER ) && \
+	LIBMOSQUITTO_VERSION_NUMBER >= 1005000
+/** @brief client library reports the flags of the connect acknowledgement */
+#	define IOT_MQTT_CONNECT_FLAGS
+#endif /* if defined( IOT_MQTT_MOSQUITTO ) && ... */
+
 /** @brief Defualt MQTT port for non-SSL connections */
 #define IOT_MQTT_PORT                  1883
 /** @brief Default MQTT port for SSL connections */
@@ -39,6 +56,18 @@
 /** @brief Default port for MQTT over Secure websocket connections */
 #define IOT_MQTT_PORT_WSS              443
 
+/** @brief MQTT 3.1.1 connection refused: unacceptable protocol version */
+#define IOT_MQTT_REFUSED_VERSION       1
+/** @brief MQTT 5 connection refused: unsupported protocol version */
+#define IOT_MQTT_REFUSED_VERSION_5     132
+
+#ifdef IOT_MQTT_V5_PROPERTIES
+/** @brief maximum number of topic aliases used on a connection */
+#define IOT_MQTT_TOPIC_ALIAS_MAX       8u
+/** @brief maximum length of a topic that is given an alias */
+#define IOT_MQTT_TOPIC_ALIAS_LEN       63u
+#endif /* ifdef IOT_MQTT_V5_PROPERTIES */
+
 /** @brief count of the number of times that MQTT initalize has been called */
 static unsigned int MQTT_INIT_COUNT = 0u;
 
@@ -54,6 +83,22 @@ static IOT_SECTION void iot_mqtt_on_connect(
 	struct mosquitto *mosq,
 	void *user_data,
 	int rc );
+#ifdef IOT_MQTT_CONNECT_FLAGS
+/**
+ * @brief callback called when a connection is established, with the flags
+ *        of the connect acknowledgement
+ *
+ * @param[in]      mosq                mosquitto instance calling the callback
+ * @param[in]      user_data           user data provided in <mosquitto_new>
+ * @param[in]      rc                  the reason for the connection
+ * @param[in]      flags               connect acknowledgement flags
+ */
+static IOT_SECTION void iot_mqtt_on_connect_flags(
+	struct mosquitto *mosq,
+	void *user_data,
+	int rc,
+	int flags );
+#endif /* ifdef IOT_MQTT_CONNECT_FLAGS */
 /**
  * @brief callback called when a connection is terminated
  *
@@ -165,6 +210,17 @@ static IOT_SECTION void iot_mqtt_on_failure(
 	MQTTAsync_failureData *response
 );
 
+/**
+ * @brief callback called on failure of sending a message
+ *
+ * @param[in]      user_data           context user data
+ * @param[in]      response            response data
+ */
+static IOT_SECTION void iot_mqtt_on_publish_failure(
+	void *user_data,
+	MQTTAsync_failureData *response
+);
+
 /**
  * @brief callback called on success of a subscribe, unsubscribe or
  * sending of a message
@@ -176,6 +232,54 @@ static IOT_SECTION void iot_mqtt_on_success(
 	void *user_data,
 	MQTTAsync_successData *response
 );
+
+#ifdef IOT_MQTT_V5_PROPERTIES
+/**
+ * @brief callback called on failure of sending a message assigning a topic
+ *        alias, the alias is released
+ *
+ * @param[in]      user_data           topic alias assigned
+ * @param[in]      response            response data
+ */
+static IOT_SECTION void iot_mqtt_on_alias_failure(
+	void *user_data,
+	MQTTAsync_failureData *response
+);
+
+/**
+ * @brief callback called on success of sending a message assigning a topic
+ *        alias, the alias can then be used without the topic
+ *
+ * @param[in]      user_data           topic alias assigned
+ * @param[in]      response            response data
+ */
+static IOT_SECTION void iot_mqtt_on_alias_success(
+	void *user_data,
+	MQTTAsync_successData *response
+);
+
+/**
+ * @brief callback called on failure of an MQTT 5 connection
+ *
+ * @param[in]      user_data           context user data
+ * @param[in]      response            response data
+ */
+static IOT_SECTION void iot_mqtt_on_connect_failure5(
+	void *user_data,
+	MQTTAsync_failureData5 *response
+);
+
+/**
+ * @brief callback called on success of an MQTT 5 connection
+ *
+ * @param[in]      user_data           context user data
+ * @param[in]      response            response data
+ */
+static IOT_SECTION void iot_mqtt_on_connect_success5(
+	void *user_data,
+	MQTTAsync_successData5 *response
+);
+#endif /* ifdef IOT_MQTT_V5_PROPERTIES */
 #else /* ifdef IOT_THREAD_SUPPORT */
 #define PAHO_OBJ(x)        MQTTClient ## x
 #define PAHO_RES(x)        MQTTCLIENT ## x
@@ -220,6 +324,19 @@ static IOT_SECTION int iot_mqtt_on_message(
 	PAHO_OBJ( _message ) *message );
 #endif /* else ifdef IOT_MQTT_MOSQUITTO */
 
+#ifdef IOT_MQTT_V5_PROPERTIES
+/**
+ * @brief applies the limits the broker returned for an MQTT 5 connection
+ *
+ * @param[in,out]  mqtt                MQTT object that connected
+ * @param[in]      props               properties of the connection
+ *                                     acknowledgement
+ */
+static IOT_SECTION void iot_mqtt_connack_properties(
+	iot_mqtt_t *mqtt,
+	MQTTProperties *props );
+#endif /* ifdef IOT_MQTT_V5_PROPERTIES */
+
 /**
  * @brief implementation for connecting to an MQTT broker
  *
@@ -243,6 +360,55 @@ static IOT_SECTION iot_status_t iot_mqtt_connect_impl(
 	iot_millisecond_t max_time_out,
 	iot_bool_t reconnect );
 
+#ifdef IOT_MQTT_V5_PROPERTIES
+/**
+ * @brief finds the alias for a topic, assigning a free one if the topic
+ *        does not have one yet
+ *
+ * An alias is only used without its topic once the message assigning it is
+ * sent; until then, the topic is sent in full.
+ *
+ * @note the alias mutex must be held by the caller
+ *
+ * @param[in,out]  mqtt                MQTT object to publish with
+ * @param[in]      topic               topic to find the alias of
+ * @param[out]     assigned            whether the alias was just assigned,
+ *                                     so the topic must be sent as well
+ *
+ * @return the alias for the topic, 0 if the topic does not have one (or the
+ *         one it has is not sent yet)
+ */
+static IOT_SECTION iot_uint16_t iot_mqtt_topic_alias(
+	iot_mqtt_t *mqtt,
+	const char *topic,
+	iot_bool_t *assigned );
+
+/**
+ * @brief frees a topic alias the broker never received
+ *
+ * @note the alias mutex must be held by the caller
+ *
+ * @param[in,out]  mqtt                MQTT object the alias is of
+ * @param[in]      alias               alias to free
+ */
+static IOT_SECTION void iot_mqtt_topic_alias_release(
+	iot_mqtt_t *mqtt,
+	iot_uint16_t alias );
+#endif /* ifdef IOT_MQTT_V5_PROPERTIES */
+
+#ifdef IOT_MQTT_V5_PROPERTIES
+/** @brief topic alias of a connection */
+struct iot_mqtt_alias
+{
+	/** @brief topic of the alias (empty = free) */
+	char topic[ IOT_MQTT_TOPIC_ALIAS_LEN + 1u ];
+	/** @brief message assigning the alias was sent to the broker */
+	iot_bool_t established;
+	/** @brief MQTT object the alias is of */
+	iot_mqtt_t *mqtt;
+};
+#endif /* ifdef IOT_MQTT_V5_PROPERTIES */
+
 /** @brief maximum length for an mqtt connection url */
 #define IOT_MQTT_URL_MAX               64u
 
@@ -254,6 +420,12 @@ struct iot_mqtt
 	os_thread_mutex_t                notification_mutex;
 	/** @brief Signal for waking another thread waiting for notification */
 	os_thread_condition_t            notification_signal;
+	/** @brief Mutex to protect the count of unacknowledged messages */
+	os_thread_mutex_t                inflight_mutex;
+#ifdef IOT_MQTT_V5_PROPERTIES
+	/** @brief Mutex to protect the topic aliases */
+	os_thread_mutex_t                alias_mutex;
+#endif /* ifdef IOT_MQTT_V5_PROPERTIES */
 #endif /* ifdef IOT_THREAD_SUPPORT */
 
 #ifdef IOT_MQTT_MOSQUITTO
@@ -276,6 +448,29 @@ struct iot_mqtt
 	iot_timestamp_t                  time_stamp_changed;
 	/** @brief the client cloud reconnect counter */
 	iot_uint32_t                     reconnect_count;
+	/** @brief keep alive interval of the connection in seconds */
+	iot_uint16_t                     keep_alive;
+	/** @brief QoS 1 & 2 messages awaiting acknowledgement */
+	iot_uint16_t                     inflight;
+	/** @brief maximum messages awaiting acknowledgement (0: no limit) */
+	iot_uint16_t                     max_inflight;
+	/** @brief protocol version used for the connection */
+	iot_mqtt_version_t               version;
+	/** @brief broker refused the protocol version on the last attempt */
+	iot_bool_t                       version_refused;
+	/** @brief broker resumed an existing session on connection */
+	iot_bool_t                       session_present;
+#ifdef IOT_MQTT_V5_PROPERTIES
+	/** @brief number of topic aliases in use, or freed below the last
+	 *         one in use */
+	iot_uint16_t                     alias_count;
+	/** @brief maximum number of topic aliases requested */
+	iot_uint16_t                     alias_limit;
+	/** @brief maximum number of topic aliases allowed by the broker */
+	iot_uint16_t                     alias_max;
+	/** @brief topic aliases (alias is the index + 1) */
+	struct iot_mqtt_alias            alias[ IOT_MQTT_TOPIC_ALIAS_MAX ];
+#endif /* ifdef IOT_MQTT_V5_PROPERTIES */
 	/** @brief callback to call when a disconnection is detected */
 	iot_mqtt_disconnect_callback_t   on_disconnect;
 	/** @brief callback to call when a message is delivered */
@@ -286,6 +481,47 @@ struct iot_mqtt
 	void * user_data;
 };
 
+#ifdef IOT_MQTT_V5_PROPERTIES
+void iot_mqtt_connack_properties(
+	iot_mqtt_t *mqtt,
+	MQTTProperties *props )
+{
+	if ( mqtt && props )
+	{
+		int value = MQTTProperties_getNumericValue( props,
+			MQTTPROPERTY_CODE_TOPIC_ALIAS_MAXIMUM );
+#ifdef IOT_THREAD_SUPPORT
+		os_thread_mutex_lock( &mqtt->alias_mutex );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+		mqtt->alias_count = 0u;
+		mqtt->alias_max = 0u;
+		if ( value > 0 )
+		{
+			mqtt->alias_max = mqtt->alias_limit;
+			if ( value < (int)mqtt->alias_max )
+				mqtt->alias_max = (iot_uint16_t)value;
+		}
+#ifdef IOT_THREAD_SUPPORT
+		os_thread_mutex_unlock( &mqtt->alias_mutex );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+
+		/* broker limits the messages awaiting acknowledgement */
+		value = MQTTProperties_getNumericValue( props,
+			MQTTPROPERTY_CODE_RECEIVE_MAXIMUM );
+#ifdef IOT_THREAD_SUPPORT
+		os_thread_mutex_lock( &mqtt->inflight_mutex );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+		if ( value > 0 && value <= 0xFFFF &&
+			( mqtt->max_inflight == 0u ||
+			  value < (int)mqtt->max_inflight ) )
+			mqtt->max_inflight = (iot_uint16_t)value;
+#ifdef IOT_THREAD_SUPPORT
+		os_thread_mutex_unlock( &mqtt->inflight_mutex );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+	}
+}
+#endif /* ifdef IOT_MQTT_V5_PROPERTIES */
+
 iot_mqtt_t* iot_mqtt_connect(
 	const iot_mqtt_connect_options_t *opts,
 	iot_millisecond_t max_time_out )
@@ -303,6 +539,10 @@ iot_mqtt_t* iot_mqtt_connect(
 			const char *uri_proto = "tcp";
 			const char *ws_path = "";
 #endif /* ifndef IOT_MQTT_MOSQUITTO */
+#ifdef IOT_MQTT_V5_PROPERTIES
+			PAHO_OBJ( _createOptions ) create_opts =
+				PAHO_OBJ( _createOptions_initializer );
+#endif /* ifdef IOT_MQTT_V5_PROPERTIES */
 			os_memzero( result, sizeof( struct iot_mqtt ) );
 
 #ifdef IOT_THREAD_SUPPORT
@@ -310,11 +550,17 @@ iot_mqtt_t* iot_mqtt_connect(
 				&result->notification_mutex );
 			os_thread_condition_create(
 				&result->notification_signal );
+			os_thread_mutex_create( &result->inflight_mutex );
+#ifdef IOT_MQTT_V5_PROPERTIES
+			os_thread_mutex_create( &result->alias_mutex );
+#endif /* ifdef IOT_MQTT_V5_PROPERTIES */
 #endif /* ifdef IOT_THREAD_SUPPORT */
 
 #ifdef IOT_MQTT_MOSQUITTO
-			result->mosq = mosquitto_new( opts->client_id, true,
-				result );
+			/* a session to resume is kept by the broker only if
+			 * it is not clean (the expiry itself can't be set) */
+			result->mosq = mosquitto_new( opts->client_id,
+				opts->session_expiry == 0u, result );
 			if ( result->mosq )
 			{
 #else /* ifdef IOT_MQTT_MOSQUITTO */
@@ -357,9 +603,20 @@ iot_mqtt_t* iot_mqtt_connect(
 				uri_proto, opts->host, port, ws_path );
 			url[ IOT_MQTT_URL_MAX ] = '\0';
 
+#ifdef IOT_MQTT_V5_PROPERTIES
+			/* client must be created for MQTT 5, it is still able
+			 * to connect using 3.1.1 if the broker refuses it */
+			if ( opts->version == IOT_MQTT_VERSION_5 )
+				create_opts.MQTTVersion = MQTTVERSION_5;
+			if ( PAHO_OBJ( _createWithOptions )( &result->client,
+				url, opts->client_id,
+				MQTTCLIENT_PERSISTENCE_NONE, NULL,
+				&create_opts ) == PAHO_RES( _SUCCESS ) )
+#else /* ifdef IOT_MQTT_V5_PROPERTIES */
 			if ( PAHO_OBJ( _create )( &result->client, url,
 				opts->client_id, MQTTCLIENT_PERSISTENCE_NONE,
 				NULL ) == PAHO_RES( _SUCCESS ) )
+#endif /* else IOT_MQTT_V5_PROPERTIES */
 			{
 #endif /* else ifdef IOT_MQTT_MOSQUITTO */
 
@@ -379,6 +636,12 @@ iot_mqtt_t* iot_mqtt_connect(
 #endif /* else ifdef IOT_MQTT_MOSQUITTO */
 
 #ifdef IOT_THREAD_SUPPORT
+				os_thread_mutex_destroy(
+					&result->inflight_mutex );
+#ifdef IOT_MQTT_V5_PROPERTIES
+				os_thread_mutex_destroy(
+					&result->alias_mutex );
+#endif /* ifdef IOT_MQTT_V5_PROPERTIES */
 				os_thread_condition_destroy(
 					&result->notification_signal );
 				os_thread_mutex_destroy(
@@ -410,10 +673,49 @@ iot_status_t iot_mqtt_connect_impl(
 		PAHO_OBJ( _SSLOptions ) ssl_opts =
 			PAHO_OBJ( _SSLOptions_initializer );
 #endif /* else ifdef IOT_MQTT_MOSQUITTO */
+#ifdef IOT_MQTT_V5_PROPERTIES
+		MQTTProperties props = MQTTProperties_initializer;
+#endif /* ifdef IOT_MQTT_V5_PROPERTIES */
 		iot_uint16_t port = opts->port;
+		iot_mqtt_version_t version = opts->version;
 		iot_millisecond_t wait_time = 0u; /* time wait so far */
 
 		mqtt->is_connected = IOT_FALSE;
+#ifdef IOT_THREAD_SUPPORT
+		os_thread_mutex_lock( &mqtt->inflight_mutex );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+		mqtt->inflight = 0u;
+		mqtt->max_inflight = opts->max_inflight;
+#ifdef IOT_THREAD_SUPPORT
+		os_thread_mutex_unlock( &mqtt->inflight_mutex );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+		mqtt->keep_alive = opts->keep_alive;
+		mqtt->session_present = IOT_FALSE;
+		mqtt->version_refused = IOT_FALSE;
+
+		/* keep using 3.1.1 once the broker refused MQTT 5 */
+#ifdef IOT_MQTT_V5_SUPPORT
+		if ( version == IOT_MQTT_VERSION_5 &&
+			mqtt->version == IOT_MQTT_VERSION_3_1_1 )
+#else /* ifdef IOT_MQTT_V5_SUPPORT */
+		if ( version == IOT_MQTT_VERSION_5 )
+#endif /* else IOT_MQTT_V5_SUPPORT */
+			version = IOT_MQTT_VERSION_3_1_1;
+
+#ifdef IOT_MQTT_V5_PROPERTIES
+		/* topic aliases only last for a connection */
+#ifdef IOT_THREAD_SUPPORT
+		os_thread_mutex_lock( &mqtt->alias_mutex );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+		mqtt->alias_count = 0u;
+		mqtt->alias_max = 0u;
+		mqtt->alias_limit = opts->topic_alias_max;
+		if ( mqtt->alias_limit > IOT_MQTT_TOPIC_ALIAS_MAX )
+			mqtt->alias_limit = IOT_MQTT_TOPIC_ALIAS_MAX;
+#ifdef IOT_THREAD_SUPPORT
+		os_thread_mutex_unlock( &mqtt->alias_mutex );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+#endif /* ifdef IOT_MQTT_V5_PROPERTIES */
 
 		result = IOT_STATUS_FAILURE;
 		if ( port == 0u )
@@ -429,8 +731,13 @@ iot_status_t iot_mqtt_connect_impl(
 		}
 
 #ifdef IOT_MQTT_MOSQUITTO
+#ifdef IOT_MQTT_CONNECT_FLAGS
+		mosquitto_connect_with_flags_callback_set( mqtt->mosq,
+			iot_mqtt_on_connect_flags );
+#else /* ifdef IOT_MQTT_CONNECT_FLAGS */
 		mosquitto_connect_callback_set( mqtt->mosq,
 			iot_mqtt_on_connect );
+#endif /* else IOT_MQTT_CONNECT_FLAGS */
 		mosquitto_disconnect_callback_set( mqtt->mosq,
 			iot_mqtt_on_disconnect );
 		mosquitto_message_callback_set( mqtt->mosq,
@@ -445,6 +752,11 @@ iot_status_t iot_mqtt_connect_impl(
 			mosquitto_username_pw_set( mqtt->mosq,
 				opts->username, opts->password );
 
+		/* mosquitto queues messages past the window internally */
+		if ( opts->max_inflight > 0u )
+			mosquitto_max_inflight_messages_set( mqtt->mosq,
+				opts->max_inflight );
+
 		if ( opts->proxy_conf )
 		{
 			if ( opts->proxy_conf->type == IOT_PROXY_SOCKS5 )
@@ -477,7 +789,7 @@ iot_status_t iot_mqtt_connect_impl(
 				opts->ssl_conf->insecure );
 		}
 
-		switch ( opts->version )
+		switch ( version )
 		{
 			case IOT_MQTT_VERSION_3_1:
 			{
@@ -490,13 +802,26 @@ iot_status_t iot_mqtt_connect_impl(
 			}
 			case IOT_MQTT_VERSION_3_1_1:
 			{
-				int ver = MQTT_PROTOCOL_V31;
+				int ver = MQTT_PROTOCOL_V311;
+				mosquitto_opts_set(
+					mqtt->mosq,
+					MOSQ_OPT_PROTOCOL_VERSION,
+					&ver );
+				break;
+			}
+#ifdef IOT_MQTT_V5_SUPPORT
+			case IOT_MQTT_VERSION_5:
+			{
+				/* connection properties are not set through
+				 * this client, so only the protocol is used */
+				int ver = MQTT_PROTOCOL_V5;
 				mosquitto_opts_set(
 					mqtt->mosq,
 					MOSQ_OPT_PROTOCOL_VERSION,
 					&ver );
 				break;
 			}
+#endif /* ifdef IOT_MQTT_V5_SUPPORT */
 			case IOT_MQTT_VERSION_DEFAULT:
 			default:
 				break;
@@ -552,6 +877,7 @@ iot_status_t iot_mqtt_connect_impl(
 				os_time( &ts, NULL );
 				while ( mosq_res == MOSQ_ERR_SUCCESS &&
 					mqtt->is_connected == IOT_FALSE &&
+					mqtt->version_refused == IOT_FALSE &&
 					wait_for_mqtt_work > 0u )
 				{
 					mosq_res = mosquitto_loop(
@@ -601,13 +927,20 @@ iot_status_t iot_mqtt_connect_impl(
 		if ( opts->keep_alive > 0u )
 			conn_opts.keepAliveInterval = opts->keep_alive;
 
-		if ( opts->version != IOT_MQTT_VERSION_3_1 )
+		if ( opts->max_inflight > 0u )
+#ifdef IOT_THREAD_SUPPORT
+			conn_opts.maxInflight = opts->max_inflight;
+#else /* ifdef IOT_THREAD_SUPPORT */
+			conn_opts.reliable = ( opts->max_inflight == 1u );
+#endif /* else ifdef IOT_THREAD_SUPPORT */
+
+		if ( version != IOT_MQTT_VERSION_3_1 )
 		{
 			conn_opts.username = opts->username;
 			conn_opts.password = opts->password;
 		}
 
-		switch ( opts->version )
+		switch ( version )
 		{
 			case IOT_MQTT_VERSION_3_1:
 				conn_opts.MQTTVersion = MQTTVERSION_3_1;
@@ -615,14 +948,50 @@ iot_status_t iot_mqtt_connect_impl(
 			case IOT_MQTT_VERSION_3_1_1:
 				conn_opts.MQTTVersion = MQTTVERSION_3_1_1;
 				break;
+#ifdef IOT_MQTT_V5_PROPERTIES
+			case IOT_MQTT_VERSION_5:
+				conn_opts.MQTTVersion = MQTTVERSION_5;
+				conn_opts.cleansession = 0;
+				conn_opts.cleanstart = !reconnect;
+				if ( opts->session_expiry > 0u )
+				{
+					MQTTProperty prop;
+					prop.identifier =
+					MQTTPROPERTY_CODE_SESSION_EXPIRY_INTERVAL;
+					prop.value.integer4 =
+						opts->session_expiry;
+					MQTTProperties_add( &props, &prop );
+				}
+				if ( opts->receive_max > 0u )
+				{
+					MQTTProperty prop;
+					prop.identifier =
+						MQTTPROPERTY_CODE_RECEIVE_MAXIMUM;
+					prop.value.integer2 = opts->receive_max;
+					MQTTProperties_add( &props, &prop );
+				}
+				break;
+#endif /* ifdef IOT_MQTT_V5_PROPERTIES */
 			case IOT_MQTT_VERSION_DEFAULT:
 			default:
 				break;
 		}
 
 #ifdef IOT_THREAD_SUPPORT
-		conn_opts.onSuccess = iot_mqtt_on_success;
-		conn_opts.onFailure = iot_mqtt_on_failure;
+#ifdef IOT_MQTT_V5_PROPERTIES
+		/* MQTT 5 callbacks receive the connection properties */
+		if ( conn_opts.MQTTVersion == MQTTVERSION_5 )
+		{
+			conn_opts.connectProperties = &props;
+			conn_opts.onSuccess5 = iot_mqtt_on_connect_success5;
+			conn_opts.onFailure5 = iot_mqtt_on_connect_failure5;
+		}
+		else
+#endif /* ifdef IOT_MQTT_V5_PROPERTIES */
+		{
+			conn_opts.onSuccess = iot_mqtt_on_success;
+			conn_opts.onFailure = iot_mqtt_on_failure;
+		}
 		conn_opts.context = mqtt;
 #endif /* ifdef IOT_THREAD_SUPPORT */
 
@@ -647,10 +1016,14 @@ iot_status_t iot_mqtt_connect_impl(
 
 		/* connect in a loop for when network is not available initially */
 		while ( mqtt->is_connected == IOT_FALSE &&
+			mqtt->version_refused == IOT_FALSE &&
 			( max_time_out == 0u || wait_time < max_time_out ) )
 		{
 			iot_millisecond_t wait_interval =
 				IOT_MILLISECONDS_IN_SECOND;
+#ifndef IOT_THREAD_SUPPORT
+			int rc;
+#endif /* ifndef IOT_THREAD_SUPPORT */
 
 			if ( opts->keep_alive > 0u )
 				wait_interval *= opts->keep_alive;
@@ -669,19 +1042,58 @@ iot_status_t iot_mqtt_connect_impl(
 			else
 				max_time_out = 0u; /* failure, so break loop */
 #else /* ifdef IOT_THREAD_SUPPORT */
-			if ( MQTTClient_connect( mqtt->client, &conn_opts )
-				== MQTTCLIENT_SUCCESS )
+#ifdef IOT_MQTT_V5_PROPERTIES
+			if ( conn_opts.MQTTVersion == MQTTVERSION_5 )
+			{
+				MQTTResponse response = MQTTClient_connect5(
+					mqtt->client, &conn_opts, &props,
+					NULL );
+				rc = (int)response.reasonCode;
+				if ( rc == MQTTCLIENT_SUCCESS )
+					iot_mqtt_connack_properties( mqtt,
+						response.properties );
+				MQTTResponse_free( response );
+			}
+			else
+#endif /* ifdef IOT_MQTT_V5_PROPERTIES */
+				rc = MQTTClient_connect( mqtt->client,
+					&conn_opts );
+			if ( rc == MQTTCLIENT_SUCCESS )
+			{
 				mqtt->is_connected = IOT_TRUE;
+				mqtt->session_present =
+					conn_opts.returned.sessionPresent ?
+					IOT_TRUE : IOT_FALSE;
+			}
+			else if ( version == IOT_MQTT_VERSION_5 &&
+				( rc == IOT_MQTT_REFUSED_VERSION ||
+				  rc == IOT_MQTT_REFUSED_VERSION_5 ) )
+				mqtt->version_refused = IOT_TRUE;
 			else
 				os_time_sleep( wait_interval, IOT_TRUE );
 #endif /* else ifdef IOT_THREAD_SUPPORT */
 			wait_time += wait_interval;
 		}
+#ifdef IOT_MQTT_V5_PROPERTIES
+		MQTTProperties_free( &props );
+#endif /* ifdef IOT_MQTT_V5_PROPERTIES */
 #endif /* else ifdef IOT_MQTT_MOSQUITTO */
 
 		/* if we connected then success */
 		if ( mqtt->is_connected != IOT_FALSE )
+		{
+			mqtt->version = version;
 			result = IOT_STATUS_SUCCESS;
+		}
+		else if ( version == IOT_MQTT_VERSION_5 &&
+			mqtt->version_refused != IOT_FALSE )
+		{
+			/* broker does not support MQTT 5, try again using
+			 * 3.1.1 (kept for any following reconnections) */
+			mqtt->version = IOT_MQTT_VERSION_3_1_1;
+			result = iot_mqtt_connect_impl( mqtt, opts,
+				max_time_out, reconnect );
+		}
 	}
 	return result;
 }
@@ -743,6 +1155,10 @@ iot_status_t iot_mqtt_disconnect(
 #endif /* else ifdef IOT_MQTT_MOSQUITTO */
 
 #ifdef IOT_THREAD_SUPPORT
+		os_thread_mutex_destroy( &mqtt->inflight_mutex );
+#ifdef IOT_MQTT_V5_PROPERTIES
+		os_thread_mutex_destroy( &mqtt->alias_mutex );
+#endif /* ifdef IOT_MQTT_V5_PROPERTIES */
 		os_thread_condition_destroy( &mqtt->notification_signal );
 		os_thread_mutex_destroy( &mqtt->notification_mutex );
 #endif /* ifdef IOT_THREAD_SUPPORT */
@@ -788,14 +1204,95 @@ iot_status_t iot_mqtt_loop( iot_mqtt_t *mqtt,
 	return result;
 }
 
+iot_status_t iot_mqtt_loop_dispatch( iot_mqtt_t *mqtt,
+	iot_bool_t readable, iot_bool_t writable )
+{
+	iot_status_t result = IOT_STATUS_BAD_PARAMETER;
+	if ( mqtt )
+	{
+#if defined( IOT_MQTT_MOSQUITTO ) && !defined( IOT_THREAD_SUPPORT )
+		int mosq_res = MOSQ_ERR_SUCCESS;
+		if ( readable != IOT_FALSE )
+			mosq_res = mosquitto_loop_read( mqtt->mosq, 1 );
+		if ( mosq_res == MOSQ_ERR_SUCCESS && writable != IOT_FALSE )
+			mosq_res = mosquitto_loop_write( mqtt->mosq, 1 );
+		/* keep alive & message retries */
+		if ( mosq_res == MOSQ_ERR_SUCCESS )
+			mosq_res = mosquitto_loop_misc( mqtt->mosq );
+
+		result = IOT_STATUS_SUCCESS;
+		if ( mosq_res != MOSQ_ERR_SUCCESS )
+			result = IOT_STATUS_FAILURE;
+#else /* if defined( IOT_MQTT_MOSQUITTO ) && !defined( IOT_THREAD_SUPPORT ) */
+		/* connection is serviced within the mqtt library */
+		(void)readable;
+		(void)writable;
+		result = IOT_STATUS_SUCCESS;
+#endif /* else if defined( IOT_MQTT_MOSQUITTO ) && !defined( IOT_THREAD_SUPPORT ) */
+	}
+	return result;
+}
+
+iot_status_t iot_mqtt_loop_socket( const iot_mqtt_t *mqtt,
+	int *fd, iot_bool_t *want_write, iot_millisecond_t *time_out )
+{
+	iot_status_t result = IOT_STATUS_BAD_PARAMETER;
+	if ( mqtt && fd )
+	{
+#if defined( IOT_MQTT_MOSQUITTO ) && !defined( IOT_THREAD_SUPPORT )
+		*fd = mosquitto_socket( mqtt->mosq );
+		result = IOT_STATUS_NOT_INITIALIZED;
+		if ( *fd >= 0 )
+		{
+			if ( want_write )
+			{
+				*want_write = IOT_FALSE;
+				if ( mosquitto_want_write( mqtt->mosq ) )
+					*want_write = IOT_TRUE;
+			}
+
+			/* ping must go out within the keep alive interval */
+			if ( time_out && mqtt->keep_alive > 0u )
+			{
+				const iot_millisecond_t keep_alive =
+					(iot_millisecond_t)mqtt->keep_alive *
+					IOT_MILLISECONDS_IN_SECOND / 2u;
+				if ( *time_out == 0u || keep_alive < *time_out )
+					*time_out = keep_alive;
+			}
+			result = IOT_STATUS_SUCCESS;
+		}
+#else /* if defined( IOT_MQTT_MOSQUITTO ) && !defined( IOT_THREAD_SUPPORT ) */
+		/* paho (and threaded mosquitto) read the socket in their own
+		 * thread, incoming messages are signalled some other way */
+		(void)want_write;
+		(void)time_out;
+		*fd = -1;
+		result = IOT_STATUS_NOT_SUPPORTED;
+#endif /* else if defined( IOT_MQTT_MOSQUITTO ) && !defined( IOT_THREAD_SUPPORT ) */
+	}
+	return result;
+}
+
 #ifdef IOT_MQTT_MOSQUITTO
 void iot_mqtt_on_connect(
 	struct mosquitto *UNUSED(mosq),
 	void *user_data,
-	int UNUSED(rc) )
+	int rc )
 {
 	iot_mqtt_t *const mqtt = (iot_mqtt_t *)user_data;
-	if ( mqtt && mqtt->is_connected == IOT_FALSE )
+	if ( mqtt && rc != 0 )
+	{
+		/* connection refused by the broker */
+		if ( rc == IOT_MQTT_REFUSED_VERSION ||
+			rc == IOT_MQTT_REFUSED_VERSION_5 )
+			mqtt->version_refused = IOT_TRUE;
+#ifdef IOT_THREAD_SUPPORT
+		os_thread_condition_signal( &mqtt->notification_signal,
+			&mqtt->notification_mutex );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+	}
+	else if ( mqtt && mqtt->is_connected == IOT_FALSE )
 	{
 		mqtt->is_connected = IOT_TRUE;
 		mqtt->time_stamp_changed = iot_timestamp_now();
@@ -808,6 +1305,21 @@ void iot_mqtt_on_connect(
 	}
 }
 
+#ifdef IOT_MQTT_CONNECT_FLAGS
+void iot_mqtt_on_connect_flags(
+	struct mosquitto *mosq,
+	void *user_data,
+	int rc,
+	int flags )
+{
+	iot_mqtt_t *const mqtt = (iot_mqtt_t *)user_data;
+	/* bit 0: session present */
+	if ( mqtt && rc == 0 )
+		mqtt->session_present = ( flags & 0x1 ) ? IOT_TRUE : IOT_FALSE;
+	iot_mqtt_on_connect( mosq, user_data, rc );
+}
+#endif /* ifdef IOT_MQTT_CONNECT_FLAGS */
+
 void iot_mqtt_on_disconnect(
 	struct mosquitto *UNUSED(mosq),
 	void *user_data,
@@ -877,6 +1389,16 @@ void iot_mqtt_on_disconnect(
 		mqtt->is_connected = IOT_FALSE;
 		mqtt->time_stamp_changed = iot_timestamp_now();
 		mqtt->reconnect_count = 0u;
+
+		/* messages in flight are not acknowledged after this; a late
+		 * completion only decrements a counter that is not zero */
+#ifdef IOT_THREAD_SUPPORT
+		os_thread_mutex_lock( &mqtt->inflight_mutex );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+		mqtt->inflight = 0u;
+#ifdef IOT_THREAD_SUPPORT
+		os_thread_mutex_unlock( &mqtt->inflight_mutex );
+#endif /* ifdef IOT_THREAD_SUPPORT */
 		if( mqtt->on_disconnect )
 			mqtt->on_disconnect( mqtt->user_data, unexpected );
 	}
@@ -892,11 +1414,103 @@ void iot_mqtt_on_delivery(
 	)
 {
 	iot_mqtt_t *const mqtt = (iot_mqtt_t *)user_data;
-	if ( mqtt && mqtt->on_delivery )
-		mqtt->on_delivery( mqtt->user_data, (int)token );
+	if ( mqtt )
+	{
+		/* only called for QoS 1 & 2 messages */
+#ifdef IOT_THREAD_SUPPORT
+		os_thread_mutex_lock( &mqtt->inflight_mutex );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+		if ( mqtt->inflight > 0u )
+			--mqtt->inflight;
+#ifdef IOT_THREAD_SUPPORT
+		os_thread_mutex_unlock( &mqtt->inflight_mutex );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+		if ( mqtt->on_delivery )
+			mqtt->on_delivery( mqtt->user_data, (int)token );
+	}
 }
 
 #ifdef IOT_THREAD_SUPPORT
+#ifdef IOT_MQTT_V5_PROPERTIES
+void iot_mqtt_on_alias_failure(
+	void *user_data,
+	MQTTAsync_failureData *response )
+{
+	struct iot_mqtt_alias *const alias =
+		(struct iot_mqtt_alias *)user_data;
+	if ( alias && alias->mqtt )
+	{
+		iot_mqtt_t *const mqtt = alias->mqtt;
+
+		/* broker never received the alias, so it can't be used */
+		os_thread_mutex_lock( &mqtt->alias_mutex );
+		if ( alias->established == IOT_FALSE )
+			iot_mqtt_topic_alias_release( mqtt, (iot_uint16_t)(
+				alias - &mqtt->alias[0] + 1 ) );
+		os_thread_mutex_unlock( &mqtt->alias_mutex );
+		iot_mqtt_on_publish_failure( mqtt, response );
+	}
+}
+
+void iot_mqtt_on_alias_success(
+	void *user_data,
+	MQTTAsync_successData *response )
+{
+	struct iot_mqtt_alias *const alias =
+		(struct iot_mqtt_alias *)user_data;
+	if ( alias && alias->mqtt )
+	{
+		iot_mqtt_t *const mqtt = alias->mqtt;
+		os_thread_mutex_lock( &mqtt->alias_mutex );
+		if ( alias->topic[0] != '\0' )
+			alias->established = IOT_TRUE;
+		os_thread_mutex_unlock( &mqtt->alias_mutex );
+		iot_mqtt_on_success( mqtt, response );
+	}
+}
+
+void iot_mqtt_on_connect_failure5(
+	void *user_data,
+	MQTTAsync_failureData5 *response )
+{
+	iot_mqtt_t *const mqtt = (iot_mqtt_t *)user_data;
+	if ( mqtt && response )
+	{
+		if ( response->code == IOT_MQTT_REFUSED_VERSION ||
+			response->reasonCode == IOT_MQTT_REFUSED_VERSION_5 )
+			mqtt->version_refused = IOT_TRUE;
+		if ( mqtt->is_connected != IOT_FALSE )
+		{
+			mqtt->is_connected = IOT_FALSE;
+			mqtt->time_stamp_changed = iot_timestamp_now();
+		}
+		os_thread_condition_signal( &mqtt->notification_signal,
+			&mqtt->notification_mutex );
+	}
+}
+
+void iot_mqtt_on_connect_success5(
+	void *user_data,
+	MQTTAsync_successData5 *response )
+{
+	iot_mqtt_t *const mqtt = (iot_mqtt_t *)user_data;
+	if ( mqtt && response )
+	{
+		iot_mqtt_connack_properties( mqtt, &response->properties );
+		mqtt->session_present =
+			response->alt.connect.sessionPresent ?
+			IOT_TRUE : IOT_FALSE;
+		if ( mqtt->is_connected == IOT_FALSE )
+		{
+			mqtt->is_connected = IOT_TRUE;
+			mqtt->time_stamp_changed = iot_timestamp_now();
+		}
+		os_thread_condition_signal( &mqtt->notification_signal,
+			&mqtt->notification_mutex );
+	}
+}
+#endif /* ifdef IOT_MQTT_V5_PROPERTIES */
+
 void iot_mqtt_on_failure(
 	void *user_data,
 	MQTTAsync_failureData *response )
@@ -933,6 +1547,22 @@ int iot_mqtt_on_message(
 }
 
 #ifdef IOT_THREAD_SUPPORT
+void iot_mqtt_on_publish_failure(
+	void *user_data,
+	MQTTAsync_failureData *response )
+{
+	iot_mqtt_t *const mqtt = (iot_mqtt_t *)user_data;
+	/* QoS 0 messages have no message id (token) and are not counted */
+	if ( mqtt && response && response->token != 0u )
+	{
+		/* message won't be acknowledged, free its place in the window */
+		os_thread_mutex_lock( &mqtt->inflight_mutex );
+		if ( mqtt->inflight > 0u )
+			--mqtt->inflight;
+		os_thread_mutex_unlock( &mqtt->inflight_mutex );
+	}
+}
+
 void iot_mqtt_on_success(
 	void *user_data,
 	MQTTAsync_successData *response )
@@ -943,6 +1573,9 @@ void iot_mqtt_on_success(
 		/* called on a connection */
 		if ( mqtt->is_connected == IOT_FALSE )
 		{
+			mqtt->session_present =
+				response->alt.connect.sessionPresent ?
+				IOT_TRUE : IOT_FALSE;
 			mqtt->is_connected = IOT_TRUE;
 			mqtt->time_stamp_changed = iot_timestamp_now();
 		}
@@ -964,47 +1597,163 @@ iot_status_t iot_mqtt_publish(
 {
 	iot_status_t result = IOT_STATUS_BAD_PARAMETER;
 	int mid = 0;
-	qos = 1;
-	if ( mqtt )
+	if ( mqtt && qos >= 0 && qos <= 2 )
 	{
+#ifndef IOT_MQTT_MOSQUITTO
+		/* reserve a place in the window for acknowledged messages */
+		result = IOT_STATUS_SUCCESS;
+		if ( qos > 0 )
+		{
+#ifdef IOT_THREAD_SUPPORT
+			os_thread_mutex_lock( &mqtt->inflight_mutex );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+			if ( mqtt->max_inflight > 0u &&
+				mqtt->inflight >= mqtt->max_inflight )
+				result = IOT_STATUS_FULL;
+			else
+				++mqtt->inflight;
+#ifdef IOT_THREAD_SUPPORT
+			os_thread_mutex_unlock( &mqtt->inflight_mutex );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+		}
+#endif /* ifndef IOT_MQTT_MOSQUITTO */
+
+		/* both clients copy the payload into their own outbound queue
+		 * (or write it out directly), so it is passed through as is */
 #ifdef IOT_MQTT_MOSQUITTO
 		result = IOT_STATUS_IO_ERROR;
 		if ( mosquitto_publish( mqtt->mosq, &mid, topic, payload_len,
 			payload, qos, retain ) == MOSQ_ERR_SUCCESS )
 			result = IOT_STATUS_SUCCESS;
 #else /* ifdef IOT_MQTT_MOSQUITTO */
-		void *pl = os_malloc( payload_len );
-		result = IOT_STATUS_NO_MEMORY;
-		if ( pl )
+		if ( result == IOT_STATUS_SUCCESS )
 		{
-#ifdef IOT_THREAD_SUPPORT
+			/* paho takes a non-const payload, though it only
+			 * reads it */
+			union
+			{
+				const void *in;
+				void *out;
+			} pl;
 			int rs;
+			const char *send_topic = topic;
+#ifdef IOT_THREAD_SUPPORT
 			const MQTTAsync_token token = mqtt->msg_id++;
 			MQTTAsync_responseOptions opts =
 				MQTTAsync_responseOptions_initializer;
+#else /* ifdef IOT_THREAD_SUPPORT */
+			MQTTClient_deliveryToken token = 0;
+#endif /* ifdef IOT_THREAD_SUPPORT */
+#ifdef IOT_MQTT_V5_PROPERTIES
+			MQTTProperties props = MQTTProperties_initializer;
+			iot_uint16_t alias = 0u;
+			iot_bool_t alias_new = IOT_FALSE;
+			const iot_bool_t use_alias =
+				( mqtt->version == IOT_MQTT_VERSION_5 &&
+				  qos == 0 ) ? IOT_TRUE : IOT_FALSE;
+
+			/* alias lock is held until the message is queued, so
+			 * the message assigning an alias is sent first; the
+			 * alias is only used alone once that message is sent */
+			if ( use_alias != IOT_FALSE )
+			{
+#ifdef IOT_THREAD_SUPPORT
+				os_thread_mutex_lock( &mqtt->alias_mutex );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+				alias = iot_mqtt_topic_alias( mqtt, topic,
+					&alias_new );
+				if ( alias > 0u )
+				{
+					MQTTProperty prop;
+					prop.identifier =
+						MQTTPROPERTY_CODE_TOPIC_ALIAS;
+					prop.value.integer2 = alias;
+					MQTTProperties_add( &props, &prop );
+					if ( alias_new == IOT_FALSE )
+						send_topic = "";
+				}
+			}
+#endif /* ifdef IOT_MQTT_V5_PROPERTIES */
+			pl.in = payload;
+#ifdef IOT_THREAD_SUPPORT
 			opts.context = mqtt;
 			opts.token = token;
-			opts.onFailure = iot_mqtt_on_failure;
+			opts.onFailure = iot_mqtt_on_publish_failure;
 			opts.onSuccess = iot_mqtt_on_success;
+#ifdef IOT_MQTT_V5_PROPERTIES
+			opts.properties = props;
+			if ( alias_new != IOT_FALSE )
+			{
+				opts.context = &mqtt->alias[alias - 1u];
+				opts.onFailure = iot_mqtt_on_alias_failure;
+				opts.onSuccess = iot_mqtt_on_alias_success;
+			}
+#endif /* ifdef IOT_MQTT_V5_PROPERTIES */
 
-			os_memcpy( pl, payload, payload_len );
-			result = IOT_STATUS_IO_ERROR;
-			rs = MQTTAsync_send( mqtt->client, topic,
-				(int)payload_len, pl, qos, retain, &opts );
-			if ( rs == MQTTASYNC_SUCCESS )
+			rs = MQTTAsync_send( mqtt->client, send_topic,
+				(int)payload_len, pl.out, qos, retain,
+				&opts );
 #else /* ifdef IOT_THREAD_SUPPORT */
-			MQTTClient_deliveryToken token;
-			os_memcpy( pl, payload, payload_len );
-			result = IOT_STATUS_IO_ERROR;
-			if ( MQTTClient_publish( mqtt->client, topic,
-				(int)payload_len, pl, qos, retain, &token )
-				== MQTTCLIENT_SUCCESS )
-#endif /* ifdef IOT_THREAD_SUPPORT */
+#ifdef IOT_MQTT_V5_PROPERTIES
+			if ( mqtt->version == IOT_MQTT_VERSION_5 )
 			{
+				MQTTResponse response = MQTTClient_publish5(
+					mqtt->client, send_topic,
+					(int)payload_len, pl.out, qos,
+					retain, &props, &token );
+				rs = (int)response.reasonCode;
+				MQTTResponse_free( response );
+			}
+			else
+#endif /* ifdef IOT_MQTT_V5_PROPERTIES */
+				rs = MQTTClient_publish( mqtt->client,
+					send_topic, (int)payload_len,
+					pl.out, qos, retain, &token );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+			if ( rs == PAHO_RES( _SUCCESS ) )
 				mid = (int)token;
-				result = IOT_STATUS_SUCCESS;
+			else if ( rs == PAHO_RES( _MAX_MESSAGES_INFLIGHT ) )
+				result = IOT_STATUS_FULL;
+#ifdef IOT_MQTT_V5_PROPERTIES
+			else if ( rs == MQTTREASONCODE_QUOTA_EXCEEDED )
+				result = IOT_STATUS_FULL;
+#endif /* ifdef IOT_MQTT_V5_PROPERTIES */
+			else
+				result = IOT_STATUS_IO_ERROR;
+
+#ifdef IOT_MQTT_V5_PROPERTIES
+			if ( use_alias != IOT_FALSE )
+			{
+				/* alias was never sent to the broker */
+				if ( result != IOT_STATUS_SUCCESS &&
+					alias_new != IOT_FALSE )
+					iot_mqtt_topic_alias_release( mqtt,
+						alias );
+#ifndef IOT_THREAD_SUPPORT
+				/* message is sent once published */
+				else if ( alias_new != IOT_FALSE )
+					mqtt->alias[alias - 1u].established =
+						IOT_TRUE;
+#endif /* ifndef IOT_THREAD_SUPPORT */
+#ifdef IOT_THREAD_SUPPORT
+				os_thread_mutex_unlock( &mqtt->alias_mutex );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+			}
+			MQTTProperties_free( &props );
+#endif /* ifdef IOT_MQTT_V5_PROPERTIES */
+
+			/* message was not sent, so won't be acknowledged */
+			if ( result != IOT_STATUS_SUCCESS && qos > 0 )
+			{
+#ifdef IOT_THREAD_SUPPORT
+				os_thread_mutex_lock( &mqtt->inflight_mutex );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+				if ( mqtt->inflight > 0u )
+					--mqtt->inflight;
+#ifdef IOT_THREAD_SUPPORT
+				os_thread_mutex_unlock( &mqtt->inflight_mutex );
+#endif /* ifdef IOT_THREAD_SUPPORT */
 			}
-			os_free( pl );
 		}
 #endif /* else IOT_MQTT_MOSQUITTO */
 	}
@@ -1033,6 +1782,23 @@ iot_status_t iot_mqtt_reconnect(
 	return result;
 }
 
+iot_status_t iot_mqtt_session_status(
+	const iot_mqtt_t *mqtt,
+	iot_mqtt_version_t *version,
+	iot_bool_t *session_present )
+{
+	iot_status_t result = IOT_STATUS_BAD_PARAMETER;
+	if ( mqtt )
+	{
+		if ( version )
+			*version = mqtt->version;
+		if ( session_present )
+			*session_present = mqtt->session_present;
+		result = IOT_STATUS_SUCCESS;
+	}
+	return result;
+}
+
 iot_status_t iot_mqtt_set_disconnect_callback(
 	iot_mqtt_t *mqtt,
 	iot_mqtt_disconnect_callback_t cb )
@@ -1131,6 +1897,77 @@ iot_status_t iot_mqtt_terminate( void )
 	return IOT_STATUS_SUCCESS;
 }
 
+#ifdef IOT_MQTT_V5_PROPERTIES
+iot_uint16_t iot_mqtt_topic_alias(
+	iot_mqtt_t *mqtt,
+	const char *topic,
+	iot_bool_t *assigned )
+{
+	iot_uint16_t result = 0u;
+	if ( assigned )
+		*assigned = IOT_FALSE;
+	if ( mqtt && topic && *topic != '\0' )
+	{
+		iot_uint16_t i;
+		iot_uint16_t found = 0u;
+		iot_uint16_t free_alias = 0u;
+		for ( i = 0u; found == 0u && i < mqtt->alias_count; ++i )
+		{
+			if ( mqtt->alias[i].topic[0] == '\0' )
+			{
+				if ( free_alias == 0u )
+					free_alias = (iot_uint16_t)(i + 1u);
+			}
+			else if ( os_strcmp( mqtt->alias[i].topic, topic ) == 0 )
+				found = (iot_uint16_t)(i + 1u);
+		}
+
+		if ( found > 0u )
+		{
+			if ( mqtt->alias[found - 1u].established != IOT_FALSE )
+				result = found;
+		}
+		else if ( os_strlen( topic ) <= IOT_MQTT_TOPIC_ALIAS_LEN )
+		{
+			/* assign a free alias, sent along with the topic */
+			if ( free_alias == 0u &&
+				mqtt->alias_count < mqtt->alias_max )
+			{
+				++mqtt->alias_count;
+				free_alias = mqtt->alias_count;
+			}
+			if ( free_alias > 0u )
+			{
+				struct iot_mqtt_alias *const a =
+					&mqtt->alias[free_alias - 1u];
+				os_strncpy( a->topic, topic,
+					IOT_MQTT_TOPIC_ALIAS_LEN + 1u );
+				a->established = IOT_FALSE;
+				a->mqtt = mqtt;
+				result = free_alias;
+				if ( assigned )
+					*assigned = IOT_TRUE;
+			}
+		}
+	}
+	return result;
+}
+
+void iot_mqtt_topic_alias_release(
+	iot_mqtt_t *mqtt,
+	iot_uint16_t alias )
+{
+	if ( mqtt && alias > 0u && alias <= mqtt->alias_count )
+	{
+		mqtt->alias[alias - 1u].topic[0] = '\0';
+		mqtt->alias[alias - 1u].established = IOT_FALSE;
+		while ( mqtt->alias_count > 0u &&
+			mqtt->alias[mqtt->alias_count - 1u].topic[0] == '\0' )
+			--mqtt->alias_count;
+	}
+}
+#endif /* ifdef IOT_MQTT_V5_PROPERTIES */
+
 iot_status_t iot_mqtt_unsubscribe( iot_mqtt_t *mqtt, const char *topic )
 {
 	iot_status_t result = IOT_STATUS_BAD_PARAMETER;
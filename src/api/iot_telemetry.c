@@ -315,7 +315,7 @@ iot_status_t iot_telemetry_deregister(
 				result = iot_plugin_perform( telemetry->lib,
 					txn, &max_time_out,
 					IOT_OPERATION_TELEMETRY_DEREGISTER,
-					NULL, NULL, NULL );
+					telemetry, NULL, NULL );
 				if ( result == IOT_STATUS_SUCCESS )
 					telemetry->state = IOT_ITEM_DEREGISTERED;
 				else
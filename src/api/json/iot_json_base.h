@@ -62,6 +62,42 @@
 	};
 #endif
 
+/** @brief maximum nesting depth supported by the streaming decoder */
+#define IOT_JSON_FEED_DEPTH_MAX 32u
+/** @brief maximum length of a key supported by the streaming decoder */
+#define IOT_JSON_FEED_KEY_MAX   128u
+
+/** @brief base structure used for streaming (push-style) decoding */
+struct iot_json_feed
+{
+	/** @brief function to call for each event */
+	iot_json_event_callback_t *callback;
+	/** @brief current nesting depth */
+	unsigned int depth;
+	/** @brief output flags */
+	unsigned int flags;
+	/** @brief whether a key is set for the next item */
+	iot_bool_t has_key;
+	/** @brief whether the current string is a key */
+	iot_bool_t is_key;
+	/** @brief key for the next item */
+	char key[ IOT_JSON_FEED_KEY_MAX + 1u ];
+	/** @brief length of the key for the next item */
+	size_t key_len;
+	/** @brief type of container at each depth ('a' or 'o') */
+	char stack[ IOT_JSON_FEED_DEPTH_MAX ];
+	/** @brief current parser state */
+	unsigned int state;
+	/** @brief buffer holding an item split between chunks */
+	char *token;
+	/** @brief amount of the token buffer used */
+	size_t token_len;
+	/** @brief size of the token buffer */
+	size_t token_size;
+	/** @brief user data to pass to the callback */
+	void *user_data;
+};
+
 /* functions */
 #ifndef IOT_STACK_ONLY
 /**
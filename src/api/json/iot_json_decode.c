@@ -143,6 +143,379 @@ iot_status_t iot_jsmn_decode_number(
 }
 #endif /* defined( IOT_JSON_JSMN ) */
 
+/** @brief states of the streaming JSON decoder */
+enum iot_json_feed_state
+{
+	IOT_JSON_FEED_STATE_VALUE = 0,      /**< @brief expecting a value */
+	IOT_JSON_FEED_STATE_VALUE_OR_END,   /**< @brief expecting a value or ']' */
+	IOT_JSON_FEED_STATE_KEY,            /**< @brief expecting a key */
+	IOT_JSON_FEED_STATE_KEY_OR_END,     /**< @brief expecting a key or '}' */
+	IOT_JSON_FEED_STATE_COLON,          /**< @brief expecting ':' */
+	IOT_JSON_FEED_STATE_STRING,         /**< @brief inside of a string */
+	IOT_JSON_FEED_STATE_STRING_ESCAPE,  /**< @brief after '\' in a string */
+	IOT_JSON_FEED_STATE_PRIMITIVE,      /**< @brief inside of a number/literal */
+	IOT_JSON_FEED_STATE_AFTER_VALUE,    /**< @brief expecting ',' or an end */
+	IOT_JSON_FEED_STATE_DONE,           /**< @brief document is complete */
+	IOT_JSON_FEED_STATE_ERROR           /**< @brief error was encountered */
+};
+
+/**
+ * @brief appends text to the token buffer of a streaming decoder
+ *
+ * @param[in,out]  feed                streaming JSON decoder object
+ * @param[in]      js                  text to append
+ * @param[in]      len                 length of text to append
+ *
+ * @retval IOT_STATUS_NO_MEMORY        token buffer is too small
+ * @retval IOT_STATUS_SUCCESS          on success
+ */
+static IOT_SECTION iot_status_t iot_json_feed_append(
+	struct iot_json_feed *feed,
+	const char *js,
+	size_t len );
+
+/**
+ * @brief closes the array or object at the current depth
+ *
+ * @param[in,out]  feed                streaming JSON decoder object
+ * @param[in]      container           type of container to close
+ *                                     ('a' or 'o')
+ *
+ * @retval IOT_STATUS_PARSE_ERROR      container does not match the one open
+ * @retval IOT_STATUS_SUCCESS          on success
+ * @retval other                       status returned by the callback
+ */
+static IOT_SECTION iot_status_t iot_json_feed_close(
+	struct iot_json_feed *feed,
+	char container );
+
+/**
+ * @brief reports an event to the callback of a streaming decoder
+ *
+ * @param[in,out]  feed                streaming JSON decoder object
+ * @param[in]      event               event to report
+ * @param[in]      type                type of the item
+ * @param[in]      value               text of the value (optional)
+ * @param[in]      value_len           length of the value text
+ *
+ * @retval IOT_STATUS_SUCCESS          on success
+ * @retval other                       status returned by the callback
+ */
+static IOT_SECTION iot_status_t iot_json_feed_emit(
+	struct iot_json_feed *feed,
+	iot_json_event_t event,
+	iot_json_type_t type,
+	const char *value,
+	size_t value_len );
+
+/**
+ * @brief opens a new array or object
+ *
+ * @param[in,out]  feed                streaming JSON decoder object
+ * @param[in]      container           type of container to open
+ *                                     ('a' or 'o')
+ *
+ * @retval IOT_STATUS_NO_MEMORY        maximum nesting depth reached
+ * @retval IOT_STATUS_SUCCESS          on success
+ * @retval other                       status returned by the callback
+ */
+static IOT_SECTION iot_status_t iot_json_feed_open(
+	struct iot_json_feed *feed,
+	char container );
+
+/**
+ * @brief handles a character outside of a string or primitive
+ *
+ * @param[in,out]  feed                streaming JSON decoder object
+ * @param[in]      c                   character to handle
+ *
+ * @retval IOT_STATUS_NO_MEMORY        maximum nesting depth reached
+ * @retval IOT_STATUS_PARSE_ERROR      unexpected character
+ * @retval IOT_STATUS_SUCCESS          on success
+ * @retval other                       status returned by the callback
+ */
+static IOT_SECTION iot_status_t iot_json_feed_structural(
+	struct iot_json_feed *feed,
+	char c );
+
+/**
+ * @brief handles a completed string or primitive
+ *
+ * @param[in,out]  feed                streaming JSON decoder object
+ * @param[in]      js                  last part of the token text
+ * @param[in]      len                 length of the last part
+ *
+ * @retval IOT_STATUS_NO_MEMORY        token or key is too large
+ * @retval IOT_STATUS_PARSE_ERROR      primitive is not valid
+ * @retval IOT_STATUS_SUCCESS          on success
+ * @retval other                       status returned by the callback
+ */
+static IOT_SECTION iot_status_t iot_json_feed_token(
+	struct iot_json_feed *feed,
+	const char *js,
+	size_t len );
+
+iot_status_t iot_json_feed_append(
+	struct iot_json_feed *feed,
+	const char *js,
+	size_t len )
+{
+	iot_status_t result = IOT_STATUS_SUCCESS;
+	if ( feed->token_len + len > feed->token_size )
+	{
+		result = IOT_STATUS_NO_MEMORY;
+#ifndef IOT_STACK_ONLY
+		if ( feed->flags & IOT_JSON_FLAG_DYNAMIC )
+		{
+			size_t new_size = feed->token_size * 2u;
+			char *new_token;
+			if ( new_size < feed->token_len + len )
+				new_size = feed->token_len + len;
+			new_token = (char *)iot_json_realloc( feed->token,
+				new_size );
+			if ( new_token )
+			{
+				feed->token = new_token;
+				feed->token_size = new_size;
+				result = IOT_STATUS_SUCCESS;
+			}
+		}
+#endif /* ifndef IOT_STACK_ONLY */
+	}
+
+	if ( result == IOT_STATUS_SUCCESS )
+	{
+		size_t i;
+		for ( i = 0u; i < len; ++i )
+			feed->token[feed->token_len + i] = js[i];
+		feed->token_len += len;
+	}
+	return result;
+}
+
+iot_status_t iot_json_feed_close(
+	struct iot_json_feed *feed,
+	char container )
+{
+	iot_status_t result = IOT_STATUS_PARSE_ERROR;
+	if ( feed->depth > 0u && feed->stack[feed->depth - 1u] == container )
+	{
+		iot_json_type_t type = IOT_JSON_TYPE_ARRAY;
+		iot_json_event_t event = IOT_JSON_EVENT_ARRAY_END;
+		if ( container == 'o' )
+		{
+			type = IOT_JSON_TYPE_OBJECT;
+			event = IOT_JSON_EVENT_OBJECT_END;
+		}
+		--feed->depth;
+		feed->state = IOT_JSON_FEED_STATE_AFTER_VALUE;
+		if ( feed->depth == 0u )
+			feed->state = IOT_JSON_FEED_STATE_DONE;
+		result = iot_json_feed_emit( feed, event, type, NULL, 0u );
+	}
+	return result;
+}
+
+iot_status_t iot_json_feed_emit(
+	struct iot_json_feed *feed,
+	iot_json_event_t event,
+	iot_json_type_t type,
+	const char *value,
+	size_t value_len )
+{
+	iot_status_t result = IOT_STATUS_SUCCESS;
+	const char *key = NULL;
+	size_t key_len = 0u;
+	if ( feed->has_key != IOT_FALSE )
+	{
+		key = feed->key;
+		key_len = feed->key_len;
+	}
+	feed->has_key = IOT_FALSE;
+	if ( feed->callback )
+		result = feed->callback( feed->user_data, event,
+			key, key_len, type, value, value_len );
+	return result;
+}
+
+iot_status_t iot_json_feed_open(
+	struct iot_json_feed *feed,
+	char container )
+{
+	iot_status_t result = IOT_STATUS_NO_MEMORY;
+	if ( feed->depth < IOT_JSON_FEED_DEPTH_MAX )
+	{
+		feed->stack[feed->depth] = container;
+		++feed->depth;
+		if ( container == 'o' )
+		{
+			feed->state = IOT_JSON_FEED_STATE_KEY_OR_END;
+			result = iot_json_feed_emit( feed,
+				IOT_JSON_EVENT_OBJECT_START,
+				IOT_JSON_TYPE_OBJECT, NULL, 0u );
+		}
+		else
+		{
+			feed->state = IOT_JSON_FEED_STATE_VALUE_OR_END;
+			result = iot_json_feed_emit( feed,
+				IOT_JSON_EVENT_ARRAY_START,
+				IOT_JSON_TYPE_ARRAY, NULL, 0u );
+		}
+	}
+	return result;
+}
+
+iot_status_t iot_json_feed_structural(
+	struct iot_json_feed *feed,
+	char c )
+{
+	iot_status_t result = IOT_STATUS_SUCCESS;
+	const unsigned int state = feed->state;
+
+	/* whitespace is ignored */
+	if ( c != ' ' && c != '\t' && c != '\r' && c != '\n' )
+	{
+		result = IOT_STATUS_PARSE_ERROR;
+		if ( state == IOT_JSON_FEED_STATE_COLON )
+		{
+			if ( c == ':' )
+			{
+				feed->state = IOT_JSON_FEED_STATE_VALUE;
+				result = IOT_STATUS_SUCCESS;
+			}
+		}
+		else if ( state == IOT_JSON_FEED_STATE_KEY ||
+			state == IOT_JSON_FEED_STATE_KEY_OR_END )
+		{
+			if ( c == '"' )
+			{
+				feed->is_key = IOT_TRUE;
+				feed->state = IOT_JSON_FEED_STATE_STRING;
+				result = IOT_STATUS_SUCCESS;
+			}
+			else if ( c == '}' &&
+				state == IOT_JSON_FEED_STATE_KEY_OR_END )
+				result = iot_json_feed_close( feed, 'o' );
+		}
+		else if ( state == IOT_JSON_FEED_STATE_VALUE ||
+			state == IOT_JSON_FEED_STATE_VALUE_OR_END )
+		{
+			if ( c == '{' )
+				result = iot_json_feed_open( feed, 'o' );
+			else if ( c == '[' )
+				result = iot_json_feed_open( feed, 'a' );
+			else if ( c == ']' &&
+				state == IOT_JSON_FEED_STATE_VALUE_OR_END )
+				result = iot_json_feed_close( feed, 'a' );
+			else if ( c == '"' )
+			{
+				feed->is_key = IOT_FALSE;
+				feed->state = IOT_JSON_FEED_STATE_STRING;
+				result = IOT_STATUS_SUCCESS;
+			}
+			else if ( c == '-' || ( c >= '0' && c <= '9' ) ||
+				c == 't' || c == 'f' || c == 'n' )
+			{
+				feed->state = IOT_JSON_FEED_STATE_PRIMITIVE;
+				result = IOT_STATUS_SUCCESS;
+			}
+		}
+		else if ( state == IOT_JSON_FEED_STATE_AFTER_VALUE )
+		{
+			if ( c == ',' && feed->depth > 0u )
+			{
+				feed->state = IOT_JSON_FEED_STATE_VALUE;
+				if ( feed->stack[feed->depth - 1u] == 'o' )
+					feed->state = IOT_JSON_FEED_STATE_KEY;
+				result = IOT_STATUS_SUCCESS;
+			}
+			else if ( c == '}' )
+				result = iot_json_feed_close( feed, 'o' );
+			else if ( c == ']' )
+				result = iot_json_feed_close( feed, 'a' );
+		}
+	}
+	return result;
+}
+
+iot_status_t iot_json_feed_token(
+	struct iot_json_feed *feed,
+	const char *js,
+	size_t len )
+{
+	iot_status_t result = IOT_STATUS_SUCCESS;
+	const char *text = js;
+	size_t text_len = len;
+
+	/* part of the token was received in a previous chunk */
+	if ( feed->token_len > 0u )
+	{
+		result = iot_json_feed_append( feed, js, len );
+		text = feed->token;
+		text_len = feed->token_len;
+	}
+
+	if ( result == IOT_STATUS_SUCCESS &&
+		feed->state == IOT_JSON_FEED_STATE_STRING &&
+		feed->is_key != IOT_FALSE )
+	{
+		result = IOT_STATUS_NO_MEMORY;
+		if ( text_len <= IOT_JSON_FEED_KEY_MAX )
+		{
+			size_t i;
+			for ( i = 0u; i < text_len; ++i )
+				feed->key[i] = text[i];
+			feed->key[text_len] = '\0';
+			feed->key_len = text_len;
+			feed->has_key = IOT_TRUE;
+			feed->is_key = IOT_FALSE;
+			feed->state = IOT_JSON_FEED_STATE_COLON;
+			result = IOT_STATUS_SUCCESS;
+		}
+	}
+	else if ( result == IOT_STATUS_SUCCESS )
+	{
+		iot_json_type_t type = IOT_JSON_TYPE_STRING;
+		if ( feed->state == IOT_JSON_FEED_STATE_PRIMITIVE )
+		{
+			size_t i;
+			type = IOT_JSON_TYPE_INTEGER;
+			if ( text_len == 4u && text[0] == 't' && text[1] == 'r' &&
+				text[2] == 'u' && text[3] == 'e' )
+				type = IOT_JSON_TYPE_BOOL;
+			else if ( text_len == 5u && text[0] == 'f' &&
+				text[1] == 'a' && text[2] == 'l' &&
+				text[3] == 's' && text[4] == 'e' )
+				type = IOT_JSON_TYPE_BOOL;
+			else if ( text_len == 4u && text[0] == 'n' &&
+				text[1] == 'u' && text[2] == 'l' && text[3] == 'l' )
+				type = IOT_JSON_TYPE_NULL;
+			else
+			{
+				for ( i = 0u; result == IOT_STATUS_SUCCESS &&
+					i < text_len; ++i )
+				{
+					const char c = text[i];
+					if ( c == '.' || c == 'e' || c == 'E' )
+						type = IOT_JSON_TYPE_REAL;
+					else if ( ( c < '0' || c > '9' ) &&
+						c != '-' && c != '+' )
+						result = IOT_STATUS_PARSE_ERROR;
+				}
+			}
+		}
+
+		feed->state = IOT_JSON_FEED_STATE_AFTER_VALUE;
+		if ( feed->depth == 0u )
+			feed->state = IOT_JSON_FEED_STATE_DONE;
+		if ( result == IOT_STATUS_SUCCESS )
+			result = iot_json_feed_emit( feed, IOT_JSON_EVENT_VALUE,
+				type, text, text_len );
+	}
+	feed->token_len = 0u;
+	return result;
+}
+
 iot_status_t iot_json_decode_array_at(
 	const iot_json_decoder_t *decoder,
 	const iot_json_item_t *item,
@@ -401,6 +774,184 @@ iot_status_t iot_json_decode_bool(
 	return result;
 }
 
+iot_status_t iot_json_decode_feed(
+	iot_json_feed_t *feed,
+	const char *js,
+	size_t len,
+	char *error,
+	size_t error_len )
+{
+	iot_status_t result = IOT_STATUS_BAD_PARAMETER;
+	if ( feed && ( js || len == 0u ) )
+	{
+		const char *error_text = NULL;
+		size_t i = 0u;
+		size_t start = 0u;
+
+		result = IOT_STATUS_SUCCESS;
+		if ( feed->state == IOT_JSON_FEED_STATE_ERROR )
+			result = IOT_STATUS_PARSE_ERROR;
+
+		while ( result == IOT_STATUS_SUCCESS && i < len )
+		{
+			const char c = js[i];
+			++i;
+			if ( feed->state == IOT_JSON_FEED_STATE_STRING )
+			{
+				if ( c == '"' )
+					result = iot_json_feed_token( feed,
+						&js[start], i - start - 1u );
+				else if ( c == '\\' )
+					feed->state =
+						IOT_JSON_FEED_STATE_STRING_ESCAPE;
+				else if ( (unsigned char)c < 0x20 )
+					result = IOT_STATUS_PARSE_ERROR;
+			}
+			else if ( feed->state ==
+				IOT_JSON_FEED_STATE_STRING_ESCAPE )
+				feed->state = IOT_JSON_FEED_STATE_STRING;
+			else if ( feed->state == IOT_JSON_FEED_STATE_PRIMITIVE )
+			{
+				if ( ( c < '0' || c > '9' ) &&
+				     ( c < 'a' || c > 'z' ) &&
+				     ( c < 'A' || c > 'Z' ) &&
+				     c != '.' && c != '+' && c != '-' )
+				{
+					/* character ending a primitive is
+					 * handled again below */
+					--i;
+					result = iot_json_feed_token( feed,
+						&js[start], i - start );
+				}
+			}
+			else
+			{
+				result = iot_json_feed_structural( feed, c );
+				if ( feed->state == IOT_JSON_FEED_STATE_STRING )
+					start = i;
+				else if ( feed->state ==
+					IOT_JSON_FEED_STATE_PRIMITIVE )
+					start = i - 1u;
+			}
+		}
+
+		/* hold on to any item that continues in the next chunk */
+		if ( result == IOT_STATUS_SUCCESS && len > 0u &&
+			( feed->state == IOT_JSON_FEED_STATE_STRING ||
+			  feed->state == IOT_JSON_FEED_STATE_STRING_ESCAPE ||
+			  feed->state == IOT_JSON_FEED_STATE_PRIMITIVE ) )
+			result = iot_json_feed_append( feed, &js[start],
+				len - start );
+
+		/* end of document */
+		if ( result == IOT_STATUS_SUCCESS && len == 0u )
+		{
+			if ( feed->state == IOT_JSON_FEED_STATE_PRIMITIVE &&
+				feed->depth == 0u )
+				result = iot_json_feed_token( feed, NULL, 0u );
+			if ( result == IOT_STATUS_SUCCESS &&
+				feed->state != IOT_JSON_FEED_STATE_DONE )
+			{
+				error_text = "incomplete json string";
+				result = IOT_STATUS_PARSE_ERROR;
+			}
+		}
+
+		if ( result == IOT_STATUS_NO_MEMORY )
+			error_text = "out of memory";
+		else if ( result == IOT_STATUS_PARSE_ERROR && !error_text )
+			error_text = "invalid character";
+
+		/* a completed document allows the decoder to be reused */
+		if ( len == 0u )
+		{
+			feed->depth = 0u;
+			feed->has_key = IOT_FALSE;
+			feed->is_key = IOT_FALSE;
+			feed->state = IOT_JSON_FEED_STATE_VALUE;
+			feed->token_len = 0u;
+		}
+		else if ( result != IOT_STATUS_SUCCESS )
+			feed->state = IOT_JSON_FEED_STATE_ERROR;
+
+		/* copy error text */
+		if ( error && error_len > 0u )
+		{
+			size_t j = 0u;
+			--error_len;
+			while ( error_text && j < error_len &&
+				*error_text != '\0' )
+			{
+				*error = *error_text;
+				++error;
+				++error_text;
+				++j;
+			}
+			*error = '\0';
+		}
+	}
+	return result;
+}
+
+iot_json_feed_t *iot_json_decode_feed_initialize(
+	void *buf,
+	size_t len,
+	unsigned int flags,
+	iot_json_event_callback_t *callback,
+	void *user_data )
+{
+	struct iot_json_feed *feed = NULL;
+#ifndef IOT_STACK_ONLY
+	if ( !buf )
+		flags |= IOT_JSON_FLAG_DYNAMIC;
+	if ( flags & IOT_JSON_FLAG_DYNAMIC )
+	{
+		len = sizeof( struct iot_json_feed );
+		buf = iot_json_realloc( NULL, len );
+	}
+#endif /* ifndef IOT_STACK_ONLY */
+
+	if ( buf && len >= sizeof( struct iot_json_feed ) )
+	{
+		feed = (struct iot_json_feed *)buf;
+		feed->callback = callback;
+		feed->depth = 0u;
+		feed->flags = flags;
+		feed->has_key = IOT_FALSE;
+		feed->is_key = IOT_FALSE;
+		feed->key[0] = '\0';
+		feed->key_len = 0u;
+		feed->state = IOT_JSON_FEED_STATE_VALUE;
+		feed->token = NULL;
+		feed->token_len = 0u;
+		feed->token_size = 0u;
+		feed->user_data = user_data;
+
+		/* remaining memory holds items split between chunks */
+		if ( len > sizeof( struct iot_json_feed ) )
+		{
+			feed->token = (char *)buf + sizeof( struct iot_json_feed );
+			feed->token_size = len - sizeof( struct iot_json_feed );
+		}
+	}
+	return feed;
+}
+
+void iot_json_decode_feed_terminate(
+	iot_json_feed_t *feed )
+{
+#ifndef IOT_STACK_ONLY
+	if ( feed && feed->flags & IOT_JSON_FLAG_DYNAMIC )
+	{
+		if ( feed->token )
+			iot_json_free( feed->token );
+		iot_json_free( feed );
+	}
+#else /* ifndef IOT_STACK_ONLY */
+	(void)feed;
+#endif /* else IOT_STACK_ONLY */
+}
+
 iot_json_decoder_t *iot_json_decode_initialize(
 	void *buf,
 	size_t len,
@@ -880,6 +1431,7 @@ iot_status_t iot_json_decode_parse(
 	{
 #if defined( IOT_JSON_JANSSON )
 		json_error_t j_error;
+		iot_json_decode_reset( decoder );
 		decoder->j_root = json_loadb( js, len, 0u, &j_error );
 		result = IOT_STATUS_PARSE_ERROR;
 		if ( decoder->j_root )
@@ -896,6 +1448,7 @@ iot_status_t iot_json_decode_parse(
 #elif defined( IOT_JSON_JSONC )
 		struct json_tokener *tok = json_tokener_new();
 		enum json_tokener_error j_error;
+		iot_json_decode_reset( decoder );
 		do
 		{
 			decoder->j_root = json_tokener_parse_ex( tok, js, len );
@@ -918,6 +1471,7 @@ iot_status_t iot_json_decode_parse(
 		jsmn_parser parser;
 		const char *error_text = NULL;
 		int i;
+		iot_json_decode_reset( decoder );
 		result = IOT_STATUS_PARSE_ERROR;
 #ifndef IOT_STACK_ONLY
 		if ( decoder->flags & IOT_JSON_FLAG_DYNAMIC )
@@ -963,7 +1517,10 @@ iot_status_t iot_json_decode_parse(
 					}
 					else
 					{
+						/* reported as out of memory, the
+						 * decoder is still safe to reuse */
 						iot_json_free( decoder->tokens );
+						decoder->tokens = NULL;
 						decoder->size = 0u;
 					}
 				}
@@ -1073,6 +1630,28 @@ iot_status_t iot_json_decode_real(
 	return result;
 }
 
+void iot_json_decode_reset(
+	iot_json_decoder_t *decoder )
+{
+	if ( decoder )
+	{
+#if defined( IOT_JSON_JANSSON )
+		if ( decoder->j_root )
+			json_decref( decoder->j_root );
+		decoder->j_root = NULL;
+#elif defined( IOT_JSON_JSONC )
+		if ( decoder->j_root )
+			json_object_put( decoder->j_root );
+		decoder->j_root = NULL;
+#else /* defined( IOT_JSON_JSMN ) */
+		/* token buffer (and its size) is kept for the next parse */
+		decoder->objs = 0u;
+		decoder->buf = NULL;
+		decoder->len = 0u;
+#endif /* defined( IOT_JSON_JSMN ) */
+	}
+}
+
 iot_status_t iot_json_decode_string(
 	const iot_json_decoder_t *decoder,
 	const iot_json_item_t *item,
@@ -1131,9 +1710,8 @@ void iot_json_decode_terminate(
 {
 	if ( decoder )
 	{
+		iot_json_decode_reset( decoder );
 #if defined( IOT_JSON_JANSSON )
-		if ( decoder->j_root )
-			json_decref( decoder->j_root );
 #elif defined( IOT_JSON_JSONC )
 #else /* defined( IOT_JSON_JSMN ) */
 #ifndef IOT_STACK_ONLY
@@ -21,6 +21,12 @@
 
 #include <os.h>
 
+/**
+ * @brief Number of spaces to indent each item by, from the output flags
+ */
+#define JSON_INDENT_GET( flags ) \
+	( ( (flags) & ~IOT_JSON_FLAG_BINARY ) >> IOT_JSON_INDENT_OFFSET )
+
 #if defined( IOT_JSON_JANSSON ) || defined( IOT_JSON_JSONC )
 /**
  * @brief Maximum supportable json depth
@@ -85,6 +91,85 @@ static const char JSON_CHARS_START[] = { '[', '{', '{' };
 /** @brief JSON tokens for the end of objects & arrays */
 static const char JSON_CHARS_END[] = { ']', '}', '}' };
 
+/** @brief binary (CBOR) major type for an unsigned integer */
+#define JSON_BINARY_TYPE_UINT            0x0u
+/** @brief binary (CBOR) major type for a negative integer */
+#define JSON_BINARY_TYPE_NINT            0x1u
+/** @brief binary (CBOR) major type for a text string */
+#define JSON_BINARY_TYPE_TEXT            0x3u
+/** @brief binary (CBOR) start of an indefinite-length array */
+#define JSON_BINARY_ARRAY_START          0x9Fu
+/** @brief binary (CBOR) start of an indefinite-length map (object) */
+#define JSON_BINARY_MAP_START            0xBFu
+/** @brief binary (CBOR) end of an indefinite-length array or map */
+#define JSON_BINARY_BREAK                0xFFu
+/** @brief binary (CBOR) simple value: false */
+#define JSON_BINARY_FALSE                0xF4u
+/** @brief binary (CBOR) simple value: true */
+#define JSON_BINARY_TRUE                 0xF5u
+/** @brief binary (CBOR) single-precision floating-point number */
+#define JSON_BINARY_FLOAT32              0xFAu
+/** @brief binary (CBOR) double-precision floating-point number */
+#define JSON_BINARY_FLOAT64              0xFBu
+/** @brief maximum size of a binary (CBOR) item head */
+#define JSON_BINARY_HEAD_MAX             9u
+
+/**
+ * @brief writes the head (major type & argument) of a binary item
+ *
+ * @param[out]     dest                destination buffer, must be at least
+ *                                     JSON_BINARY_HEAD_MAX bytes
+ * @param[in]      major               major type of the item
+ * @param[in]      value               argument of the item (value or length)
+ *
+ * @return the number of bytes written
+ */
+static IOT_SECTION size_t iot_json_encode_binary_head(
+	unsigned char *dest,
+	unsigned int major,
+	iot_uint64_t value );
+
+/**
+ * @brief helper function to add a new item to a binary encoding
+ *
+ * @param[in,out]  encoder             JSON encoder object
+ * @param[in]      key                 (optional) key for the new item
+ * @param[in]      head                head of the item
+ * @param[in]      head_len            length of the head of the item
+ * @param[in]      payload             (optional) payload following the head
+ * @param[in]      payload_len         length of the payload
+ *
+ * @retval IOT_STATUS_BAD_PARAMETER    bad parameter passed to the function
+ * @retval IOT_STATUS_NO_MEMORY        no more memory available
+ * @retval IOT_STATUS_SUCCESS          on success
+ */
+static IOT_SECTION iot_status_t iot_json_encode_binary_item(
+	iot_json_encoder_t *encoder,
+	const char *key,
+	const unsigned char *head,
+	size_t head_len,
+	const void *payload,
+	size_t payload_len );
+
+/**
+ * @brief helper function to add the key of a new item to a binary encoding
+ *
+ * @note This function also ensures there is space for the item & for closing
+ *       all structures currently open
+ *
+ * @param[in,out]  encoder             JSON encoder object
+ * @param[in]      key                 (optional) key for the new item
+ * @param[in]      value_len           length of the value for the new item
+ * @param[out]     added_parent        (optional) whether this call required
+ *                                     adding a new parent object to ensure
+ *                                     the output remains valid
+ */
+static IOT_SECTION iot_status_t iot_json_encode_binary_key(
+	iot_json_encoder_t *encoder,
+	const char *key,
+	size_t value_len,
+	iot_bool_t *added_parent );
+
 /**
  * @brief determines the current depth of structures at the current position
  *
@@ -370,6 +455,14 @@ iot_status_t iot_json_encode_bool(
 	/* can't add boolean as root element */
 	if ( !key && ( encoder && encoder->structs == 0u ) )
 		result = IOT_STATUS_BAD_REQUEST;
+	else if ( encoder && ( encoder->flags & IOT_JSON_FLAG_BINARY ) )
+	{
+		unsigned char head = JSON_BINARY_FALSE;
+		if ( value )
+			head = JSON_BINARY_TRUE;
+		result = iot_json_encode_binary_item( encoder, key,
+			&head, 1u, NULL, 0u );
+	}
 	else
 	{
 		iot_bool_t added_parent = IOT_FALSE;
@@ -393,6 +486,158 @@ iot_status_t iot_json_encode_bool(
 }
 
 #if !defined( IOT_JSON_JANSSON ) && !defined( IOT_JSON_JSONC )
+size_t iot_json_encode_binary_head(
+	unsigned char *dest,
+	unsigned int major,
+	iot_uint64_t value )
+{
+	size_t result = 1u;
+	unsigned int bytes = 0u;
+	major <<= 5;
+	if ( value < 24u )
+		*dest = (unsigned char)( major | (unsigned int)value );
+	else if ( value <= 0xFFu )
+	{
+		*dest = (unsigned char)( major | 24u );
+		bytes = 1u;
+	}
+	else if ( value <= 0xFFFFu )
+	{
+		*dest = (unsigned char)( major | 25u );
+		bytes = 2u;
+	}
+	else if ( value <= 0xFFFFFFFFu )
+	{
+		*dest = (unsigned char)( major | 26u );
+		bytes = 4u;
+	}
+	else
+	{
+		*dest = (unsigned char)( major | 27u );
+		bytes = 8u;
+	}
+
+	/* argument is stored in network byte order */
+	while ( bytes > 0u )
+	{
+		--bytes;
+		dest[result] = (unsigned char)( ( value >> ( bytes * 8u ) ) & 0xFFu );
+		++result;
+	}
+	return result;
+}
+
+iot_status_t iot_json_encode_binary_item(
+	iot_json_encoder_t *encoder,
+	const char *key,
+	const unsigned char *head,
+	size_t head_len,
+	const void *payload,
+	size_t payload_len )
+{
+	iot_bool_t added_parent = IOT_FALSE;
+	iot_status_t result = iot_json_encode_binary_key( encoder, key,
+		head_len + payload_len, &added_parent );
+	if ( result == IOT_STATUS_SUCCESS )
+	{
+		os_memcpy( encoder->cur, head, head_len );
+		encoder->cur += head_len;
+		if ( payload && payload_len > 0u )
+		{
+			os_memcpy( encoder->cur, payload, payload_len );
+			encoder->cur += payload_len;
+		}
+
+		if ( added_parent )
+			result = iot_json_encode_struct_end( encoder,
+				IOT_JSON_TYPE_OBJECT << 1u );
+	}
+	return result;
+}
+
+iot_status_t iot_json_encode_binary_key(
+	iot_json_encoder_t *encoder,
+	const char *key,
+	size_t value_len,
+	iot_bool_t *added_parent )
+{
+	iot_status_t result = IOT_STATUS_BAD_PARAMETER;
+	if ( encoder )
+	{
+		unsigned char head[ JSON_BINARY_HEAD_MAX ];
+		size_t head_len = 0u;
+		size_t key_len = 0u;
+		result = IOT_STATUS_SUCCESS;
+
+		if ( key && !( encoder->structs & IOT_JSON_TYPE_OBJECT ) )
+		{
+			if ( encoder->structs )
+			{
+				result = iot_json_encode_struct_start( encoder,
+					NULL, IOT_JSON_TYPE_OBJECT << 1 );
+				if ( added_parent )
+					*added_parent = IOT_TRUE;
+			} else /* add root item if not there */
+				result = iot_json_encode_struct_start( encoder,
+					NULL, IOT_JSON_TYPE_OBJECT );
+		}
+		else if ( !key && encoder->structs & IOT_JSON_TYPE_OBJECT )
+			key = ""; /* we are inside object we must have a key */
+
+		if ( key )
+		{
+			key_len = os_strlen( key );
+			head_len = iot_json_encode_binary_head( head,
+				JSON_BINARY_TYPE_TEXT, key_len );
+		}
+
+		if ( result == IOT_STATUS_SUCCESS )
+		{
+			/* space to close every open structure is always kept */
+			const size_t required = head_len + key_len + value_len +
+				iot_json_encode_depth( encoder );
+			size_t used = 0u;
+
+			if ( encoder->cur )
+				used = (size_t)(encoder->cur - encoder->buf);
+			else
+				encoder->cur = encoder->buf;
+
+#ifndef IOT_STACK_ONLY
+			if ( ( encoder->flags & IOT_JSON_FLAG_DYNAMIC ) &&
+				used + required > encoder->len )
+			{
+				size_t new_len = encoder->len * 2u;
+				void *new_buf;
+				if ( new_len < used + required )
+					new_len = used + required;
+				new_buf = iot_json_realloc( encoder->buf, new_len );
+				if ( new_buf )
+				{
+					encoder->buf = new_buf;
+					encoder->cur = encoder->buf + used;
+					encoder->len = new_len;
+				}
+			}
+#endif /* ifndef IOT_STACK_ONLY */
+
+			if ( encoder->cur && used + required <= encoder->len )
+			{
+				if ( key )
+				{
+					os_memcpy( encoder->cur, head, head_len );
+					encoder->cur += head_len;
+					os_memcpy( encoder->cur, key, key_len );
+					encoder->cur += key_len;
+				}
+			}
+			else
+				result = IOT_STATUS_NO_MEMORY;
+		}
+	}
+	return result;
+}
+
 unsigned int iot_json_encode_depth( const iot_json_encoder_t *encoder )
 {
 	unsigned int i = 0u;
@@ -415,8 +660,8 @@ const char *iot_json_encode_dump(
 	size_t flags = JSON_PRESERVE_ORDER;
 	if ( encoder && !( encoder->flags & IOT_JSON_FLAG_EXPAND ) )
 		flags |= JSON_COMPACT;
-	if ( encoder && encoder->flags >> IOT_JSON_INDENT_OFFSET )
-		flags |= JSON_INDENT( encoder->flags >> IOT_JSON_INDENT_OFFSET );
+	if ( encoder && JSON_INDENT_GET( encoder->flags ) )
+		flags |= JSON_INDENT( JSON_INDENT_GET( encoder->flags ) );
 
 	/* if previous dump free memory */
 	if ( encoder && encoder->output )
@@ -449,7 +694,7 @@ const char *iot_json_encode_dump(
 		if ( encoder->flags & IOT_JSON_FLAG_EXPAND )
 			flags |= JSON_C_TO_STRING_SPACED;
 
-		if ( encoder->flags >> IOT_JSON_INDENT_OFFSET )
+		if ( JSON_INDENT_GET( encoder->flags ) )
 			flags |= JSON_C_TO_STRING_PRETTY;
 
 		if ( encoder->j_cur && encoder->j_cur[0u] )
@@ -469,13 +714,28 @@ const char *iot_json_encode_dump(
 		}
 	}
 #else /* defined( IOT_JSON_JSMN ) */
-	if ( encoder && encoder->buf && *encoder->buf != '\0' )
+	if ( encoder && ( encoder->flags & IOT_JSON_FLAG_BINARY ) )
+	{
+		/* close any open structures in the output */
+		if ( encoder->cur && encoder->cur > encoder->buf )
+		{
+			char *p_cur = encoder->cur;
+			unsigned int depth = iot_json_encode_depth( encoder );
+			while ( depth )
+			{
+				*p_cur++ = (char)JSON_BINARY_BREAK;
+				--depth;
+			}
+			result = encoder->buf;
+		}
+	}
+	else if ( encoder && encoder->buf && *encoder->buf != '\0' )
 	{
 		/* complete any open objects in the output string */
 		char *p_cur = encoder->cur;
 		if ( p_cur )
 		{
-			unsigned int indent = (encoder->flags >> IOT_JSON_INDENT_OFFSET);
+			unsigned int indent = JSON_INDENT_GET( encoder->flags );
 			unsigned int depth = iot_json_encode_depth( encoder );
 			iot_json_encode_struct_t s = encoder->structs;
 
@@ -519,6 +779,28 @@ const char *iot_json_encode_dump(
 	return result;
 }
 
+const char *iot_json_encode_dump_len(
+	iot_json_encoder_t *encoder,
+	size_t *len )
+{
+	const char *const result = iot_json_encode_dump( encoder );
+	if ( len )
+	{
+		*len = 0u;
+		if ( result )
+		{
+#if !defined( IOT_JSON_JANSSON ) && !defined( IOT_JSON_JSONC )
+			if ( encoder->flags & IOT_JSON_FLAG_BINARY )
+				*len = (size_t)(encoder->cur - encoder->buf) +
+					iot_json_encode_depth( encoder );
+			else
+#endif /* if !defined( IOT_JSON_JANSSON ) && !defined( IOT_JSON_JSONC ) */
+				*len = os_strlen( result );
+		}
+	}
+	return result;
+}
+
 iot_json_encoder_t *iot_json_encode_initialize(
 	void *buf,
 	size_t len,
@@ -538,10 +820,15 @@ iot_json_encoder_t *iot_json_encode_initialize(
 #endif /* ifndef IOT_STACK_ONLY */
 
 	if (
+#if defined( IOT_JSON_JANSSON ) || defined( IOT_JSON_JSONC )
+	     /* binary output is only supported by the built-in encoder */
+	     !( flags & IOT_JSON_FLAG_BINARY ) &&
+#endif /* if defined( IOT_JSON_JANSSON ) || defined( IOT_JSON_JSONC ) */
+	     (
 #ifndef IOT_STACK_ONLY
 	     ( flags & IOT_JSON_FLAG_DYNAMIC ) ||
 #endif /* ifndef IOT_STACK_ONLY */
-	     ( buf && len >= sizeof(struct iot_json_encoder) + extra_space ) )
+	     ( buf && len >= sizeof(struct iot_json_encoder) + extra_space ) ) )
 	{
 #ifndef IOT_STACK_ONLY
 		if ( flags & IOT_JSON_FLAG_DYNAMIC )
@@ -601,6 +888,20 @@ iot_status_t iot_json_encode_integer(
 	/* can't add boolean as root element */
 	if ( !key && ( encoder && encoder->structs == 0u ) )
 		result = IOT_STATUS_BAD_REQUEST;
+	else if ( encoder && ( encoder->flags & IOT_JSON_FLAG_BINARY ) )
+	{
+		unsigned char head[ JSON_BINARY_HEAD_MAX ];
+		size_t head_len;
+		if ( value < 0 )
+			head_len = iot_json_encode_binary_head( head,
+				JSON_BINARY_TYPE_NINT,
+				(iot_uint64_t)( -( value + 1 ) ) );
+		else
+			head_len = iot_json_encode_binary_head( head,
+				JSON_BINARY_TYPE_UINT, (iot_uint64_t)value );
+		result = iot_json_encode_binary_item( encoder, key,
+			head, head_len, NULL, 0u );
+	}
 	else
 	{
 		iot_bool_t added_parent = IOT_FALSE;
@@ -695,11 +996,15 @@ iot_status_t iot_json_encode_key(
 
 		if ( result == IOT_STATUS_SUCCESS )
 		{
-			size_t space = encoder->len - (size_t)(encoder->cur - encoder->buf);
+			size_t space;
 			iot_bool_t add_comma = 0;
-			unsigned int indent = (encoder->flags >> IOT_JSON_INDENT_OFFSET);
+			unsigned int indent = JSON_INDENT_GET( encoder->flags );
 			const unsigned int depth = iot_json_encode_depth( encoder );
 
+			if ( !encoder->cur )
+				encoder->cur = encoder->buf;
+			space = encoder->len - (size_t)(encoder->cur - encoder->buf);
+
 			/* space required for closing current level */
 			if ( indent )
 			{
@@ -729,27 +1034,31 @@ iot_status_t iot_json_encode_key(
 				extra_space += ( indent * 2u * depth ) + 1u; /* +1 for '\n' */
 
 #ifndef IOT_STACK_ONLY
-			if ( encoder->flags & IOT_JSON_FLAG_DYNAMIC )
+			/* grow geometrically, so that a reused encoder stops
+			 * allocating once its buffer is large enough (space to
+			 * close every open structure is always kept) */
+			if ( ( encoder->flags & IOT_JSON_FLAG_DYNAMIC ) &&
+				key_len + value_len + extra_space + depth > space )
 			{
-				const size_t new_space =
-					encoder->len + key_len + value_len + extra_space;
-				void *const new_buf = iot_json_realloc(
-					encoder->buf, new_space + 1u );
+				const size_t used =
+					(size_t)(encoder->cur - encoder->buf);
+				const size_t required = used + key_len +
+					value_len + extra_space + depth;
+				size_t new_space = encoder->len * 2u;
+				void *new_buf;
+				if ( new_space < required )
+					new_space = required;
+				new_buf = iot_json_realloc( encoder->buf,
+					new_space + 1u );
 				if ( new_buf )
 				{
-					encoder->cur = (char*)new_buf +
-						(encoder->cur - encoder->buf);
 					encoder->buf = new_buf;
+					encoder->cur = encoder->buf + used;
 					encoder->len = new_space;
-					space = new_space;
+					space = new_space - used;
 				}
 			}
-			else
 #endif /* ifndef IOT_STACK_ONLY */
-			{
-				if ( !encoder->cur )
-					encoder->cur = encoder->buf;
-			}
 
 			if ( key_len + value_len + extra_space <= space )
 			{
@@ -893,7 +1202,10 @@ iot_status_t iot_json_encode_object_cancel(
 			}
 		}
 #else /* defined( IOT_JSON_JSMN ) */
-		if ( encoder->structs >> 1 ) /* inside an object */
+		/* binary output can't be scanned backwards for the object start */
+		if ( encoder->flags & IOT_JSON_FLAG_BINARY )
+			result = IOT_STATUS_NOT_SUPPORTED;
+		else if ( encoder->structs >> 1 ) /* inside an object */
 		{
 			char *new_pos = encoder->cur - 1;
 			char *save_pos;
@@ -987,7 +1299,9 @@ iot_status_t iot_json_encode_object_clear(
 			}
 		}
 #else /* defined( IOT_JSON_JSMN ) */
-		if ( encoder->structs >> 1 ) /* inside an object */
+		if ( encoder->flags & IOT_JSON_FLAG_BINARY )
+			result = IOT_STATUS_NOT_SUPPORTED;
+		else if ( encoder->structs >> 1 ) /* inside an object */
 		{
 			char *new_pos = encoder->cur - 1;
 			unsigned int depth_count = 0u;
@@ -1075,6 +1389,47 @@ iot_status_t iot_json_encode_real(
 	/* can't add boolean as root element */
 	if ( !key && ( encoder && encoder->structs == 0u ) )
 		result = IOT_STATUS_BAD_REQUEST;
+	else if ( encoder && ( encoder->flags & IOT_JSON_FLAG_BINARY ) )
+	{
+		unsigned char head;
+		unsigned char payload[8u];
+		size_t i;
+		size_t payload_len;
+		iot_uint64_t bits;
+		const float value32 = (float)value;
+		union
+		{
+			iot_float32_t f32;
+			iot_float64_t f64;
+			iot_uint32_t u32;
+			iot_uint64_t u64;
+		} conv;
+
+		/* use single precision when no precision is lost (compared
+		 * without "==", floating-point equality is flagged) */
+		if ( !( (iot_float64_t)value32 < value ) &&
+			!( (iot_float64_t)value32 > value ) )
+		{
+			conv.f32 = value32;
+			bits = conv.u32;
+			head = JSON_BINARY_FLOAT32;
+			payload_len = 4u;
+		}
+		else
+		{
+			conv.f64 = value;
+			bits = conv.u64;
+			head = JSON_BINARY_FLOAT64;
+			payload_len = 8u;
+		}
+
+		/* stored in network byte order */
+		for ( i = 0u; i < payload_len; ++i )
+			payload[i] = (unsigned char)( ( bits >>
+				( ( payload_len - i - 1u ) * 8u ) ) & 0xFFu );
+		result = iot_json_encode_binary_item( encoder, key,
+			&head, 1u, payload, payload_len );
+	}
 	else
 	{
 		iot_bool_t added_parent = 0;
@@ -1136,6 +1491,48 @@ iot_status_t iot_json_encode_real(
 	return result;
 }
 
+void iot_json_encode_reset(
+	iot_json_encoder_t *encoder )
+{
+	if ( encoder )
+	{
+#if defined( IOT_JSON_JANSSON )
+		if ( encoder->output )
+		{
+			json_free_t free_fn = os_free;
+#if JANSSON_VERSION_HEX >= 0x020800
+			json_get_alloc_funcs( NULL, &free_fn );
+#endif /* if JANSSON_VERSION_HEX >= 0x020800 */
+			if ( free_fn )
+				free_fn( encoder->output );
+			encoder->output = NULL;
+		}
+		if ( encoder->j_cur )
+		{
+			json_decref( encoder->j_cur[0] );
+			encoder->j_cur[0] = NULL;
+		}
+		encoder->depth = 0u;
+#elif defined( IOT_JSON_JSONC )
+		if ( encoder->output )
+		{
+			iot_json_free( encoder->output );
+			encoder->output = NULL;
+		}
+		if ( encoder->j_cur && encoder->j_cur[0] )
+		{
+			json_object_put( encoder->j_cur[0] );
+			encoder->j_cur[0] = NULL;
+		}
+		encoder->depth = 0u;
+#else /* defined( IOT_JSON_JSMN ) */
+		/* output buffer (and its size) is kept for the next string */
+		encoder->cur = NULL;
+		encoder->structs = 0u;
+#endif /* defined( IOT_JSON_JSMN ) */
+	}
+}
+
 iot_status_t iot_json_encode_string(
 	iot_json_encoder_t *encoder,
 	const char *key,
@@ -1153,6 +1550,19 @@ iot_status_t iot_json_encode_string(
 	/* can't add boolean as root element */
 	if ( !key && ( encoder && encoder->structs == 0u ) )
 		result = IOT_STATUS_BAD_REQUEST;
+	else if ( encoder && ( encoder->flags & IOT_JSON_FLAG_BINARY ) )
+	{
+		unsigned char head[ JSON_BINARY_HEAD_MAX ];
+		size_t head_len;
+		size_t value_len = 0u;
+
+		if ( value )
+			value_len = os_strlen( value );
+		head_len = iot_json_encode_binary_head( head,
+			JSON_BINARY_TYPE_TEXT, value_len );
+		result = iot_json_encode_binary_item( encoder, key,
+			head, head_len, value, value_len );
+	}
 	else
 	{
 		iot_bool_t added_parent = 0;
@@ -1263,10 +1673,23 @@ iot_status_t iot_json_encode_struct_end(
 	if ( encoder )
 	{
 		result = IOT_STATUS_BAD_REQUEST;
-		if ( encoder->structs & s )
+		if ( ( encoder->flags & IOT_JSON_FLAG_BINARY ) &&
+			( encoder->structs & s ) )
+		{
+			iot_json_encode_struct_t i;
+
+			/* space for the breaks was reserved at the start */
+			for ( i = 0u; i < JSON_STRUCT_BITS; ++i )
+				if ( ((iot_json_encode_struct_t)(1u) << (i)) &
+					encoder->structs )
+					*encoder->cur++ = (char)JSON_BINARY_BREAK;
+			encoder->structs >>= JSON_STRUCT_BITS;
+			result = IOT_STATUS_SUCCESS;
+		}
+		else if ( encoder->structs & s )
 		{
 			unsigned int depth = iot_json_encode_depth( encoder ) - 1u;
-			const unsigned int indent = (encoder->flags >> IOT_JSON_INDENT_OFFSET);
+			const unsigned int indent = JSON_INDENT_GET( encoder->flags );
 			size_t space = encoder->len - (size_t)(encoder->cur - encoder->buf);
 			iot_json_encode_struct_t i;
 
@@ -1348,11 +1771,29 @@ iot_status_t iot_json_encode_struct_start(
 		if ( iot_json_encode_depth( encoder ) < JSON_MAX_DEPTH )
 		{
 			iot_bool_t added_parent = IOT_FALSE;
-			unsigned int indent = (encoder->flags >> IOT_JSON_INDENT_OFFSET);
-			/* +2u for '[' & ']' characters */
-			result = iot_json_encode_key( encoder, key, indent + 2u,
-				&added_parent );
-			if ( result == IOT_STATUS_SUCCESS )
+			unsigned int indent = JSON_INDENT_GET( encoder->flags );
+			if ( encoder->flags & IOT_JSON_FLAG_BINARY )
+			{
+				/* +2u for start & break bytes */
+				result = iot_json_encode_binary_key( encoder, key,
+					2u, &added_parent );
+				if ( result == IOT_STATUS_SUCCESS )
+				{
+					if ( s & IOT_JSON_TYPE_ARRAY )
+						*encoder->cur++ = (char)JSON_BINARY_ARRAY_START;
+					else
+						*encoder->cur++ = (char)JSON_BINARY_MAP_START;
+				}
+			}
+			else
+			{
+				/* +2u for '[' & ']' characters */
+				result = iot_json_encode_key( encoder, key,
+					indent + 2u, &added_parent );
+			}
+
+			if ( result == IOT_STATUS_SUCCESS &&
+				!( encoder->flags & IOT_JSON_FLAG_BINARY ) )
 			{
 				unsigned int i;
 				for ( i = JSON_STRUCT_BITS; i > 0u; --i )
@@ -1361,10 +1802,14 @@ iot_status_t iot_json_encode_struct_start(
 					unsigned int i_1 = i - 1u;
 					if ( s & ( (iot_json_encode_struct_t)(1u) << ( i_1 ) ) )
 					{
-						indent = (encoder->flags >> IOT_JSON_INDENT_OFFSET);
+						indent = JSON_INDENT_GET( encoder->flags );
 						*encoder->cur++ = JSON_CHARS_START[i_1];
 					}
 				}
+			}
+
+			if ( result == IOT_STATUS_SUCCESS )
+			{
 				if ( !added_parent )
 					encoder->structs <<= JSON_STRUCT_BITS;
 				encoder->structs |= (iot_json_encode_struct_t)s;
@@ -18,6 +18,8 @@
 #include "../../shared/iot_base64.h"
 #include "../../shared/iot_defs.h"
 #include "../../shared/iot_types.h"
+#include "tr50_hub.h"
+#include "tr50_transfer.h"
 
 #include <iot_checksum.h>
 #include <iot_json.h>
@@ -25,88 +27,172 @@
 #include <iot_plugin.h>
 #include <os.h>
 #include <curl/curl.h>
+#include <float.h> /* for DBL_MAX */
 
 #ifdef IOT_STACK_ONLY
 #define TR50_IN_BUFFER_SIZE                 1024u
-#endif /* ifdef IOT_STACK_ONLY */
-
-/** @brief Maximum concurrent file transfers */
-#define TR50_FILE_TRANSFER_MAX              10u
-/** @brief Time interval in seconds to check file
- *         transfer queue */
-#define TR50_FILE_QUEUE_CHECK_INTERVAL      30u * IOT_MILLISECONDS_IN_SECOND /* 30 seconds */
-/** @brief Time interval in seconds for a file
- *         transfer to expire if it keeps failing */
-#define TR50_FILE_TRANSFER_EXPIRY_TIME      1u * IOT_MINUTES_IN_HOUR * \
-                                            IOT_SECONDS_IN_MINUTE * \
-                                            IOT_MILLISECONDS_IN_SECOND /* 1 hour */
+#else /* ifdef IOT_STACK_ONLY */
+/** @brief Number of reusable decoders kept for inbound messages */
+#define TR50_DECODER_POOL_MAX               2u
+/** @brief Number of reusable encoders kept for outbound requests */
+#define TR50_ENCODER_POOL_MAX               2u
+/** @brief Maximum number of telemetry items with a cached request */
+#define TR50_TEMPLATE_MAX                   IOT_TELEMETRY_MAX
+/** @brief Maximum length of a cached telemetry request */
+#define TR50_TEMPLATE_LEN_MAX               384u
+/** @brief Size of the buffer for a request built from a cached request */
+#define TR50_TEMPLATE_MSG_MAX               ( TR50_TEMPLATE_LEN_MAX + 96u )
+#endif /* else IOT_STACK_ONLY */
+
+/** @brief Length of the date & time portion of a formatted time stamp */
+#define TR50_TIME_PREFIX_LEN                19u
+/** @brief Size of the scratch space for the string parameters of inbound
+ *         requests (grown on the heap for longer values) */
+#define TR50_ARENA_SIZE                     256u
+
 /** @brief Amount to offset the request id by */
 #define TR50_FILE_REQUEST_ID_OFFSET         256u
 /** @brief number of seconds before sending a keep alive message */
 #define TR50_MQTT_KEEP_ALIVE                60u
-/** @brief Time interval to send a ping if not data received */
+/** @brief longest number of seconds between keep alive messages */
+#define TR50_MQTT_KEEP_ALIVE_MAX            600u
+/** @brief Keep alive intervals a connection must last for the interval to
+ *         be considered safe (i.e. below any NAT time out on the path) */
+#define TR50_KEEP_ALIVE_STABLE              3u
+/** @brief Minimum time a keep alive is used before trying a longer one */
+#define TR50_KEEP_ALIVE_PROBE_MS            30u * IOT_SECONDS_IN_MINUTE * \
+                                            IOT_MILLISECONDS_IN_SECOND /* 30 minutes */
+/** @brief Connections lost early with a longer keep alive before it is
+ *         considered too long for the path */
+#define TR50_KEEP_ALIVE_FAILS               3u
+/** @brief Time a lowered keep alive limit is kept before longer keep alives
+ *         are tried again */
+#define TR50_KEEP_ALIVE_CAP_MS              IOT_HOURS_IN_DAY * \
+                                            IOT_MINUTES_IN_HOUR * \
+                                            IOT_SECONDS_IN_MINUTE * \
+                                            IOT_MILLISECONDS_IN_SECOND /* 1 day */
+/** @brief Time interval to send a ping if not data received (only used if
+ *         the mqtt keep alive is disabled) */
 #define TR50_PING_INTERVAL                  60 * IOT_MILLISECONDS_IN_SECOND
 /** @brief Time interval to check mailbox if nothing */
 #define TR50_MAILBOX_CHECK_INTERVAL         120 * IOT_MILLISECONDS_IN_SECOND
+/** @brief Longest time interval to check mailbox, while notifications of
+ *         mailbox activity are found to be reliable */
+#define TR50_MAILBOX_CHECK_INTERVAL_MAX     30u * IOT_SECONDS_IN_MINUTE * \
+                                            IOT_MILLISECONDS_IN_SECOND /* 30 minutes */
+/** @brief Time to wait for the reply of a mailbox check before another
+ *         check can be sent */
+#define TR50_MAILBOX_CHECK_TIMEOUT          30u * IOT_MILLISECONDS_IN_SECOND
+/** @brief Maximum number of mailbox acknowledgements sent in one message */
+#define TR50_MAILBOX_ACK_MAX                8u
+/** @brief Longest time a mailbox acknowledgement is held to be sent with
+ *         others */
+#define TR50_MAILBOX_ACK_DELAY              1u * IOT_MILLISECONDS_IN_SECOND
+/** @brief Time interval to retry sending queued messages */
+#define TR50_SEND_QUEUE_RETRY_INTERVAL      1u * IOT_MILLISECONDS_IN_SECOND
 /** @brief Number of pings that can be missed before reconnection */
 #define TR50_PING_MISS_ALLOWED              0u
 /** @brief default QOS level */
 #define TR50_MQTT_QOS                       1
+/** @brief highest QOS level supported by MQTT */
+#define TR50_MQTT_QOS_MAX                   2
+/** @brief topic aliases to use on an MQTT 5 connection ("api" topics) */
+#define TR50_MQTT_TOPIC_ALIAS_MAX           2u
+/** @brief longest topic configured for api requests in binary encoding */
+#define TR50_MQTT_TOPIC_BINARY_MAX          64u
 /** @brief number of seconds to show "Connection loss message" */
 #define TR50_TIMEOUT_CONNECTION_LOSS_MSG_MS 20u * IOT_MILLISECONDS_IN_SECOND /* 20 seconds */
-/** @brief number of milliseconds between reconnect attempts */
+/** @brief minimum number of milliseconds between reconnect attempts */
 #define TR50_TIMEOUT_RECONNECT_MS           5u * IOT_MILLISECONDS_IN_SECOND /* 5 seconds */
+/** @brief maximum number of milliseconds between reconnect attempts */
+#define TR50_TIMEOUT_RECONNECT_MAX_MS       5u * IOT_SECONDS_IN_MINUTE * \
+                                            IOT_MILLISECONDS_IN_SECOND /* 5 minutes */
 /** @brief Maximum length for a "thingkey" */
 #define TR50_THING_KEY_MAX_LEN              ( IOT_ID_MAX_LEN * 2u ) + 1u
 
-#ifdef IOT_THREAD_SUPPORT
-/** @brief File transfer progress interval in seconds */
-#define TR50_FILE_TRANSFER_PROGRESS_INTERVAL 5.0
-/** @brief Default value for ssl verify host */
-#define TR50_DEFAULT_SSL_VERIFY_HOST        2u
-/** @brief Default value for ssl verify peer */
-#define TR50_DEFAULT_SSL_VERIFY_PEER        1u
-/** @brief Extension for temporary downloaded file */
-#define TR50_DOWNLOAD_EXTENSION             ".part"
-#endif /* ifdef IOT_THREAD_SUPPORT */
+#ifndef IOT_STACK_ONLY
+/**
+ * @brief pre-serialized telemetry publish request for a telemetry item
+ *
+ * Holds the part of the request from after the message id up to the value,
+ * so publishing only requires adding the id, value & time stamp
+ */
+struct tr50_template
+{
+	/** @brief thing key generation the template was built for */
+	iot_uint32_t generation;
+	/** @brief length of the template */
+	size_t len;
+	/** @brief serialized request */
+	char msg[ TR50_TEMPLATE_LEN_MAX ];
+	/** @brief name of the telemetry item the template is for */
+	char name[ IOT_NAME_MAX_LEN + 1u ];
+};
+#endif /* ifndef IOT_STACK_ONLY */
+
+/** @brief priority classes of outbound messages, highest priority first */
+enum tr50_send_class
+{
+	TR50_SEND_CONTROL = 0, /**< @brief acknowledgements & control requests */
+	TR50_SEND_ALARM,       /**< @brief alarms */
+	TR50_SEND_EVENT,       /**< @brief events & attributes */
+	TR50_SEND_TELEMETRY,   /**< @brief telemetry samples */
+	TR50_SEND_BULK,        /**< @brief file transfer requests */
+	TR50_SEND_CLASS_COUNT  /**< @brief number of priority classes */
+};
+
+#ifndef IOT_STACK_ONLY
+/** @brief outbound message waiting to be handed to the mqtt client */
+struct tr50_send_msg
+{
+	/** @brief whether a transaction is set */
+	iot_bool_t has_txn;
+	/** @brief encoder holding the payload (NULL if the payload is copied
+	 *         after the structure) */
+	iot_json_encoder_t *json;
+	/** @brief next message in the same priority class */
+	struct tr50_send_msg *next;
+	/** @brief payload to publish */
+	const void *payload;
+	/** @brief size of the payload */
+	size_t payload_len;
+	/** @brief mqtt quality of service level */
+	int qos;
+	/** @brief time the message was queued */
+	iot_timestamp_t time;
+	/** @brief topic to publish on (static string) */
+	const char *topic;
+	/** @brief transaction status information */
+	iot_transaction_t txn;
+};
 
-/** @brief structure containing informaiton about a file transfer */
-struct tr50_file_transfer
+/** @brief outbound messages of a priority class & the class' budget */
+struct tr50_send_queue
 {
-	/** @brief progress function callback */
-	iot_file_progress_callback_t *callback;
-	/** @brief flag to cancel transfer */
-	iot_bool_t cancel;
-	/** @brief crc32 checksum */
-	iot_uint64_t crc32;
-	/** @brief time when transfer expired */
-	iot_timestamp_t expiry_time;
-	/** @brief last time progress was sent */
-	double last_update_time;
-	/** @brief curl handle */
-	CURL *lib_curl;
-	/** @brief cloud's file name */
-	char name[ PATH_MAX + 1u ];
-	/** @brief file operation (get/put) */
-	iot_operation_t op;
-	/** @brief local file path */
-	char path[ PATH_MAX + 1u ];
-	/** @brief total byte transfered in previous session(s) */
-	long prev_byte;
-	/** @brief pointer to plugin data */
-	void *plugin_data;
-	/** @brief file size */
-	iot_uint64_t size;
-	/** @brief next time transfer is retried */
-	iot_timestamp_t retry_time;
-	/** @brief cloud download url */
-	char url[ PATH_MAX + 1u ];
-	/** @brief Use global file store */
-	iot_bool_t use_global_store;
-	/** @brief callback's user data */
-	void *user_data;
-	/** @brief callback's maximum number of retries */
-	iot_int64_t max_retries;
+	/** @brief number of bytes queued */
+	size_t bytes;
+	/** @brief number of messages queued */
+	size_t count;
+	/** @brief first message in the queue */
+	struct tr50_send_msg *head;
+	/** @brief maximum number of bytes that can be queued */
+	size_t max_bytes;
+	/** @brief maximum number of messages that can be queued */
+	size_t max_count;
+	/** @brief last message in the queue */
+	struct tr50_send_msg *tail;
+};
+#endif /* ifndef IOT_STACK_ONLY */
+
+/** @brief date & time portion of the last time stamp formatted */
+struct tr50_time_cache
+{
+	/** @brief length of the formatted date & time (0 if not set) */
+	size_t len;
+	/** @brief formatted date & time: "YYYY-MM-DDTHH:MM:SS" */
+	char prefix[ TR50_TIME_PREFIX_LEN + 1u ];
+	/** @brief second the formatted date & time is for */
+	iot_timestamp_t second;
 };
 
 /** @brief internal data required for the plug-in */
@@ -114,32 +200,166 @@ struct tr50_data
 {
 	/** @brief number of times connection lost reported */
 	iot_uint32_t connection_lost_msg_count;
-	/** @brief file transfer queue */
-	struct tr50_file_transfer file_transfer_queue[ TR50_FILE_TRANSFER_MAX ];
-	/** @brief number of ongoing file transfer */
-	iot_uint8_t file_transfer_count;
-	/** @brief time when file transfer queue is last checked */
-	iot_timestamp_t file_queue_last_checked;
+	/** @brief encoder flags for outbound api requests */
+	unsigned int encode_flags;
+	/** @brief topic for api requests in binary encoding */
+	char encode_topic[ TR50_MQTT_TOPIC_BINARY_MAX + 1u ];
+	/** @brief default QOS level for publishing telemetry */
+	int telemetry_qos;
+#ifdef TR50_HUB_SUPPORT
+	/** @brief local hub shared with other applications (or connected to) */
+	tr50_hub_t *hub;
+	/** @brief whether requests are sent through a local hub */
+	iot_bool_t hub_client;
+#endif /* ifdef TR50_HUB_SUPPORT */
+	/** @brief engine performing the file transfers */
+	tr50_transfer_engine_t *transfer;
+#ifndef IOT_STACK_ONLY
+	/** @brief reusable decoders for inbound messages */
+	iot_json_decoder_t *decoder_pool[ TR50_DECODER_POOL_MAX ];
+	/** @brief whether a decoder in the pool is currently in use */
+	iot_bool_t decoder_in_use[ TR50_DECODER_POOL_MAX ];
+#ifdef IOT_THREAD_SUPPORT
+	/** @brief mutex protecting the decoder pool */
+	os_thread_mutex_t decoder_mutex;
+#endif /* ifdef IOT_THREAD_SUPPORT */
+	/** @brief reusable encoders for outbound requests */
+	iot_json_encoder_t *encoder_pool[ TR50_ENCODER_POOL_MAX ];
+	/** @brief flags each encoder in the pool was created with */
+	unsigned int encoder_flags[ TR50_ENCODER_POOL_MAX ];
+	/** @brief whether an encoder in the pool is currently in use */
+	iot_bool_t encoder_in_use[ TR50_ENCODER_POOL_MAX ];
+#ifdef IOT_THREAD_SUPPORT
+	/** @brief mutex protecting the encoder pool */
+	os_thread_mutex_t encoder_mutex;
+#endif /* ifdef IOT_THREAD_SUPPORT */
+	/** @brief thing key generation, incremented when the thing key changes */
+	iot_uint32_t template_generation;
+	/** @brief cached telemetry publish requests */
+	struct tr50_template *templates[ TR50_TEMPLATE_MAX ];
+#ifdef IOT_THREAD_SUPPORT
+	/** @brief mutex protecting the cached telemetry requests */
+	os_thread_mutex_t template_mutex;
+#endif /* ifdef IOT_THREAD_SUPPORT */
+	/** @brief outbound messages the mqtt client could not accept yet */
+	struct tr50_send_queue send_queue[ TR50_SEND_CLASS_COUNT ];
+	/** @brief total number of outbound messages queued */
+	size_t send_queued;
+#ifdef IOT_THREAD_SUPPORT
+	/** @brief mutex protecting the outbound queue */
+	os_thread_mutex_t send_mutex;
+#endif /* ifdef IOT_THREAD_SUPPORT */
+#endif /* ifndef IOT_STACK_ONLY */
 	/** @brief library handle */
 	iot_t *lib;
 	/** @brief pointer to the mqtt connection to the cloud */
 	iot_mqtt_t *mqtt;
 	/** @brief current number of pings missed */
 	iot_uint8_t ping_miss_count;
+	/** @brief mqtt keep alive in seconds used for the connection */
+	iot_uint16_t keep_alive;
+	/** @brief longest keep alive the connection is known to survive */
+	iot_uint16_t keep_alive_good;
+	/** @brief longest keep alive to try (lowered if a try fails) */
+	iot_uint16_t keep_alive_limit;
+	/** @brief configured longest keep alive */
+	iot_uint16_t keep_alive_max;
+	/** @brief configured shortest keep alive (0 = application ping) */
+	iot_uint16_t keep_alive_min;
+	/** @brief longer keep alive to use on the next connection (0 = none) */
+	iot_uint16_t keep_alive_next;
+	/** @brief connections lost early with the keep alive being tried */
+	iot_uint8_t keep_alive_fails;
+	/** @brief time the limit was lowered (0 = not lowered) */
+	iot_timestamp_t keep_alive_capped;
+	/** @brief time the current keep alive started being used */
+	iot_timestamp_t keep_alive_since;
 	/** @brief proxy details */
 	struct iot_proxy proxy;
 	/** @brief number of times reconnection has been attempted */
 	iot_uint32_t reconnect_count;
+	/** @brief delay before the last reconnect attempt (0 if none) */
+	iot_millisecond_t reconnect_delay;
+	/** @brief longest delay between reconnect attempts */
+	iot_millisecond_t reconnect_delay_max;
+	/** @brief shortest delay between reconnect attempts */
+	iot_millisecond_t reconnect_delay_min;
+	/** @brief state for randomizing reconnect delays */
+	iot_uint32_t reconnect_random;
+	/** @brief time of the next reconnect attempt (0 if not scheduled) */
+	iot_timestamp_t reconnect_time;
 	/** @brief the key of the thing */
 	char thing_key[ TR50_THING_KEY_MAX_LEN + 1u ];
 	/** @brief time when mailbox was last checked */
 	iot_timestamp_t time_last_mailbox_check;
+	/** @brief time between polls of the mailbox (stretched while
+	 *         notifications of mailbox activity are reliable) */
+	iot_millisecond_t mailbox_interval;
+	/** @brief longest time between polls of the mailbox */
+	iot_millisecond_t mailbox_interval_max;
+	/** @brief shortest time between polls of the mailbox */
+	iot_millisecond_t mailbox_interval_min;
+	/** @brief number of requests asked for by the last mailbox check */
+	iot_uint8_t mailbox_limit;
+	/** @brief requests may be left in the mailbox, check again once
+	 *         there is room for them */
+	iot_bool_t mailbox_more;
+	/** @brief last mailbox check was sent by the poll timer */
+	iot_bool_t mailbox_polled;
+	/** @brief reply to the last mailbox check not yet received */
+	iot_bool_t mailbox_waiting;
+#ifndef IOT_STACK_ONLY
+	/** @brief mailbox acknowledgements waiting to be sent together */
+	iot_json_encoder_t *ack_json;
+	/** @brief number of acknowledgements waiting in ack_json */
+	unsigned int ack_count;
+	/** @brief most acknowledgements to send in one message */
+	unsigned int ack_max;
+	/** @brief time the first acknowledgement was added to ack_json */
+	iot_timestamp_t ack_time;
+#endif /* ifndef IOT_STACK_ONLY */
+#ifdef IOT_THREAD_SUPPORT
+	/** @brief mutex protecting the mailbox state & acknowledgements */
+	os_thread_mutex_t mailbox_mutex;
+#endif /* ifdef IOT_THREAD_SUPPORT */
 	/** @brief time when last message was received from cloud */
 	iot_timestamp_t time_last_msg_received;
+	/** @brief formatted date & time of the last time stamp */
+	struct tr50_time_cache time_cache;
+#ifdef IOT_THREAD_SUPPORT
+	/** @brief mutex protecting the formatted time stamp cache */
+	os_thread_mutex_t time_mutex;
+#endif /* ifdef IOT_THREAD_SUPPORT */
 	/** @brief transaction status based on id */
 	iot_uint32_t transactions[16u];
 };
 
+/** @brief two digit strings for each number from 0 to 99 */
+static const char TR50_DIGIT_PAIRS[] =
+	"00010203040506070809101112131415161718192021222324252627282930313233"
+	"34353637383940414243444546474849505152535455565758596061626364656667"
+	"6869707172737475767778798081828384858687888990919293949596979899";
+
+#ifndef IOT_STACK_ONLY
+/** @brief configuration name & default budget of each priority class */
+static const struct
+{
+	/** @brief name of the class in the configuration */
+	const char *name;
+	/** @brief default maximum number of messages queued */
+	size_t max_count;
+	/** @brief default maximum number of bytes queued */
+	size_t max_bytes;
+} TR50_SEND_CLASS_INFO[ TR50_SEND_CLASS_COUNT ] =
+{
+	{ "control",   32u,  16384u },
+	{ "alarm",     64u,  65536u },
+	{ "event",     64u,  65536u },
+	{ "telemetry", 256u, 131072u },
+	{ "bulk",      16u,  16384u }
+};
+#endif /* ifndef IOT_STACK_ONLY */
+
 /** @brief transaction status values */
 enum tr50_transaction_status
 {
@@ -153,6 +373,10 @@ enum tr50_transaction_status
 /**
  * @brief function called to respond to the cloud on an action complete
  *
+ * @note acknowledgements are held and sent together, in one message, once
+ *       no other request is executing, TR50_MAILBOX_ACK_MAX are waiting or
+ *       the oldest has waited TR50_MAILBOX_ACK_DELAY
+ *
  * @param[in]      data                plug-in specific data
  * @param[in]      action              action being executed
  * @param[in]      request             action request
@@ -245,6 +469,8 @@ static IOT_SECTION iot_status_t tr50_attribute_publish(
  * @param[in]      data                plug-in specific data
  * @param[in]      txn                 transaction status information
  * @param[in]      iteration_check     being called during an "iteration"
+ *                                     (only checks if the poll interval
+ *                                     expired or more requests are waiting)
  *
  * @retval IOT_STATUS_BAD_PARAMETER    bad parameter passed to the function
  * @retval IOT_STATUS_SUCCESS          on success
@@ -300,6 +526,35 @@ static IOT_SECTION iot_status_t tr50_connect_check(
 	const iot_transaction_t *txn,
 	iot_millisecond_t max_time_out );
 
+#ifndef IOT_STACK_ONLY
+/**
+ * @brief obtains a decoder for parsing an inbound message
+ *
+ * @note decoders are taken from a small pool and keep their token buffers
+ * between messages; if the pool is exhausted a temporary decoder is created
+ *
+ * @param[in,out]  data                plug-in specific data
+ *
+ * @return a decoder to use, or NULL on failure
+ *
+ * @see tr50_decoder_release
+ */
+static IOT_SECTION iot_json_decoder_t *tr50_decoder_acquire(
+	struct tr50_data *data );
+
+/**
+ * @brief returns a decoder obtained from tr50_decoder_acquire
+ *
+ * @param[in,out]  data                plug-in specific data
+ * @param[in]      decoder             decoder to return
+ *
+ * @see tr50_decoder_acquire
+ */
+static IOT_SECTION void tr50_decoder_release(
+	struct tr50_data *data,
+	iot_json_decoder_t *decoder );
+#endif /* ifndef IOT_STACK_ONLY */
+
 /**
  * @brief plug-in function called to disable the plug-in
  *
@@ -350,6 +605,35 @@ iot_status_t tr50_enable(
 	iot_t *lib,
 	void* plugin_data );
 
+#ifndef IOT_STACK_ONLY
+/**
+ * @brief obtains an encoder for building an outbound request
+ *
+ * @note encoders are taken from a small pool and keep their output buffers
+ * between requests; if the pool is exhausted a temporary encoder is created
+ *
+ * @param[in,out]  data                plug-in specific data
+ *
+ * @return an encoder to use, or NULL on failure
+ *
+ * @see tr50_encoder_release
+ */
+static IOT_SECTION iot_json_encoder_t *tr50_encoder_acquire(
+	struct tr50_data *data );
+
+/**
+ * @brief returns an encoder obtained from tr50_encoder_acquire
+ *
+ * @param[in,out]  data                plug-in specific data
+ * @param[in]      encoder             encoder to return
+ *
+ * @see tr50_encoder_acquire
+ */
+static IOT_SECTION void tr50_encoder_release(
+	struct tr50_data *data,
+	iot_json_encoder_t *encoder );
+#endif /* ifndef IOT_STACK_ONLY */
+
 /**
  * @brief called when event log api publish is called
  *
@@ -403,6 +687,22 @@ iot_status_t tr50_execute(
 	const iot_options_t *options );
 
 
+/**
+ * @brief sets the checksum a download is to be verified with, from the
+ *        "sha256" or "md5" option (hexadecimal) given for it
+ *
+ * @param[in]      data                plug-in specific data
+ * @param[in]      transfer_id         identifier of the download
+ * @param[in]      options             map containing an optional options set
+ *
+ * @retval IOT_STATUS_BAD_PARAMETER    invalid checksum given
+ * @retval IOT_STATUS_SUCCESS          on success (or no checksum given)
+ */
+static IOT_SECTION iot_status_t tr50_file_checksum_set(
+	struct tr50_data *data,
+	iot_uint32_t transfer_id,
+	const iot_options_t *options );
+
 /**
  * @brief sends file.get or file.put rest api to tr50 requesting
  *        for file id, file size and crc
@@ -422,77 +722,131 @@ static IOT_SECTION iot_status_t tr50_file_request_send(
 	const iot_transaction_t *txn,
 	const iot_options_t *options );
 
-#ifdef IOT_THREAD_SUPPORT
+#ifdef TR50_HUB_SUPPORT
 /**
- * @brief a thread to perform file transfer
+ * @brief returns the priority class for a request from the hub
  *
- * @param[in]      arg                 info required to transfer file
+ * @param[in]      json                decoded request
+ * @param[in]      root                root object of the request
  *
- * @retval IOT_STATUS_BAD_PARAMETER    bad params
+ * @return the highest priority class of the commands in the request
+ */
+static IOT_SECTION enum tr50_send_class tr50_hub_classify(
+	const iot_json_decoder_t *json,
+	const iot_json_item_t *root );
+
+/**
+ * @brief publishes a request from an application connected to the hub
+ *
+ * @param[in]      user_data           plug-in specific data
+ * @param[in]      topic               topic to publish on
+ * @param[in]      payload             payload to publish
+ * @param[in]      payload_len         size of the payload
+ * @param[in]      qos                 mqtt quality of service level
+ *
+ * @retval IOT_STATUS_BAD_PARAMETER    invalid parameter passed to the function
  * @retval IOT_STATUS_FAILURE          on failure
  * @retval IOT_STATUS_SUCCESS          on success
  */
-static IOT_SECTION OS_THREAD_DECL tr50_file_transfer(
-	void* arg );
+static IOT_SECTION iot_status_t tr50_hub_forward(
+	void *user_data,
+	const char *topic,
+	const void *payload,
+	size_t payload_len,
+	int qos );
+#endif /* ifdef TR50_HUB_SUPPORT */
 
 /**
- * @brief Callback called for progress updates (and to cancel transfers)
+ * @brief plug-in function called to initialize the plug-in
  *
- * @param[in]      user_data           pointer to information about the transfer
- * @param[in]      down_total          total number of bytes to download
- * @param[in]      down_now            current number of bytes downloaded
- * @param[in]      up_total            total number of bytes to upload
- * @param[in]      up_now              current number of bytes uploaded
+ * @param[in]      lib                 library handle
+ * @param[out]     plugin_data         plugin specific data
+ *
+ * @retval IOT_STATUS_FAILURE          on failure
+ * @retval IOT_STATUS_SUCCESS          on success
  *
- * @retval 0 continue the transfer
- * @retval 1 cancel the transfer
+ * @see tr50_enable
+ * @see tr50_terminate
  */
-static IOT_SECTION int tr50_file_progress( void *user_data,
-	curl_off_t down_total, curl_off_t down_now,
-	curl_off_t up_total, curl_off_t up_now );
+iot_status_t tr50_initialize(
+	iot_t *lib,
+	void **plugin_data );
 
 /**
- * @brief Callback called for progress updates (and to cancel transfers)
- *        for older versions of libcurl
+ * @brief adapts the mqtt keep alive to the connection
  *
- * @param[in]      user_data           pointer to information about the transfer
- * @param[in]      down_total          total number of bytes to download
- * @param[in]      down_now            current number of bytes downloaded
- * @param[in]      up_total            total number of bytes to upload
- * @param[in]      up_now              current number of bytes uploaded
+ * The keep alive is doubled, up to the configured maximum, once the
+ * connection has lasted long enough with the current one.  As the keep
+ * alive is set on connection, the longer one is used the next time the
+ * connection is made.  A connection lost before lasting long enough with a
+ * longer keep alive may have been timed out by a device on the path (i.e.
+ * NAT): after a few such losses the last working keep alive is used &
+ * becomes the limit for a while.  If a proven keep alive fails, it is
+ * halved.
+ *
+ * @param[in]      lib                 library handle
+ * @param[in,out]  data                plug-in specific data
+ * @param[in]      connected           whether the connection is up
  *
- * @retval 0 continue the transfer
- * @retval 1 cancel the transfer
+ * @see tr50_connect_check
  */
-static IOT_SECTION int tr50_file_progress_old(
-	void *user_data,
-	double down_total, double down_now,
-	double up_total, double up_now );
-#endif /* ifdef IOT_THREAD_SUPPORT */
+static IOT_SECTION void tr50_keep_alive_update(
+	iot_t *lib,
+	struct tr50_data *data,
+	iot_bool_t connected );
 
 /**
- * @brief checks file transfer queue and execute those which need retrying
+ * @brief services the connection for descriptors reported ready by an
+ *        external event loop
  *
  * @param[in]      data                plug-in specific data
+ * @param[in]      poll                descriptors that are ready
  */
-static IOT_SECTION void tr50_file_queue_check(
-	struct tr50_data *data );
+static IOT_SECTION void tr50_loop_dispatch(
+	struct tr50_data *data,
+	const struct iot_loop_poll *poll );
 
 /**
- * @brief plug-in function called to initialize the plug-in
+ * @brief adds the descriptors & the time of the next plug-in timer for an
+ *        external event loop to wait on
  *
- * @param[in]      lib                 library handle
- * @param[out]     plugin_data         plugin specific data
+ * @param[in]      data                plug-in specific data
+ * @param[in,out]  poll                descriptors & deadline to update
+ */
+static IOT_SECTION void tr50_loop_poll(
+	struct tr50_data *data,
+	struct iot_loop_poll *poll );
+
+#ifndef IOT_STACK_ONLY
+/**
+ * @brief sends the mailbox acknowledgements being held
  *
- * @retval IOT_STATUS_FAILURE          on failure
- * @retval IOT_STATUS_SUCCESS          on success
+ * @param[in,out]  data                plug-in specific data
+ * @param[in]      force               send even if the oldest has not waited
+ *                                     TR50_MAILBOX_ACK_DELAY
  *
- * @see tr50_enable
- * @see tr50_terminate
+ * @retval IOT_STATUS_BAD_PARAMETER    invalid parameter passed to the function
+ * @retval IOT_STATUS_FULL             budget of the priority class exhausted
+ * @retval IOT_STATUS_SUCCESS          on success (or nothing to send)
  */
-iot_status_t tr50_initialize(
-	iot_t *lib,
-	void **plugin_data );
+static IOT_SECTION iot_status_t tr50_mailbox_ack_flush(
+	struct tr50_data *data,
+	iot_bool_t force );
+#endif /* ifndef IOT_STACK_ONLY */
+
+/**
+ * @brief updates the mailbox state on the reply to a mailbox check
+ *
+ * A full page of requests means more may be waiting, so the mailbox is
+ * checked again right away if there is room for them.  Polling backs off
+ * while polls find nothing the notifications did not already report.
+ *
+ * @param[in,out]  data                plug-in specific data
+ * @param[in]      count               number of requests received
+ */
+static IOT_SECTION void tr50_mailbox_reply(
+	struct tr50_data *data,
+	size_t count );
 
 /**
  * @brief helper fuction to publish data using MQTT
@@ -501,22 +855,100 @@ iot_status_t tr50_initialize(
  * @param[in]      topic               mqtt topic to send data on
  * @param[in]      payload             pointer to data to send
  * @param[in]      payload_len         size of the data to send
+ * @param[in]      qos                 mqtt quality of service level
+ * @param[in]      send_class          priority class of the message
+ * @param[in]      json                (optional) encoder holding the
+ *                                     payload, released once published
  * @param[in]      txn                 transaction status information
  *
+ * @note messages the mqtt client can not accept (i.e. not connected or
+ *       too many awaiting acknowledgement) are queued within the budget
+ *       of the priority class and sent in priority order
+ *
  * @retval IOT_STATUS_BAD_PARAMETER    invalid parameter passed to the function
- * @retval IOT_STATUS_SUCCESS          on success
+ * @retval IOT_STATUS_FULL             budget of the priority class exhausted
+ * @retval IOT_STATUS_SUCCESS          on success (sent or queued)
  */
 static IOT_SECTION iot_status_t tr50_mqtt_publish(
 	struct tr50_data *data,
 	const char *topic,
 	const void *payload,
 	size_t payload_len,
+	int qos,
+	enum tr50_send_class send_class,
+	iot_json_encoder_t *json,
+	const iot_transaction_t *txn );
+
+/**
+ * @brief helper function to publish an encoded api request using MQTT
+ *
+ * @note requests encoded in binary are published to the topic configured for
+ * them ("cloud.encoding_topic").  The encoder is released by this function,
+ * whether or not the publish succeeds.
+ *
+ * @param[in,out]  data                plug-in specific data
+ * @param[in]      json                encoded request to publish
+ * @param[in]      qos                 mqtt quality of service level
+ * @param[in]      send_class          priority class of the request
+ * @param[in]      txn                 transaction status information
+ *
+ * @retval IOT_STATUS_BAD_PARAMETER    invalid parameter passed to the function
+ * @retval IOT_STATUS_FAILURE          failed to obtain the encoded request
+ * @retval IOT_STATUS_FULL             budget of the priority class exhausted
+ * @retval IOT_STATUS_SUCCESS          on success
+ */
+static IOT_SECTION iot_status_t tr50_mqtt_publish_request(
+	struct tr50_data *data,
+	iot_json_encoder_t *json,
+	int qos,
+	enum tr50_send_class send_class,
 	const iot_transaction_t *txn );
 
+/**
+ * @brief handles the reply to a file transfer request
+ *
+ * @param[in,out]  data                plug-in specific data
+ * @param[in]      json                decoder holding the reply
+ * @param[in]      j_params            parameters of the reply
+ * @param[in]      msg_id              id of the request replied to
+ */
+static IOT_SECTION void tr50_on_file_reply(
+	struct tr50_data *data,
+	iot_json_decoder_t *json,
+	const iot_json_item_t *j_params,
+	int msg_id );
+
+/**
+ * @brief handles a notification of activity in the mailbox
+ *
+ * @param[in,out]  data                plug-in specific data
+ * @param[in]      json                decoder holding the notification
+ * @param[in]      root                root object of the notification
+ */
+static IOT_SECTION void tr50_on_mailbox_activity(
+	struct tr50_data *data,
+	iot_json_decoder_t *json,
+	const iot_json_item_t *root );
+
+/**
+ * @brief executes the requests returned by a mailbox check
+ *
+ * @param[in,out]  data                plug-in specific data
+ * @param[in]      json                decoder holding the reply
+ * @param[in]      j_messages          array of requests
+ */
+static IOT_SECTION void tr50_on_mailbox_messages(
+	struct tr50_data *data,
+	iot_json_decoder_t *json,
+	const iot_json_item_t *j_messages );
+
 /**
  * @brief callback function that is called when tr50 receives a message from the
  *        cloud
  *
+ * @note the message is passed to the handler for its topic, in
+ *       TR50_TOPIC_HANDLERS
+ *
  * @param[in]      user_data           user specific data
  * @param[in]      topic               topic the message was received on
  * @param[in]      payload             payload that was received
@@ -532,10 +964,23 @@ static IOT_SECTION void tr50_on_message(
 	int qos,
 	iot_bool_t retain );
 
+/**
+ * @brief handles the reply to a request
+ *
+ * @param[in,out]  data                plug-in specific data
+ * @param[in]      json                decoder holding the reply
+ * @param[in]      root                root object of the reply
+ */
+static IOT_SECTION void tr50_on_reply(
+	struct tr50_data *data,
+	iot_json_decoder_t *json,
+	const iot_json_item_t *root );
+
 /**
  * @brief appends an option to the encoder if the key is set properly in the
  *        options map
  *
+ * @param[in,out]  data                plug-in specific data
  * @param[out]     json                json encoder to add options to
  * @param[in]      json_key            key to add the item to in the json
  * @param[in]      options             map containing optional settings
@@ -543,6 +988,7 @@ static IOT_SECTION void tr50_on_message(
  * @param[in]      type                type of data that must be set in map
  */
 static IOT_SECTION void tr50_optional(
+	struct tr50_data *data,
 	iot_json_encoder_t *json,
 	const char *json_key,
 	const iot_options_t *options,
@@ -552,6 +998,8 @@ static IOT_SECTION void tr50_optional(
 /**
  * @brief sends a ping to the server if required (i.e. timeout expired)
  *
+ * @note only used if the mqtt keep alive is disabled
+ *
  * @param[in]      lib                 loaded iot library
  * @param[in]      data                plug-in specific data
  * @param[in]      txn                 transaction status information
@@ -567,9 +1015,110 @@ static IOT_SECTION void tr50_ping(
 	const iot_transaction_t *txn,
 	iot_millisecond_t max_time_out );
 
+/**
+ * @brief schedules the next reconnect attempt
+ *
+ * The delay grows with each failed attempt using decorrelated jitter: a
+ * random delay between the minimum & three times the previous delay,
+ * capped at the maximum.  Devices losing their connection at the same time
+ * (i.e. broker restart) then spread out their reconnect attempts.
+ *
+ * @param[in,out]  data                plug-in specific data
+ * @param[in]      from                time to schedule the attempt from
+ *
+ * @see tr50_connect_check
+ */
+static IOT_SECTION void tr50_reconnect_schedule(
+	struct tr50_data *data,
+	iot_timestamp_t from );
+
+#ifndef IOT_STACK_ONLY
+/**
+ * @brief releases all outbound messages waiting in the queue
+ *
+ * @param[in,out]  data                plug-in specific data
+ *
+ * @see tr50_send_queue_push
+ */
+static IOT_SECTION void tr50_send_queue_clear(
+	struct tr50_data *data );
+
+/**
+ * @brief hands queued outbound messages to the mqtt client, highest
+ *        priority class first
+ *
+ * @note stops at the first message the mqtt client can not accept
+ *
+ * The time the oldest message (other than file transfer requests) has waited
+ * is reported to the file transfers, so they yield bandwidth to the messages.
+ *
+ * @param[in,out]  data                plug-in specific data
+ *
+ * @return the number of messages still waiting in the queue
+ *
+ * @see tr50_send_queue_push
+ */
+static IOT_SECTION size_t tr50_send_queue_flush(
+	struct tr50_data *data );
+
+/**
+ * @brief adds an outbound message to the queue of its priority class
+ *
+ * @note on success the queue takes ownership of @p json, if no encoder is
+ *       given the payload is copied
+ *
+ * @param[in,out]  data                plug-in specific data
+ * @param[in]      send_class          priority class of the message
+ * @param[in]      topic               topic to publish on (static string)
+ * @param[in]      payload             data to send
+ * @param[in]      payload_len         size of the data to send
+ * @param[in]      qos                 mqtt quality of service level
+ * @param[in]      json                (optional) encoder holding the payload
+ * @param[in]      txn                 transaction status information
+ *
+ * @retval IOT_STATUS_BAD_PARAMETER    invalid parameter passed to the function
+ * @retval IOT_STATUS_FULL             budget of the priority class exhausted
+ * @retval IOT_STATUS_NO_MEMORY        failed to allocate the message
+ * @retval IOT_STATUS_SUCCESS          on success
+ *
+ * @see tr50_send_queue_clear
+ * @see tr50_send_queue_flush
+ */
+static IOT_SECTION iot_status_t tr50_send_queue_push(
+	struct tr50_data *data,
+	enum tr50_send_class send_class,
+	const char *topic,
+	const void *payload,
+	size_t payload_len,
+	int qos,
+	iot_json_encoder_t *json,
+	const iot_transaction_t *txn );
+#endif /* ifndef IOT_STACK_ONLY */
+
+/**
+ * @brief copies a string that is not null-terminated (i.e. part of a
+ *        decoded message), truncating it to fit
+ *
+ * @param[out]     dest                destination buffer
+ * @param[in]      dest_len            size of the destination buffer
+ * @param[in]      src                 string to copy
+ * @param[in]      src_len             length of the string to copy
+ *
+ * @return a pointer to the destination buffer
+ */
+static IOT_SECTION char *tr50_slice_copy(
+	char *dest,
+	size_t dest_len,
+	const char *src,
+	size_t src_len );
+
 /**
  * @brief convert a timestamp to a formatted time as in RFC3339
  *
+ * @note the date & time portion is cached in @p data, so time stamps within
+ *       the same second only require formatting the milliseconds
+ *
+ * @param[in,out]  data                (optional) plug-in specific data
  * @param[in]      ts                  time stamp to convert
  * @param[in,out]  out                 output buffer
  * @param[in]      len                 size of the output buffer
@@ -577,6 +1126,7 @@ static IOT_SECTION void tr50_ping(
  * @return a pointer to the output buffer
  */
 static IOT_SECTION char *tr50_strtime(
+	struct tr50_data *data,
 	iot_timestamp_t ts,
 	char *out,
 	size_t len );
@@ -584,6 +1134,10 @@ static IOT_SECTION char *tr50_strtime(
 /**
  * @brief publishes a piece of iot telemetry to the cloud
  *
+ * @note the quality of service is taken from the "qos" option of the
+ * publish, then the "qos" option of the telemetry item, then the
+ * "cloud.telemetry_qos" configuration setting
+ *
  * @param[in]      data                plug-in specific data
  * @param[in]      t                   telemetry object to publish
  * @param[in]      d                   data for telemetry object to publish
@@ -591,6 +1145,8 @@ static IOT_SECTION char *tr50_strtime(
  * @param[in]      options             map containing an optional options set
  *
  * @retval IOT_STATUS_FAILURE          on failure
+ * @retval IOT_STATUS_FULL             too many messages awaiting
+ *                                     acknowledgement
  * @retval IOT_STATUS_SUCCESS          on success
  */
 static IOT_SECTION iot_status_t tr50_telemetry_publish(
@@ -600,28 +1156,82 @@ static IOT_SECTION iot_status_t tr50_telemetry_publish(
 	const iot_transaction_t *txn,
 	const iot_options_t *options );
 
+#ifndef IOT_STACK_ONLY
 /**
- * @brief plug-in function called to terminate the plug-in
+ * @brief finds (or creates) the cached request for a telemetry item
  *
- * @param[in]      lib                 library handle
- * @param[in]      plugin_data         plugin specific data
+ * @note the template mutex must be held when calling this function
  *
- * @retval IOT_STATUS_FAILURE          on failure
- * @retval IOT_STATUS_SUCCESS          on success
+ * @param[in,out]  data                plug-in specific data
+ * @param[in]      t                   telemetry object
+ * @param[in]      create              create the template if not found
  *
- * @see tr50_disable
- * @see tr50_initialize
+ * @return the cached request, NULL if not available
  */
-iot_status_t tr50_terminate(
-	iot_t *lib,
-	void *plugin_data );
+static IOT_SECTION struct tr50_template *tr50_template_find(
+	struct tr50_data *data,
+	const iot_telemetry_t *t,
+	iot_bool_t create );
 
 /**
- * @brief function called to determine the status of a transaction
+ * @brief publishes a numeric telemetry sample using the cached request for
+ *        the telemetry item
  *
  * @param[in]      data                plug-in specific data
- * @param[in]      txn                 transaction
- * @param[in]      options             optional parameters set for request
+ * @param[in]      t                   telemetry object to publish
+ * @param[in]      value               value to publish
+ * @param[in]      qos                 mqtt quality of service level
+ * @param[in]      txn                 transaction status information
+ *
+ * @retval IOT_STATUS_FAILURE          on failure
+ * @retval IOT_STATUS_FULL             too many messages awaiting
+ *                                     acknowledgement
+ * @retval IOT_STATUS_NOT_SUPPORTED    sample must be published by encoding
+ *                                     the full request
+ * @retval IOT_STATUS_SUCCESS          on success
+ */
+static IOT_SECTION iot_status_t tr50_template_publish(
+	struct tr50_data *data,
+	const iot_telemetry_t *t,
+	iot_float64_t value,
+	int qos,
+	const iot_transaction_t *txn );
+
+/**
+ * @brief builds or removes the cached request for a telemetry item
+ *
+ * @param[in,out]  data                plug-in specific data
+ * @param[in]      t                   telemetry object
+ * @param[in]      remove              whether to remove the cached request
+ */
+static IOT_SECTION void tr50_template_update(
+	struct tr50_data *data,
+	const iot_telemetry_t *t,
+	iot_bool_t remove );
+#endif /* ifndef IOT_STACK_ONLY */
+
+/**
+ * @brief plug-in function called to terminate the plug-in
+ *
+ * @param[in]      lib                 library handle
+ * @param[in]      plugin_data         plugin specific data
+ *
+ * @retval IOT_STATUS_FAILURE          on failure
+ * @retval IOT_STATUS_SUCCESS          on success
+ *
+ * @see tr50_disable
+ * @see tr50_initialize
+ */
+iot_status_t tr50_terminate(
+	iot_t *lib,
+	void *plugin_data );
+
+/**
+ * @brief function called to determine the status of a transaction
+ *
+ * @param[in]      data                plug-in specific data
+ * @param[in]      txn                 transaction
+ * @param[in]      options             optional parameters set for request
  *
  * @retval IOT_STATUS_BAD_PARAMETER    invalid parameter passed to the function
  * @retval IOT_STATUS_INVOKED          message has been sent/queue no response
@@ -650,6 +1260,81 @@ static void tr50_transaction_status_set(
 	iot_uint8_t txn_id,
 	enum tr50_transaction_status tx_status );
 
+/**
+ * @brief hands a message to the connection in use, either the mqtt client
+ *        or the local hub
+ *
+ * @param[in]      data                plug-in specific data
+ * @param[in]      topic               topic to publish on
+ * @param[in]      payload             payload to publish
+ * @param[in]      payload_len         size of the payload
+ * @param[in]      qos                 mqtt quality of service level
+ *
+ * @retval IOT_STATUS_BAD_PARAMETER    invalid parameter passed to the function
+ * @retval IOT_STATUS_FULL             too many messages awaiting
+ *                                     acknowledgement
+ * @retval IOT_STATUS_IO_ERROR         connection is not available
+ * @retval IOT_STATUS_SUCCESS          on success
+ */
+static IOT_SECTION iot_status_t tr50_transport_publish(
+	struct tr50_data *data,
+	const char *topic,
+	const void *payload,
+	size_t payload_len,
+	int qos );
+
+
+/**
+ * @brief handles a message received from the cloud
+ *
+ * @param[in,out]  data                plug-in specific data
+ * @param[in]      json                decoder holding the message
+ * @param[in]      root                root object of the message
+ */
+typedef void (*tr50_topic_handler_t)(
+	struct tr50_data *data,
+	iot_json_decoder_t *json,
+	const iot_json_item_t *root );
+
+/** @brief handler for the messages received on each topic */
+static const struct
+{
+	/** @brief topic the message is received on */
+	const char *topic;
+	/** @brief function to handle the message */
+	tr50_topic_handler_t handler;
+} TR50_TOPIC_HANDLERS[] =
+{
+	{ "reply",                   tr50_on_reply },
+	{ "notify/mailbox_activity", tr50_on_mailbox_activity }
+};
+
+/** @brief number of topics with a handler */
+#define TR50_TOPIC_HANDLER_COUNT \
+	( sizeof( TR50_TOPIC_HANDLERS ) / sizeof( TR50_TOPIC_HANDLERS[0] ) )
+
+#ifdef TR50_HUB_SUPPORT
+/** @brief priority class of the commands a hub application may send */
+static const struct tr50_hub_command
+{
+	/** @brief start of the command name */
+	const char *prefix;
+	/** @brief priority class to queue the command in */
+	enum tr50_send_class send_class;
+} TR50_HUB_COMMANDS[] =
+{
+	{ "mailbox.",          TR50_SEND_CONTROL },
+	{ "diag.",             TR50_SEND_CONTROL },
+	{ "alarm.",            TR50_SEND_ALARM },
+	{ "property.",         TR50_SEND_TELEMETRY },
+	{ "location.",         TR50_SEND_TELEMETRY },
+	{ "file.",             TR50_SEND_BULK }
+};
+
+/** @brief number of commands with a priority class */
+#define TR50_HUB_COMMAND_COUNT \
+	( sizeof( TR50_HUB_COMMANDS ) / sizeof( TR50_HUB_COMMANDS[0] ) )
+#endif /* ifdef TR50_HUB_SUPPORT */
 
 iot_status_t tr50_action_complete(
 	struct tr50_data *data,
@@ -671,9 +1356,27 @@ iot_status_t tr50_action_complete(
 				request, "id", IOT_FALSE, IOT_TYPE_STRING, &req_id );
 			if ( data && result == IOT_STATUS_SUCCESS && req_id && *req_id )
 			{
-				char buf[ 512u ];
 				iot_json_encoder_t *json;
-				json = iot_json_encode_initialize( buf, 512u, 0 );
+#ifdef IOT_STACK_ONLY
+				char buf[ 512u ];
+				json = iot_json_encode_initialize( buf, 512u,
+					data->encode_flags );
+#else /* ifdef IOT_STACK_ONLY */
+				iot_bool_t flush = IOT_FALSE;
+
+				/* add to the acknowledgements being held */
+#ifdef IOT_THREAD_SUPPORT
+				os_thread_mutex_lock( &data->mailbox_mutex );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+				json = data->ack_json;
+				if ( !json )
+				{
+					json = tr50_encoder_acquire( data );
+					data->ack_json = json;
+					data->ack_count = 0u;
+					data->ack_time = iot_timestamp_now();
+				}
+#endif /* else IOT_STACK_ONLY */
 				result = IOT_STATUS_NO_MEMORY;
 				if ( json )
 				{
@@ -684,6 +1387,12 @@ iot_status_t tr50_action_complete(
 
 					if ( txn )
 						os_snprintf( id, sizeof(id), "%u", (unsigned int)(*txn) );
+#ifndef IOT_STACK_ONLY
+					/* each command in a message needs its own name */
+					else if ( data->ack_count > 0u )
+						os_snprintf( id, sizeof(id), "cmd%u",
+							data->ack_count );
+#endif /* ifndef IOT_STACK_ONLY */
 					else
 						os_snprintf( id, sizeof(id), "cmd" );
 
@@ -796,15 +1505,28 @@ iot_status_t tr50_action_complete(
 					iot_json_encode_object_end( json );
 					iot_json_encode_object_end( json );
 
-					msg = iot_json_encode_dump( json );
-					result = tr50_mqtt_publish(
-						data,
-						"api",
-						msg,
-						os_strlen( msg ),
-						txn );
-					iot_json_encode_terminate( json );
+#ifdef IOT_STACK_ONLY
+					result = tr50_mqtt_publish_request(
+						data, json, TR50_MQTT_QOS,
+						TR50_SEND_CONTROL, txn );
+#else /* ifdef IOT_STACK_ONLY */
+					/* this request is still counted as in use,
+					 * so send once it is the last one */
+					++data->ack_count;
+					if ( data->ack_count >= data->ack_max ||
+						data->lib->request_queue_free_count <= 1u )
+						flush = IOT_TRUE;
+					result = IOT_STATUS_SUCCESS;
+#endif /* else IOT_STACK_ONLY */
 				}
+#ifndef IOT_STACK_ONLY
+#ifdef IOT_THREAD_SUPPORT
+				os_thread_mutex_unlock( &data->mailbox_mutex );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+				if ( flush != IOT_FALSE )
+					result = tr50_mailbox_ack_flush( data,
+						IOT_TRUE );
+#endif /* ifndef IOT_STACK_ONLY */
 			}
 		}
 	}
@@ -818,46 +1540,53 @@ iot_status_t tr50_alarm_publish(
 	const iot_transaction_t *txn,
 	const iot_options_t *options )
 {
-	iot_status_t result = IOT_STATUS_FAILURE;
-	char id[11u];
-	const char *out_msg;
-
+	iot_status_t result = IOT_STATUS_BAD_PARAMETER;
+	if ( data && alarm && payload )
+	{
+		iot_json_encoder_t *json;
 #ifdef IOT_STACK_ONLY
-	char buffer[1024u];
-	iot_json_encoder_t *const json =
-		iot_json_encode_initialize( buffer, 1024u, 0 );
+		char buffer[1024u];
+		json = iot_json_encode_initialize( buffer, 1024u,
+			data->encode_flags );
 #else
-	iot_json_encoder_t *const json =
-		iot_json_encode_initialize( NULL, 0u, IOT_JSON_FLAG_DYNAMIC );
+		json = tr50_encoder_acquire( data );
 #endif
+		result = IOT_STATUS_NO_MEMORY;
+		if ( json )
+		{
+			char id[11u];
 
-	if ( txn )
-		os_snprintf( id, sizeof(id), "%u", (unsigned int)(*txn) );
-	else
-		os_snprintf( id, sizeof(id), "cmd" );
-	iot_json_encode_object_start( json, id );
-	iot_json_encode_string( json, "command", "alarm.publish" );
-	iot_json_encode_object_start( json, "params" );
-	iot_json_encode_string( json, "thingKey",
-		data->thing_key );
-	iot_json_encode_string( json, "key", alarm->name);
-
-	iot_json_encode_real( json, "state", payload->severity );
-	if( payload->message && *payload->message != '\0')
-		iot_json_encode_string( json, "msg", payload->message );
-
-	/* publish optional arguments */
-	tr50_optional( json, "ts", options, "time_stamp", IOT_TYPE_NULL );
-	tr50_optional( json, NULL, options, "location", IOT_TYPE_LOCATION );
-	tr50_optional( json, "republish", options, "republish", IOT_TYPE_BOOL );
-
-	iot_json_encode_object_end( json );
-	iot_json_encode_object_end( json );
-
-	out_msg = iot_json_encode_dump( json );
-	result = tr50_mqtt_publish(
-		data, "api", out_msg, os_strlen( out_msg ), txn );
-	iot_json_encode_terminate( json );
+			if ( txn )
+				os_snprintf( id, sizeof(id), "%u", (unsigned int)(*txn) );
+			else
+				os_snprintf( id, sizeof(id), "cmd" );
+			iot_json_encode_object_start( json, id );
+			iot_json_encode_string( json, "command", "alarm.publish" );
+			iot_json_encode_object_start( json, "params" );
+			iot_json_encode_string( json, "thingKey",
+				data->thing_key );
+			iot_json_encode_string( json, "key", alarm->name);
+
+			iot_json_encode_real( json, "state", payload->severity );
+			if( payload->message && *payload->message != '\0')
+				iot_json_encode_string( json, "msg",
+					payload->message );
+
+			/* publish optional arguments */
+			tr50_optional( data, json, "ts", options, "time_stamp",
+				IOT_TYPE_NULL );
+			tr50_optional( data, json, NULL, options, "location",
+				IOT_TYPE_LOCATION );
+			tr50_optional( data, json, "republish", options,
+				"republish", IOT_TYPE_BOOL );
+
+			iot_json_encode_object_end( json );
+			iot_json_encode_object_end( json );
+
+			result = tr50_mqtt_publish_request( data, json,
+				TR50_MQTT_QOS, TR50_SEND_ALARM, txn );
+		}
+	}
 	return result;
 }
 
@@ -950,16 +1679,15 @@ iot_status_t tr50_attribute_publish(
 		iot_json_encoder_t *json;
 #ifdef IOT_STACK_ONLY
 		char buffer[1024u];
-		json = iot_json_encode_initialize( buffer, 1024u, 0 );
+		json = iot_json_encode_initialize( buffer, 1024u,
+			data->encode_flags );
 #else
-		json = iot_json_encode_initialize(
-			NULL, 0u, IOT_JSON_FLAG_DYNAMIC );
+		json = tr50_encoder_acquire( data );
 #endif
 		result = IOT_STATUS_NO_MEMORY;
 		if ( json )
 		{
 			char id[11u];
-			const char *msg;
 
 			if ( txn )
 				os_snprintf( id, sizeof(id), "%u", (unsigned int)(*txn) );
@@ -976,18 +1704,16 @@ iot_status_t tr50_attribute_publish(
 			iot_json_encode_string( json, "value",
 				value );
 
-			tr50_optional( json, "ts", options, "time_stamp",
+			tr50_optional( data, json, "ts", options, "time_stamp",
 				IOT_TYPE_NULL );
-			tr50_optional( json, "republish", options, "republish",
+			tr50_optional( data, json, "republish", options, "republish",
 				IOT_TYPE_BOOL );
 
 			iot_json_encode_object_end( json );
 			iot_json_encode_object_end( json );
 
-			msg = iot_json_encode_dump( json );
-			result = tr50_mqtt_publish(
-				data, "api", msg, os_strlen( msg ), txn );
-			iot_json_encode_terminate( json );
+			result = tr50_mqtt_publish_request( data, json,
+				TR50_MQTT_QOS, TR50_SEND_EVENT, txn );
 		}
 	}
 	return result;
@@ -999,22 +1725,56 @@ iot_status_t tr50_check_mailbox(
 	iot_bool_t iteration_check )
 {
 	iot_status_t result = IOT_STATUS_BAD_PARAMETER;
-	iot_bool_t check_mailbox = IOT_TRUE;
-	if ( iteration_check != IOT_FALSE && data )
+	iot_bool_t check_mailbox = IOT_FALSE;
+	if ( data && data->lib )
 	{
 		const iot_timestamp_t now = iot_timestamp_now();
-		check_mailbox = IOT_FALSE;
-		if ( now - data->time_last_mailbox_check >=
-			TR50_MAILBOX_CHECK_INTERVAL )
+#ifdef IOT_THREAD_SUPPORT
+		os_thread_mutex_lock( &data->mailbox_mutex );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+		if ( iteration_check == IOT_FALSE )
 			check_mailbox = IOT_TRUE;
+		else
+		{
+			/* reply to the last check was lost */
+			if ( data->mailbox_waiting != IOT_FALSE &&
+				now - data->time_last_mailbox_check >=
+				TR50_MAILBOX_CHECK_TIMEOUT )
+				data->mailbox_waiting = IOT_FALSE;
+			if ( now - data->time_last_mailbox_check >=
+				data->mailbox_interval )
+			{
+				check_mailbox = IOT_TRUE;
+				data->mailbox_polled = IOT_TRUE;
+			}
+			else if ( data->mailbox_more != IOT_FALSE &&
+				data->mailbox_waiting == IOT_FALSE )
+				check_mailbox = IOT_TRUE;
+		}
+
+		/* only ask for as many requests as there is room for */
+		if ( check_mailbox != IOT_FALSE &&
+			data->lib->request_queue_free_count < IOT_ACTION_QUEUE_MAX )
+		{
+			data->mailbox_limit = (iot_uint8_t)( IOT_ACTION_QUEUE_MAX -
+				data->lib->request_queue_free_count );
+			if ( iteration_check == IOT_FALSE )
+				data->mailbox_polled = IOT_FALSE;
+			data->mailbox_more = IOT_FALSE;
+			data->mailbox_waiting = IOT_TRUE;
+			data->time_last_mailbox_check = now;
+		}
+		else
+			check_mailbox = IOT_FALSE;
+#ifdef IOT_THREAD_SUPPORT
+		os_thread_mutex_unlock( &data->mailbox_mutex );
+#endif /* ifdef IOT_THREAD_SUPPORT */
 	}
 
 	/* check for any outstanding messages on the cloud */
-	if ( check_mailbox != IOT_FALSE && data && data->lib &&
-		data->lib->request_queue_free_count < IOT_ACTION_QUEUE_MAX )
+	if ( check_mailbox != IOT_FALSE )
 	{
 		char id[11u];
-		const char *msg;
 		char req_buf[376u];
 		iot_json_encoder_t *req_json;
 
@@ -1024,27 +1784,26 @@ iot_status_t tr50_check_mailbox(
 		else
 			os_snprintf( id, sizeof(id), "cmd" );
 		req_json = iot_json_encode_initialize(
-			req_buf, 376u, 0 );
+			req_buf, 376u, data->encode_flags );
 		iot_json_encode_object_start( req_json, id );
 		iot_json_encode_string( req_json, "command", "mailbox.check" );
 		iot_json_encode_object_start( req_json, "params" );
 		iot_json_encode_integer( req_json, "limit",
-			IOT_ACTION_QUEUE_MAX - data->lib->request_queue_free_count );
+			data->mailbox_limit );
 		iot_json_encode_bool( req_json, "autoComplete", IOT_FALSE );
+#ifdef TR50_HUB_SUPPORT
+		/* requests through a hub are authenticated as the hub's thing */
+		if ( data->hub_client != IOT_FALSE )
+			iot_json_encode_string( req_json, "thingKey",
+				data->thing_key );
+#endif /* ifdef TR50_HUB_SUPPORT */
 		iot_json_encode_object_end( req_json );
 		iot_json_encode_object_end( req_json );
-		msg = iot_json_encode_dump( req_json );
-		result = IOT_STATUS_FAILURE;
-		if ( msg )
-		{
-			result = tr50_mqtt_publish(
-				data, "api", msg, os_strlen( msg ), txn );
-		}
-		else
+		result = tr50_mqtt_publish_request( data, req_json,
+			TR50_MQTT_QOS, TR50_SEND_CONTROL, txn );
+		if ( result != IOT_STATUS_SUCCESS )
 			IOT_LOG( data->lib, IOT_LOG_ERROR, "%s",
 				"Error failed to obtain device requests" );
-		iot_json_encode_terminate( req_json );
-		data->time_last_mailbox_check = iot_timestamp_now();
 	}
 	return result;
 }
@@ -1067,12 +1826,46 @@ iot_status_t tr50_connect(
 		const char *app_token = NULL;
 		const char *ca_bundle = NULL;
 		iot_mqtt_connect_options_t con_opts = IOT_MQTT_CONNECT_OPTIONS_INIT;
+		const char *encoding = NULL;
+		const char *encoding_topic = NULL;
 		const char *host = NULL;
+#ifdef TR50_HUB_SUPPORT
+		const char *hub_mode = NULL;
+		const char *hub_path = NULL;
+		char hub_path_buf[ PATH_MAX + 1u ];
+#endif /* ifdef TR50_HUB_SUPPORT */
+#ifndef IOT_STACK_ONLY
+		size_t i;
+#endif /* ifndef IOT_STACK_ONLY */
+		iot_int64_t keep_alive_max = TR50_MQTT_KEEP_ALIVE_MAX;
+		iot_int64_t keep_alive_min = TR50_MQTT_KEEP_ALIVE;
+#ifndef IOT_STACK_ONLY
+		iot_int64_t ack_max = TR50_MAILBOX_ACK_MAX;
+#endif /* ifndef IOT_STACK_ONLY */
+		iot_int64_t concurrency = TR50_TRANSFER_CONCURRENCY;
+		iot_int64_t segments = TR50_TRANSFER_SEGMENTS;
+		iot_int64_t mailbox_max = TR50_MAILBOX_CHECK_INTERVAL_MAX /
+			IOT_MILLISECONDS_IN_SECOND;
+		iot_int64_t mailbox_min = TR50_MAILBOX_CHECK_INTERVAL /
+			IOT_MILLISECONDS_IN_SECOND;
+		iot_int64_t max_inflight = 0;
+		const char *mqtt_version = NULL;
 		const char *proxy_type = NULL;
 		iot_int64_t port = 0;
+		iot_int64_t cache_size = 0;
+		iot_int64_t qos = TR50_MQTT_QOS;
+		iot_int64_t rate_limit = 0;
+		iot_int64_t receive_max = 0;
+		iot_int64_t reconnect_max = TR50_TIMEOUT_RECONNECT_MAX_MS /
+			IOT_MILLISECONDS_IN_SECOND;
+		iot_int64_t reconnect_min = TR50_TIMEOUT_RECONNECT_MS /
+			IOT_MILLISECONDS_IN_SECOND;
+		iot_bool_t session_present = IOT_FALSE;
+		iot_int64_t session_expiry = 0;
 		iot_mqtt_ssl_t ssl_conf;
 		iot_mqtt_proxy_t proxy_conf;
 		iot_mqtt_proxy_t *proxy_conf_p = NULL;
+		char thing_key[ TR50_THING_KEY_MAX_LEN + 1u ];
 		iot_bool_t validate_cert = IOT_FALSE;
 
 		iot_config_get( lib, "cloud.host", IOT_FALSE,
@@ -1088,6 +1881,246 @@ iot_status_t tr50_connect(
 		iot_config_get( lib, "validate_cloud_cert", IOT_FALSE,
 			IOT_TYPE_BOOL, &validate_cert );
 
+		/* high-rate telemetry can be sent without acknowledgement,
+		 * while acknowledged messages are limited to a window */
+		iot_config_get( lib, "cloud.telemetry_qos", IOT_FALSE,
+			IOT_TYPE_INT64, &qos );
+		if ( qos < 0 || qos > TR50_MQTT_QOS_MAX )
+			qos = TR50_MQTT_QOS;
+		data->telemetry_qos = (int)qos;
+		iot_config_get( lib, "cloud.max_inflight", IOT_FALSE,
+			IOT_TYPE_INT64, &max_inflight );
+		if ( max_inflight < 0 || max_inflight > 0xFFFF )
+			max_inflight = 0;
+
+		/* mqtt 5 falls back to 3.1.1 if the broker refuses it */
+		iot_config_get( lib, "cloud.mqtt_version", IOT_FALSE,
+			IOT_TYPE_STRING, &mqtt_version );
+		con_opts.version = IOT_MQTT_VERSION_3_1_1;
+		if ( mqtt_version && os_strcmp( mqtt_version, "5" ) == 0 )
+			con_opts.version = IOT_MQTT_VERSION_5;
+		else if ( mqtt_version &&
+			os_strcmp( mqtt_version, "3.1.1" ) != 0 )
+			IOT_LOG( lib, IOT_LOG_WARNING,
+				"tr50 %s: unknown mqtt version \"%s\", using 3.1.1",
+				reason, mqtt_version );
+		iot_config_get( lib, "cloud.session_expiry", IOT_FALSE,
+			IOT_TYPE_INT64, &session_expiry );
+		if ( session_expiry > 0 && session_expiry <= 0xFFFFFFFF )
+			con_opts.session_expiry = (iot_uint32_t)session_expiry;
+		iot_config_get( lib, "cloud.receive_max", IOT_FALSE,
+			IOT_TYPE_INT64, &receive_max );
+		if ( receive_max > 0 && receive_max <= 0xFFFF )
+			con_opts.receive_max = (iot_uint16_t)receive_max;
+		con_opts.topic_alias_max = TR50_MQTT_TOPIC_ALIAS_MAX;
+
+		/* keep alive adapts between these, 0 disables it in favour
+		 * of an application level ping */
+		iot_config_get( lib, "cloud.keep_alive.min", IOT_FALSE,
+			IOT_TYPE_INT64, &keep_alive_min );
+		iot_config_get( lib, "cloud.keep_alive.max", IOT_FALSE,
+			IOT_TYPE_INT64, &keep_alive_max );
+		if ( keep_alive_min < 0 || keep_alive_min > 0xFFFF )
+			keep_alive_min = TR50_MQTT_KEEP_ALIVE;
+		if ( keep_alive_max < keep_alive_min ||
+			keep_alive_max > 0xFFFF )
+			keep_alive_max = keep_alive_min;
+		if ( data->keep_alive_min != (iot_uint16_t)keep_alive_min ||
+			data->keep_alive_max != (iot_uint16_t)keep_alive_max )
+		{
+			data->keep_alive_min = (iot_uint16_t)keep_alive_min;
+			data->keep_alive_max = (iot_uint16_t)keep_alive_max;
+			data->keep_alive = data->keep_alive_min;
+			data->keep_alive_good = data->keep_alive_min;
+			data->keep_alive_limit = data->keep_alive_max;
+			data->keep_alive_next = 0u;
+			data->keep_alive_fails = 0u;
+			data->keep_alive_capped = 0u;
+		}
+
+		/* polling of the mailbox backs off between these while
+		 * notifications of mailbox activity are received; it starts
+		 * over on each connection as notifications may have been
+		 * missed while disconnected */
+		iot_config_get( lib, "cloud.mailbox.poll_min", IOT_FALSE,
+			IOT_TYPE_INT64, &mailbox_min );
+		iot_config_get( lib, "cloud.mailbox.poll_max", IOT_FALSE,
+			IOT_TYPE_INT64, &mailbox_max );
+		if ( mailbox_min < 1 || mailbox_min > 86400 )
+			mailbox_min = TR50_MAILBOX_CHECK_INTERVAL /
+				IOT_MILLISECONDS_IN_SECOND;
+		if ( mailbox_max < mailbox_min || mailbox_max > 86400 )
+			mailbox_max = mailbox_min;
+#ifdef IOT_THREAD_SUPPORT
+		os_thread_mutex_lock( &data->mailbox_mutex );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+		data->mailbox_interval_min = (iot_millisecond_t)mailbox_min *
+			IOT_MILLISECONDS_IN_SECOND;
+		data->mailbox_interval_max = (iot_millisecond_t)mailbox_max *
+			IOT_MILLISECONDS_IN_SECOND;
+		data->mailbox_interval = data->mailbox_interval_min;
+		data->mailbox_waiting = IOT_FALSE;
+#ifndef IOT_STACK_ONLY
+		iot_config_get( lib, "cloud.mailbox.ack_max", IOT_FALSE,
+			IOT_TYPE_INT64, &ack_max );
+		if ( ack_max < 1 || ack_max > 256 )
+			ack_max = TR50_MAILBOX_ACK_MAX;
+		data->ack_max = (unsigned int)ack_max;
+#endif /* ifndef IOT_STACK_ONLY */
+#ifdef IOT_THREAD_SUPPORT
+		os_thread_mutex_unlock( &data->mailbox_mutex );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+
+		/* files transferred at the same time */
+		iot_config_get( lib, "cloud.file_transfer.concurrency",
+			IOT_FALSE, IOT_TYPE_INT64, &concurrency );
+		if ( concurrency < 1 || concurrency > 64 )
+			concurrency = TR50_TRANSFER_CONCURRENCY;
+		tr50_transfer_concurrency_set( data->transfer,
+			(unsigned int)concurrency );
+		iot_config_get( lib, "cloud.file_transfer.segments",
+			IOT_FALSE, IOT_TYPE_INT64, &segments );
+		if ( segments < 1 || segments > TR50_TRANSFER_SEGMENT_MAX )
+			segments = TR50_TRANSFER_SEGMENTS;
+		tr50_transfer_segments_set( data->transfer,
+			(unsigned int)segments );
+
+		/* bandwidth shared by the transfers (bytes per second) */
+		iot_config_get( lib, "cloud.file_transfer.rate_limit",
+			IOT_FALSE, IOT_TYPE_INT64, &rate_limit );
+		if ( rate_limit < 0 )
+			rate_limit = 0;
+		tr50_transfer_bandwidth_set( data->transfer,
+			(iot_uint64_t)rate_limit );
+
+		/* downloads kept to be copied if downloaded again (bytes) */
+		iot_config_get( lib, "cloud.file_transfer.cache_size",
+			IOT_FALSE, IOT_TYPE_INT64, &cache_size );
+		if ( cache_size < 0 )
+			cache_size = 0;
+		tr50_transfer_cache_set( data->transfer,
+			(iot_uint64_t)cache_size );
+
+		/* bounds of the randomized delay between reconnect attempts */
+		iot_config_get( lib, "cloud.reconnect.delay_min", IOT_FALSE,
+			IOT_TYPE_INT64, &reconnect_min );
+		iot_config_get( lib, "cloud.reconnect.delay_max", IOT_FALSE,
+			IOT_TYPE_INT64, &reconnect_max );
+		if ( reconnect_min < 1 || reconnect_min > 86400 )
+			reconnect_min = TR50_TIMEOUT_RECONNECT_MS /
+				IOT_MILLISECONDS_IN_SECOND;
+		if ( reconnect_max < reconnect_min || reconnect_max > 86400 )
+			reconnect_max = reconnect_min;
+		data->reconnect_delay_min = (iot_millisecond_t)reconnect_min *
+			IOT_MILLISECONDS_IN_SECOND;
+		data->reconnect_delay_max = (iot_millisecond_t)reconnect_max *
+			IOT_MILLISECONDS_IN_SECOND;
+
+#ifndef IOT_STACK_ONLY
+		/* budgets for messages queued while the client is busy */
+		for ( i = 0u; i < TR50_SEND_CLASS_COUNT; ++i )
+		{
+			char key[ 48u ];
+			iot_int64_t max_bytes =
+				(iot_int64_t)TR50_SEND_CLASS_INFO[i].max_bytes;
+			iot_int64_t max_count =
+				(iot_int64_t)TR50_SEND_CLASS_INFO[i].max_count;
+			os_snprintf( key, sizeof( key ),
+				"cloud.send_queue.%s.bytes",
+				TR50_SEND_CLASS_INFO[i].name );
+			iot_config_get( lib, key, IOT_FALSE,
+				IOT_TYPE_INT64, &max_bytes );
+			os_snprintf( key, sizeof( key ),
+				"cloud.send_queue.%s.messages",
+				TR50_SEND_CLASS_INFO[i].name );
+			iot_config_get( lib, key, IOT_FALSE,
+				IOT_TYPE_INT64, &max_count );
+#ifdef IOT_THREAD_SUPPORT
+			os_thread_mutex_lock( &data->send_mutex );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+			data->send_queue[i].max_bytes =
+				max_bytes > 0 ? (size_t)max_bytes : 0u;
+			data->send_queue[i].max_count =
+				max_count > 0 ? (size_t)max_count : 0u;
+#ifdef IOT_THREAD_SUPPORT
+			os_thread_mutex_unlock( &data->send_mutex );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+		}
+#endif /* ifndef IOT_STACK_ONLY */
+
+		/* binary encoding is only used when the endpoint is configured
+		 * to accept it, on the topic it is configured with, & the json
+		 * library is able to produce it */
+		data->encode_flags = 0u;
+		iot_config_get( lib, "cloud.encoding", IOT_FALSE,
+			IOT_TYPE_STRING, &encoding );
+		iot_config_get( lib, "cloud.encoding_topic", IOT_FALSE,
+			IOT_TYPE_STRING, &encoding_topic );
+		if ( encoding && os_strcmp( encoding, "cbor" ) == 0 &&
+			( !encoding_topic || *encoding_topic == '\0' ||
+			  os_strlen( encoding_topic ) >
+				TR50_MQTT_TOPIC_BINARY_MAX ) )
+		{
+			IOT_LOG( lib, IOT_LOG_WARNING, "tr50 %s: %s",
+				reason, "binary encoding requires a valid "
+				"cloud.encoding_topic, using json" );
+			encoding = NULL;
+		}
+		if ( encoding && os_strcmp( encoding, "cbor" ) == 0 )
+		{
+			char probe_buf[ 64u ];
+			iot_json_encoder_t *const probe =
+				iot_json_encode_initialize( probe_buf,
+					sizeof( probe_buf ), IOT_JSON_FLAG_BINARY );
+			if ( probe )
+			{
+				data->encode_flags = IOT_JSON_FLAG_BINARY;
+				os_strncpy( data->encode_topic, encoding_topic,
+					TR50_MQTT_TOPIC_BINARY_MAX );
+				data->encode_topic[
+					TR50_MQTT_TOPIC_BINARY_MAX ] = '\0';
+				iot_json_encode_terminate( probe );
+			}
+			else
+				IOT_LOG( lib, IOT_LOG_WARNING, "tr50 %s: %s",
+					reason, "binary encoding not supported, "
+					"using json" );
+		}
+		else if ( encoding && os_strcmp( encoding, "json" ) != 0 )
+			IOT_LOG( lib, IOT_LOG_WARNING,
+				"tr50 %s: unknown encoding \"%s\", using json",
+				reason, encoding );
+
+#ifdef TR50_HUB_SUPPORT
+		/* applications on the device can share a single connection:
+		 * "server" owns it, "client" connects through the server */
+		iot_config_get( lib, "cloud.hub.mode", IOT_FALSE,
+			IOT_TYPE_STRING, &hub_mode );
+		iot_config_get( lib, "cloud.hub.path", IOT_FALSE,
+			IOT_TYPE_STRING, &hub_path );
+		if ( hub_mode && !hub_path )
+		{
+			const size_t dir_len = iot_directory_name_get(
+				IOT_DIR_RUNTIME, hub_path_buf, PATH_MAX );
+			if ( dir_len < PATH_MAX )
+			{
+				os_snprintf( &hub_path_buf[dir_len],
+					PATH_MAX - dir_len, "%c%s",
+					OS_DIR_SEP, TR50_HUB_SOCKET_NAME );
+				hub_path_buf[ PATH_MAX ] = '\0';
+				hub_path = hub_path_buf;
+			}
+		}
+		if ( hub_mode && os_strcmp( hub_mode, "server" ) != 0 &&
+			os_strcmp( hub_mode, "client" ) != 0 )
+		{
+			IOT_LOG( lib, IOT_LOG_WARNING,
+				"tr50 %s: unknown hub mode \"%s\", ignoring",
+				reason, hub_mode );
+			hub_mode = NULL;
+		}
+#endif /* ifdef TR50_HUB_SUPPORT */
+
 		os_memzero( &ssl_conf, sizeof( iot_mqtt_ssl_t ) );
 		ssl_conf.ca_path = ca_bundle;
 		ssl_conf.insecure = !validate_cert;
@@ -1120,43 +2153,128 @@ iot_status_t tr50_connect(
 			IOT_LOG( lib, IOT_LOG_ERROR, "tr50 %s: %s",
 				reason, "no application token provided" );
 
-		os_snprintf( data->thing_key, TR50_THING_KEY_MAX_LEN,
+		os_snprintf( thing_key, TR50_THING_KEY_MAX_LEN,
 			"%s-%s", lib->device_id, iot_id( lib ) );
-		data->thing_key[ TR50_THING_KEY_MAX_LEN ] = '\0';
+		thing_key[ TR50_THING_KEY_MAX_LEN ] = '\0';
+		if ( os_strcmp( thing_key, data->thing_key ) != 0 )
+		{
+#if defined( IOT_THREAD_SUPPORT ) && !defined( IOT_STACK_ONLY )
+			os_thread_mutex_lock( &data->template_mutex );
+#endif /* if defined( IOT_THREAD_SUPPORT ) && !defined( IOT_STACK_ONLY ) */
+			os_strncpy( data->thing_key, thing_key,
+				TR50_THING_KEY_MAX_LEN + 1u );
+#ifndef IOT_STACK_ONLY
+			/* cached telemetry requests contain the thing key */
+			++data->template_generation;
+#endif /* ifndef IOT_STACK_ONLY */
+#if defined( IOT_THREAD_SUPPORT ) && !defined( IOT_STACK_ONLY )
+			os_thread_mutex_unlock( &data->template_mutex );
+#endif /* if defined( IOT_THREAD_SUPPORT ) && !defined( IOT_STACK_ONLY ) */
+		}
 
 		con_opts.client_id = iot_id( lib );
 		con_opts.host = host;
 		con_opts.port = (iot_uint16_t)port;
-		con_opts.keep_alive = TR50_MQTT_KEEP_ALIVE;
+		/* a longer keep alive waits for the connection to be made */
+		if ( data->keep_alive_next > 0u )
+		{
+			data->keep_alive = data->keep_alive_next;
+			data->keep_alive_next = 0u;
+		}
+		con_opts.keep_alive = data->keep_alive;
 		con_opts.proxy_conf = proxy_conf_p;
 		con_opts.ssl_conf = &ssl_conf;
 		con_opts.username = data->thing_key;
 		con_opts.password = app_token;
-		con_opts.version = IOT_MQTT_VERSION_3_1_1;
-		if ( is_reconnect == IOT_FALSE )
+		con_opts.max_inflight = (iot_uint16_t)max_inflight;
+#ifdef TR50_HUB_SUPPORT
+		if ( data->hub_client != IOT_FALSE )
+		{
+			tr50_hub_close( data->hub );
+			data->hub = NULL;
+			data->hub_client = IOT_FALSE;
+		}
+		if ( hub_mode && os_strcmp( hub_mode, "client" ) == 0 &&
+			hub_path && !data->mqtt )
 		{
-			data->mqtt = iot_mqtt_connect( &con_opts, max_time_out );
-			if ( data->mqtt )
+			data->hub = tr50_hub_connect( hub_path,
+				tr50_on_message, data );
+			if ( data->hub )
+			{
+				/* hub forwards requests as text (json) */
+				data->hub_client = IOT_TRUE;
+				data->encode_flags = 0u;
 				result = IOT_STATUS_SUCCESS;
+			}
+			else
+				IOT_LOG( lib, IOT_LOG_WARNING,
+					"tr50 %s: no hub listening on %s, "
+					"connecting directly", reason,
+					hub_path );
 		}
-		else
+		if ( data->hub_client == IOT_FALSE )
+#endif /* ifdef TR50_HUB_SUPPORT */
 		{
-			result = iot_mqtt_reconnect( data->mqtt, &con_opts,
-				max_time_out );
+			if ( is_reconnect == IOT_FALSE || !data->mqtt )
+			{
+				data->mqtt = iot_mqtt_connect( &con_opts,
+					max_time_out );
+				if ( data->mqtt )
+					result = IOT_STATUS_SUCCESS;
+			}
+			else
+			{
+				result = iot_mqtt_reconnect( data->mqtt,
+					&con_opts, max_time_out );
+			}
 		}
 
 		data->time_last_msg_received = iot_timestamp_now();
 		data->ping_miss_count = 0u;
+#ifdef TR50_HUB_SUPPORT
+		if ( data->hub_client != IOT_FALSE )
+		{
+			data->reconnect_count = 1u;
+			data->reconnect_delay = 0u;
+			data->reconnect_time = 0u;
+			data->connection_lost_msg_count = 1u;
+			IOT_LOG( lib, IOT_LOG_INFO, "tr50 %s: %s %s",
+				reason, "successfully through hub", hub_path );
+			result = tr50_check_mailbox( data, txn, IOT_FALSE );
+		}
+		else
+#endif /* ifdef TR50_HUB_SUPPORT */
 		if ( data->mqtt && result == IOT_STATUS_SUCCESS )
 		{
 			data->reconnect_count = 1u;
+			data->reconnect_delay = 0u;
+			data->reconnect_time = 0u;
 			data->connection_lost_msg_count = 1u;
+			data->keep_alive_since = iot_timestamp_now();
 			iot_mqtt_set_user_data( data->mqtt, data );
 			iot_mqtt_set_message_callback( data->mqtt,
 				tr50_on_message );
-			iot_mqtt_subscribe( data->mqtt, "reply/#", TR50_MQTT_QOS );
+
+			/* a resumed session keeps its subscriptions */
+			iot_mqtt_session_status( data->mqtt, NULL,
+				&session_present );
+			if ( session_present == IOT_FALSE )
+				iot_mqtt_subscribe( data->mqtt, "reply/#",
+					TR50_MQTT_QOS );
 			IOT_LOG( lib, IOT_LOG_INFO, "tr50 %s: %s",
 				reason, "successfully" );
+#ifdef TR50_HUB_SUPPORT
+			if ( hub_mode && os_strcmp( hub_mode, "server" ) == 0 &&
+				hub_path && !data->hub )
+			{
+				data->hub = tr50_hub_listen( hub_path,
+					tr50_hub_forward, data );
+				if ( !data->hub )
+					IOT_LOG( lib, IOT_LOG_ERROR,
+						"tr50 %s: failed to listen on %s",
+						reason, hub_path );
+			}
+#endif /* ifdef TR50_HUB_SUPPORT */
 			result = tr50_check_mailbox( data, txn, IOT_FALSE );
 		}
 		else if ( is_reconnect == IOT_FALSE ) /* show on connect only */
@@ -1176,6 +2294,39 @@ iot_status_t tr50_connect_check(
 {
 	iot_status_t result = IOT_STATUS_BAD_PARAMETER;
 
+#ifdef TR50_HUB_SUPPORT
+	/* hub went away: connect to its replacement, or to the cloud */
+	if ( lib && data && ( data->hub_client != IOT_FALSE ||
+		( !data->mqtt && data->reconnect_count > 0u ) ) )
+	{
+		result = IOT_STATUS_SUCCESS;
+		if ( tr50_hub_connected( data->hub ) == IOT_FALSE &&
+			data->reconnect_count > 0u )
+		{
+			const iot_timestamp_t now = iot_timestamp_now();
+			if ( data->reconnect_time == 0u )
+			{
+				IOT_LOG( lib, IOT_LOG_WARNING, "%s",
+					"tr50: connection to hub lost" );
+				tr50_reconnect_schedule( data, now );
+			}
+			result = IOT_STATUS_FAILURE;
+			if ( now >= data->reconnect_time )
+			{
+				++data->reconnect_count;
+				if ( max_time_out == 0u )
+					max_time_out =
+						IOT_MILLISECONDS_IN_SECOND;
+				result = tr50_connect( lib, data, txn,
+					max_time_out, IOT_TRUE );
+				if ( result != IOT_STATUS_SUCCESS )
+					tr50_reconnect_schedule( data,
+						iot_timestamp_now() );
+			}
+		}
+	}
+	else
+#endif /* ifdef TR50_HUB_SUPPORT */
 	if ( lib && data && data->mqtt )
 	{
 		iot_bool_t connected = IOT_TRUE;
@@ -1193,9 +2344,20 @@ iot_status_t tr50_connect_check(
 		{
 			result = IOT_STATUS_FAILURE; /* not connected */
 
+			/* first attempt is also delayed by a random amount,
+			 * so devices dropped together don't return together */
+			if ( data->reconnect_count > 0u &&
+				data->reconnect_time == 0u )
+			{
+				tr50_keep_alive_update( lib, data,
+					IOT_FALSE );
+				tr50_reconnect_schedule( data,
+					time_stamp_changed );
+			}
+
 			/* attempt to reconnect, if time out condition is met */
-			if ( data->reconnect_count > 0u && time_stamp_diff >=
-			     ( data->reconnect_count * TR50_TIMEOUT_RECONNECT_MS ) )
+			if ( data->reconnect_count > 0u &&
+				iot_timestamp_now() >= data->reconnect_time )
 			{
 				++data->reconnect_count;
 
@@ -1205,6 +2367,9 @@ iot_status_t tr50_connect_check(
 
 				result = tr50_connect( lib, data, txn,
 					max_time_out, IOT_TRUE );
+				if ( result != IOT_STATUS_SUCCESS )
+					tr50_reconnect_schedule( data,
+						iot_timestamp_now() );
 				if ( result == IOT_STATUS_SUCCESS ||
 				   ( time_stamp_diff >=
 				     data->connection_lost_msg_count *
@@ -1217,10 +2382,81 @@ iot_status_t tr50_connect_check(
 				}
 			}
 		}
+		else if ( result == IOT_STATUS_SUCCESS )
+			tr50_keep_alive_update( lib, data, IOT_TRUE );
+	}
+	return result;
+}
+
+#ifndef IOT_STACK_ONLY
+iot_json_decoder_t *tr50_decoder_acquire(
+	struct tr50_data *data )
+{
+	iot_json_decoder_t *result = NULL;
+	if ( data )
+	{
+		size_t i;
+#ifdef IOT_THREAD_SUPPORT
+		os_thread_mutex_lock( &data->decoder_mutex );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+		for ( i = 0u; !result && i < TR50_DECODER_POOL_MAX; ++i )
+		{
+			if ( data->decoder_in_use[i] == IOT_FALSE )
+			{
+				if ( !data->decoder_pool[i] )
+					data->decoder_pool[i] =
+						iot_json_decode_initialize( NULL, 0u,
+							IOT_JSON_FLAG_DYNAMIC );
+				if ( data->decoder_pool[i] )
+				{
+					data->decoder_in_use[i] = IOT_TRUE;
+					result = data->decoder_pool[i];
+				}
+			}
+		}
+#ifdef IOT_THREAD_SUPPORT
+		os_thread_mutex_unlock( &data->decoder_mutex );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+
+		/* pool is exhausted, use a temporary decoder */
+		if ( !result )
+			result = iot_json_decode_initialize( NULL, 0u,
+				IOT_JSON_FLAG_DYNAMIC );
 	}
 	return result;
 }
 
+void tr50_decoder_release(
+	struct tr50_data *data,
+	iot_json_decoder_t *decoder )
+{
+	if ( data && decoder )
+	{
+		size_t i;
+		iot_bool_t found = IOT_FALSE;
+#ifdef IOT_THREAD_SUPPORT
+		os_thread_mutex_lock( &data->decoder_mutex );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+		for ( i = 0u; !found && i < TR50_DECODER_POOL_MAX; ++i )
+		{
+			if ( data->decoder_pool[i] == decoder )
+			{
+				iot_json_decode_reset( decoder );
+				data->decoder_in_use[i] = IOT_FALSE;
+				found = IOT_TRUE;
+			}
+		}
+#ifdef IOT_THREAD_SUPPORT
+		os_thread_mutex_unlock( &data->decoder_mutex );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+
+		/* not from the pool, free the temporary decoder */
+		if ( found == IOT_FALSE )
+			iot_json_decode_terminate( decoder );
+	}
+}
+#endif /* ifndef IOT_STACK_ONLY */
+
 iot_status_t tr50_disconnect(
 	iot_t *lib,
 	struct tr50_data *data )
@@ -1230,7 +2466,25 @@ iot_status_t tr50_disconnect(
 	if ( data )
 	{
 		data->reconnect_count = 0u; /* don't reconnect */
-		result = iot_mqtt_disconnect( data->mqtt );
+#ifndef IOT_STACK_ONLY
+		/* acknowledgements being held go out before closing */
+		tr50_mailbox_ack_flush( data, IOT_TRUE );
+#endif /* ifndef IOT_STACK_ONLY */
+#ifdef TR50_HUB_SUPPORT
+		/* stop sharing the connection before closing it */
+		if ( data->hub )
+		{
+			tr50_hub_close( data->hub );
+			data->hub = NULL;
+		}
+		if ( data->hub_client != IOT_FALSE )
+		{
+			data->hub_client = IOT_FALSE;
+			result = IOT_STATUS_SUCCESS;
+		}
+		else
+#endif /* ifdef TR50_HUB_SUPPORT */
+			result = iot_mqtt_disconnect( data->mqtt );
 	}
 	return result;
 }
@@ -1262,29 +2516,112 @@ iot_status_t tr50_enable(
 	return IOT_STATUS_SUCCESS;
 }
 
-iot_status_t tr50_event_publish(
-	struct tr50_data *data,
-	const char *message,
-	const iot_transaction_t *txn,
-	const iot_options_t *options )
+#ifndef IOT_STACK_ONLY
+iot_json_encoder_t *tr50_encoder_acquire(
+	struct tr50_data *data )
 {
-	iot_status_t result = IOT_STATUS_BAD_PARAMETER;
-	if ( data && message )
+	iot_json_encoder_t *result = NULL;
+	if ( data )
 	{
-		iot_json_encoder_t *json;
-#ifdef IOT_STACK_ONLY
-		char buffer[1024u];
-		json = iot_json_encode_initialize( buffer, 1024u, 0 );
+		const unsigned int flags =
+			IOT_JSON_FLAG_DYNAMIC | data->encode_flags;
+		size_t i;
+#ifdef IOT_THREAD_SUPPORT
+		os_thread_mutex_lock( &data->encoder_mutex );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+		for ( i = 0u; !result && i < TR50_ENCODER_POOL_MAX; ++i )
+		{
+			if ( data->encoder_in_use[i] == IOT_FALSE )
+			{
+				/* encoding changed since the encoder was created */
+				if ( data->encoder_pool[i] &&
+					data->encoder_flags[i] != flags )
+				{
+					iot_json_encode_terminate(
+						data->encoder_pool[i] );
+					data->encoder_pool[i] = NULL;
+				}
+				if ( !data->encoder_pool[i] )
+				{
+					data->encoder_pool[i] =
+						iot_json_encode_initialize( NULL, 0u,
+							flags );
+					data->encoder_flags[i] = flags;
+				}
+				if ( data->encoder_pool[i] )
+				{
+					data->encoder_in_use[i] = IOT_TRUE;
+					result = data->encoder_pool[i];
+				}
+			}
+		}
+#ifdef IOT_THREAD_SUPPORT
+		os_thread_mutex_unlock( &data->encoder_mutex );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+
+		/* pool is exhausted, use a temporary encoder */
+		if ( !result )
+			result = iot_json_encode_initialize( NULL, 0u, flags );
+	}
+	return result;
+}
+
+void tr50_encoder_release(
+	struct tr50_data *data,
+	iot_json_encoder_t *encoder )
+{
+	if ( encoder )
+	{
+		size_t i;
+		iot_bool_t found = IOT_FALSE;
+		if ( data )
+		{
+#ifdef IOT_THREAD_SUPPORT
+			os_thread_mutex_lock( &data->encoder_mutex );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+			for ( i = 0u; !found && i < TR50_ENCODER_POOL_MAX; ++i )
+			{
+				if ( data->encoder_pool[i] == encoder )
+				{
+					iot_json_encode_reset( encoder );
+					data->encoder_in_use[i] = IOT_FALSE;
+					found = IOT_TRUE;
+				}
+			}
+#ifdef IOT_THREAD_SUPPORT
+			os_thread_mutex_unlock( &data->encoder_mutex );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+		}
+
+		/* not from the pool, free the temporary encoder */
+		if ( found == IOT_FALSE )
+			iot_json_encode_terminate( encoder );
+	}
+}
+#endif /* ifndef IOT_STACK_ONLY */
+
+iot_status_t tr50_event_publish(
+	struct tr50_data *data,
+	const char *message,
+	const iot_transaction_t *txn,
+	const iot_options_t *options )
+{
+	iot_status_t result = IOT_STATUS_BAD_PARAMETER;
+	if ( data && message )
+	{
+		iot_json_encoder_t *json;
+#ifdef IOT_STACK_ONLY
+		char buffer[1024u];
+		json = iot_json_encode_initialize( buffer, 1024u,
+			data->encode_flags );
 #else
-		json = iot_json_encode_initialize(
-			NULL, 0u, IOT_JSON_FLAG_DYNAMIC );
+		json = tr50_encoder_acquire( data );
 #endif
 		result = IOT_STATUS_NO_MEMORY;
 		if ( json )
 		{
 			char id[11u];
 			iot_int64_t level;
-			const char *msg;
 
 			if ( txn )
 				os_snprintf( id, sizeof(id), "%u", (unsigned int)(*txn) );
@@ -1299,9 +2636,9 @@ iot_status_t tr50_event_publish(
 				message );
 
 			/* publish optional arguments */
-			tr50_optional( json, "ts", options, "time_stamp",
+			tr50_optional( data, json, "ts", options, "time_stamp",
 				IOT_TYPE_NULL );
-			tr50_optional( json, "global", options, "global",
+			tr50_optional( data, json, "global", options, "global",
 				IOT_TYPE_BOOL );
 
 			if ( iot_options_get_integer( options,
@@ -1319,10 +2656,8 @@ iot_status_t tr50_event_publish(
 			iot_json_encode_object_end( json );
 			iot_json_encode_object_end( json );
 
-			msg = iot_json_encode_dump( json );
-			result = tr50_mqtt_publish(
-				data, "api", msg, os_strlen( msg ), txn );
-			iot_json_encode_terminate( json );
+			result = tr50_mqtt_publish_request( data, json,
+				TR50_MQTT_QOS, TR50_SEND_EVENT, txn );
 		}
 	}
 	return result;
@@ -1341,11 +2676,12 @@ iot_status_t tr50_execute(
 {
 	iot_status_t result = IOT_STATUS_SUCCESS;
 	struct tr50_data *const data = plugin_data;
-	if ( op != IOT_OPERATION_ITERATION )
+	if ( op == IOT_OPERATION_ITERATION ||
+		op == IOT_OPERATION_LOOP_DISPATCH )
+		tr50_connect_check( lib, data, txn, max_time_out );
+	else if ( op != IOT_OPERATION_LOOP_POLL )
 		IOT_LOG( lib, IOT_LOG_TRACE, "tr50: %s %d.%d",
 			"execute", (int)op, (int)*step );
-	else
-		tr50_connect_check( lib, data, txn, max_time_out );
 
 	if ( txn )
 		tr50_transaction_status_set( data, (iot_uint8_t)(*txn),
@@ -1377,13 +2713,63 @@ iot_status_t tr50_execute(
 					(const struct iot_data*)value,
 					txn, options );
 				break;
+#ifndef IOT_STACK_ONLY
+			case IOT_OPERATION_TELEMETRY_REGISTER:
+			case IOT_OPERATION_TELEMETRY_DEREGISTER:
+				tr50_template_update( data,
+					(const iot_telemetry_t*)item,
+					op == IOT_OPERATION_TELEMETRY_DEREGISTER );
+				break;
+#endif /* ifndef IOT_STACK_ONLY */
 			case IOT_OPERATION_ITERATION:
-				if ( data )
+			case IOT_OPERATION_LOOP_DISPATCH:
+				if ( op == IOT_OPERATION_LOOP_DISPATCH )
+					tr50_loop_dispatch( data,
+						(const struct iot_loop_poll *)value );
+#ifdef TR50_HUB_SUPPORT
+				else if ( data && data->hub_client != IOT_FALSE )
+					tr50_hub_loop( data->hub, max_time_out );
+#endif /* ifdef TR50_HUB_SUPPORT */
+				else if ( data )
 					iot_mqtt_loop( data->mqtt, max_time_out );
+#ifdef TR50_HUB_SUPPORT
+				/* applications sharing this connection */
+				if ( data && data->hub && ( data->hub_client ==
+					IOT_FALSE || op == IOT_OPERATION_LOOP_DISPATCH ) )
+					tr50_hub_loop( data->hub, 0u );
+#endif /* ifdef TR50_HUB_SUPPORT */
+#ifndef IOT_STACK_ONLY
+				tr50_send_queue_flush( data );
+#endif /* ifndef IOT_STACK_ONLY */
 				tr50_ping( lib, data, txn, max_time_out );
-				tr50_file_queue_check( data );
+				if ( data )
+					tr50_transfer_loop( data->transfer );
+#ifndef IOT_STACK_ONLY
+				tr50_mailbox_ack_flush( data, IOT_FALSE );
+#endif /* ifndef IOT_STACK_ONLY */
 				tr50_check_mailbox( data, NULL, IOT_TRUE );
 				break;
+			case IOT_OPERATION_LOOP_POLL:
+			{
+				/* descriptors are filled in, the value passed
+				 * is only const for the other operations */
+				union
+				{
+					const void *in;
+					struct iot_loop_poll *out;
+				} loop_poll;
+				loop_poll.in = value;
+				tr50_loop_poll( data, loop_poll.out );
+#ifdef TR50_HUB_SUPPORT
+				if ( data && data->hub )
+					tr50_hub_loop_poll( data->hub,
+						loop_poll.out );
+#endif /* ifdef TR50_HUB_SUPPORT */
+				if ( data && data->transfer )
+					tr50_transfer_loop_poll( data->transfer,
+						loop_poll.out );
+				break;
+			}
 			case IOT_OPERATION_ACTION_COMPLETE:
 				result = tr50_action_complete( data,
 					(const iot_action_t*)item,
@@ -1422,6 +2808,41 @@ iot_status_t tr50_execute(
 	return result;
 }
 
+iot_status_t tr50_file_checksum_set(
+	struct tr50_data *data,
+	iot_uint32_t transfer_id,
+	const iot_options_t *options )
+{
+	iot_status_t result = IOT_STATUS_SUCCESS;
+	const char *checksum = NULL;
+	iot_checksum_type_t type = IOT_CHECKSUM_TYPE_SHA256;
+
+	if ( iot_options_get_string( options, "sha256", IOT_FALSE,
+		&checksum ) != IOT_STATUS_SUCCESS )
+	{
+		checksum = NULL;
+		type = IOT_CHECKSUM_TYPE_MD5;
+		if ( iot_options_get_string( options, "md5", IOT_FALSE,
+			&checksum ) != IOT_STATUS_SUCCESS )
+			checksum = NULL;
+	}
+
+	if ( checksum )
+	{
+		result = tr50_transfer_checksum_set( data->transfer,
+			transfer_id, type, checksum );
+		if ( result != IOT_STATUS_SUCCESS )
+		{
+			IOT_LOG( data->lib, IOT_LOG_ERROR,
+				"Invalid %s checksum: %s",
+				( type == IOT_CHECKSUM_TYPE_MD5 ) ?
+					"md5" : "sha256", checksum );
+			result = IOT_STATUS_BAD_PARAMETER;
+		}
+	}
+	return result;
+}
+
 iot_status_t tr50_file_request_send(
 	struct tr50_data *data,
 	iot_operation_t op,
@@ -1432,25 +2853,41 @@ iot_status_t tr50_file_request_send(
 	iot_status_t result = IOT_STATUS_BAD_PARAMETER;
 	if ( data && file_transfer )
 	{
-		result = IOT_STATUS_FULL;
-		if ( data->file_transfer_count < TR50_FILE_TRANSFER_MAX )
+		iot_uint32_t transfer_id = 0u;
+		result = tr50_transfer_add( data->transfer, op, file_transfer,
+			&transfer_id );
+		if ( result == IOT_STATUS_SUCCESS )
+		{
+			iot_int64_t rate_limit = 0;
+
+			/* bytes per second, for this transfer */
+			if ( iot_options_get_integer( options, "rate_limit",
+				IOT_TRUE, &rate_limit ) == IOT_STATUS_SUCCESS &&
+				rate_limit > 0 )
+				tr50_transfer_rate_set( data->transfer,
+					transfer_id, (iot_uint64_t)rate_limit );
+		}
+		if ( result == IOT_STATUS_SUCCESS &&
+			op == IOT_OPERATION_FILE_DOWNLOAD )
+		{
+			result = tr50_file_checksum_set( data, transfer_id,
+				options );
+			if ( result != IOT_STATUS_SUCCESS )
+				tr50_transfer_cancel( data->transfer,
+					transfer_id, IOT_FALSE );
+		}
+
+		if ( result == IOT_STATUS_SUCCESS )
 		{
 			char buf[ 512u ];
 			const char *msg;
-			struct tr50_file_transfer transfer;
+			iot_bool_t use_global_store = IOT_FALSE;
 
 			iot_json_encoder_t *json =
 				iot_json_encode_initialize( buf, sizeof( buf ), 0u);
 
-			os_memzero( &transfer, sizeof( struct tr50_file_transfer ) );
-			os_strncpy( transfer.name, file_transfer->name, PATH_MAX );
-			os_strncpy( transfer.path, file_transfer->path, PATH_MAX );
-			transfer.callback = file_transfer->callback;
-			transfer.user_data = file_transfer->user_data;
-			transfer.op = op;
-			transfer.use_global_store = IOT_FALSE;
 			iot_options_get_bool( options, "global", IOT_FALSE,
-				&transfer.use_global_store );
+				&use_global_store );
 
 			result = IOT_STATUS_FAILURE;
 			if ( json )
@@ -1458,14 +2895,15 @@ iot_status_t tr50_file_request_send(
 				char id[11u];
 				char global_name[PATH_MAX];
 
-				/* create json string request for file.get/file.put */
-				os_snprintf( id, sizeof(id), "%u",
-					(data->file_transfer_count +
-					TR50_FILE_REQUEST_ID_OFFSET) );
+				/* create json string request for file.get/file.put,
+				 * the reply is matched to the transfer by its id */
+				os_snprintf( id, sizeof(id), "%lu",
+					(unsigned long)transfer_id +
+					TR50_FILE_REQUEST_ID_OFFSET );
 
 				iot_json_encode_object_start( json, id );
 				iot_json_encode_string( json, "command",
-					(transfer.op == IOT_OPERATION_FILE_UPLOAD)?
+					(op == IOT_OPERATION_FILE_UPLOAD)?
 						"file.put" : "file.get" );
 
 				iot_json_encode_object_start( json, "params" );
@@ -1473,24 +2911,26 @@ iot_status_t tr50_file_request_send(
 				/* Use the global file store if true */
 
 				iot_json_encode_bool( json, "global",
-					transfer.use_global_store);
+					use_global_store);
 
 				/* prepend a thing key if this is
 				 * global, but strip any path information in the file.  It is not
 				 * valid to upload a file with a path name */
-				if ( transfer.op == IOT_OPERATION_FILE_UPLOAD &&
-					transfer.use_global_store == IOT_TRUE )
+				if ( op == IOT_OPERATION_FILE_UPLOAD &&
+					use_global_store == IOT_TRUE )
 				{
 					os_snprintf( global_name, PATH_MAX,
-						"%s_%s", data->thing_key, transfer.name);
+						"%s_%s", data->thing_key,
+						file_transfer->name );
 					iot_json_encode_string( json, "fileName", global_name );
 				}
 				else
-					iot_json_encode_string( json, "fileName", transfer.name );
+					iot_json_encode_string( json, "fileName",
+						file_transfer->name );
 
 				iot_json_encode_string( json, "thingKey", data->thing_key );
 
-				if ( transfer.op == IOT_OPERATION_FILE_UPLOAD )
+				if ( op == IOT_OPERATION_FILE_UPLOAD )
 					iot_json_encode_bool( json, "public", IOT_FALSE );
 
 				iot_json_encode_object_end( json );
@@ -1499,20 +2939,10 @@ iot_status_t tr50_file_request_send(
 				msg = iot_json_encode_dump( json );
 
 				/* publish */
-				result = iot_mqtt_publish( data->mqtt, "api",
+				result = tr50_mqtt_publish( data, "api",
 					msg, os_strlen( msg ), TR50_MQTT_QOS,
-					IOT_FALSE, NULL );
-				if ( result == IOT_STATUS_SUCCESS )
-				{
-					/* add it to the queue */
-					os_memcpy(
-						&data->file_transfer_queue[ data->file_transfer_count ],
-						&transfer, sizeof( struct tr50_file_transfer ) );
-					data->file_transfer_queue[ data->file_transfer_count ].plugin_data =
-						(void*)data;
-					++data->file_transfer_count;
-				}
-				else
+					TR50_SEND_BULK, NULL, NULL );
+				if ( result != IOT_STATUS_SUCCESS )
 					IOT_LOG( data->lib, IOT_LOG_ERROR, "%s",
 						"Failed send file request" );
 
@@ -1521,482 +2951,443 @@ iot_status_t tr50_file_request_send(
 			else
 				IOT_LOG( data->lib, IOT_LOG_ERROR, "%s",
 					"Failed to encode json" );
+
+			/* the cloud will never reply, so drop the transfer */
+			if ( result != IOT_STATUS_SUCCESS )
+				tr50_transfer_cancel( data->transfer,
+					transfer_id, IOT_FALSE );
 		}
 		else
 			IOT_LOG( data->lib, IOT_LOG_ERROR, "%s",
-				"Maximum file transfer reached" );
+				"Failed to queue file transfer" );
 	}
 	return result;
 }
-
-#ifdef IOT_THREAD_SUPPORT
-OS_THREAD_DECL tr50_file_transfer(
-	void* arg )
+#ifdef TR50_HUB_SUPPORT
+enum tr50_send_class tr50_hub_classify(
+	const iot_json_decoder_t *json,
+	const iot_json_item_t *root )
 {
-	iot_status_t result = IOT_STATUS_BAD_PARAMETER;
-	iot_bool_t remove_from_queue = IOT_FALSE;
-	struct tr50_file_transfer *const transfer =
-		(struct tr50_file_transfer*)arg;
-	if ( transfer )
+	enum tr50_send_class result = TR50_SEND_CLASS_COUNT;
+	const iot_json_object_iterator_t *iter =
+		iot_json_decode_object_iterator( json, root );
+	while ( iter )
 	{
-		const struct tr50_data *const data =
-			(const struct tr50_data * )transfer->plugin_data;
-		char file_path[ PATH_MAX +1u ];
-		transfer->lib_curl = curl_easy_init();
-		if ( transfer->lib_curl && data )
-		{
-			const char *ca_bundle_file = NULL;
-			CURLcode curl_result = CURLE_FAILED_INIT;
-			os_file_t file_handle;
-			iot_bool_t validate_cert = IOT_FALSE;
-			int retry = 0;
-			iot_bool_t append_mode = IOT_FALSE;
-
-			if ( transfer->op == IOT_OPERATION_FILE_UPLOAD )
-				os_strncpy( file_path, transfer->path, PATH_MAX );
-			else
-				os_snprintf( file_path, PATH_MAX, "%s%s",
-					transfer->path, TR50_DOWNLOAD_EXTENSION );
-
-			if ( os_file_exists( file_path ) &&  transfer->op == IOT_OPERATION_FILE_DOWNLOAD)
-				append_mode = IOT_TRUE;
-
-			file_handle = os_file_open( file_path,
-				(transfer->op == IOT_OPERATION_FILE_UPLOAD)? OS_READ : OS_READ_WRITE |
-				( (append_mode == IOT_TRUE)? OS_APPEND: OS_CREATE) );
-
-			if ( file_handle )
+		const iot_json_item_t *j_obj = NULL;
+		const char *cmd = NULL;
+		size_t cmd_len = 0u;
+		enum tr50_send_class cmd_class = TR50_SEND_EVENT;
+		size_t i;
+
+		iot_json_decode_object_iterator_value( json, root, iter,
+			&j_obj );
+		iot_json_decode_string( json,
+			iot_json_decode_object_find( json, j_obj, "command" ),
+			&cmd, &cmd_len );
+
+		/* commands without a class of their own are events */
+		for ( i = 0u; cmd && i < TR50_HUB_COMMAND_COUNT; ++i )
+		{
+			const size_t prefix_len =
+				os_strlen( TR50_HUB_COMMANDS[i].prefix );
+			if ( cmd_len > prefix_len &&
+				os_strncmp( cmd, TR50_HUB_COMMANDS[i].prefix,
+					prefix_len ) == 0 )
 			{
-#ifdef __clang__
-#pragma clang diagnostic push
-#pragma clang diagnostic ignored "-Wdisabled-macro-expansion"
-#endif /* ifdef __clang__ */
-				curl_easy_setopt( transfer->lib_curl,
-					CURLOPT_URL, transfer->url );
-				curl_easy_setopt( transfer->lib_curl,
-					CURLOPT_VERBOSE, 1L );
-				curl_easy_setopt( transfer->lib_curl,
-					CURLOPT_NOSIGNAL, 1L );
-				curl_easy_setopt( transfer->lib_curl,
-					CURLOPT_FAILONERROR, 1L);
-				curl_easy_setopt( transfer->lib_curl,
-					CURLOPT_ACCEPT_ENCODING, "" );
-				curl_easy_setopt( transfer->lib_curl,
-					CURLOPT_NOPROGRESS, 0L );
-				curl_easy_setopt( transfer->lib_curl,
-					CURLOPT_PROGRESSFUNCTION,
-					tr50_file_progress_old );
-				curl_easy_setopt( transfer->lib_curl,
-					CURLOPT_PROGRESSDATA, transfer );
-#if LIBCURL_VERSION_NUM >= 0x072000
-				curl_easy_setopt( transfer->lib_curl,
-					CURLOPT_XFERINFOFUNCTION,
-					tr50_file_progress );
-				curl_easy_setopt( transfer->lib_curl,
-					CURLOPT_XFERINFODATA, transfer );
-#endif /* LIBCURL_VERSION_NUM >= 0x072000 */
-				iot_config_get( data->lib,
-					"ca_bundle_file", IOT_FALSE,
-					IOT_TYPE_STRING, &ca_bundle_file );
-				iot_config_get( data->lib,
-					"validate_cloud_cert", IOT_FALSE,
-					IOT_TYPE_BOOL, &validate_cert );
-				if ( !ca_bundle_file )
-					ca_bundle_file = IOT_DEFAULT_CERT_PATH;
-				curl_easy_setopt( transfer->lib_curl,
-					CURLOPT_CAINFO, ca_bundle_file );
-
-				/* SSL verification */
-				if ( validate_cert != IOT_FALSE )
-				{
-					curl_easy_setopt( transfer->lib_curl,
-						CURLOPT_SSL_VERIFYHOST,
-						TR50_DEFAULT_SSL_VERIFY_HOST );
-					curl_easy_setopt( transfer->lib_curl,
-						CURLOPT_SSL_VERIFYPEER,
-						TR50_DEFAULT_SSL_VERIFY_PEER );
-
-					/* In some OSs libcurl cannot access the default CAs
-					 * and it has to be added in the fs */
-
-				}
-				else
-				{
-					curl_easy_setopt(transfer->lib_curl, CURLOPT_SSL_VERIFYHOST, 0L);
-					curl_easy_setopt(transfer->lib_curl, CURLOPT_SSL_VERIFYPEER, 0L);
-				}
-
-				/* Proxy settings */
-				if ( data->proxy.type != IOT_PROXY_UNKNOWN &&
-				     data->proxy.host && *data->proxy.host != '\0' )
-				{
-					long proxy_type = CURLPROXY_HTTP;
-					if ( data->proxy.type == IOT_PROXY_SOCKS5 )
-						proxy_type = CURLPROXY_SOCKS5_HOSTNAME;
-
-					curl_easy_setopt( transfer->lib_curl,
-						CURLOPT_PROXY, data->proxy.host );
-					curl_easy_setopt( transfer->lib_curl,
-						CURLOPT_PROXYPORT, data->proxy.port );
-					curl_easy_setopt( transfer->lib_curl,
-						CURLOPT_PROXYTYPE, proxy_type );
-
-					if ( data->proxy.username && data->proxy.username[0] != '\0' )
-						curl_easy_setopt( transfer->lib_curl,
-							CURLOPT_PROXYUSERNAME,
-							data->proxy.username );
-					if ( data->proxy.password && data->proxy.password[0] != '\0' )
-						curl_easy_setopt( transfer->lib_curl,
-							CURLOPT_PROXYPASSWORD,
-							data->proxy.password );
-				}
-
-				if ( transfer->op == IOT_OPERATION_FILE_UPLOAD )
-				{
-					transfer->size =
-						os_file_size( transfer->path );
-					curl_easy_setopt( transfer->lib_curl,
-						CURLOPT_POST, 1L );
-					curl_easy_setopt( transfer->lib_curl,
-						CURLOPT_READDATA, file_handle );
-					curl_easy_setopt( transfer->lib_curl,
-						CURLOPT_READFUNCTION, os_file_read );
-					curl_easy_setopt( transfer->lib_curl,
-						CURLOPT_POSTFIELDSIZE,
-						transfer->size );
-				}
-				else
-				{
-
-					curl_easy_setopt( transfer->lib_curl,
-						CURLOPT_WRITEFUNCTION, os_file_write );
-					curl_easy_setopt( transfer->lib_curl,
-						CURLOPT_WRITEDATA, file_handle );
-				}
-				IOT_LOG( data->lib, IOT_LOG_DEBUG, "Maximum number of retries: %ld",
-					transfer->max_retries);
-
-				/* max_retries defined in iot_defs.h */
-				for ( retry = 0; (retry <= transfer->max_retries ||
-					transfer->max_retries< 0 ) && curl_result != CURLE_OK; retry++)
-				{
-					IOT_LOG( data->lib, IOT_LOG_TRACE, "retry count=%d", retry);
-					if ( os_file_exists( file_path ) )
-					{
-						long resume_from = 0;
-
-						/* Force a timeout when speed is less than the low speed limit
-						 * for certain period of time so libcurl will stop trying for nothing
-						 * and wait until network gets better */
-						curl_easy_setopt( transfer->lib_curl,
-							CURLOPT_LOW_SPEED_LIMIT, IOT_TRANSFER_LOW_SPEED_LIMIT );     /* bytes/second */
-						curl_easy_setopt( transfer->lib_curl,
-							CURLOPT_LOW_SPEED_TIME, IOT_TRANSFER_LOW_SPEED_TIMEOUT );      /* low speed timeout */
-
-						/* set resume from amount for download */
-						if ( transfer->op == IOT_OPERATION_FILE_DOWNLOAD)
-						{
-							resume_from = (long)os_file_size_handle( file_handle );
-							IOT_LOG( data->lib, IOT_LOG_DEBUG,
-								"File exists %s, resume xfer from %ld bytes",
-								file_path, resume_from);
-							curl_easy_setopt( transfer->lib_curl,
-								CURLOPT_RESUME_FROM, resume_from );
-						}
-						else
-						{
-							curl_easy_setopt( transfer->lib_curl,
-								CURLOPT_APPEND, 1L);
-						}
-						curl_easy_setopt( transfer->lib_curl,
-							CURLOPT_FRESH_CONNECT, 1L);                 /* fresh connect ctx */
-						curl_easy_setopt( transfer->lib_curl,
-								CURLOPT_DNS_CACHE_TIMEOUT, 0L);     /* no dns cache */
-					}
-					curl_result = curl_easy_perform( transfer->lib_curl );
-
-					/* need to handle errors 400 * without retrying */
-					if ( curl_result == CURLE_HTTP_RETURNED_ERROR ||
-					     curl_result == CURLE_SSL_CACERT )
-					{
-						IOT_LOG( data->lib, IOT_LOG_ERROR,
-							"File transfer not recoverable(%d) exiting.\nReason: %s",
-							curl_result, curl_easy_strerror( curl_result ) );
-						break;
-					}
-					else
-						IOT_LOG( data->lib, IOT_LOG_TRACE, "curl result %d", curl_result);
+				cmd_class = TR50_HUB_COMMANDS[i].send_class;
+				break;
+			}
+		}
+		if ( cmd && cmd_class < result )
+			result = cmd_class;
+		iter = iot_json_decode_object_iterator_next( json, root, iter );
+	}
 
-					/* add a delay before immediately trying again */
-					if ( curl_result != CURLE_OK )
-						os_time_sleep(10000, IOT_FALSE);
-				}
+	if ( result == TR50_SEND_CLASS_COUNT )
+		result = TR50_SEND_EVENT;
+	return result;
+}
 
-#ifdef __clang__
-#pragma clang diagnostic pop
-#endif /* ifdef __clang__ */
+iot_status_t tr50_hub_forward(
+	void *user_data,
+	const char *topic,
+	const void *payload,
+	size_t payload_len,
+	int qos )
+{
+	struct tr50_data *const data = (struct tr50_data *)user_data;
+	iot_status_t result = IOT_STATUS_BAD_PARAMETER;
+	if ( data && data->mqtt && topic )
+	{
+		enum tr50_send_class send_class = TR50_SEND_EVENT;
+		iot_json_decoder_t *const json = tr50_decoder_acquire( data );
+		const iot_json_item_t *root = NULL;
+
+		/* queue the request as the commands it holds */
+		if ( json && iot_json_decode_parse( json, payload, payload_len,
+			&root, NULL, 0u ) == IOT_STATUS_SUCCESS )
+			send_class = tr50_hub_classify( json, root );
+		else
+			root = NULL;
+		result = tr50_mqtt_publish( data, topic, payload, payload_len,
+			qos, send_class, NULL, NULL );
+
+		/* the application waits for a reply to each request id in
+		 * the message, so answer them rather than dropping it */
+		if ( result != IOT_STATUS_SUCCESS && root &&
+			os_strncmp( topic, "api/", 4u ) == 0 )
+		{
+			iot_json_encoder_t *const reply =
+				tr50_encoder_acquire( data );
+			const iot_json_object_iterator_t *iter =
+				iot_json_decode_object_iterator( json, root );
+			const char *msg;
+			size_t msg_len = 0u;
+			char reply_topic[ 32u ];
 
-				if ( curl_result == CURLE_OK )
-					result = IOT_STATUS_SUCCESS;
-				else
-					IOT_LOG( data->lib, IOT_LOG_ERROR,
-						"File transfer failed: %s",
-						curl_easy_strerror( curl_result ) );
+			IOT_LOG( data->lib, IOT_LOG_WARNING,
+				"tr50: hub request not sent (%s)",
+				iot_error( result ) );
+			while ( reply && iter )
+			{
+				char id[ IOT_NAME_MAX_LEN + 1u ];
+				const char *v = NULL;
+				size_t v_len = 0u;
 
-				os_file_close( file_handle );
+				iot_json_decode_object_iterator_key( json, root,
+					iter, &v, &v_len );
+				tr50_slice_copy( id, sizeof( id ), v, v_len );
+				iot_json_encode_object_start( reply, id );
+				iot_json_encode_bool( reply, "success", IOT_FALSE );
+				iot_json_encode_array_start( reply,
+					"errorMessages" );
+				iot_json_encode_string( reply, NULL,
+					iot_error( result ) );
+				iot_json_encode_array_end( reply );
+				iot_json_encode_object_end( reply );
+				iter = iot_json_decode_object_iterator_next( json,
+					root, iter );
 			}
-			else
-				IOT_LOG( data->lib, IOT_LOG_ERROR,
-					"Failed to open %s", transfer->path );
 
-			curl_easy_cleanup( transfer->lib_curl );
+			os_snprintf( reply_topic, sizeof( reply_topic ),
+				"reply/%s", &topic[4] );
+			msg = iot_json_encode_dump_len( reply, &msg_len );
+			if ( msg && msg_len > 0u )
+				tr50_hub_route( data->hub, reply_topic, msg,
+					msg_len, qos );
+			tr50_encoder_release( data, reply );
 		}
-		else
-			IOT_LOG( data->lib, IOT_LOG_ERROR, "%s",
-				"Failed to initialize libcurl" );
+		tr50_decoder_release( data, json );
+	}
+	return result;
+}
+#endif /* ifdef TR50_HUB_SUPPORT */
 
+iot_status_t tr50_initialize(
+	iot_t *lib,
+	void **plugin_data )
+{
+	iot_status_t result = IOT_STATUS_NO_MEMORY;
+	struct tr50_data *const data = os_malloc( sizeof( struct tr50_data ) );
+	IOT_LOG( lib, IOT_LOG_TRACE, "tr50: %s", "initialize" );
+	if ( data )
+	{
+		os_memzero( data, sizeof( struct tr50_data ) );
+		data->lib = lib;
+		*plugin_data = data;
+		data->mailbox_interval = TR50_MAILBOX_CHECK_INTERVAL;
+		data->mailbox_interval_max = TR50_MAILBOX_CHECK_INTERVAL;
+		data->mailbox_interval_min = TR50_MAILBOX_CHECK_INTERVAL;
+#ifndef IOT_STACK_ONLY
+		data->ack_max = TR50_MAILBOX_ACK_MAX;
+#endif /* ifndef IOT_STACK_ONLY */
+#if defined( IOT_THREAD_SUPPORT ) && !defined( IOT_STACK_ONLY )
+		os_thread_mutex_create( &data->decoder_mutex );
+		os_thread_mutex_create( &data->encoder_mutex );
+		os_thread_mutex_create( &data->send_mutex );
+		os_thread_mutex_create( &data->template_mutex );
+#endif /* if defined( IOT_THREAD_SUPPORT ) && !defined( IOT_STACK_ONLY ) */
+#ifdef IOT_THREAD_SUPPORT
+		os_thread_mutex_create( &data->mailbox_mutex );
+		os_thread_mutex_create( &data->time_mutex );
+#endif /* ifdef IOT_THREAD_SUPPORT */
 
-		/* final checks and cleanup */
-		if ( result == IOT_STATUS_SUCCESS )
+		curl_global_init( CURL_GLOBAL_ALL );
+		data->transfer = tr50_transfer_engine_create( lib,
+			&data->proxy );
+		result = iot_mqtt_initialize();
+	}
+	return result;
+}
+
+void tr50_keep_alive_update(
+	iot_t *lib,
+	struct tr50_data *data,
+	iot_bool_t connected )
+{
+	/* not used with an application ping, or before connecting */
+	if ( data->keep_alive > 0u && data->keep_alive_since > 0u )
+	{
+		const iot_timestamp_t now = iot_timestamp_now();
+		const iot_timestamp_t up_time = now - data->keep_alive_since;
+		const iot_timestamp_t stable_time = (iot_timestamp_t)
+			data->keep_alive * TR50_KEEP_ALIVE_STABLE *
+			IOT_MILLISECONDS_IN_SECOND;
+
+		/* a connection that lasted long enough was not lost to the
+		 * keep alive; a longer one waiting is used on reconnecting */
+		if ( connected == IOT_FALSE )
 		{
-			if ( transfer->op == IOT_OPERATION_FILE_DOWNLOAD )
+			if ( up_time < stable_time &&
+				data->keep_alive > data->keep_alive_good )
 			{
-				os_file_t file_handle = os_file_open(
-					file_path, OS_READ );
-				if ( file_handle )
+				/* path may time out the idle connection */
+				++data->keep_alive_fails;
+				if ( data->keep_alive_fails >=
+					TR50_KEEP_ALIVE_FAILS )
 				{
-					iot_uint64_t crc32 = 0u;
-
-					result = iot_checksum_file_get(
-						data->lib, file_handle,
-						IOT_CHECKSUM_TYPE_CRC32, &crc32 );
-					if ( result == IOT_STATUS_SUCCESS &&
-						crc32 != transfer->crc32 )
-					{
-						IOT_LOG( data->lib, IOT_LOG_ERROR,
-							"Checksum for %s does not match. "
-							"Expected: 0x%lX, calculated: 0x%lX",
-							transfer->path, transfer->crc32, crc32);
-						os_file_delete( file_path );
-						result = IOT_STATUS_FAILURE;
-					}
-					os_file_close( file_handle );
-
-					if ( result == IOT_STATUS_SUCCESS )
-						os_file_move( file_path, transfer->path );
+					IOT_LOG( lib, IOT_LOG_INFO,
+						"tr50: keep alive of %u seconds "
+						"too long, using %u",
+						(unsigned int)data->keep_alive,
+						(unsigned int)data->keep_alive_good );
+					data->keep_alive_limit =
+						data->keep_alive_good;
+					data->keep_alive = data->keep_alive_good;
+					data->keep_alive_fails = 0u;
+					data->keep_alive_capped = now;
 				}
 			}
-			else
+			else if ( up_time < stable_time )
 			{
-				if ( os_strlen( transfer->path ) > 4u  &&
-					os_strncmp(
-						transfer->path +
-						os_strlen( transfer->path ) - 4u,
-						".tar", 4u ) == 0 )
-					os_file_delete( transfer->path );
+				data->keep_alive /= 2u;
+				if ( data->keep_alive < data->keep_alive_min )
+					data->keep_alive = data->keep_alive_min;
+				data->keep_alive_good = data->keep_alive;
+				data->keep_alive_next = 0u;
 			}
-
-			remove_from_queue = IOT_TRUE;
 		}
-		else
-			remove_from_queue = IOT_TRUE;
-
-		if ( transfer->callback )
+		else if ( data->keep_alive > data->keep_alive_good &&
+			up_time >= stable_time )
 		{
-			iot_file_progress_t transfer_progress;
-			os_memzero( &transfer_progress, sizeof(transfer_progress) );
-			transfer_progress.percentage = (result == IOT_STATUS_SUCCESS)?
-				100.0 : (iot_float32_t)(100.0 * transfer->prev_byte / transfer->size);
-			transfer_progress.status = result;
-			transfer_progress.completed = IOT_TRUE;
-
-			transfer->callback( &transfer_progress, transfer->user_data );
+			data->keep_alive_good = data->keep_alive;
+			data->keep_alive_fails = 0u;
+			IOT_LOG( lib, IOT_LOG_DEBUG,
+				"tr50: keep alive of %u seconds is stable",
+				(unsigned int)data->keep_alive );
 		}
-
-		if ( remove_from_queue )
+		else if ( data->keep_alive_capped > 0u &&
+			now - data->keep_alive_capped >= TR50_KEEP_ALIVE_CAP_MS )
 		{
-			struct tr50_data *const tr50 =
-				(struct tr50_data *)transfer->plugin_data;
-
-			if ( tr50 )
-			{
-				/* remove the transfer from the queue */
-				iot_uint8_t i = (iot_uint8_t)(
-					(unsigned long)((const unsigned char *)(transfer) - (const unsigned char*)&tr50->file_transfer_queue[0]) / (unsigned long)sizeof(struct tr50_file_transfer));
-				os_memmove(
-					&tr50->file_transfer_queue[i],
-					&tr50->file_transfer_queue[i+1u],
-					( tr50->file_transfer_count - i -1u ) *
-					sizeof( iot_file_transfer_t ) );
-				os_memzero(
-					&tr50->file_transfer_queue[ tr50->file_transfer_count - 1u ],
-					sizeof( iot_file_transfer_t ) );
-				--tr50->file_transfer_count;
-				result = IOT_STATUS_SUCCESS;
-			}
+			/* path may have changed, so try longer ones again */
+			data->keep_alive_limit = data->keep_alive_max;
+			data->keep_alive_capped = 0u;
+		}
+		else if ( data->keep_alive == data->keep_alive_good &&
+			data->keep_alive_next == 0u &&
+			data->keep_alive < data->keep_alive_limit &&
+			up_time >= stable_time &&
+			up_time >= TR50_KEEP_ALIVE_PROBE_MS )
+		{
+			/* longer keep alive only applies on connection */
+			if ( data->keep_alive > data->keep_alive_limit / 2u )
+				data->keep_alive_next = data->keep_alive_limit;
 			else
-			{
-				IOT_LOG( data->lib, IOT_LOG_ERROR, "%s",
-					"Cannot find plugin data" );
-				result = IOT_STATUS_FAILURE;
-			}
+				data->keep_alive_next =
+					(iot_uint16_t)( data->keep_alive * 2u );
+			data->keep_alive_fails = 0u;
+			IOT_LOG( lib, IOT_LOG_INFO,
+				"tr50: trying keep alive of %u seconds on "
+				"the next connection",
+				(unsigned int)data->keep_alive_next );
 		}
 	}
-	return (OS_THREAD_RETURN)result;
 }
 
-int tr50_file_progress( void *user_data,
-	curl_off_t UNUSED(down_total), curl_off_t down_now,
-	curl_off_t up_total, curl_off_t up_now )
+void tr50_loop_dispatch(
+	struct tr50_data *data,
+	const struct iot_loop_poll *poll )
 {
-	int result = 0;
-	struct tr50_file_transfer *const transfer =
-		(struct tr50_file_transfer*)user_data;
-
-	if ( transfer )
+	int fd = -1;
+	if ( data && poll && data->mqtt &&
+		iot_mqtt_loop_socket( data->mqtt, &fd, NULL, NULL ) ==
+			IOT_STATUS_SUCCESS )
 	{
-		if ( transfer->cancel )
-			result = 1;
-		else
-		{
-			/* Get the total transfer time and compare it to the last time the
-			 * progress is updated. This is done to minimize printing in the logs.
-			 * The end of the transfer will still be printed to show some
-			 * progress for small files. */
-			double cur_time = 0, int_time = 0;
-			long now = 0, total = 0;
-			const char *transfer_type = NULL;
+		iot_bool_t readable = IOT_FALSE;
+		iot_bool_t writable = IOT_FALSE;
+		size_t i;
 
-#ifdef __clang__
-#pragma clang diagnostic push
-#pragma clang diagnostic ignored "-Wdisabled-macro-expansion"
-#endif /* ifdef __clang__ */
-			curl_easy_getinfo(
-				transfer->lib_curl, CURLINFO_TOTAL_TIME, &cur_time);
-#ifdef __clang__
-#pragma clang diagnostic pop
-#endif /* ifdef __clang__ */
-			int_time = cur_time - transfer->last_update_time;
-
-			if ( transfer->op == IOT_OPERATION_FILE_UPLOAD )
-			{
-				now = (long)up_now + transfer->prev_byte;
-				total = (long)up_total + transfer->prev_byte;
-				transfer_type = "Upload";
-			}
-			else
+		for ( i = 0u; i < poll->ready_count; ++i )
+		{
+			if ( poll->ready[i].fd == fd )
 			{
-				/* For larger files, cloud does not specify total
-				 * size, so use the file size given in the beginning */
-				now = (long)down_now + transfer->prev_byte;
-				total = (long)transfer->size;
-				transfer_type = "Download";
+				if ( poll->ready[i].events & IOT_LOOP_EVENT_READ )
+					readable = IOT_TRUE;
+				if ( poll->ready[i].events & IOT_LOOP_EVENT_WRITE )
+					writable = IOT_TRUE;
 			}
+		}
 
-			if ( total > 0 && (now == total ||
-				int_time > TR50_FILE_TRANSFER_PROGRESS_INTERVAL) )
-			{
-				double progress = (double)( 100.0 * now / total );
-				transfer->last_update_time = cur_time;
+		/* called even if not ready, to service the keep alive */
+		if ( iot_mqtt_loop_dispatch( data->mqtt, readable,
+			writable ) != IOT_STATUS_SUCCESS )
+			IOT_LOG( data->lib, IOT_LOG_DEBUG, "%s",
+				"tr50: connection error while servicing socket" );
+	}
+}
 
-				if ( transfer->callback )
-				{
-					iot_file_progress_t transfer_progress;
-					os_memzero( &transfer_progress, sizeof(transfer_progress) );
-					transfer_progress.percentage = (iot_float32_t)progress;
-					transfer_progress.status = IOT_STATUS_INVOKED;
-					transfer_progress.completed = IOT_FALSE;
+void tr50_loop_poll(
+	struct tr50_data *data,
+	struct iot_loop_poll *poll )
+{
+	if ( data && poll )
+	{
+		const iot_timestamp_t now = iot_timestamp_now();
+		iot_timestamp_t next = data->time_last_mailbox_check +
+			data->mailbox_interval;
+		iot_bool_t want_write = IOT_FALSE;
+		int fd = -1;
 
-					transfer->callback( &transfer_progress, transfer->user_data );
-				}
-				else
-				{
-					struct tr50_data *data =
-						transfer->plugin_data;
-					iot_t *lib = NULL;
-					if ( data )
-						lib = data->lib;
-					IOT_LOG( lib, IOT_LOG_TRACE,
-						"%sing %s: %.1f%% (%ld/%ld bytes)\n",
-						transfer_type, transfer->path,
-						progress, now, total );
-				}
+		if ( data->mqtt && iot_mqtt_loop_socket( data->mqtt, &fd,
+			&want_write, &poll->time_out ) == IOT_STATUS_SUCCESS )
+		{
+			if ( poll->fds_count < poll->fds_max )
+			{
+				poll->fds[poll->fds_count].fd = fd;
+				poll->fds[poll->fds_count].events =
+					IOT_LOOP_EVENT_READ;
+				if ( want_write != IOT_FALSE )
+					poll->fds[poll->fds_count].events |=
+						IOT_LOOP_EVENT_WRITE;
 			}
+			++poll->fds_count;
 		}
-	}
-	return result;
-}
 
-int tr50_file_progress_old(
-	void *user_data,
-	double down_total, double down_now,
-	double up_total, double up_now )
-{
-	return tr50_file_progress( user_data,
-		(curl_off_t)down_total, (curl_off_t)down_now,
-		(curl_off_t)up_total, (curl_off_t)up_now );
+		/* same timers as checked each loop iteration */
+		if ( data->keep_alive == 0u &&
+			data->time_last_msg_received > 0u &&
+			data->time_last_msg_received + TR50_PING_INTERVAL < next )
+			next = data->time_last_msg_received +
+				TR50_PING_INTERVAL;
+		if ( data->keep_alive > 0u && data->keep_alive_since > 0u &&
+			data->keep_alive < data->keep_alive_limit &&
+			data->keep_alive_next == 0u )
+		{
+			iot_timestamp_t probe = (iot_timestamp_t)
+				data->keep_alive * TR50_KEEP_ALIVE_STABLE *
+				IOT_MILLISECONDS_IN_SECOND;
+			if ( data->keep_alive == data->keep_alive_good &&
+				probe < TR50_KEEP_ALIVE_PROBE_MS )
+				probe = TR50_KEEP_ALIVE_PROBE_MS;
+			if ( data->keep_alive_since + probe < next )
+				next = data->keep_alive_since + probe;
+		}
+		if ( data->reconnect_count > 0u && data->mqtt )
+		{
+			iot_bool_t connected = IOT_TRUE;
+			iot_timestamp_t time_stamp_changed = 0u;
+			/* connection lost, but no attempt scheduled yet */
+			if ( iot_mqtt_connection_status( data->mqtt,
+				&connected, &time_stamp_changed ) ==
+				IOT_STATUS_SUCCESS && connected == IOT_FALSE &&
+				data->reconnect_time == 0u &&
+				time_stamp_changed < next )
+				next = time_stamp_changed;
+		}
+		if ( data->reconnect_time > 0u && data->reconnect_time < next )
+			next = data->reconnect_time;
+		if ( data->mailbox_more != IOT_FALSE &&
+			data->mailbox_waiting == IOT_FALSE && data->lib &&
+			data->lib->request_queue_free_count < IOT_ACTION_QUEUE_MAX )
+			next = now;
+#ifndef IOT_STACK_ONLY
+		if ( data->send_queued > 0u &&
+			now + TR50_SEND_QUEUE_RETRY_INTERVAL < next )
+			next = now + TR50_SEND_QUEUE_RETRY_INTERVAL;
+		if ( data->ack_json &&
+			data->ack_time + TR50_MAILBOX_ACK_DELAY < next )
+			next = data->ack_time + TR50_MAILBOX_ACK_DELAY;
+#endif /* ifndef IOT_STACK_ONLY */
+
+		/* timer already expired, so return as soon as possible */
+		if ( next <= now )
+			next = now + 1u;
+		if ( poll->time_out == 0u ||
+			next - now < (iot_timestamp_t)poll->time_out )
+			poll->time_out = (iot_millisecond_t)( next - now );
+	}
 }
-#endif /* ifdef IOT_THREAD_SUPPORT */
 
-void tr50_file_queue_check(
-	struct tr50_data *data )
+#ifndef IOT_STACK_ONLY
+iot_status_t tr50_mailbox_ack_flush(
+	struct tr50_data *data,
+	iot_bool_t force )
 {
+	iot_status_t result = IOT_STATUS_BAD_PARAMETER;
 	if ( data )
 	{
-		iot_timestamp_t now = iot_timestamp_now();
-		if ( data->file_queue_last_checked == 0u ||
-			now - data->file_queue_last_checked >=
-			TR50_FILE_QUEUE_CHECK_INTERVAL )
-		{
+		iot_json_encoder_t *json = NULL;
 #ifdef IOT_THREAD_SUPPORT
-			iot_uint8_t i = 0u;
-			for ( i= 0u;
-				i < data->file_transfer_count;
-				i++ )
-			{
-				struct tr50_file_transfer *transfer =
-					&data->file_transfer_queue[i];
-				if ( transfer &&
-					transfer->retry_time != 0u &&
-					transfer->retry_time <= now )
-				{
-					os_thread_t thread;
-					size_t stack_size = 0u;
-
-					/* Create a thread to do the file transfer */
-#if defined( __VXWORKS__ )
-					stack_size = deviceCloudStackSizeGet();
-#endif /* if defined( __VXWORKS__ ) */
-
-					if ( os_thread_create( &thread,
-						tr50_file_transfer,
-						transfer, stack_size ) == 0 )
-						transfer->retry_time = 0u;
-				}
-			}
+		os_thread_mutex_lock( &data->mailbox_mutex );
 #endif /* ifdef IOT_THREAD_SUPPORT */
-			data->file_queue_last_checked = now;
+		if ( data->ack_json && ( force != IOT_FALSE ||
+			iot_timestamp_now() - data->ack_time >=
+			TR50_MAILBOX_ACK_DELAY ) )
+		{
+			json = data->ack_json;
+			data->ack_json = NULL;
+			data->ack_count = 0u;
 		}
+#ifdef IOT_THREAD_SUPPORT
+		os_thread_mutex_unlock( &data->mailbox_mutex );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+
+		/* one message, holding a "mailbox.ack" command for each */
+		result = IOT_STATUS_SUCCESS;
+		if ( json )
+			result = tr50_mqtt_publish_request( data, json,
+				TR50_MQTT_QOS, TR50_SEND_CONTROL, NULL );
 	}
+	return result;
 }
+#endif /* ifndef IOT_STACK_ONLY */
 
-iot_status_t tr50_initialize(
-	iot_t *lib,
-	void **plugin_data )
+void tr50_mailbox_reply(
+	struct tr50_data *data,
+	size_t count )
 {
-	iot_status_t result = IOT_STATUS_NO_MEMORY;
-	struct tr50_data *const data = os_malloc( sizeof( struct tr50_data ) );
-	IOT_LOG( lib, IOT_LOG_TRACE, "tr50: %s", "initialize" );
 	if ( data )
 	{
-		os_memzero( data, sizeof( struct tr50_data ) );
-		data->lib = lib;
-		*plugin_data = data;
+		iot_bool_t check_again;
+#ifdef IOT_THREAD_SUPPORT
+		os_thread_mutex_lock( &data->mailbox_mutex );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+		data->mailbox_waiting = IOT_FALSE;
+		if ( count > 0u && count >= data->mailbox_limit )
+			data->mailbox_more = IOT_TRUE;
+		if ( data->mailbox_polled != IOT_FALSE )
+		{
+			/* poll found requests, so a notification was missed */
+			if ( count > 0u )
+				data->mailbox_interval =
+					data->mailbox_interval_min;
+			else if ( data->mailbox_interval <
+				data->mailbox_interval_max / 2u )
+				data->mailbox_interval *= 2u;
+			else
+				data->mailbox_interval =
+					data->mailbox_interval_max;
+			data->mailbox_polled = IOT_FALSE;
+		}
+		check_again = data->mailbox_more;
+#ifdef IOT_THREAD_SUPPORT
+		os_thread_mutex_unlock( &data->mailbox_mutex );
+#endif /* ifdef IOT_THREAD_SUPPORT */
 
-		curl_global_init( CURL_GLOBAL_ALL );
-		result = iot_mqtt_initialize();
+		/* fetch the next page, if there is room for it */
+		if ( check_again != IOT_FALSE )
+			tr50_check_mailbox( data, NULL, IOT_FALSE );
 	}
-	return result;
 }
 
 iot_status_t tr50_mqtt_publish(
@@ -2004,30 +3395,371 @@ iot_status_t tr50_mqtt_publish(
 	const char *topic,
 	const void *payload,
 	size_t payload_len,
+	int qos,
+	enum tr50_send_class send_class,
+	iot_json_encoder_t *json,
 	const iot_transaction_t *txn )
 {
 	iot_status_t result = IOT_STATUS_BAD_PARAMETER;
 	if ( data && topic && payload )
 	{
-		IOT_LOG( data->lib, IOT_LOG_DEBUG,
-			"tr50: sent (%u bytes on %s): %.*s",
-				(unsigned int)payload_len, topic,
-				(int)payload_len, (const char*)payload );
-		result = iot_mqtt_publish( data->mqtt, topic,
-			payload, payload_len, TR50_MQTT_QOS, IOT_FALSE, NULL );
+		/* requests encoded in binary (CBOR) are not printable */
+		if ( ( data->encode_flags & IOT_JSON_FLAG_BINARY ) &&
+			os_strcmp( topic, data->encode_topic ) == 0 )
+			IOT_LOG( data->lib, IOT_LOG_DEBUG,
+				"tr50: sent (%u bytes on %s): <binary>",
+					(unsigned int)payload_len, topic );
+		else
+			IOT_LOG( data->lib, IOT_LOG_DEBUG,
+				"tr50: sent (%u bytes on %s): %.*s",
+					(unsigned int)payload_len, topic,
+					(int)payload_len, (const char*)payload );
+#ifndef IOT_STACK_ONLY
+		/* messages waiting in the queue go first */
+		if ( tr50_send_queue_flush( data ) > 0u )
+			result = IOT_STATUS_FULL;
+		else
+#endif /* ifndef IOT_STACK_ONLY */
+			/* payload is published straight from the encoder's
+			 * buffer, as the mqtt client copies or sends it */
+			result = tr50_transport_publish( data, topic,
+				payload, payload_len, qos );
+#ifndef IOT_STACK_ONLY
+		/* mqtt client can not accept the message now, queue it */
+		if ( result == IOT_STATUS_FULL ||
+			result == IOT_STATUS_IO_ERROR )
+		{
+			result = tr50_send_queue_push( data, send_class, topic,
+				payload, payload_len, qos, json, txn );
+			if ( result == IOT_STATUS_SUCCESS )
+				json = NULL;
+		}
+#else /* ifndef IOT_STACK_ONLY */
+		(void)send_class;
+#endif /* else IOT_STACK_ONLY */
 		if ( result != IOT_STATUS_SUCCESS && txn )
 			tr50_transaction_status_set( data, (iot_uint8_t)(*txn),
 				TR50_TRANSACTION_FAILURE );
 	}
+
+	/* encoder was not queued */
+	if ( json )
+	{
+#ifdef IOT_STACK_ONLY
+		iot_json_encode_terminate( json );
+#else /* ifdef IOT_STACK_ONLY */
+		tr50_encoder_release( data, json );
+#endif /* else IOT_STACK_ONLY */
+	}
 	return result;
 }
 
+iot_status_t tr50_mqtt_publish_request(
+	struct tr50_data *data,
+	iot_json_encoder_t *json,
+	int qos,
+	enum tr50_send_class send_class,
+	const iot_transaction_t *txn )
+{
+	iot_status_t result = IOT_STATUS_BAD_PARAMETER;
+	if ( json )
+	{
+		size_t msg_len = 0u;
+		const char *const msg = iot_json_encode_dump_len( json, &msg_len );
+		const char *topic = "api";
+		if ( data && ( data->encode_flags & IOT_JSON_FLAG_BINARY ) )
+			topic = data->encode_topic;
+
+		/* releases the encoder */
+		result = tr50_mqtt_publish( data, topic, msg, msg_len, qos,
+			send_class, json, txn );
+		if ( data && !msg )
+			result = IOT_STATUS_FAILURE;
+	}
+	return result;
+}
+
+void tr50_on_file_reply(
+	struct tr50_data *data,
+	iot_json_decoder_t *json,
+	const iot_json_item_t *j_params,
+	int msg_id )
+{
+	const iot_json_item_t *j_obj;
+	j_obj = iot_json_decode_object_find( json, j_params, "fileId" );
+	if ( data && j_obj && iot_json_decode_type( json, j_obj )
+		== IOT_JSON_TYPE_STRING &&
+		msg_id > 0 && (unsigned int)msg_id >= TR50_FILE_REQUEST_ID_OFFSET )
+	{
+		const char *v = NULL;
+		size_t v_len = 0u;
+		/* determine host name from config file */
+		const char *host = NULL;
+		char url[ PATH_MAX + 1u ];
+		int url_len;
+		iot_int64_t crc32 = 0u;
+		iot_int64_t fileSize = 0u;
+
+		/* obtain the fileId */
+		iot_json_decode_string( json, j_obj, &v, &v_len );
+
+		j_obj = iot_json_decode_object_find( json,
+			j_params, "crc32" );
+		if ( j_obj && iot_json_decode_type( json, j_obj )
+			== IOT_JSON_TYPE_INTEGER )
+			iot_json_decode_integer( json, j_obj, &crc32 );
+
+		j_obj = iot_json_decode_object_find( json,
+			j_params, "fileSize" );
+		if ( j_obj && iot_json_decode_type( json, j_obj )
+			== IOT_JSON_TYPE_INTEGER )
+			iot_json_decode_integer( json, j_obj, &fileSize );
+
+		iot_config_get( data->lib, "cloud.host", IOT_FALSE,
+			IOT_TYPE_STRING, &host );
+		url_len = os_snprintf( url, PATH_MAX, "https://%s/file/",
+			host );
+		if ( url_len < 0 )
+			url_len = 0;
+		else if ( url_len > (int)PATH_MAX )
+			url_len = (int)PATH_MAX;
+		os_snprintf( &url[url_len], PATH_MAX - (size_t)url_len, "%.*s",
+			(int)v_len, v );
+		url[ PATH_MAX ] = '\0';
+
+		/* the url ends with the fileId, caching the download under it */
+		if ( tr50_transfer_start( data->transfer,
+			(iot_uint32_t)msg_id - TR50_FILE_REQUEST_ID_OFFSET,
+			url, &url[url_len],
+			(iot_uint64_t)crc32, (iot_uint64_t)fileSize,
+			IOT_TRANSFER_MAX_RETRIES ) != IOT_STATUS_SUCCESS )
+			IOT_LOG( data->lib, IOT_LOG_ERROR,
+				"Failed to start file transfer for message #%u",
+				(unsigned int)msg_id );
+	}
+}
+
+void tr50_on_mailbox_activity(
+	struct tr50_data *data,
+	iot_json_decoder_t *json,
+	const iot_json_item_t *root )
+{
+	const iot_json_item_t *const j_thing_key =
+		iot_json_decode_object_find( json, root, "thingKey" );
+
+	if ( iot_json_decode_type( json, j_thing_key ) ==
+		IOT_JSON_TYPE_STRING )
+	{
+		const char *v = NULL;
+		size_t v_len = 0u;
+		iot_json_decode_string( json, j_thing_key, &v, &v_len );
+
+		/* check if message is for us */
+		if ( os_strncmp( v, data->thing_key, v_len ) == 0 )
+		{
+			iot_bool_t check = IOT_TRUE;
+#ifdef IOT_THREAD_SUPPORT
+			os_thread_mutex_lock( &data->mailbox_mutex );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+			/* the reply to the check in progress may not include
+			 * the new requests, check once it arrives instead of
+			 * sending another now */
+			if ( data->mailbox_waiting != IOT_FALSE &&
+				iot_timestamp_now() - data->time_last_mailbox_check <
+				TR50_MAILBOX_CHECK_TIMEOUT )
+			{
+				data->mailbox_more = IOT_TRUE;
+				check = IOT_FALSE;
+			}
+#ifdef IOT_THREAD_SUPPORT
+			os_thread_mutex_unlock( &data->mailbox_mutex );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+			if ( check != IOT_FALSE )
+				tr50_check_mailbox( data, NULL, IOT_FALSE );
+		}
+	}
+}
+
+void tr50_on_mailbox_messages(
+	struct tr50_data *data,
+	iot_json_decoder_t *json,
+	const iot_json_item_t *j_messages )
+{
+	char arena_buf[ TR50_ARENA_SIZE ];
+	char *arena = arena_buf;
+	size_t arena_size = TR50_ARENA_SIZE;
+	size_t i;
+	const size_t msg_count = iot_json_decode_array_size( json, j_messages );
+
+	for ( i = 0u; i < msg_count; ++i )
+	{
+		const iot_json_item_t *j_cmd_item;
+		if ( iot_json_decode_array_at( json, j_messages, i,
+			&j_cmd_item ) == IOT_STATUS_SUCCESS )
+		{
+			const iot_json_item_t *j_id;
+			const iot_json_item_t *j_params;
+
+			j_id = iot_json_decode_object_find( json, j_cmd_item, "id" );
+			if ( !j_id )
+				IOT_LOG( data->lib, IOT_LOG_WARNING,
+					"\"%s\" not found!", "id" );
+
+			j_params = iot_json_decode_object_find( json, j_cmd_item,
+				"params" );
+			if ( !j_params )
+				IOT_LOG( data->lib, IOT_LOG_WARNING,
+					"\"%s\" not found!", "params" );
+
+			if ( j_id && j_params )
+			{
+				char id[ IOT_ID_MAX_LEN + 1u ];
+				const iot_json_item_t *j_method;
+				const iot_json_object_iterator_t *iter = NULL;
+				char name[ IOT_NAME_MAX_LEN + 1u ];
+				iot_action_request_t *req = NULL;
+				const char *v = NULL;
+				size_t v_len = 0u;
+
+				j_method = iot_json_decode_object_find( json,
+					j_params, "method" );
+				if ( j_method )
+				{
+					iot_json_decode_string( json, j_id, &v, &v_len );
+					tr50_slice_copy( id, sizeof( id ), v, v_len );
+
+					iot_json_decode_string( json, j_method, &v, &v_len );
+					tr50_slice_copy( name, sizeof( name ), v, v_len );
+					req = iot_action_request_allocate( data->lib, name, "tr50" );
+					if ( req )
+						iot_action_request_option_set( req, "id", IOT_TYPE_STRING, id );
+					else
+					{
+						/* send response that message can't be handled */
+						const char *out_msg;
+						char out_msg_id[6u];
+						char out_msg_buf[ 512u ];
+						iot_json_encoder_t *out_json;
+						out_json = iot_json_encode_initialize( out_msg_buf, 512u, 0 );
+						os_snprintf( out_msg_id, sizeof(out_msg_id), "cmd" );
+						iot_json_encode_object_start( out_json, out_msg_id );
+						iot_json_encode_string( out_json, "command", "mailbox.ack" );
+						iot_json_encode_object_start( out_json, "params" );
+						iot_json_encode_string( out_json, "id", id );
+						iot_json_encode_integer( out_json, "errorCode", (int)IOT_STATUS_FULL );
+						iot_json_encode_string( out_json, "errorMessage", "maximum inbound requests reached" );
+						iot_json_encode_object_end( out_json );
+						iot_json_encode_object_end( out_json );
+
+						out_msg = iot_json_encode_dump( out_json );
+						tr50_mqtt_publish(
+							data, "api", out_msg,
+							os_strlen( out_msg ), TR50_MQTT_QOS,
+							TR50_SEND_CONTROL, NULL, NULL );
+						iot_json_encode_terminate( out_json );
+					}
+				}
+
+				/* for each parameter, values are taken straight from
+				 * the received payload (the request keeps a copy) */
+				j_params = iot_json_decode_object_find( json,
+					j_params, "params" );
+				if ( req )
+					iter = iot_json_decode_object_iterator(
+						json, j_params );
+				while ( iter )
+				{
+					const iot_json_item_t *j_value = NULL;
+					iot_json_decode_object_iterator_key(
+						json, j_params, iter, &v, &v_len );
+					iot_json_decode_object_iterator_value(
+						json, j_params, iter, &j_value );
+					tr50_slice_copy( name, sizeof( name ), v, v_len );
+					iter = iot_json_decode_object_iterator_next(
+						json, j_params, iter );
+					switch ( iot_json_decode_type( json, j_value ) )
+					{
+					case IOT_JSON_TYPE_BOOL:
+						{
+						iot_bool_t value;
+						iot_json_decode_bool( json, j_value, &value );
+						iot_action_request_parameter_set( req, name, IOT_TYPE_BOOL, value );
+						}
+						break;
+					case IOT_JSON_TYPE_INTEGER:
+						{
+						iot_int64_t value;
+						iot_json_decode_integer( json, j_value, &value );
+						iot_action_request_parameter_set( req, name, IOT_TYPE_INT64, value );
+						}
+						break;
+					case IOT_JSON_TYPE_REAL:
+						{
+						iot_float64_t value;
+						iot_json_decode_real( json, j_value, &value );
+						iot_action_request_parameter_set( req, name, IOT_TYPE_FLOAT64, value );
+						}
+						break;
+					case IOT_JSON_TYPE_STRING:
+						{
+						iot_json_decode_string( json, j_value, &v, &v_len );
+
+						/* scratch space is reused for each value, only
+						 * growing for one that does not fit */
+						if ( v_len + 1u > arena_size )
+						{
+							char *const heap = os_malloc( v_len + 1u );
+							if ( heap )
+							{
+								if ( arena != arena_buf )
+									os_free( arena );
+								arena = heap;
+								arena_size = v_len + 1u;
+							}
+						}
+						if ( v_len + 1u <= arena_size )
+						{
+							size_t j;
+							char *p = arena;
+							/* drop the escape of a quote, only looking
+							 * ahead while inside the value */
+							for ( j = 0u; j < v_len; ++j )
+							{
+								if ( !( *v == '\\' && j + 1u < v_len &&
+									*(v+1) == '"' ) )
+									*p++ = *v;
+								++v;
+							}
+							*p = '\0';
+							iot_action_request_parameter_set( req, name, IOT_TYPE_STRING, arena );
+						}
+						}
+						break;
+					case IOT_JSON_TYPE_ARRAY:
+					case IOT_JSON_TYPE_OBJECT:
+					case IOT_JSON_TYPE_NULL:
+					default:
+						break;
+					}
+				}
+
+				if ( req )
+					iot_action_request_execute( req, 0u );
+			}
+		}
+	}
+
+	if ( arena != arena_buf )
+		os_free( arena );
+	tr50_mailbox_reply( data, msg_count );
+}
+
 void tr50_on_message(
 	void *user_data,
 	const char *topic,
 	void *payload,
 	size_t payload_len,
-	int UNUSED(qos),
+	int qos,
 	iot_bool_t UNUSED(retain) )
 {
 #ifdef IOT_STACK_ONLY
@@ -2035,6 +3767,7 @@ void tr50_on_message(
 #endif
 	struct tr50_data *const data = (struct tr50_data *)(user_data);
 	iot_json_decoder_t *json;
+	iot_bool_t routed = IOT_FALSE;
 	const iot_json_item_t *root;
 
 	if ( data )
@@ -2044,332 +3777,129 @@ void tr50_on_message(
 			(unsigned int)payload_len, topic,
 			(int)payload_len, (const char *)payload );
 		data->time_last_msg_received = iot_timestamp_now();
+#ifdef TR50_HUB_SUPPORT
+		/* replies for applications sharing this connection */
+		if ( data->hub && data->hub_client == IOT_FALSE )
+			routed = tr50_hub_route( data->hub, topic, payload,
+				payload_len, qos );
+#else /* ifdef TR50_HUB_SUPPORT */
+		(void)qos;
+#endif /* else TR50_HUB_SUPPORT */
 	}
 
 #ifdef IOT_STACK_ONLY
 	json = iot_json_decode_initialize( buf, TR50_IN_BUFFER_SIZE, 0u );
 #else
-	json = iot_json_decode_initialize( NULL, 0u, IOT_JSON_FLAG_DYNAMIC );
+	json = tr50_decoder_acquire( data );
 #endif
-	if ( data && json &&
+	if ( data && json && routed == IOT_FALSE &&
 		iot_json_decode_parse( json, payload, payload_len, &root,
 			NULL, 0u ) == IOT_STATUS_SUCCESS )
 	{
+		size_t i;
+		tr50_topic_handler_t handler = NULL;
 
-		if ( os_strcmp( topic, "notify/mailbox_activity" ) == 0 )
+		for ( i = 0u; handler == NULL && i < TR50_TOPIC_HANDLER_COUNT; ++i )
 		{
-			iot_json_type_t type;
-			const iot_json_item_t *const j_thing_key =
-				iot_json_decode_object_find( json, root,
-					"thingKey" );
-			type = iot_json_decode_type( json, j_thing_key );
-
-			if ( type == IOT_JSON_TYPE_STRING )
-			{
-				const char *v = NULL;
-				size_t v_len = 0u;
-				iot_json_decode_string( json, j_thing_key,
-					&v, &v_len );
-
-				/* check if message is for us */
-				if ( os_strncmp( v, data->thing_key, v_len ) == 0 )
-					tr50_check_mailbox( data, NULL, IOT_FALSE );
-			}
+			if ( os_strcmp( topic, TR50_TOPIC_HANDLERS[i].topic ) == 0 )
+				handler = TR50_TOPIC_HANDLERS[i].handler;
 		}
-		else if ( os_strcmp( topic, "reply" ) == 0 )
-		{
-			const iot_json_object_iterator_t *root_iter =
-				iot_json_decode_object_iterator( json, root );
-			if ( root_iter )
-			{
-				char name[ IOT_NAME_MAX_LEN + 1u ];
-				const char *v = NULL;
-				size_t v_len = 0u;
-				const iot_json_item_t *j_obj = NULL;
-				int msg_id = 0;
-
-				iot_json_decode_object_iterator_key(
-					json, root, root_iter,
-					&v, &v_len );
-				os_snprintf( name, IOT_NAME_MAX_LEN, "%.*s", (int)v_len, v );
-				msg_id = os_atoi( name );
-				iot_json_decode_object_iterator_value(
-					json, root, root_iter, &j_obj );
-
-
-				if ( os_strncmp( name, "ping", 4 ) == 0 &&
-					data->ping_miss_count > 0u )
-					--data->ping_miss_count;
-				else if ( j_obj )
-				{
-					const iot_json_item_t *j_success;
-					iot_bool_t is_success;
 
-					j_success = iot_json_decode_object_find( json,
-						j_obj, "success" );
-					if ( j_success )
-					{
-						enum tr50_transaction_status s = TR50_TRANSACTION_FAILURE;
-						iot_json_decode_bool( json, j_success, &is_success );
+		if ( handler )
+			handler( data, json, root );
+		else
+			IOT_LOG( data->lib, IOT_LOG_TRACE, "tr50: %s",
+				"message received on unknown topic" );
+	}
+	else if ( data && routed == IOT_FALSE )
+		IOT_LOG( data->lib, IOT_LOG_ERROR, "tr50: %s",
+			"failed to parse incoming message" );
 
-						/* update transaction status */
-						if ( msg_id > 0 && msg_id < 256 )
-						{
-							if ( is_success )
-								s = TR50_TRANSACTION_SUCCESS;
-							tr50_transaction_status_set(
-								data, (iot_uint8_t)msg_id, s );
-						}
+#ifdef IOT_STACK_ONLY
+	iot_json_decode_terminate( json );
+#else
+	tr50_decoder_release( data, json );
+#endif
+}
 
-						if ( is_success )
-						{
-							const iot_json_item_t *j_params;
-							const iot_json_item_t *j_messages;
-							j_params = iot_json_decode_object_find(
-								json, j_obj, "params" );
+void tr50_on_reply(
+	struct tr50_data *data,
+	iot_json_decoder_t *json,
+	const iot_json_item_t *root )
+{
+	const iot_json_object_iterator_t *const root_iter =
+		iot_json_decode_object_iterator( json, root );
+	if ( root_iter )
+	{
+		char name[ IOT_NAME_MAX_LEN + 1u ];
+		const char *v = NULL;
+		size_t v_len = 0u;
+		const iot_json_item_t *j_obj = NULL;
+		int msg_id = 0;
+
+		iot_json_decode_object_iterator_key( json, root, root_iter,
+			&v, &v_len );
+		tr50_slice_copy( name, sizeof( name ), v, v_len );
+		msg_id = os_atoi( name );
+		iot_json_decode_object_iterator_value( json, root, root_iter,
+			&j_obj );
+
+		if ( os_strncmp( name, "ping", 4 ) == 0 &&
+			data->ping_miss_count > 0u )
+			--data->ping_miss_count;
+		else if ( j_obj )
+		{
+			const iot_json_item_t *j_success;
+			iot_bool_t is_success;
 
-							j_messages = iot_json_decode_object_find( json,
-								j_params, "messages" );
+			j_success = iot_json_decode_object_find( json,
+				j_obj, "success" );
+			if ( j_success )
+			{
+				enum tr50_transaction_status s = TR50_TRANSACTION_FAILURE;
+				iot_json_decode_bool( json, j_success, &is_success );
 
-							/* actions (aka methods) parsing */
-							if ( j_messages && iot_json_decode_type( json, j_messages )
-								== IOT_JSON_TYPE_ARRAY )
-							{
-								size_t i;
-								const size_t msg_count =
-									iot_json_decode_array_size( json, j_messages );
-								for ( i = 0u; i < msg_count; ++i )
-								{
-									const iot_json_item_t *j_cmd_item;
-									if ( iot_json_decode_array_at( json,
-										j_messages, i, &j_cmd_item ) == IOT_STATUS_SUCCESS )
-									{
-										const iot_json_item_t *j_id;
-										j_id = iot_json_decode_object_find(
-											json, j_cmd_item, "id" );
-										if ( !j_id )
-											IOT_LOG( data->lib, IOT_LOG_WARNING,
-												"\"%s\" not found!", "id" );
-
-										j_params = iot_json_decode_object_find(
-											json, j_cmd_item, "params" );
-										if ( !j_params )
-											IOT_LOG( data->lib, IOT_LOG_WARNING,
-												"\"%s\" not found!", "params" );
-
-										if ( j_id && j_params )
-										{
-											const iot_json_item_t *j_method;
-											const iot_json_object_iterator_t *iter;
-											iot_action_request_t *req = NULL;
-
-											j_method = iot_json_decode_object_find(
-												json, j_params, "method" );
-											if ( j_method )
-											{
-												char id[ IOT_ID_MAX_LEN + 1u ];
-												*id = '\0';
-
-												iot_json_decode_string( json, j_id, &v, &v_len );
-												os_snprintf( id, IOT_ID_MAX_LEN, "%.*s", (int)v_len, v );
-												id[ IOT_ID_MAX_LEN ] = '\0';
-
-												iot_json_decode_string( json, j_method, &v, &v_len );
-												os_snprintf( name, IOT_NAME_MAX_LEN, "%.*s", (int)v_len, v );
-												name[ IOT_NAME_MAX_LEN ] = '\0';
-												req = iot_action_request_allocate( data->lib, name, "tr50" );
-												if ( req )
-													iot_action_request_option_set( req, "id", IOT_TYPE_STRING, id );
-												else
-												{
-													/* send response that message can't be handled */
-													const char *out_msg;
-													char out_msg_id[6u];
-													char out_msg_buf[ 512u ];
-													iot_json_encoder_t *out_json;
-													out_json = iot_json_encode_initialize( out_msg_buf, 512u, 0 );
-													os_snprintf( out_msg_id, sizeof(out_msg_id), "cmd" );
-													iot_json_encode_object_start( out_json, out_msg_id );
-													iot_json_encode_string( out_json, "command", "mailbox.ack" );
-													iot_json_encode_object_start( out_json, "params" );
-													iot_json_encode_string( out_json, "id", id );
-													iot_json_encode_integer( out_json, "errorCode", (int)IOT_STATUS_FULL );
-													iot_json_encode_string( out_json, "errorMessage", "maximum inbound requests reached" );
-													iot_json_encode_object_end( out_json );
-													iot_json_encode_object_end( out_json );
-
-													out_msg = iot_json_encode_dump( out_json );
-													tr50_mqtt_publish(
-														data, "api", out_msg,
-														os_strlen( out_msg ), NULL );
-													iot_json_encode_terminate( out_json );
-												}
-											}
-
-											/* for each parameter */
-											j_params = iot_json_decode_object_find(
-												json, j_params, "params" );
-											iter = iot_json_decode_object_iterator(
-												json, j_params );
-											while ( iter )
-											{
-												const iot_json_item_t *j_value = NULL;
-												iot_json_decode_object_iterator_key(
-													json, j_params, iter,
-													&v, &v_len );
-												iot_json_decode_object_iterator_value(
-													json, j_params, iter,
-													&j_value );
-												os_snprintf( name, IOT_NAME_MAX_LEN, "%.*s", (int)v_len, v );
-												name[ IOT_NAME_MAX_LEN ] = '\0';
-												iter = iot_json_decode_object_iterator_next(
-													json, j_params, iter );
-												switch ( iot_json_decode_type( json,
-													j_value ) )
-												{
-												case IOT_JSON_TYPE_BOOL:
-													{
-													iot_bool_t value;
-													iot_json_decode_bool( json, j_value, &value );
-													iot_action_request_parameter_set( req, name, IOT_TYPE_BOOL, value );
-													}
-													break;
-												case IOT_JSON_TYPE_INTEGER:
-													{
-													iot_int64_t value;
-													iot_json_decode_integer( json, j_value, &value );
-													iot_action_request_parameter_set( req, name, IOT_TYPE_INT64, value );
-													}
-													break;
-												case IOT_JSON_TYPE_REAL:
-													{
-													iot_float64_t value;
-													iot_json_decode_real( json, j_value, &value );
-													iot_action_request_parameter_set( req, name, IOT_TYPE_FLOAT64, value );
-													}
-													break;
-												case IOT_JSON_TYPE_STRING:
-													{
-													char *value;
-													iot_json_decode_string( json, j_value, &v, &v_len );
-													value = os_malloc( v_len + 1u );
-													if( value )
-													{
-														size_t j;
-														char *p = value;
-														for ( j = 0u; j < v_len; ++j )
-														{
-															if ( *v != '\\' || *(v+1) != '"' )
-																*p++ = *v;
-															++v;
-														}
-														*p = '\0';
-														iot_action_request_parameter_set( req, name, IOT_TYPE_STRING, value );
-														os_free( value );
-													}
-													}
-												case IOT_JSON_TYPE_ARRAY:
-												case IOT_JSON_TYPE_OBJECT:
-												case IOT_JSON_TYPE_NULL:
-												default:
-													break;
-												}
-											}
-
-											if ( req )
-												iot_action_request_execute( req, 0u );
-										}
-									}
-								}
-							}
-							else
-							{
-								j_obj = iot_json_decode_object_find( json,
-									j_params, "fileId" );
-								if ( j_obj && iot_json_decode_type( json, j_obj )
-									== IOT_JSON_TYPE_STRING )
-								{
-									/* file transfer request parsing */
-									iot_bool_t found_transfer = IOT_FALSE;
-									struct tr50_file_transfer *transfer = NULL;
-									iot_int64_t crc32 = 0u;
-									iot_int64_t fileSize = 0u;
-
-									/* obtain the fileId */
-									iot_json_decode_string( json, j_obj, &v, &v_len );
-
-									j_obj = iot_json_decode_object_find( json,
-										j_params, "crc32" );
-									if ( j_obj && iot_json_decode_type( json, j_obj )
-										== IOT_JSON_TYPE_INTEGER )
-										iot_json_decode_integer( json, j_obj, &crc32 );
-
-									j_obj = iot_json_decode_object_find( json,
-										j_params, "fileSize" );
-									if ( j_obj && iot_json_decode_type( json, j_obj )
-										== IOT_JSON_TYPE_INTEGER )
-										iot_json_decode_integer( json, j_obj, &fileSize );
-
-									if ( msg_id > 0 && (unsigned int)msg_id >= TR50_FILE_REQUEST_ID_OFFSET &&
-										(unsigned int)msg_id - TR50_FILE_REQUEST_ID_OFFSET < TR50_FILE_TRANSFER_MAX )
-									{
-										transfer = &data->file_transfer_queue[(unsigned int)msg_id - TR50_FILE_REQUEST_ID_OFFSET];
-										if ( transfer->path[0] )
-										{
-											/* determine host name from config file */
-											const char *host = NULL;
-											iot_config_get( data->lib,
-												"cloud.host", IOT_FALSE,
-												IOT_TYPE_STRING, &host );
-											os_snprintf( transfer->url, PATH_MAX,
-												"https://%s/file/%.*s", host, (int)v_len, v );
-											transfer->crc32 = (iot_uint64_t)crc32;
-											transfer->size = (iot_uint64_t)fileSize;
-											transfer->retry_time = 0u;
-											transfer->expiry_time =
-												iot_timestamp_now() +
-												TR50_FILE_TRANSFER_EXPIRY_TIME;
-											transfer->max_retries =
-												IOT_TRANSFER_MAX_RETRIES;
-											found_transfer = IOT_TRUE;
-										}
-									}
-
-									if ( found_transfer )
-									{
-#if defined( IOT_THREAD_SUPPORT )
-										os_thread_t thread;
-										size_t stack_size = 0u;
-
-#if defined( __VXWORKS__ )
-										stack_size = deviceCloudStackSizeGet();
-#endif /* if defined( __VXWORKS__ ) */
-
-										/* Create a thread to do the file transfer */
-										if ( os_thread_create( &thread, tr50_file_transfer, transfer, stack_size ) )
-											IOT_LOG( data->lib, IOT_LOG_ERROR,
-												"Failed to create a thread to transfer "
-												"file for message #%u", (unsigned int)msg_id );
-#endif /* if defined( IOT_THREAD_SUPPORT ) */
-									}
-								}
-							}
-						}
-					}
+				/* update transaction status */
+				if ( msg_id > 0 && msg_id < 256 )
+				{
+					if ( is_success )
+						s = TR50_TRANSACTION_SUCCESS;
+					tr50_transaction_status_set(
+						data, (iot_uint8_t)msg_id, s );
+				}
+
+				if ( is_success )
+				{
+					const iot_json_item_t *j_params;
+					const iot_json_item_t *j_messages;
+					j_params = iot_json_decode_object_find(
+						json, j_obj, "params" );
+
+					j_messages = iot_json_decode_object_find( json,
+						j_params, "messages" );
+
+					/* actions (aka methods) parsing */
+					if ( j_messages && iot_json_decode_type( json, j_messages )
+						== IOT_JSON_TYPE_ARRAY )
+						tr50_on_mailbox_messages( data, json,
+							j_messages );
+					else
+						tr50_on_file_reply( data, json,
+							j_params, msg_id );
 				}
+				else if ( msg_id > 0 && (unsigned int)msg_id >=
+					TR50_FILE_REQUEST_ID_OFFSET )
+					/* cloud refused the file transfer */
+					tr50_transfer_cancel( data->transfer,
+						(iot_uint32_t)msg_id -
+						TR50_FILE_REQUEST_ID_OFFSET, IOT_TRUE );
 			}
 		}
-		else
-			IOT_LOG( data->lib, IOT_LOG_TRACE, "tr50: %s",
-				"message received on unknown topic" );
-		iot_json_decode_terminate( json );
 	}
-	else if ( data )
-		IOT_LOG( data->lib, IOT_LOG_ERROR, "tr50: %s",
-			"failed to parse incoming message" );
 }
 
 void tr50_optional(
+	struct tr50_data *data,
 	iot_json_encoder_t *json,
 	const char *json_key,
 	const iot_options_t *options,
@@ -2378,29 +3908,29 @@ void tr50_optional(
 {
 	if ( json && options && options_key && *options_key != '\0' )
 	{
-		struct iot_data data;
+		struct iot_data value;
 		switch( type )
 		{
 		case IOT_TYPE_BOOL:
 		{
-			data.value.boolean = IOT_FALSE;
+			value.value.boolean = IOT_FALSE;
 			if ( iot_options_get_bool( options, options_key, IOT_FALSE,
-				&data.value.boolean ) == IOT_STATUS_SUCCESS )
+				&value.value.boolean ) == IOT_STATUS_SUCCESS )
 			{
 				iot_json_encode_bool( json, json_key,
-					data.value.boolean );
+					value.value.boolean );
 			}
 			break;
 		}
 		case IOT_TYPE_FLOAT32:
 		case IOT_TYPE_FLOAT64:
 		{
-			data.value.float64 = 0.0;
+			value.value.float64 = 0.0;
 			if ( iot_options_get_real( options, options_key, IOT_FALSE,
-				&data.value.float64 ) == IOT_STATUS_SUCCESS )
+				&value.value.float64 ) == IOT_STATUS_SUCCESS )
 			{
 				iot_json_encode_real( json, json_key,
-					data.value.float64 );
+					value.value.float64 );
 			}
 			break;
 		}
@@ -2413,62 +3943,62 @@ void tr50_optional(
 		case IOT_TYPE_UINT32:
 		case IOT_TYPE_UINT64:
 		{
-			data.value.int64 = 0;
+			value.value.int64 = 0;
 			if ( iot_options_get_integer( options, options_key, IOT_FALSE,
-				&data.value.int64 ) == IOT_STATUS_SUCCESS )
+				&value.value.int64 ) == IOT_STATUS_SUCCESS )
 			{
 				iot_json_encode_integer( json, json_key,
-					data.value.int64 );
+					value.value.int64 );
 			}
 			break;
 		}
 		case IOT_TYPE_LOCATION:
 		{
-			data.value.location = NULL;
+			value.value.location = NULL;
 			if ( iot_options_get_location( options, options_key,
-				IOT_FALSE, &data.value.location ) == IOT_STATUS_SUCCESS &&
-				data.value.location )
+				IOT_FALSE, &value.value.location ) == IOT_STATUS_SUCCESS &&
+				value.value.location )
 			{
 				if ( json_key )
 					iot_json_encode_object_start( json, json_key );
 				iot_json_encode_real( json, "lat",
-					data.value.location->latitude );
+					value.value.location->latitude );
 				iot_json_encode_real( json, "lng",
-					data.value.location->longitude );
+					value.value.location->longitude );
 				if ( json_key )
 					iot_json_encode_object_end( json );
 			}
 			break;
 		}
 		case IOT_TYPE_RAW:
-			data.value.raw.ptr = NULL;
+			value.value.raw.ptr = NULL;
 			if ( iot_options_get_raw( options, options_key,
-				IOT_FALSE, &data.value.raw.length,
-				&data.value.raw.ptr ) == IOT_STATUS_SUCCESS &&
-				data.value.raw.ptr )
+				IOT_FALSE, &value.value.raw.length,
+				&value.value.raw.ptr ) == IOT_STATUS_SUCCESS &&
+				value.value.raw.ptr )
 			{
 				iot_json_encode_string( json, json_key,
-					data.value.raw.ptr );
+					value.value.raw.ptr );
 			}
 			break;
 		case IOT_TYPE_STRING:
-			data.value.string = NULL;
+			value.value.string = NULL;
 			if ( iot_options_get_string( options, options_key,
-				IOT_FALSE, &data.value.string ) == IOT_STATUS_SUCCESS &&
-				data.value.string )
+				IOT_FALSE, &value.value.string ) == IOT_STATUS_SUCCESS &&
+				value.value.string )
 			{
 				iot_json_encode_string( json, json_key,
-					data.value.string );
+					value.value.string );
 			}
 			break;
 		case IOT_TYPE_NULL: /* special case: time stamp */
 		{
 			if ( iot_options_get_integer( options, options_key,
-				IOT_FALSE, &data.value.int64 ) == IOT_STATUS_SUCCESS )
+				IOT_FALSE, &value.value.int64 ) == IOT_STATUS_SUCCESS )
 			{
 				char ts_str[32u];
-				tr50_strtime(
-					(iot_timestamp_t)data.value.int64,
+				tr50_strtime( data,
+					(iot_timestamp_t)value.value.int64,
 					ts_str, 25u );
 				iot_json_encode_string( json, json_key, ts_str );
 			}
@@ -2484,7 +4014,14 @@ void tr50_ping(
 	const iot_transaction_t *txn,
 	iot_millisecond_t max_time_out )
 {
-	if ( data )
+	/* mqtt keep alive detects a lost connection, unless disabled; the
+	 * hub keeps a shared connection alive */
+#ifdef TR50_HUB_SUPPORT
+	if ( data && data->keep_alive == 0u &&
+		data->hub_client == IOT_FALSE )
+#else /* ifdef TR50_HUB_SUPPORT */
+	if ( data && data->keep_alive == 0u )
+#endif /* else TR50_HUB_SUPPORT */
 	{
 		iot_timestamp_t now = iot_timestamp_now();
 		if ( data->time_last_msg_received > 0u &&
@@ -2492,9 +4029,11 @@ void tr50_ping(
 		{
 			if ( data->ping_miss_count > TR50_PING_MISS_ALLOWED )
 			{
-				/* try to reconnect */
-				tr50_connect( lib, data, txn,
-					max_time_out, IOT_TRUE );
+				/* try to reconnect, backing off if it fails */
+				if ( tr50_connect( lib, data, txn,
+					max_time_out, IOT_TRUE ) !=
+					IOT_STATUS_SUCCESS )
+					tr50_reconnect_schedule( data, now );
 				data->ping_miss_count = 0u;
 			}
 			else
@@ -2513,7 +4052,8 @@ void tr50_ping(
 				out_msg = iot_json_encode_dump( out_json );
 				tr50_mqtt_publish(
 					data, "api", out_msg,
-					os_strlen( out_msg ), NULL );
+					os_strlen( out_msg ), TR50_MQTT_QOS,
+					TR50_SEND_CONTROL, NULL, NULL );
 				iot_json_encode_terminate( out_json );
 
 				/* update receive time, so another ping isn't sent */
@@ -2524,26 +4064,309 @@ void tr50_ping(
 	}
 }
 
-char *tr50_strtime( iot_timestamp_t ts,
+void tr50_reconnect_schedule(
+	struct tr50_data *data,
+	iot_timestamp_t from )
+{
+	iot_millisecond_t delay_min = data->reconnect_delay_min;
+	iot_millisecond_t delay_max = data->reconnect_delay_max;
+	iot_millisecond_t upper;
+	iot_uint32_t x = data->reconnect_random;
+
+	if ( delay_min == 0u )
+		delay_min = TR50_TIMEOUT_RECONNECT_MS;
+	if ( delay_max < delay_min )
+		delay_max = delay_min;
+
+	/* seed differs between devices (thing key) & between runs */
+	if ( x == 0u )
+	{
+		const char *p;
+		x = 2166136261u;
+		for ( p = data->thing_key; *p != '\0'; ++p )
+			x = ( x ^ (iot_uint8_t)*p ) * 16777619u;
+		x ^= (iot_uint32_t)iot_timestamp_now();
+		if ( x == 0u )
+			x = 1u;
+	}
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	data->reconnect_random = x;
+
+	/* random delay between minimum & 3x previous delay, capped */
+	upper = data->reconnect_delay;
+	if ( upper < delay_min )
+		upper = delay_min;
+	if ( upper > delay_max / 3u )
+		upper = delay_max;
+	else
+		upper *= 3u;
+	data->reconnect_delay = delay_min +
+		(iot_millisecond_t)( x % ( upper - delay_min + 1u ) );
+	data->reconnect_time = from + data->reconnect_delay;
+}
+
+#ifndef IOT_STACK_ONLY
+void tr50_send_queue_clear(
+	struct tr50_data *data )
+{
+	if ( data )
+	{
+		size_t i;
+#ifdef IOT_THREAD_SUPPORT
+		os_thread_mutex_lock( &data->send_mutex );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+		for ( i = 0u; i < TR50_SEND_CLASS_COUNT; ++i )
+		{
+			struct tr50_send_queue *const queue =
+				&data->send_queue[i];
+			while ( queue->head )
+			{
+				struct tr50_send_msg *const msg = queue->head;
+				queue->head = msg->next;
+				tr50_encoder_release( data, msg->json );
+				os_free( msg );
+			}
+			queue->tail = NULL;
+			queue->bytes = 0u;
+			queue->count = 0u;
+		}
+		data->send_queued = 0u;
+#ifdef IOT_THREAD_SUPPORT
+		os_thread_mutex_unlock( &data->send_mutex );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+	}
+}
+
+size_t tr50_send_queue_flush(
+	struct tr50_data *data )
+{
+	size_t result = 0u;
+	if ( data )
+	{
+		size_t i;
+		iot_bool_t stop = IOT_FALSE;
+		iot_millisecond_t latency = 0u;
+#ifdef IOT_THREAD_SUPPORT
+		os_thread_mutex_lock( &data->send_mutex );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+		if ( !data->mqtt )
+			stop = IOT_TRUE;
+#ifdef TR50_HUB_SUPPORT
+		if ( data->hub_client != IOT_FALSE )
+			stop = IOT_FALSE;
+#endif /* ifdef TR50_HUB_SUPPORT */
+		for ( i = 0u; stop == IOT_FALSE && data->send_queued > 0u &&
+			i < TR50_SEND_CLASS_COUNT; ++i )
+		{
+			struct tr50_send_queue *const queue =
+				&data->send_queue[i];
+			while ( stop == IOT_FALSE && queue->head )
+			{
+				struct tr50_send_msg *const msg = queue->head;
+				const iot_status_t status =
+					tr50_transport_publish( data,
+						msg->topic, msg->payload,
+						msg->payload_len, msg->qos );
+
+				/* client still busy, retry on next flush */
+				if ( status == IOT_STATUS_FULL ||
+					status == IOT_STATUS_IO_ERROR )
+					stop = IOT_TRUE;
+				else
+				{
+					if ( status != IOT_STATUS_SUCCESS &&
+						msg->has_txn != IOT_FALSE )
+						tr50_transaction_status_set( data,
+							msg->txn,
+							TR50_TRANSACTION_FAILURE );
+					queue->head = msg->next;
+					if ( !queue->head )
+						queue->tail = NULL;
+					queue->bytes -= msg->payload_len;
+					--queue->count;
+					--data->send_queued;
+					tr50_encoder_release( data, msg->json );
+					os_free( msg );
+				}
+			}
+		}
+		result = data->send_queued;
+		if ( result > 0u )
+		{
+			const iot_timestamp_t now = iot_timestamp_now();
+			for ( i = 0u; i < TR50_SEND_BULK; ++i )
+			{
+				const struct tr50_send_msg *const msg =
+					data->send_queue[i].head;
+				if ( msg && now > msg->time &&
+					now - msg->time > latency )
+					latency = (iot_millisecond_t)
+						( now - msg->time );
+			}
+		}
+#ifdef IOT_THREAD_SUPPORT
+		os_thread_mutex_unlock( &data->send_mutex );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+		tr50_transfer_latency_set( data->transfer, latency );
+	}
+	return result;
+}
+
+iot_status_t tr50_send_queue_push(
+	struct tr50_data *data,
+	enum tr50_send_class send_class,
+	const char *topic,
+	const void *payload,
+	size_t payload_len,
+	int qos,
+	iot_json_encoder_t *json,
+	const iot_transaction_t *txn )
+{
+	iot_status_t result = IOT_STATUS_BAD_PARAMETER;
+	if ( data && topic && payload && send_class < TR50_SEND_CLASS_COUNT )
+	{
+		struct tr50_send_queue *const queue =
+			&data->send_queue[send_class];
+#ifdef IOT_THREAD_SUPPORT
+		os_thread_mutex_lock( &data->send_mutex );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+		result = IOT_STATUS_FULL;
+		/* budget may be lowered below the bytes already queued */
+		if ( queue->count < queue->max_count &&
+			queue->bytes <= queue->max_bytes &&
+			payload_len <= queue->max_bytes - queue->bytes )
+		{
+			size_t msg_len = sizeof( struct tr50_send_msg );
+			struct tr50_send_msg *msg;
+
+			/* without an encoder the payload is copied */
+			if ( !json )
+				msg_len += payload_len;
+			result = IOT_STATUS_NO_MEMORY;
+			msg = os_malloc( msg_len );
+			if ( msg )
+			{
+				os_memzero( msg, sizeof( struct tr50_send_msg ) );
+				msg->json = json;
+				msg->payload = payload;
+				if ( !json )
+				{
+					os_memcpy( msg + 1, payload, payload_len );
+					msg->payload = msg + 1;
+				}
+				msg->payload_len = payload_len;
+				msg->qos = qos;
+				msg->time = iot_timestamp_now();
+				msg->topic = topic;
+				if ( txn )
+				{
+					msg->has_txn = IOT_TRUE;
+					msg->txn = *txn;
+				}
+
+				if ( queue->tail )
+					queue->tail->next = msg;
+				else
+					queue->head = msg;
+				queue->tail = msg;
+				queue->bytes += payload_len;
+				++queue->count;
+				++data->send_queued;
+				result = IOT_STATUS_SUCCESS;
+			}
+		}
+		else
+			IOT_LOG( data->lib, IOT_LOG_WARNING,
+				"tr50: outbound %s queue is full",
+				TR50_SEND_CLASS_INFO[send_class].name );
+#ifdef IOT_THREAD_SUPPORT
+		os_thread_mutex_unlock( &data->send_mutex );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+	}
+	return result;
+}
+#endif /* ifndef IOT_STACK_ONLY */
+
+char *tr50_slice_copy(
+	char *dest,
+	size_t dest_len,
+	const char *src,
+	size_t src_len )
+{
+	if ( dest && dest_len > 0u )
+	{
+		if ( !src )
+			src_len = 0u;
+		if ( src_len >= dest_len )
+			src_len = dest_len - 1u;
+		os_memcpy( dest, src, src_len );
+		dest[src_len] = '\0';
+	}
+	return dest;
+}
+
+char *tr50_strtime( struct tr50_data *data, iot_timestamp_t ts,
 	char *out, size_t len )
 {
-	size_t out_len;
+	size_t out_len = 0u;
+	const iot_timestamp_t second = ts / 1000u;
+	const unsigned int msec = (unsigned int)( ts % 1000u );
+
+	/* TR50 format: "YYYY-MM-DDTHH:MM:SS.mmmZ" */
+	if ( data )
+	{
+#ifdef IOT_THREAD_SUPPORT
+		os_thread_mutex_lock( &data->time_mutex );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+		if ( data->time_cache.len > 0u &&
+			data->time_cache.second == second &&
+			data->time_cache.len < len )
+		{
+			os_memcpy( out, data->time_cache.prefix,
+				data->time_cache.len );
+			out_len = data->time_cache.len;
+		}
+#ifdef IOT_THREAD_SUPPORT
+		os_thread_mutex_unlock( &data->time_mutex );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+	}
+
+	if ( out_len == 0u )
+	{
+		out_len = os_time_format( out, len,
+			"%Y-%m-%dT%H:%M:%S", ts, OS_FALSE );
+
+		/* save for other time stamps within the same second */
+		if ( data && out_len > 0u && out_len <= TR50_TIME_PREFIX_LEN )
+		{
+#ifdef IOT_THREAD_SUPPORT
+			os_thread_mutex_lock( &data->time_mutex );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+			os_memcpy( data->time_cache.prefix, out, out_len );
+			data->time_cache.len = out_len;
+			data->time_cache.second = second;
+#ifdef IOT_THREAD_SUPPORT
+			os_thread_mutex_unlock( &data->time_mutex );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+		}
+	}
 
-	/* TR50 format: "YYYY-MM-DDTHH:MM:SS.mmZ" */
-	out_len = os_time_format( out, len,
-		"%Y-%m-%dT%H:%M:%S", ts, OS_FALSE );
 	if ( out_len > 0u )
 	{
 		/* add milliseconds, if there are any remaining */
-		ts %= 1000u;
-		if ( ts > 0u )
+		if ( msec > 0u )
 		{
-			size_t out_req;
-			out_req = (size_t)os_snprintf( &out[out_len],
-				len - out_len, ".%03u", (unsigned int)ts );
-
-			if ( out_req < len - out_len )
-				out_len += out_req;
+			if ( out_len + 4u < len )
+			{
+				const char *const pair =
+					&TR50_DIGIT_PAIRS[ ( msec % 100u ) * 2u ];
+				out[out_len++] = '.';
+				out[out_len++] = (char)( '0' + msec / 100u );
+				out[out_len++] = pair[0];
+				out[out_len++] = pair[1];
+			}
 			else
 				out_len = 0u;
 		}
@@ -2566,117 +4389,318 @@ iot_status_t tr50_telemetry_publish(
 	const iot_telemetry_t *t,
 	const struct iot_data *d,
 	const iot_transaction_t *txn,
-	const iot_options_t *UNUSED(options) )
+	const iot_options_t *options )
 {
 	iot_status_t result = IOT_STATUS_FAILURE;
 	if ( d->has_value )
 	{
-		const char *cmd;
-		char id[11u];
-		const char *msg;
-		const char *const value_key = "value";
-		iot_json_encoder_t *const json =
-			iot_json_encode_initialize( NULL, 0u, 0u);
-
-		if ( d->type == IOT_TYPE_LOCATION )
-			cmd = "location.publish";
-		else if ( d->type == IOT_TYPE_STRING ||
-			d->type == IOT_TYPE_RAW )
-			cmd = "attribute.publish";
-		else
-			cmd = "property.publish";
-
-		/* convert id to string */
-		if ( txn )
-			os_snprintf( id, sizeof(id), "%u", (unsigned int)(*txn) );
-		else
-			os_snprintf( id, sizeof(id), "cmd" );
-		iot_json_encode_object_start( json, id );
-		iot_json_encode_string( json, "command", cmd );
-		iot_json_encode_object_start( json, "params" );
-		iot_json_encode_string( json, "thingKey",
-			data->thing_key );
-		iot_json_encode_string( json, "key",
-			iot_telemetry_name_get( t ) );
+		iot_bool_t is_number = IOT_TRUE;
+		iot_float64_t number = 0.0;
+		iot_int64_t qos = data->telemetry_qos;
+
+		/* quality of service for this sample */
+		if ( iot_options_get_integer( options, "qos", IOT_TRUE,
+			&qos ) != IOT_STATUS_SUCCESS )
+			iot_telemetry_option_get( t, "qos", IOT_TRUE,
+				IOT_TYPE_INT64, &qos );
+		if ( qos < 0 || qos > TR50_MQTT_QOS_MAX )
+			qos = data->telemetry_qos;
+
+		/* numeric values are all published as real numbers */
 		switch ( d->type )
 		{
 		case IOT_TYPE_BOOL:
-			iot_json_encode_real( json, value_key,
-				(double)d->value.boolean );
+			number = (iot_float64_t)d->value.boolean;
 			break;
 		case IOT_TYPE_FLOAT32:
-			iot_json_encode_real( json, value_key,
-				(double)d->value.float32 );
+			number = (iot_float64_t)d->value.float32;
 			break;
 		case IOT_TYPE_FLOAT64:
-			iot_json_encode_real( json, value_key,
-				(double)d->value.float64 );
+			number = (iot_float64_t)d->value.float64;
 			break;
 		case IOT_TYPE_INT8:
-			iot_json_encode_real( json, value_key,
-				(double)d->value.int8 );
+			number = (iot_float64_t)d->value.int8;
 			break;
 		case IOT_TYPE_INT16:
-			iot_json_encode_real( json, value_key,
-				(double)d->value.int16 );
+			number = (iot_float64_t)d->value.int16;
 			break;
 		case IOT_TYPE_INT32:
-			iot_json_encode_real( json, value_key,
-				(double)d->value.int32 );
+			number = (iot_float64_t)d->value.int32;
 			break;
 		case IOT_TYPE_INT64:
-			iot_json_encode_real( json, value_key,
-				(double)d->value.int64 );
+			number = (iot_float64_t)d->value.int64;
 			break;
 		case IOT_TYPE_UINT8:
-			iot_json_encode_real( json, value_key,
-				(double)d->value.uint8 );
+			number = (iot_float64_t)d->value.uint8;
 			break;
 		case IOT_TYPE_UINT16:
-			iot_json_encode_real( json, value_key,
-				(double)d->value.uint16 );
+			number = (iot_float64_t)d->value.uint16;
 			break;
 		case IOT_TYPE_UINT32:
-			iot_json_encode_real( json, value_key,
-				(double)d->value.uint32 );
+			number = (iot_float64_t)d->value.uint32;
 			break;
 		case IOT_TYPE_UINT64:
-			iot_json_encode_real( json, value_key,
-				(double)d->value.uint64 );
-			break;
-		case IOT_TYPE_RAW:
-			tr50_append_value_raw( json, value_key,
-				d->value.raw.ptr, d->value.raw.length );
-			break;
-		case IOT_TYPE_STRING:
-			tr50_append_value_raw( json, value_key,
-				d->value.string, (size_t)-1 );
+			number = (iot_float64_t)d->value.uint64;
 			break;
 		case IOT_TYPE_LOCATION:
-			tr50_append_location( json, NULL, d->value.location );
-			break;
 		case IOT_TYPE_NULL:
+		case IOT_TYPE_RAW:
+		case IOT_TYPE_STRING:
 		default:
-			break;
+			is_number = IOT_FALSE;
+		}
+
+#ifndef IOT_STACK_ONLY
+		/* splice the value into the cached request if possible */
+		result = IOT_STATUS_NOT_SUPPORTED;
+		if ( is_number != IOT_FALSE )
+			result = tr50_template_publish( data, t, number,
+				(int)qos, txn );
+		if ( result == IOT_STATUS_NOT_SUPPORTED )
+#endif /* ifndef IOT_STACK_ONLY */
+		{
+			const char *cmd;
+			char id[11u];
+			const char *const value_key = "value";
+#ifdef IOT_STACK_ONLY
+			iot_json_encoder_t *const json =
+				iot_json_encode_initialize( NULL, 0u,
+					data->encode_flags );
+#else /* ifdef IOT_STACK_ONLY */
+			iot_json_encoder_t *const json =
+				tr50_encoder_acquire( data );
+#endif /* else IOT_STACK_ONLY */
+
+			if ( d->type == IOT_TYPE_LOCATION )
+				cmd = "location.publish";
+			else if ( d->type == IOT_TYPE_STRING ||
+				d->type == IOT_TYPE_RAW )
+				cmd = "attribute.publish";
+			else
+				cmd = "property.publish";
+
+			/* convert id to string */
+			if ( txn )
+				os_snprintf( id, sizeof(id), "%u", (unsigned int)(*txn) );
+			else
+				os_snprintf( id, sizeof(id), "cmd" );
+			iot_json_encode_object_start( json, id );
+			iot_json_encode_string( json, "command", cmd );
+			iot_json_encode_object_start( json, "params" );
+			iot_json_encode_string( json, "thingKey",
+				data->thing_key );
+			iot_json_encode_string( json, "key",
+				iot_telemetry_name_get( t ) );
+			if ( is_number != IOT_FALSE )
+				iot_json_encode_real( json, value_key, number );
+			else if ( d->type == IOT_TYPE_RAW )
+				tr50_append_value_raw( json, value_key,
+					d->value.raw.ptr, d->value.raw.length );
+			else if ( d->type == IOT_TYPE_STRING )
+				tr50_append_value_raw( json, value_key,
+					d->value.string, (size_t)-1 );
+			else if ( d->type == IOT_TYPE_LOCATION )
+				tr50_append_location( json, NULL,
+					d->value.location );
+
+			if ( t->time_stamp > 0u )
+			{
+				char ts_str[32u];
+				tr50_strtime( data, t->time_stamp, ts_str, 25u );
+				iot_json_encode_string( json, "ts", ts_str );
+			}
+			iot_json_encode_object_end( json );
+			iot_json_encode_object_end( json );
+
+			result = tr50_mqtt_publish_request( data, json,
+				(int)qos, TR50_SEND_TELEMETRY, txn );
 		}
+	}
+	return result;
+}
+
+#ifndef IOT_STACK_ONLY
+struct tr50_template *tr50_template_find(
+	struct tr50_data *data,
+	const iot_telemetry_t *t,
+	iot_bool_t create )
+{
+	struct tr50_template *result = NULL;
+	struct tr50_template **slot = NULL;
+	const char *const name = iot_telemetry_name_get( t );
+	size_t i;
+
+	/* keyed by name, a telemetry handle may be freed & its memory reused */
+	for ( i = 0u; name && i < TR50_TEMPLATE_MAX && !result; ++i )
+	{
+		if ( data->templates[i] && os_strncmp( data->templates[i]->name,
+			name, IOT_NAME_MAX_LEN + 1u ) == 0 )
+			result = data->templates[i];
+		else if ( !data->templates[i] && !slot )
+			slot = &data->templates[i];
+	}
 
-		if ( t->time_stamp > 0u )
+	if ( !result && create != IOT_FALSE && slot )
+	{
+		result = (struct tr50_template *)os_malloc(
+			sizeof( struct tr50_template ) );
+		if ( result )
 		{
-			char ts_str[32u];
-			tr50_strtime( t->time_stamp, ts_str, 25u );
-			iot_json_encode_string( json, "ts", ts_str );
+			os_strncpy( result->name, name, IOT_NAME_MAX_LEN );
+			result->name[ IOT_NAME_MAX_LEN ] = '\0';
+			result->len = 0u;
+			*slot = result;
 		}
-		iot_json_encode_object_end( json );
-		iot_json_encode_object_end( json );
+	}
+
+	/* (re)build the template if never built or the thing key changed */
+	if ( result && ( result->len == 0u ||
+		result->generation != data->template_generation ) )
+	{
+		iot_json_encoder_t *const json = iot_json_encode_initialize(
+			NULL, 0u, IOT_JSON_FLAG_DYNAMIC );
+		const char *msg;
+		size_t msg_len = 0u;
 
-		msg = iot_json_encode_dump( json );
-		result = tr50_mqtt_publish(
-			data, "api", msg, os_strlen( msg ), txn );
+		iot_json_encode_string( json, "command", "property.publish" );
+		iot_json_encode_object_start( json, "params" );
+		iot_json_encode_string( json, "thingKey", data->thing_key );
+		iot_json_encode_string( json, "key", name );
+		msg = iot_json_encode_dump_len( json, &msg_len );
+
+		/* template: '":' + request without closing "}}" + ',"value":' */
+		result->len = 0u;
+		if ( msg && msg_len > 2u &&
+			os_strncmp( &msg[msg_len - 2u], "}}", 2u ) == 0 &&
+			msg_len + 9u <= TR50_TEMPLATE_LEN_MAX )
+		{
+			os_memcpy( result->msg, "\":", 2u );
+			os_memcpy( &result->msg[2u], msg, msg_len - 2u );
+			os_memcpy( &result->msg[msg_len], ",\"value\":", 9u );
+			result->len = msg_len + 9u;
+			result->generation = data->template_generation;
+		}
 		iot_json_encode_terminate( json );
+
+		if ( result->len == 0u )
+			result = NULL;
+	}
+	return result;
+}
+
+iot_status_t tr50_template_publish(
+	struct tr50_data *data,
+	const iot_telemetry_t *t,
+	iot_float64_t value,
+	int qos,
+	const iot_transaction_t *txn )
+{
+	iot_status_t result = IOT_STATUS_NOT_SUPPORTED;
+
+	/* binary requests & values that can't be represented in json text
+	 * (infinity, not-a-number) are built by the encoder */
+	if ( data && t && !( data->encode_flags & IOT_JSON_FLAG_BINARY ) &&
+		value >= -DBL_MAX && value <= DBL_MAX )
+	{
+		char msg[ TR50_TEMPLATE_MSG_MAX ];
+		size_t msg_len = 0u;
+		const struct tr50_template *tmpl;
+
+#ifdef IOT_THREAD_SUPPORT
+		os_thread_mutex_lock( &data->template_mutex );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+		tmpl = tr50_template_find( data, t, IOT_TRUE );
+		if ( tmpl )
+		{
+			if ( txn )
+				msg_len = (size_t)os_snprintf( msg, sizeof( msg ),
+					"{\"%u", (unsigned int)(*txn) );
+			else
+				msg_len = (size_t)os_snprintf( msg, sizeof( msg ),
+					"{\"cmd" );
+			os_memcpy( &msg[msg_len], tmpl->msg, tmpl->len );
+			msg_len += tmpl->len;
+		}
+#ifdef IOT_THREAD_SUPPORT
+		os_thread_mutex_unlock( &data->template_mutex );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+
+		/* format the value the same way the encoder does: the
+		 * compact output is '{"value":' + number + '}' */
+		if ( msg_len > 0u )
+		{
+			iot_json_encoder_t *const json =
+				tr50_encoder_acquire( data );
+			const char *num = NULL;
+			size_t num_len = 0u;
+
+			if ( iot_json_encode_real( json, "value", value ) ==
+				IOT_STATUS_SUCCESS )
+				num = iot_json_encode_dump_len( json, &num_len );
+			if ( num && num_len > 10u && num_len - 10u <
+				sizeof( msg ) - msg_len - 40u &&
+				os_strncmp( num, "{\"value\":", 9u ) == 0 )
+			{
+				os_memcpy( &msg[msg_len], &num[9u],
+					num_len - 10u );
+				msg_len += num_len - 10u;
+			}
+			else
+				msg_len = 0u;
+			tr50_encoder_release( data, json );
+		}
+
+		if ( msg_len > 0u )
+		{
+			if ( t->time_stamp > 0u )
+			{
+				os_memcpy( &msg[msg_len], ",\"ts\":\"", 7u );
+				msg_len += 7u;
+				tr50_strtime( data, t->time_stamp, &msg[msg_len],
+					25u );
+				msg_len += os_strlen( &msg[msg_len] );
+				msg[msg_len++] = '"';
+			}
+			os_memcpy( &msg[msg_len], "}}}", 3u );
+			msg_len += 3u;
+			result = tr50_mqtt_publish( data, "api", msg, msg_len,
+				qos, TR50_SEND_TELEMETRY, NULL, txn );
+		}
 	}
 	return result;
 }
 
+void tr50_template_update(
+	struct tr50_data *data,
+	const iot_telemetry_t *t,
+	iot_bool_t remove )
+{
+	if ( data && t )
+	{
+#ifdef IOT_THREAD_SUPPORT
+		os_thread_mutex_lock( &data->template_mutex );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+		if ( remove != IOT_FALSE )
+		{
+			const char *const name = iot_telemetry_name_get( t );
+			size_t i;
+			for ( i = 0u; name && i < TR50_TEMPLATE_MAX; ++i )
+			{
+				if ( data->templates[i] && os_strncmp(
+					data->templates[i]->name, name,
+					IOT_NAME_MAX_LEN + 1u ) == 0 )
+					os_free_null( (void**)&data->templates[i] );
+			}
+		}
+		else
+			tr50_template_find( data, t, IOT_TRUE );
+#ifdef IOT_THREAD_SUPPORT
+		os_thread_mutex_unlock( &data->template_mutex );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+	}
+}
+#endif /* ifndef IOT_STACK_ONLY */
+
 iot_status_t tr50_terminate(
 	iot_t *lib,
 	void *plugin_data )
@@ -2684,6 +4708,41 @@ iot_status_t tr50_terminate(
 	iot_status_t result = IOT_STATUS_SUCCESS;
 	struct tr50_data *data = plugin_data;
 	IOT_LOG( lib, IOT_LOG_TRACE, "tr50: %s", "terminate" );
+#ifdef TR50_HUB_SUPPORT
+	if ( data && data->hub )
+		tr50_hub_close( data->hub );
+#endif /* ifdef TR50_HUB_SUPPORT */
+#ifndef IOT_STACK_ONLY
+	if ( data )
+	{
+		size_t i;
+		/* queued messages may hold encoders from the pool */
+		tr50_send_queue_clear( data );
+		if ( data->ack_json )
+			tr50_encoder_release( data, data->ack_json );
+		for ( i = 0u; i < TR50_DECODER_POOL_MAX; ++i )
+			iot_json_decode_terminate( data->decoder_pool[i] );
+		for ( i = 0u; i < TR50_ENCODER_POOL_MAX; ++i )
+			iot_json_encode_terminate( data->encoder_pool[i] );
+		for ( i = 0u; i < TR50_TEMPLATE_MAX; ++i )
+			os_free_null( (void**)&data->templates[i] );
+#ifdef IOT_THREAD_SUPPORT
+		os_thread_mutex_destroy( &data->decoder_mutex );
+		os_thread_mutex_destroy( &data->encoder_mutex );
+		os_thread_mutex_destroy( &data->send_mutex );
+		os_thread_mutex_destroy( &data->template_mutex );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+	}
+#endif /* ifndef IOT_STACK_ONLY */
+#ifdef IOT_THREAD_SUPPORT
+	if ( data )
+	{
+		os_thread_mutex_destroy( &data->mailbox_mutex );
+		os_thread_mutex_destroy( &data->time_mutex );
+	}
+#endif /* ifdef IOT_THREAD_SUPPORT */
+	if ( data && data->transfer )
+		tr50_transfer_engine_destroy( data->transfer );
 	os_free_null( (void**)&data );
 	iot_mqtt_terminate();
 	curl_global_cleanup();
@@ -2755,6 +4814,25 @@ void tr50_transaction_status_set(
 	}
 }
 
+iot_status_t tr50_transport_publish(
+	struct tr50_data *data,
+	const char *topic,
+	const void *payload,
+	size_t payload_len,
+	int qos )
+{
+	iot_status_t result;
+#ifdef TR50_HUB_SUPPORT
+	if ( data->hub_client != IOT_FALSE )
+		result = tr50_hub_publish( data->hub, topic, payload,
+			payload_len, qos );
+	else
+#endif /* ifdef TR50_HUB_SUPPORT */
+		result = iot_mqtt_publish( data->mqtt, topic, payload,
+			payload_len, qos, IOT_FALSE, NULL );
+	return result;
+}
+
 IOT_PLUGIN( tr50, 10, iot_version_encode(1,0,0,0),
 	iot_version_encode(2,3,0,0), 0 )
 
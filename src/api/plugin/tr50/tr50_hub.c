@@ -0,0 +1,1068 @@
+/**
+ * @file
+ * @brief source file for sharing a single cloud connection between the
+ *        applications on a device (local hub)
+ *
+ * @copyright Copyright (C) 2018 Wind River Systems, Inc. All Rights Reserved.
+ *
+ * @license Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied."
+ */
+
+#ifndef _GNU_SOURCE
+#	define _GNU_SOURCE /* for struct ucred */
+#endif /* ifndef _GNU_SOURCE */
+
+#include "tr50_hub.h"
+
+#ifdef TR50_HUB_SUPPORT
+#include "../../shared/iot_defs.h"
+
+#include <os.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#	define MSG_NOSIGNAL 0
+#endif /* ifndef MSG_NOSIGNAL */
+
+/** @brief Maximum number of applications connected to the hub */
+#define TR50_HUB_CLIENT_MAX                 16u
+/** @brief Maximum size of a frame (header, topic & payload) */
+#define TR50_HUB_FRAME_MAX                  65536u
+/** @brief Size of the header at the start of each frame */
+#define TR50_HUB_HEADER_LEN                 8u
+/** @brief Maximum length of a topic sent between the hub & its clients */
+#define TR50_HUB_TOPIC_MAX                  64u
+/** @brief Only topic clients may send requests on, forwarded with their id */
+#define TR50_HUB_TOPIC_REQUEST              "api"
+/** @brief Maximum bytes waiting for a peer to read before it is dropped */
+#define TR50_HUB_TX_MAX                     ( 4u * TR50_HUB_FRAME_MAX )
+/** @brief Version of the frame format */
+#define TR50_HUB_VERSION                    1u
+
+/** @brief header at the start of each frame (native byte order) */
+struct tr50_hub_header
+{
+	/** @brief size of the payload following the topic */
+	iot_uint32_t payload_len;
+	/** @brief length of the topic following the header */
+	iot_uint16_t topic_len;
+	/** @brief mqtt quality of service level */
+	iot_uint8_t qos;
+	/** @brief version of the frame format */
+	iot_uint8_t version;
+};
+
+/** @brief connection between the hub & one of its clients */
+struct tr50_hub_link
+{
+	/** @brief socket of the connection (-1 if closed) */
+	int fd;
+	/** @brief identifier of the client, used to route replies */
+	iot_uint32_t id;
+	/** @brief buffer for frames being received */
+	char *rx;
+	/** @brief number of bytes held in the receive buffer */
+	size_t rx_len;
+	/** @brief frames waiting for the peer to accept them */
+	char *tx;
+	/** @brief number of bytes held in the send buffer */
+	size_t tx_len;
+	/** @brief size of the send buffer */
+	size_t tx_size;
+};
+
+/** @brief local hub connection */
+struct tr50_hub
+{
+	/** @brief listening socket (hub only, -1 for a client) */
+	int fd;
+	/** @brief connected clients (hub), or connection to the hub (client) */
+	struct tr50_hub_link links[ TR50_HUB_CLIENT_MAX ];
+	/** @brief number of connections in use */
+	size_t link_count;
+	/** @brief identifier to assign to the next client */
+	iot_uint32_t next_id;
+	/** @brief callback for messages received from the cloud (client) */
+	iot_mqtt_message_callback_t on_message;
+	/** @brief callback for publishing client requests (hub) */
+	tr50_hub_publish_callback_t on_publish;
+	/** @brief user data to pass to the callbacks */
+	void *user_data;
+	/** @brief path of the hub socket */
+	char path[ PATH_MAX + 1u ];
+#ifdef IOT_THREAD_SUPPORT
+	/** @brief mutex protecting the connections & their send buffers */
+	os_thread_mutex_t lock;
+	/** @brief thread servicing the sockets */
+	os_thread_t thread;
+	/** @brief whether the thread has been started */
+	iot_bool_t thread_started;
+	/** @brief flag to stop the thread */
+	iot_bool_t to_quit;
+	/** @brief pipe waking the thread when frames are left to send */
+	int wake_fd[2u];
+#endif /* ifdef IOT_THREAD_SUPPORT */
+};
+
+/**
+ * @brief accepts a new client on the hub socket
+ *
+ * @param[in,out]  hub                 hub
+ */
+static IOT_SECTION void tr50_hub_accept(
+	tr50_hub_t *hub );
+
+/**
+ * @brief sets the address of the hub socket
+ *
+ * @param[out]     addr                address to set
+ * @param[in]      path                path of the hub socket
+ *
+ * @retval IOT_FALSE                   path is too long for a socket address
+ * @retval IOT_TRUE                    on success
+ */
+static IOT_SECTION iot_bool_t tr50_hub_address(
+	struct sockaddr_un *addr,
+	const char *path );
+
+/**
+ * @brief allocates a hub structure
+ *
+ * @param[in]      path                path of the hub socket
+ *
+ * @return a new hub structure, NULL on failure
+ */
+static IOT_SECTION tr50_hub_t *tr50_hub_alloc(
+	const char *path );
+
+/**
+ * @brief handles a complete frame received on a connection
+ *
+ * @param[in,out]  hub                 hub or connection to the hub
+ * @param[in]      link                connection the frame was received on
+ * @param[in]      topic               topic of the frame
+ * @param[in]      payload             payload of the frame
+ * @param[in]      payload_len         size of the payload
+ * @param[in]      qos                 mqtt quality of service level
+ *
+ * @retval IOT_FALSE                   client sent on a topic not allowed
+ * @retval IOT_TRUE                    frame was handled
+ */
+static IOT_SECTION iot_bool_t tr50_hub_frame(
+	tr50_hub_t *hub,
+	const struct tr50_hub_link *link,
+	const char *topic,
+	void *payload,
+	size_t payload_len,
+	int qos );
+
+/**
+ * @brief closes a connection & releases its receive buffer
+ *
+ * @param[in,out]  hub                 hub or connection to the hub
+ * @param[in]      idx                 index of the connection to close
+ */
+static IOT_SECTION void tr50_hub_link_close(
+	tr50_hub_t *hub,
+	size_t idx );
+
+/**
+ * @brief sends as much of the frames waiting on a connection as possible
+ *
+ * @note the caller must hold the lock protecting the connections
+ *
+ * @param[in,out]  link                connection to send on
+ *
+ * @retval IOT_STATUS_IO_ERROR         connection failed
+ * @retval IOT_STATUS_SUCCESS          on success (some data may still wait)
+ */
+static IOT_SECTION iot_status_t tr50_hub_link_flush(
+	struct tr50_hub_link *link );
+
+/**
+ * @brief reads available data from a connection & handles complete frames
+ *
+ * @param[in,out]  hub                 hub or connection to the hub
+ * @param[in,out]  link                connection to read from
+ *
+ * @retval IOT_FALSE                   connection was closed or is invalid
+ * @retval IOT_TRUE                    connection is still usable
+ */
+static IOT_SECTION iot_bool_t tr50_hub_link_read(
+	tr50_hub_t *hub,
+	struct tr50_hub_link *link );
+
+/**
+ * @brief sends a frame on a connection, without blocking
+ *
+ * @note the caller must hold the lock protecting the connections.  Any part
+ * of the frame the peer can't accept yet is kept in the send buffer of the
+ * connection, until the socket is writable again.
+ *
+ * @param[in,out]  link                connection to send on
+ * @param[in]      topic               topic of the frame
+ * @param[in]      payload             payload of the frame
+ * @param[in]      payload_len         size of the payload
+ * @param[in]      qos                 mqtt quality of service level
+ *
+ * @retval IOT_STATUS_BAD_PARAMETER    frame is larger than supported
+ * @retval IOT_STATUS_IO_ERROR         connection failed or the peer is not
+ *                                     keeping up, it is shut down
+ * @retval IOT_STATUS_SUCCESS          on success
+ */
+static IOT_SECTION iot_status_t tr50_hub_link_write(
+	struct tr50_hub_link *link,
+	const char *topic,
+	const void *payload,
+	size_t payload_len,
+	int qos );
+
+/**
+ * @brief checks that the peer of a connection runs as the same user
+ *
+ * @param[in]      fd                  connected socket to check
+ *
+ * @retval IOT_FALSE                   peer is another user (or unknown)
+ * @retval IOT_TRUE                    peer runs as the same user
+ */
+static IOT_SECTION iot_bool_t tr50_hub_peer_allowed(
+	int fd );
+
+/**
+ * @brief waits for & handles activity on the hub sockets
+ *
+ * @param[in,out]  hub                 hub or connection to the hub
+ * @param[in]      max_time_out        maximum time to wait for activity
+ */
+static IOT_SECTION void tr50_hub_service(
+	tr50_hub_t *hub,
+	iot_millisecond_t max_time_out );
+
+/**
+ * @brief sets a socket to non-blocking mode
+ *
+ * @param[in]      fd                  socket to set the mode of
+ */
+static IOT_SECTION void tr50_hub_socket_nonblock(
+	int fd );
+
+#ifdef IOT_THREAD_SUPPORT
+/**
+ * @brief thread servicing the hub sockets
+ *
+ * @param[in,out]  arg                 hub or connection to the hub
+ *
+ * @retval 0                           on thread exit
+ */
+static IOT_SECTION OS_THREAD_DECL tr50_hub_thread(
+	void *arg );
+
+/**
+ * @brief starts the thread servicing the hub sockets
+ *
+ * @param[in,out]  hub                 hub or connection to the hub
+ *
+ * @retval IOT_FALSE                   failed to start the thread
+ * @retval IOT_TRUE                    on success
+ */
+static IOT_SECTION iot_bool_t tr50_hub_thread_start(
+	tr50_hub_t *hub );
+
+/**
+ * @brief wakes the thread servicing the hub sockets if frames are waiting
+ *        to be sent, so it waits for the sockets to be writable
+ *
+ * @note the caller must hold the lock protecting the connections
+ *
+ * @param[in]      hub                 hub or connection to the hub
+ */
+static IOT_SECTION void tr50_hub_wake(
+	const tr50_hub_t *hub );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+
+void tr50_hub_accept(
+	tr50_hub_t *hub )
+{
+	const int fd = accept( hub->fd, NULL, NULL );
+	if ( fd >= 0 )
+	{
+		char *rx = NULL;
+		/* only applications of the user owning the hub may share it */
+		if ( hub->link_count < TR50_HUB_CLIENT_MAX &&
+			tr50_hub_peer_allowed( fd ) != IOT_FALSE )
+			rx = (char *)os_malloc( TR50_HUB_FRAME_MAX );
+		if ( rx )
+		{
+			struct tr50_hub_link *link;
+			tr50_hub_socket_nonblock( fd );
+#ifdef IOT_THREAD_SUPPORT
+			os_thread_mutex_lock( &hub->lock );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+			link = &hub->links[hub->link_count];
+			link->fd = fd;
+			link->id = hub->next_id++;
+			link->rx = rx;
+			link->rx_len = 0u;
+			link->tx = NULL;
+			link->tx_len = 0u;
+			link->tx_size = 0u;
+			++hub->link_count;
+#ifdef IOT_THREAD_SUPPORT
+			os_thread_mutex_unlock( &hub->lock );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+		}
+		else
+		{
+			/* out of resources or not permitted, refuse the client */
+			os_free_null( (void **)&rx );
+			close( fd );
+		}
+	}
+}
+
+iot_bool_t tr50_hub_address(
+	struct sockaddr_un *addr,
+	const char *path )
+{
+	iot_bool_t result = IOT_FALSE;
+	os_memzero( addr, sizeof( struct sockaddr_un ) );
+	addr->sun_family = AF_UNIX;
+	if ( path && *path != '\0' &&
+		os_strlen( path ) < sizeof( addr->sun_path ) )
+	{
+		os_strncpy( addr->sun_path, path, sizeof( addr->sun_path ) );
+		result = IOT_TRUE;
+	}
+	return result;
+}
+
+tr50_hub_t *tr50_hub_alloc(
+	const char *path )
+{
+	tr50_hub_t *result = (tr50_hub_t *)os_malloc( sizeof( tr50_hub_t ) );
+	if ( result )
+	{
+		size_t i;
+		os_memzero( result, sizeof( tr50_hub_t ) );
+		result->fd = -1;
+		result->next_id = 1u;
+		for ( i = 0u; i < TR50_HUB_CLIENT_MAX; ++i )
+			result->links[i].fd = -1;
+		os_strncpy( result->path, path, PATH_MAX );
+		result->path[ PATH_MAX ] = '\0';
+#ifdef IOT_THREAD_SUPPORT
+		result->wake_fd[0] = -1;
+		result->wake_fd[1] = -1;
+		if ( os_thread_mutex_create( &result->lock ) !=
+			OS_STATUS_SUCCESS )
+			os_free_null( (void **)&result );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+	}
+	return result;
+}
+
+iot_status_t tr50_hub_close(
+	tr50_hub_t *hub )
+{
+	iot_status_t result = IOT_STATUS_BAD_PARAMETER;
+	if ( hub )
+	{
+#ifdef IOT_THREAD_SUPPORT
+		if ( hub->thread_started != IOT_FALSE )
+		{
+			hub->to_quit = IOT_TRUE;
+			os_thread_wait( &hub->thread );
+			os_thread_destroy( &hub->thread );
+		}
+		if ( hub->wake_fd[0] >= 0 )
+			close( hub->wake_fd[0] );
+		if ( hub->wake_fd[1] >= 0 )
+			close( hub->wake_fd[1] );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+		while ( hub->link_count > 0u )
+			tr50_hub_link_close( hub, hub->link_count - 1u );
+		if ( hub->fd >= 0 )
+		{
+			close( hub->fd );
+			unlink( hub->path );
+		}
+#ifdef IOT_THREAD_SUPPORT
+		os_thread_mutex_destroy( &hub->lock );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+		os_free( hub );
+		result = IOT_STATUS_SUCCESS;
+	}
+	return result;
+}
+
+tr50_hub_t *tr50_hub_connect(
+	const char *path,
+	iot_mqtt_message_callback_t on_message,
+	void *user_data )
+{
+	tr50_hub_t *result = NULL;
+	struct sockaddr_un addr;
+	if ( on_message && tr50_hub_address( &addr, path ) != IOT_FALSE )
+	{
+		const int fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+		/* a hub run by another user could see all the requests */
+		if ( fd >= 0 && connect( fd, (struct sockaddr *)&addr,
+			sizeof( struct sockaddr_un ) ) == 0 &&
+			tr50_hub_peer_allowed( fd ) != IOT_FALSE )
+			result = tr50_hub_alloc( path );
+		if ( result )
+		{
+			result->links[0].rx =
+				(char *)os_malloc( TR50_HUB_FRAME_MAX );
+			result->links[0].fd = fd;
+			result->link_count = 1u;
+			result->on_message = on_message;
+			result->user_data = user_data;
+			tr50_hub_socket_nonblock( fd );
+#ifdef IOT_THREAD_SUPPORT
+			if ( !result->links[0].rx ||
+				tr50_hub_thread_start( result ) == IOT_FALSE )
+#else /* ifdef IOT_THREAD_SUPPORT */
+			if ( !result->links[0].rx )
+#endif /* else IOT_THREAD_SUPPORT */
+			{
+				tr50_hub_close( result );
+				result = NULL;
+			}
+		}
+		else if ( fd >= 0 )
+			close( fd );
+	}
+	return result;
+}
+
+iot_bool_t tr50_hub_connected(
+	const tr50_hub_t *hub )
+{
+	iot_bool_t result = IOT_FALSE;
+	if ( hub && hub->fd < 0 && hub->link_count > 0u )
+		result = IOT_TRUE;
+	return result;
+}
+
+iot_bool_t tr50_hub_frame(
+	tr50_hub_t *hub,
+	const struct tr50_hub_link *link,
+	const char *topic,
+	void *payload,
+	size_t payload_len,
+	int qos )
+{
+	iot_bool_t result = IOT_TRUE;
+	if ( hub->fd >= 0 )
+	{
+		/* request from a client: tag it, so the reply comes back; a
+		 * client can't publish on any other topic of the connection */
+		if ( os_strcmp( topic, TR50_HUB_TOPIC_REQUEST ) == 0 )
+		{
+			char fwd_topic[ TR50_HUB_TOPIC_MAX + 12u ];
+			os_snprintf( fwd_topic, sizeof( fwd_topic ), "%s/%u",
+				TR50_HUB_TOPIC_REQUEST,
+				(unsigned int)link->id );
+			if ( hub->on_publish )
+				hub->on_publish( hub->user_data, fwd_topic,
+					payload, payload_len, qos );
+		}
+		else
+			result = IOT_FALSE;
+	}
+	else if ( hub->on_message )
+		hub->on_message( hub->user_data, topic, payload, payload_len,
+			qos, IOT_FALSE );
+	return result;
+}
+
+void tr50_hub_link_close(
+	tr50_hub_t *hub,
+	size_t idx )
+{
+	struct tr50_hub_link *const link = &hub->links[idx];
+#ifdef IOT_THREAD_SUPPORT
+	os_thread_mutex_lock( &hub->lock );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+	if ( link->fd >= 0 )
+		close( link->fd );
+	os_free_null( (void **)&link->rx );
+	os_free_null( (void **)&link->tx );
+	--hub->link_count;
+	if ( idx != hub->link_count )
+		os_memcpy( link, &hub->links[hub->link_count],
+			sizeof( struct tr50_hub_link ) );
+	hub->links[hub->link_count].fd = -1;
+	hub->links[hub->link_count].rx = NULL;
+	hub->links[hub->link_count].rx_len = 0u;
+	hub->links[hub->link_count].tx = NULL;
+	hub->links[hub->link_count].tx_len = 0u;
+	hub->links[hub->link_count].tx_size = 0u;
+#ifdef IOT_THREAD_SUPPORT
+	os_thread_mutex_unlock( &hub->lock );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+}
+
+iot_status_t tr50_hub_link_flush(
+	struct tr50_hub_link *link )
+{
+	iot_status_t result = IOT_STATUS_SUCCESS;
+	size_t sent = 0u;
+	while ( result == IOT_STATUS_SUCCESS && sent < link->tx_len )
+	{
+		const ssize_t rc = send( link->fd, link->tx + sent,
+			link->tx_len - sent, MSG_NOSIGNAL );
+		if ( rc > 0 )
+			sent += (size_t)rc;
+		else if ( rc < 0 && errno == EINTR )
+			continue;
+		else if ( rc < 0 && ( errno == EAGAIN ||
+			errno == EWOULDBLOCK ) )
+			break; /* peer is not ready for more */
+		else
+			result = IOT_STATUS_IO_ERROR;
+	}
+
+	if ( sent > 0u )
+	{
+		link->tx_len -= sent;
+		if ( link->tx_len > 0u )
+			os_memmove( link->tx, link->tx + sent, link->tx_len );
+	}
+	return result;
+}
+
+iot_bool_t tr50_hub_link_read(
+	tr50_hub_t *hub,
+	struct tr50_hub_link *link )
+{
+	iot_bool_t result = IOT_FALSE;
+	const ssize_t rc = recv( link->fd, link->rx + link->rx_len,
+		TR50_HUB_FRAME_MAX - link->rx_len, 0 );
+	if ( rc > 0 || ( rc < 0 && ( errno == EAGAIN ||
+		errno == EWOULDBLOCK || errno == EINTR ) ) )
+	{
+		size_t offset = 0u;
+		result = IOT_TRUE;
+		if ( rc > 0 )
+			link->rx_len += (size_t)rc;
+
+		/* handle each complete frame in the buffer */
+		while ( result != IOT_FALSE &&
+			link->rx_len - offset >= TR50_HUB_HEADER_LEN )
+		{
+			struct tr50_hub_header hdr;
+			size_t frame_len;
+			os_memcpy( &hdr, link->rx + offset, TR50_HUB_HEADER_LEN );
+			frame_len = TR50_HUB_HEADER_LEN + hdr.topic_len +
+				hdr.payload_len;
+			if ( hdr.version != TR50_HUB_VERSION ||
+				hdr.topic_len == 0u ||
+				hdr.topic_len > TR50_HUB_TOPIC_MAX ||
+				frame_len > TR50_HUB_FRAME_MAX )
+				result = IOT_FALSE; /* not a peer we understand */
+			else if ( link->rx_len - offset >= frame_len )
+			{
+				char topic[ TR50_HUB_TOPIC_MAX + 1u ];
+				os_memcpy( topic,
+					link->rx + offset + TR50_HUB_HEADER_LEN,
+					hdr.topic_len );
+				topic[ hdr.topic_len ] = '\0';
+				result = tr50_hub_frame( hub, link, topic,
+					link->rx + offset + TR50_HUB_HEADER_LEN +
+						hdr.topic_len,
+					hdr.payload_len, (int)hdr.qos );
+				offset += frame_len;
+			}
+			else
+				break; /* wait for the rest of the frame */
+		}
+
+		/* keep any partial frame at the start of the buffer */
+		if ( result != IOT_FALSE && offset > 0u )
+		{
+			link->rx_len -= offset;
+			if ( link->rx_len > 0u )
+				os_memmove( link->rx, link->rx + offset,
+					link->rx_len );
+		}
+	}
+	return result;
+}
+
+iot_status_t tr50_hub_link_write(
+	struct tr50_hub_link *link,
+	const char *topic,
+	const void *payload,
+	size_t payload_len,
+	int qos )
+{
+	iot_status_t result = IOT_STATUS_BAD_PARAMETER;
+	const size_t topic_len = os_strlen( topic );
+	if ( topic_len > 0u && topic_len <= TR50_HUB_TOPIC_MAX &&
+		TR50_HUB_HEADER_LEN + topic_len + payload_len <=
+			TR50_HUB_FRAME_MAX )
+	{
+		struct tr50_hub_header hdr;
+		const void *part[3u];
+		size_t part_len[3u];
+		size_t sent = 0u;
+		const size_t total = TR50_HUB_HEADER_LEN + topic_len +
+			payload_len;
+		size_t i;
+
+		hdr.payload_len = (iot_uint32_t)payload_len;
+		hdr.topic_len = (iot_uint16_t)topic_len;
+		hdr.qos = (iot_uint8_t)qos;
+		hdr.version = TR50_HUB_VERSION;
+		part[0u] = &hdr;
+		part_len[0u] = TR50_HUB_HEADER_LEN;
+		part[1u] = topic;
+		part_len[1u] = topic_len;
+		part[2u] = payload;
+		part_len[2u] = payload_len;
+
+		/* frames already waiting go out first */
+		result = tr50_hub_link_flush( link );
+		while ( result == IOT_STATUS_SUCCESS && link->tx_len == 0u &&
+			sent < total )
+		{
+			/* header, topic & payload in one call; resumed if
+			 * only part of the frame was accepted */
+			struct iovec iov[3u];
+			struct msghdr msg;
+			union
+			{
+				const void *in;
+				void *out;
+			} base; /* iovec is shared with readv, so it is not const */
+			size_t skip = sent;
+			ssize_t rc;
+			for ( i = 0u; i < 3u; ++i )
+			{
+				const size_t adv = skip < part_len[i] ?
+					skip : part_len[i];
+				base.in = part[i];
+				iov[i].iov_base = (char *)base.out + adv;
+				iov[i].iov_len = part_len[i] - adv;
+				skip -= adv;
+			}
+			os_memzero( &msg, sizeof( struct msghdr ) );
+			msg.msg_iov = iov;
+			msg.msg_iovlen = 3u;
+			rc = sendmsg( link->fd, &msg, MSG_NOSIGNAL );
+			if ( rc > 0 )
+				sent += (size_t)rc;
+			else if ( rc < 0 && errno == EINTR )
+				continue;
+			else if ( rc < 0 && ( errno == EAGAIN ||
+				errno == EWOULDBLOCK ) )
+				break; /* peer is not ready for more */
+			else
+				result = IOT_STATUS_IO_ERROR;
+		}
+
+		/* keep the rest of the frame until the socket is writable;
+		 * a peer not keeping up is dropped rather than holding up
+		 * the cloud connection */
+		if ( result == IOT_STATUS_SUCCESS && sent < total )
+		{
+			const size_t tx_len = link->tx_len + total - sent;
+			result = IOT_STATUS_IO_ERROR;
+			if ( tx_len <= TR50_HUB_TX_MAX && tx_len > link->tx_size )
+			{
+				char *const tx = (char *)os_realloc( link->tx,
+					tx_len );
+				if ( tx )
+				{
+					link->tx = tx;
+					link->tx_size = tx_len;
+				}
+			}
+			if ( tx_len <= link->tx_size )
+			{
+				size_t skip = sent;
+				for ( i = 0u; i < 3u; ++i )
+				{
+					const size_t adv = skip < part_len[i] ?
+						skip : part_len[i];
+					os_memcpy( link->tx + link->tx_len,
+						(const char *)part[i] + adv,
+						part_len[i] - adv );
+					link->tx_len += part_len[i] - adv;
+					skip -= adv;
+				}
+				result = IOT_STATUS_SUCCESS;
+			}
+		}
+
+		/* the loop closes the connection */
+		if ( result != IOT_STATUS_SUCCESS )
+			shutdown( link->fd, SHUT_RDWR );
+	}
+	return result;
+}
+
+tr50_hub_t *tr50_hub_listen(
+	const char *path,
+	tr50_hub_publish_callback_t on_publish,
+	void *user_data )
+{
+	tr50_hub_t *result = NULL;
+	struct sockaddr_un addr;
+	if ( on_publish && tr50_hub_address( &addr, path ) != IOT_FALSE )
+	{
+		const int fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+		if ( fd >= 0 )
+		{
+			mode_t old_mask;
+			int rc;
+
+			/* remove socket left behind by a previous hub */
+			unlink( path );
+
+			/* socket is created accessible to its owner only (0600) */
+			old_mask = umask( S_IRWXG | S_IRWXO | S_IXUSR );
+			rc = bind( fd, (struct sockaddr *)&addr,
+				sizeof( struct sockaddr_un ) );
+			umask( old_mask );
+			if ( rc == 0 &&
+				listen( fd, (int)TR50_HUB_CLIENT_MAX ) == 0 )
+				result = tr50_hub_alloc( path );
+			if ( result )
+			{
+				result->fd = fd;
+				result->on_publish = on_publish;
+				result->user_data = user_data;
+#ifdef IOT_THREAD_SUPPORT
+				if ( tr50_hub_thread_start( result ) ==
+					IOT_FALSE )
+				{
+					tr50_hub_close( result );
+					result = NULL;
+				}
+#endif /* ifdef IOT_THREAD_SUPPORT */
+			}
+			else
+				close( fd );
+		}
+	}
+	return result;
+}
+
+iot_status_t tr50_hub_loop(
+	tr50_hub_t *hub,
+	iot_millisecond_t max_time_out )
+{
+	iot_status_t result = IOT_STATUS_BAD_PARAMETER;
+	if ( hub )
+	{
+#ifdef IOT_THREAD_SUPPORT
+		(void)max_time_out;
+#else /* ifdef IOT_THREAD_SUPPORT */
+		tr50_hub_service( hub, max_time_out );
+#endif /* else IOT_THREAD_SUPPORT */
+		result = IOT_STATUS_SUCCESS;
+	}
+	return result;
+}
+
+void tr50_hub_loop_poll(
+	const tr50_hub_t *hub,
+	struct iot_loop_poll *poll )
+{
+#ifdef IOT_THREAD_SUPPORT
+	(void)hub;
+	(void)poll;
+#else /* ifdef IOT_THREAD_SUPPORT */
+	if ( hub && poll )
+	{
+		size_t i;
+		if ( hub->fd >= 0 )
+		{
+			if ( poll->fds_count < poll->fds_max )
+			{
+				poll->fds[poll->fds_count].fd = hub->fd;
+				poll->fds[poll->fds_count].events =
+					IOT_LOOP_EVENT_READ;
+			}
+			++poll->fds_count;
+		}
+		for ( i = 0u; i < hub->link_count; ++i )
+		{
+			if ( poll->fds_count < poll->fds_max )
+			{
+				poll->fds[poll->fds_count].fd =
+					hub->links[i].fd;
+				poll->fds[poll->fds_count].events =
+					IOT_LOOP_EVENT_READ;
+				if ( hub->links[i].tx_len > 0u )
+					poll->fds[poll->fds_count].events |=
+						IOT_LOOP_EVENT_WRITE;
+			}
+			++poll->fds_count;
+		}
+	}
+#endif /* else IOT_THREAD_SUPPORT */
+}
+
+iot_status_t tr50_hub_publish(
+	tr50_hub_t *hub,
+	const char *topic,
+	const void *payload,
+	size_t payload_len,
+	int qos )
+{
+	iot_status_t result = IOT_STATUS_BAD_PARAMETER;
+	if ( hub && hub->fd < 0 && topic && ( payload || payload_len == 0u ) )
+	{
+		result = IOT_STATUS_IO_ERROR;
+#ifdef IOT_THREAD_SUPPORT
+		os_thread_mutex_lock( &hub->lock );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+		if ( hub->link_count > 0u )
+			result = tr50_hub_link_write( &hub->links[0], topic,
+				payload, payload_len, qos );
+#ifdef IOT_THREAD_SUPPORT
+		tr50_hub_wake( hub );
+		os_thread_mutex_unlock( &hub->lock );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+	}
+	return result;
+}
+
+iot_bool_t tr50_hub_route(
+	tr50_hub_t *hub,
+	const char *topic,
+	const void *payload,
+	size_t payload_len,
+	int qos )
+{
+	iot_bool_t result = IOT_FALSE;
+	if ( hub && hub->fd >= 0 && topic )
+	{
+		size_t i;
+		iot_uint32_t id = 0u;
+		const char *p = NULL;
+
+		/* replies tagged with a numeric client id */
+		if ( os_strncmp( topic, "reply/", 6u ) == 0 && topic[6] != '\0' )
+		{
+			p = &topic[6];
+			while ( *p >= '0' && *p <= '9' )
+				id = ( id * 10u ) + (iot_uint32_t)( *p++ - '0' );
+		}
+
+#ifdef IOT_THREAD_SUPPORT
+		os_thread_mutex_lock( &hub->lock );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+		if ( p && *p == '\0' )
+		{
+			result = IOT_TRUE;
+			for ( i = 0u; i < hub->link_count; ++i )
+				if ( hub->links[i].id == id )
+					tr50_hub_link_write( &hub->links[i],
+						"reply", payload, payload_len,
+						qos );
+		}
+		else if ( os_strncmp( topic, "notify/", 7u ) == 0 )
+		{
+			for ( i = 0u; i < hub->link_count; ++i )
+				tr50_hub_link_write( &hub->links[i], topic,
+					payload, payload_len, qos );
+		}
+#ifdef IOT_THREAD_SUPPORT
+		tr50_hub_wake( hub );
+		os_thread_mutex_unlock( &hub->lock );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+	}
+	return result;
+}
+
+iot_bool_t tr50_hub_peer_allowed(
+	int fd )
+{
+	iot_bool_t result = IOT_FALSE;
+#if defined( SO_PEERCRED )
+	struct ucred cred;
+	socklen_t cred_len = sizeof( struct ucred );
+	if ( getsockopt( fd, SOL_SOCKET, SO_PEERCRED, &cred,
+		&cred_len ) == 0 && cred.uid == geteuid() )
+		result = IOT_TRUE;
+#else /* if defined( SO_PEERCRED ) */
+	uid_t uid;
+	gid_t gid;
+	if ( getpeereid( fd, &uid, &gid ) == 0 && uid == geteuid() )
+		result = IOT_TRUE;
+#endif /* else if defined( SO_PEERCRED ) */
+	return result;
+}
+
+void tr50_hub_service(
+	tr50_hub_t *hub,
+	iot_millisecond_t max_time_out )
+{
+	struct pollfd fds[ TR50_HUB_CLIENT_MAX + 2u ];
+	nfds_t fds_count = 0u;
+	size_t link_count;
+	size_t i;
+
+	/* only this function changes the connections, so they stay valid
+	 * while it runs; the lock guards against concurrent writers */
+	if ( hub->fd >= 0 )
+	{
+		fds[fds_count].fd = hub->fd;
+		fds[fds_count].events = POLLIN;
+		fds[fds_count].revents = 0;
+		++fds_count;
+	}
+#ifdef IOT_THREAD_SUPPORT
+	os_thread_mutex_lock( &hub->lock );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+	link_count = hub->link_count;
+	for ( i = 0u; i < link_count; ++i )
+	{
+		fds[fds_count].fd = hub->links[i].fd;
+		fds[fds_count].events = POLLIN;
+		if ( hub->links[i].tx_len > 0u )
+			fds[fds_count].events |= POLLOUT;
+		fds[fds_count].revents = 0;
+		++fds_count;
+	}
+#ifdef IOT_THREAD_SUPPORT
+	os_thread_mutex_unlock( &hub->lock );
+	if ( hub->wake_fd[0] >= 0 )
+	{
+		fds[fds_count].fd = hub->wake_fd[0];
+		fds[fds_count].events = POLLIN;
+		fds[fds_count].revents = 0;
+		++fds_count;
+	}
+#endif /* ifdef IOT_THREAD_SUPPORT */
+
+	if ( fds_count > 0u &&
+		poll( fds, fds_count, (int)max_time_out ) > 0 )
+	{
+		size_t base = 0u;
+		if ( hub->fd >= 0 )
+			base = 1u;
+
+#ifdef IOT_THREAD_SUPPORT
+		/* woken up: the connections are now also polled for writing */
+		if ( hub->wake_fd[0] >= 0 &&
+			( fds[base + link_count].revents & POLLIN ) )
+		{
+			char buf[ 16u ];
+			while ( read( hub->wake_fd[0], buf, sizeof( buf ) ) > 0 )
+				continue;
+		}
+#endif /* ifdef IOT_THREAD_SUPPORT */
+
+		/* walk backwards, closing a link moves the last one down */
+		for ( i = link_count; i > 0u; --i )
+		{
+			struct tr50_hub_link *const link = &hub->links[i - 1u];
+			const short revents = fds[base + i - 1u].revents;
+			iot_bool_t keep = IOT_TRUE;
+			if ( revents & POLLOUT )
+			{
+#ifdef IOT_THREAD_SUPPORT
+				os_thread_mutex_lock( &hub->lock );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+				if ( tr50_hub_link_flush( link ) !=
+					IOT_STATUS_SUCCESS )
+					keep = IOT_FALSE;
+#ifdef IOT_THREAD_SUPPORT
+				os_thread_mutex_unlock( &hub->lock );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+			}
+			if ( keep != IOT_FALSE && ( revents & POLLIN ) )
+				keep = tr50_hub_link_read( hub, link );
+			else if ( revents & ( POLLERR | POLLHUP | POLLNVAL ) )
+				keep = IOT_FALSE;
+			if ( keep == IOT_FALSE )
+				tr50_hub_link_close( hub, i - 1u );
+		}
+		if ( base > 0u && ( fds[0].revents & POLLIN ) )
+			tr50_hub_accept( hub );
+	}
+}
+
+void tr50_hub_socket_nonblock(
+	int fd )
+{
+	const int flags = fcntl( fd, F_GETFL, 0 );
+	if ( flags >= 0 )
+		fcntl( fd, F_SETFL, flags | O_NONBLOCK );
+}
+
+#ifdef IOT_THREAD_SUPPORT
+OS_THREAD_DECL tr50_hub_thread(
+	void *arg )
+{
+	tr50_hub_t *const hub = (tr50_hub_t *)arg;
+	while ( hub->to_quit == IOT_FALSE )
+	{
+		tr50_hub_service( hub, IOT_MILLISECONDS_IN_SECOND );
+
+		/* a client has nothing left to do without its connection */
+		if ( hub->fd < 0 && hub->link_count == 0u )
+			break;
+	}
+	return (OS_THREAD_RETURN)0;
+}
+
+iot_bool_t tr50_hub_thread_start(
+	tr50_hub_t *hub )
+{
+	iot_bool_t result = IOT_FALSE;
+	if ( pipe( hub->wake_fd ) == 0 )
+	{
+		tr50_hub_socket_nonblock( hub->wake_fd[0] );
+		tr50_hub_socket_nonblock( hub->wake_fd[1] );
+		if ( os_thread_create( &hub->thread, tr50_hub_thread, hub,
+			0u ) == OS_STATUS_SUCCESS )
+		{
+			hub->thread_started = IOT_TRUE;
+			result = IOT_TRUE;
+		}
+	}
+	return result;
+}
+
+void tr50_hub_wake(
+	const tr50_hub_t *hub )
+{
+	size_t i;
+	iot_bool_t queued = IOT_FALSE;
+	for ( i = 0u; queued == IOT_FALSE && i < hub->link_count; ++i )
+		if ( hub->links[i].tx_len > 0u )
+			queued = IOT_TRUE;
+
+	/* a full pipe already wakes the thread, so errors are ignored */
+	if ( queued != IOT_FALSE && hub->wake_fd[1] >= 0 )
+	{
+		const char c = '\0';
+		const ssize_t rc = write( hub->wake_fd[1], &c, 1u );
+		(void)rc;
+	}
+}
+#endif /* ifdef IOT_THREAD_SUPPORT */
+#endif /* ifdef TR50_HUB_SUPPORT */
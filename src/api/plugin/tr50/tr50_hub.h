@@ -0,0 +1,190 @@
+/**
+ * @file
+ * @brief header file for sharing a single cloud connection between the
+ *        applications on a device (local hub)
+ *
+ * One process, the hub, owns the connection to the cloud & listens on a local
+ * socket, accessible only to the user running it.  Other processes of that
+ * user connect to the hub instead of the cloud; their requests, sent on "api",
+ * are forwarded on "api/<client id>" so the replies, which the cloud publishes
+ * on "reply/<client id>", can be routed back to them.
+ *
+ * @copyright Copyright (C) 2018 Wind River Systems, Inc. All Rights Reserved.
+ *
+ * @license Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied."
+ */
+#ifndef TR50_HUB_H
+#define TR50_HUB_H
+
+#include <iot_mqtt.h>
+#include <iot_plugin.h>
+
+#if ( defined( __unix__ ) || \
+	( defined( __APPLE__ ) && defined( __MACH__ ) ) ) && \
+	!defined( IOT_STACK_ONLY )
+/** @brief local hub is supported (uses POSIX sockets directly, as the
+ *         operating system abstraction has no unix domain sockets) */
+#	define TR50_HUB_SUPPORT
+#endif /* if ( defined( __unix__ ) || ... */
+
+/** @brief default name of the hub socket, within the runtime directory */
+#define TR50_HUB_SOCKET_NAME                "iot-hub.sock"
+
+/** @brief local hub connection (either the hub itself or a client of it) */
+typedef struct tr50_hub tr50_hub_t;
+
+/**
+ * @brief callback called by the hub to publish a request from one of its
+ *        clients to the cloud
+ *
+ * @param[in]      user_data           user data passed to tr50_hub_listen
+ * @param[in]      topic               topic to publish on
+ * @param[in]      payload             payload to publish
+ * @param[in]      payload_len         size of the payload
+ * @param[in]      qos                 mqtt quality of service level
+ *
+ * @return the status of the publish
+ */
+typedef iot_status_t (*tr50_hub_publish_callback_t)(
+	void *user_data,
+	const char *topic,
+	const void *payload,
+	size_t payload_len,
+	int qos );
+
+#ifdef TR50_HUB_SUPPORT
+/**
+ * @brief closes a hub, or the connection of a client to the hub
+ *
+ * @param[in,out]  hub                 hub to close
+ *
+ * @retval IOT_STATUS_BAD_PARAMETER    invalid parameter passed to the function
+ * @retval IOT_STATUS_SUCCESS          on success
+ */
+IOT_SECTION iot_status_t tr50_hub_close(
+	tr50_hub_t *hub );
+
+/**
+ * @brief connects to the hub as a client
+ *
+ * @param[in]      path                path of the hub socket
+ * @param[in]      on_message          callback for messages received from
+ *                                     the cloud
+ * @param[in]      user_data           user data to pass to @p on_message
+ *
+ * @return a handle to the connection, NULL if no hub is listening
+ *
+ * @see tr50_hub_close
+ */
+IOT_SECTION tr50_hub_t *tr50_hub_connect(
+	const char *path,
+	iot_mqtt_message_callback_t on_message,
+	void *user_data );
+
+/**
+ * @brief returns whether a client is still connected to the hub
+ *
+ * @param[in]      hub                 connection to the hub
+ *
+ * @retval IOT_FALSE                   connection to the hub was lost
+ * @retval IOT_TRUE                    connected to the hub
+ */
+IOT_SECTION iot_bool_t tr50_hub_connected(
+	const tr50_hub_t *hub );
+
+/**
+ * @brief listens for clients, as the process owning the cloud connection
+ *
+ * @param[in]      path                path of the hub socket
+ * @param[in]      on_publish          callback to publish client requests
+ * @param[in]      user_data           user data to pass to @p on_publish
+ *
+ * @return a handle to the hub, NULL on failure
+ *
+ * @see tr50_hub_close
+ * @see tr50_hub_route
+ */
+IOT_SECTION tr50_hub_t *tr50_hub_listen(
+	const char *path,
+	tr50_hub_publish_callback_t on_publish,
+	void *user_data );
+
+/**
+ * @brief services the hub sockets
+ *
+ * @note with thread support the sockets are serviced by a thread owned by
+ *       the hub and this function returns immediately
+ *
+ * @param[in,out]  hub                 hub or connection to the hub
+ * @param[in]      max_time_out        maximum time to wait for activity
+ *                                     (0 = return immediately)
+ *
+ * @retval IOT_STATUS_BAD_PARAMETER    invalid parameter passed to the function
+ * @retval IOT_STATUS_SUCCESS          on success
+ */
+IOT_SECTION iot_status_t tr50_hub_loop(
+	tr50_hub_t *hub,
+	iot_millisecond_t max_time_out );
+
+/**
+ * @brief adds the hub sockets for an external event loop to wait on
+ *
+ * @param[in]      hub                 hub or connection to the hub
+ * @param[in,out]  poll                descriptors to wait on
+ */
+IOT_SECTION void tr50_hub_loop_poll(
+	const tr50_hub_t *hub,
+	struct iot_loop_poll *poll );
+
+/**
+ * @brief sends a request from a client to the hub
+ *
+ * @param[in,out]  hub                 connection to the hub
+ * @param[in]      topic               topic to publish on
+ * @param[in]      payload             payload to publish
+ * @param[in]      payload_len         size of the payload
+ * @param[in]      qos                 mqtt quality of service level
+ *
+ * @retval IOT_STATUS_BAD_PARAMETER    invalid parameter passed to the function
+ * @retval IOT_STATUS_IO_ERROR         connection to the hub was lost
+ * @retval IOT_STATUS_SUCCESS          on success
+ */
+IOT_SECTION iot_status_t tr50_hub_publish(
+	tr50_hub_t *hub,
+	const char *topic,
+	const void *payload,
+	size_t payload_len,
+	int qos );
+
+/**
+ * @brief routes a message received from the cloud by the hub to its clients
+ *
+ * Replies for a client ("reply/<client id>") are only sent to that client,
+ * notifications ("notify/...") are sent to all clients.
+ *
+ * @param[in,out]  hub                 hub
+ * @param[in]      topic               topic the message was received on
+ * @param[in]      payload             payload received
+ * @param[in]      payload_len         size of the payload
+ * @param[in]      qos                 mqtt quality of service level
+ *
+ * @retval IOT_FALSE                   message is (also) for the hub process
+ * @retval IOT_TRUE                    message was for a client only
+ */
+IOT_SECTION iot_bool_t tr50_hub_route(
+	tr50_hub_t *hub,
+	const char *topic,
+	const void *payload,
+	size_t payload_len,
+	int qos );
+#endif /* ifdef TR50_HUB_SUPPORT */
+
+#endif /* ifndef TR50_HUB_H */
@@ -0,0 +1,3356 @@
+/**
+ * @file
+ * @brief source file for the engine performing file transfers to & from the
+ *        cloud
+ *
+ * @copyright Copyright (C) 2018 Wind River Systems, Inc. All Rights Reserved.
+ *
+ * @license Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied."
+ */
+
+#include "tr50_transfer.h"
+
+#include "../../shared/iot_archive.h"
+#include "../../shared/iot_defs.h"
+
+#include <iot_checksum.h>
+#include <os.h>
+
+#include <curl/curl.h>
+
+/** @brief Extension for temporary downloaded file */
+#define TR50_DOWNLOAD_EXTENSION             ".part"
+/** @brief Extension (after the download extension) of the file recording
+ *         the progress of a download, to resume it */
+#define TR50_DOWNLOAD_MAP_EXTENSION         ".map"
+/** @brief Identifies a file recording the progress of a download */
+#define TR50_DOWNLOAD_MAP_MAGIC             0x5031524Du
+/** @brief Default value for ssl verify host */
+#define TR50_DEFAULT_SSL_VERIFY_HOST        2L
+/** @brief Default value for ssl verify peer */
+#define TR50_DEFAULT_SSL_VERIFY_PEER        1L
+/** @brief File transfer progress interval */
+#define TR50_FILE_TRANSFER_PROGRESS_INTERVAL 5u * IOT_MILLISECONDS_IN_SECOND /* 5 seconds */
+/** @brief Time interval for a file transfer to expire if the cloud does not
+ *         reply with its location */
+#define TR50_FILE_TRANSFER_EXPIRY_TIME      1u * IOT_MINUTES_IN_HOUR * \
+                                            IOT_SECONDS_IN_MINUTE * \
+                                            IOT_MILLISECONDS_IN_SECOND /* 1 hour */
+/** @brief HTTP status of a response to a range request */
+#define TR50_HTTP_PARTIAL_CONTENT           206L
+/** @brief Time interval the bandwidth of the transfers is adapted at */
+#define TR50_TRANSFER_ADAPT_INTERVAL        1u * IOT_MILLISECONDS_IN_SECOND /* 1 second */
+/** @brief Largest burst of a rate limited transfer, in time at its rate */
+#define TR50_TRANSFER_BURST_TIME            250u /* 250 milliseconds */
+/** @brief Directory of the download cache, in the runtime directory */
+#define TR50_TRANSFER_CACHE_DIR             "download_cache"
+/** @brief File listing the entries of the download cache, least recently
+ *         used first */
+#define TR50_TRANSFER_CACHE_INDEX           "index"
+/** @brief Length of the name of an entry in the download cache */
+#define TR50_TRANSFER_CACHE_NAME_LEN        34u
+/** @brief Extension of a file being written to the download cache */
+#define TR50_TRANSFER_CACHE_NEW_EXTENSION   ".new"
+/** @brief Size of the chunks a ranged download is split into (a download
+ *         must be at least 2 chunks to be split) */
+#define TR50_TRANSFER_CHUNK_SIZE            4194304u /* 4 MB */
+/** @brief Number of idle curl handles kept to be reused */
+#define TR50_TRANSFER_HANDLES_MAX           8u
+/** @brief Largest identifier given to a transfer (before wrapping) */
+#define TR50_TRANSFER_ID_MAX                0xFFFFFFu
+/** @brief Time messages can wait to be sent before the transfers yield
+ *         bandwidth to them */
+#define TR50_TRANSFER_LATENCY_MAX           1u * IOT_MILLISECONDS_IN_SECOND /* 1 second */
+/** @brief Lowest rate the transfers yield bandwidth down to (bytes/s) */
+#define TR50_TRANSFER_RATE_MIN              4096u
+/** @brief Size of the reads checksumming data already on disk */
+#define TR50_TRANSFER_READ_SIZE             65536u
+/** @brief Time to wait before retrying a failed transfer */
+#define TR50_TRANSFER_RETRY_DELAY           10u * IOT_MILLISECONDS_IN_SECOND /* 10 seconds */
+/** @brief Longest time the engine thread waits before checking its timers */
+#define TR50_TRANSFER_WAIT_MAX              1u * IOT_MILLISECONDS_IN_SECOND /* 1 second */
+
+/** @brief states of a file transfer */
+enum tr50_transfer_state
+{
+	/** @brief waiting for the cloud to reply with the file location */
+	TR50_TRANSFER_REQUESTED = 0,
+	/** @brief waiting for a free slot, or the time to retry */
+	TR50_TRANSFER_READY,
+	/** @brief being transferred */
+	TR50_TRANSFER_ACTIVE,
+	/** @brief finished, to be reported & released */
+	TR50_TRANSFER_DONE
+};
+
+/** @brief header of the file recording the progress of a download
+ *
+ * For a ranged download it is followed by the bitmap of the completed chunks
+ * and the crc32 checksum of each chunk.
+ */
+struct tr50_transfer_map
+{
+	/** @brief identifies the file (TR50_DOWNLOAD_MAP_MAGIC) */
+	iot_uint32_t magic;
+	/** @brief size of the chunks (0 = single stream download) */
+	iot_uint32_t chunk_size;
+	/** @brief crc32 checksum of the file being downloaded */
+	iot_uint64_t crc32;
+	/** @brief size of the file being downloaded */
+	iot_uint64_t size;
+	/** @brief bytes at the start of the ".part" file covered by
+	 *         @p checksum (single stream download) */
+	iot_uint64_t length;
+	/** @brief crc32 checksum of those bytes (single stream download) */
+	iot_uint64_t checksum;
+};
+
+/** @brief token bucket limiting the rate of transfers */
+struct tr50_transfer_bucket
+{
+	/** @brief bytes per second (0 = no limit) */
+	iot_uint64_t rate;
+	/** @brief last time tokens were added */
+	iot_timestamp_t time;
+	/** @brief bytes that can be transferred (negative = in debt) */
+	iot_int64_t tokens;
+};
+
+/** @brief file in the download cache */
+struct tr50_transfer_cache_entry
+{
+	/** @brief name of the file: checksum, size & file identifier */
+	char name[TR50_TRANSFER_CACHE_NAME_LEN + 1u];
+	/** @brief size of the file */
+	iot_uint64_t size;
+};
+
+/** @brief connection transferring a file, or a range of it */
+struct tr50_transfer_segment
+{
+	/** @brief chunk being downloaded (ranged downloads) */
+	unsigned int chunk;
+	/** @brief running crc32 checksum of the data written */
+	iot_uint32_t crc32;
+	/** @brief curl handle (while active) */
+	CURL *curl;
+	/** @brief local file being transferred (while active) */
+	os_file_t file;
+	/** @brief size of the chunk being downloaded (ranged downloads) */
+	iot_uint64_t length;
+	/** @brief bytes written to the file */
+	iot_uint64_t now;
+	/** @brief paused by curl, until the rate limits allow more data */
+	iot_bool_t paused;
+	/** @brief archive being uploaded (while active) */
+	iot_archive_stream_t *stream;
+	/** @brief transfer the connection is for */
+	struct tr50_transfer *transfer;
+};
+
+/** @brief structure containing information about a file transfer */
+struct tr50_transfer
+{
+	/** @brief local path is a directory, archived as it is uploaded */
+	iot_bool_t archive;
+	/** @brief rate limit of the transfer */
+	struct tr50_transfer_bucket bucket;
+	/** @brief name of the download in the cache (empty = not cached) */
+	char cache_name[TR50_TRANSFER_CACHE_NAME_LEN + 1u];
+	/** @brief progress function callback */
+	iot_file_progress_callback_t *callback;
+	/** @brief flag to cancel transfer */
+	iot_bool_t cancel;
+	/** @brief checksum of the download, calculated as the data is received
+	 *         (in the order of the file) when one is to be verified */
+	iot_checksum_ctx_t checksum;
+	/** @brief expected checksum of the download */
+	iot_uint8_t checksum_expected[ IOT_CHECKSUM_SIZE_MAX ];
+	/** @brief bytes at the start of the file added to @p checksum */
+	iot_uint64_t checksum_offset;
+	/** @brief size of @p checksum_expected (0 = nothing to verify) */
+	size_t checksum_size;
+	/** @brief number of chunks (ranged downloads) */
+	unsigned int chunk_count;
+	/** @brief next chunk to look at for one to download */
+	unsigned int chunk_next;
+	/** @brief crc32 checksum of each completed chunk (ranged downloads) */
+	iot_uint32_t *chunk_crc32;
+	/** @brief bitmap of the completed chunks (ranged downloads) */
+	iot_uint8_t *chunks;
+	/** @brief compression of the archive uploaded */
+	iot_archive_compression_t compression;
+	/** @brief crc32 checksum */
+	iot_uint64_t crc32;
+	/** @brief first failure of the current attempt (CURLE_OK if none) */
+	CURLcode curl_result;
+	/** @brief bytes in completed chunks (ranged downloads) */
+	iot_uint64_t done_bytes;
+	/** @brief engine performing the transfer */
+	tr50_transfer_engine_t *engine;
+	/** @brief time the transfer expires if the cloud does not reply */
+	iot_timestamp_t expiry_time;
+	/** @brief next attempt uses a new connection & name lookup */
+	iot_bool_t fresh_connect;
+	/** @brief identifier of the transfer */
+	iot_uint32_t id;
+	/** @brief last time progress was sent */
+	iot_timestamp_t last_update_time;
+	/** @brief maximum number of retries (negative = no limit) */
+	iot_int64_t max_retries;
+	/** @brief next transfer in the engine */
+	struct tr50_transfer *next;
+	/** @brief server does not support range requests */
+	iot_bool_t no_ranges;
+	/** @brief whether to report completion to the callback */
+	iot_bool_t notify;
+	/** @brief file operation (get/put) */
+	iot_operation_t op;
+	/** @brief crc32 checksum of the ".part" file so far (single stream
+	 *         downloads) */
+	iot_uint32_t part_crc32;
+	/** @brief local file path (allocated with the transfer) */
+	char *path;
+	/** @brief total byte transfered in previous session(s) */
+	long prev_byte;
+	/** @brief whether the download is split into chunks */
+	iot_bool_t ranged;
+	/** @brief number of times the transfer was retried */
+	iot_int64_t retries;
+	/** @brief next time transfer is retried */
+	iot_timestamp_t retry_time;
+	/** @brief number of connections still active */
+	unsigned int segment_count;
+	/** @brief number of connections in @p segments */
+	unsigned int segment_max;
+	/** @brief connections of the transfer (while active) */
+	struct tr50_transfer_segment *segments;
+	/** @brief file size */
+	iot_uint64_t size;
+	/** @brief state of the transfer */
+	enum tr50_transfer_state state;
+	/** @brief result of the transfer, once done */
+	iot_status_t status;
+	/** @brief cloud url to transfer the file to or from */
+	char *url;
+	/** @brief callback's user data */
+	void *user_data;
+};
+
+/** @brief engine performing file transfers */
+struct tr50_transfer_engine
+{
+	/** @brief number of transfers in progress */
+	unsigned int active;
+	/** @brief bandwidth set for the transfers (bytes/s, 0 = no limit) */
+	iot_uint64_t bandwidth;
+	/** @brief bandwidth shared by the transfers, as adapted */
+	struct tr50_transfer_bucket bucket;
+	/** @brief files in the download cache, least recently used first
+	 *
+	 * @note the download cache is only used by the thread servicing the
+	 *       transfers, which updates it & its files without the lock */
+	struct tr50_transfer_cache_entry *cache;
+	/** @brief number of files in @p cache */
+	unsigned int cache_count;
+	/** @brief directory of the download cache (empty = not available) */
+	char cache_dir[PATH_MAX + 1u];
+	/** @brief whether the download cache was loaded from its directory */
+	iot_bool_t cache_loaded;
+	/** @brief largest size of the download cache (0 = no cache) */
+	iot_uint64_t cache_max;
+	/** @brief size of the files in @p cache */
+	iot_uint64_t cache_size;
+	/** @brief maximum number of transfers in progress */
+	unsigned int concurrency;
+	/** @brief number of handles in @p handles */
+	unsigned int handle_count;
+	/** @brief idle curl handles, to be reused */
+	CURL *handles[TR50_TRANSFER_HANDLES_MAX];
+	/** @brief first transfer (oldest) */
+	struct tr50_transfer *head;
+	/** @brief age of the oldest message waiting to be sent */
+	iot_millisecond_t latency;
+	/** @brief library handle */
+	iot_t *lib;
+	/** @brief curl multi handle driving the transfers */
+	CURLM *multi;
+	/** @brief identifier to give to the next transfer */
+	iot_uint32_t next_id;
+	/** @brief earliest timer of a waiting transfer (0 = none) */
+	iot_timestamp_t next_time;
+	/** @brief proxy settings */
+	const struct iot_proxy *proxy;
+	/** @brief bandwidth is reduced, to let messages through */
+	iot_bool_t rate_adapted;
+	/** @brief bytes transferred since @p rate_time */
+	iot_uint64_t rate_bytes;
+	/** @brief start of the interval the rate is measured over */
+	iot_timestamp_t rate_time;
+	/** @brief number of connections used for a large download */
+	unsigned int segments;
+	/** @brief data shared by the curl handles: name lookups, TLS
+	 *         sessions & connections (NULL if not supported) */
+	CURLSH *share;
+	/** @brief last transfer (newest) */
+	struct tr50_transfer *tail;
+#ifdef IOT_THREAD_SUPPORT
+	/** @brief mutex protecting the transfers */
+	os_thread_mutex_t lock;
+	/** @brief mutexes protecting the data in @p share */
+	os_thread_mutex_t share_lock[CURL_LOCK_DATA_LAST];
+	/** @brief signal to wake the thread when there is work */
+	os_thread_condition_t signal;
+	/** @brief thread servicing the transfers */
+	os_thread_t thread;
+	/** @brief whether the thread has been started */
+	iot_bool_t thread_started;
+	/** @brief flag to stop the thread */
+	iot_bool_t to_quit;
+#endif /* ifdef IOT_THREAD_SUPPORT */
+};
+
+/**
+ * @brief adapts the bandwidth of the transfers to the messages waiting to be
+ *        sent: halving it while they wait too long, then restoring it
+ *        gradually
+ *
+ * @note the caller must hold the lock protecting the transfers
+ *
+ * @param[in,out]  engine              transfer engine
+ * @param[in]      now                 current time
+ */
+static IOT_SECTION void tr50_transfer_adapt(
+	tr50_transfer_engine_t *engine,
+	iot_timestamp_t now );
+
+/**
+ * @brief handles the end of an attempt at a transfer, once all of its
+ *        connections finished, scheduling a retry if possible
+ *
+ * @param[in,out]  engine              transfer engine
+ * @param[in,out]  transfer            transfer attempted
+ */
+static IOT_SECTION void tr50_transfer_attempt_end(
+	tr50_transfer_engine_t *engine,
+	struct tr50_transfer *transfer );
+
+/**
+ * @brief starts transferring a file on the multi handle
+ *
+ * @note the caller must hold the lock protecting the transfers, it is
+ *       released while the progress of an earlier attempt is read (the
+ *       transfer is marked active meanwhile)
+ *
+ * @param[in,out]  engine              transfer engine
+ * @param[in,out]  transfer            transfer to start
+ *
+ * @retval IOT_STATUS_FAILURE          failed to open the file or set up curl
+ * @retval IOT_STATUS_NO_MEMORY        not enough memory to start the transfer
+ * @retval IOT_STATUS_SUCCESS          on success
+ */
+static IOT_SECTION iot_status_t tr50_transfer_begin(
+	tr50_transfer_engine_t *engine,
+	struct tr50_transfer *transfer );
+
+/**
+ * @brief adds the tokens earned since the last call to a token bucket
+ *
+ * @param[in,out]  bucket              token bucket
+ * @param[in]      now                 current time
+ *
+ * @return time until data can be transferred (0 = now)
+ */
+static IOT_SECTION iot_millisecond_t tr50_transfer_bucket_wait(
+	struct tr50_transfer_bucket *bucket,
+	iot_timestamp_t now );
+
+/**
+ * @brief adds a completed download to the cache, making room for it by
+ *        removing the least recently used files
+ *
+ * @note the caller must hold the lock protecting the transfers, it is
+ *       released while the file is copied (the transfer is still active)
+ *
+ * @param[in,out]  engine              transfer engine
+ * @param[in]      transfer            download completed
+ */
+static IOT_SECTION void tr50_transfer_cache_add(
+	tr50_transfer_engine_t *engine,
+	const struct tr50_transfer *transfer );
+
+/**
+ * @brief finds a file in the download cache
+ *
+ * @param[in]      engine              transfer engine
+ * @param[in]      name                name of the file
+ *
+ * @return index of the file, the number of files if not found
+ */
+static IOT_SECTION unsigned int tr50_transfer_cache_find(
+	const tr50_transfer_engine_t *engine,
+	const char *name );
+
+/**
+ * @brief completes a download with the file in the cache, if there is one
+ *
+ * The file is copied to the ".part" file & verified as a download would be.
+ * A file that can't be copied or fails verification is removed from the
+ * cache, and downloaded instead.
+ *
+ * @note the caller must hold the lock protecting the transfers, it is
+ *       released while the file is copied & verified (the transfer is
+ *       marked active meanwhile)
+ *
+ * @param[in,out]  engine              transfer engine
+ * @param[in,out]  transfer            download to complete
+ *
+ * @retval IOT_STATUS_FAILURE          file in the cache can't be used
+ * @retval IOT_STATUS_NOT_FOUND        file is not in the cache
+ * @retval IOT_STATUS_SUCCESS          download completed from the cache
+ */
+static IOT_SECTION iot_status_t tr50_transfer_cache_get(
+	tr50_transfer_engine_t *engine,
+	struct tr50_transfer *transfer );
+
+/**
+ * @brief loads the download cache from its directory, the first time it is
+ *        used
+ *
+ * Files in the directory not listed in its index are left from an
+ * interrupted update, and are removed.
+ *
+ * @param[in,out]  engine              transfer engine
+ *
+ * @retval IOT_STATUS_FAILURE          cache directory is not available
+ * @retval IOT_STATUS_SUCCESS          on success
+ */
+static IOT_SECTION iot_status_t tr50_transfer_cache_load(
+	tr50_transfer_engine_t *engine );
+
+/**
+ * @brief builds the path of a file in the download cache
+ *
+ * @param[out]     dest                destination buffer (PATH_MAX + 1)
+ * @param[in]      engine              transfer engine
+ * @param[in]      name                name of the file
+ * @param[in]      extension           extension added to the name
+ */
+static IOT_SECTION void tr50_transfer_cache_path(
+	char *dest,
+	const tr50_transfer_engine_t *engine,
+	const char *name,
+	const char *extension );
+
+/**
+ * @brief removes a file from the download cache
+ *
+ * @param[in,out]  engine              transfer engine
+ * @param[in]      i                   index of the file
+ */
+static IOT_SECTION void tr50_transfer_cache_remove(
+	tr50_transfer_engine_t *engine,
+	unsigned int i );
+
+/**
+ * @brief saves the index of the download cache
+ *
+ * @param[in]      engine              transfer engine
+ */
+static IOT_SECTION void tr50_transfer_cache_save(
+	const tr50_transfer_engine_t *engine );
+
+/**
+ * @brief marks a file in the download cache as the most recently used
+ *
+ * @param[in,out]  engine              transfer engine
+ * @param[in]      i                   index of the file
+ */
+static IOT_SECTION void tr50_transfer_cache_use(
+	tr50_transfer_engine_t *engine,
+	unsigned int i );
+
+/**
+ * @brief adds data received to the checksum of a download, if it follows
+ *        the data already added
+ *
+ * @param[in,out]  transfer            transfer receiving the data
+ * @param[in]      offset              position of the data in the file
+ * @param[in]      data                data received
+ * @param[in]      len                 size of the data
+ */
+static IOT_SECTION void tr50_transfer_checksum_add(
+	struct tr50_transfer *transfer,
+	iot_uint64_t offset,
+	const void *data,
+	size_t len );
+
+/**
+ * @brief adds the data already in the ".part" file, following the data
+ *        added so far, to the checksum of a download
+ *
+ * Data is only read when it arrived out of order (chunks ahead of the one
+ * being checksummed) or by an earlier run of the application.
+ *
+ * @param[in]      engine              transfer engine
+ * @param[in,out]  transfer            transfer to update
+ */
+static IOT_SECTION void tr50_transfer_checksum_read(
+	const tr50_transfer_engine_t *engine,
+	struct tr50_transfer *transfer );
+
+/**
+ * @brief restarts the checksum of a download, once its data is discarded
+ *
+ * @param[in,out]  transfer            transfer to restart the checksum of
+ */
+static IOT_SECTION void tr50_transfer_checksum_reset(
+	struct tr50_transfer *transfer );
+
+/**
+ * @brief whether a failure is likely caused by the connection (or the name
+ *        lookup), so a retry should not reuse it
+ *
+ * @param[in]      curl_result         result of the connection
+ *
+ * @retval IOT_FALSE                   failure not related to the connection
+ * @retval IOT_TRUE                    connection or name lookup failed
+ */
+static IOT_SECTION iot_bool_t tr50_transfer_connection_bad(
+	CURLcode curl_result );
+
+/**
+ * @brief provides a curl handle, idle or new, with the options common to all
+ *        connections
+ *
+ * @param[in,out]  engine              transfer engine
+ * @param[in]      segment             connection to provide the handle for
+ *
+ * @return a curl handle, NULL on failure
+ */
+static IOT_SECTION CURL *tr50_transfer_curl(
+	tr50_transfer_engine_t *engine,
+	struct tr50_transfer_segment *segment );
+
+/**
+ * @brief releases a curl handle, keeping it to be reused if there is room
+ *
+ * @param[in,out]  engine              transfer engine
+ * @param[in]      curl                handle to release
+ */
+static IOT_SECTION void tr50_transfer_curl_release(
+	tr50_transfer_engine_t *engine,
+	CURL *curl );
+
+/**
+ * @brief handles a connection finished by curl
+ *
+ * @param[in,out]  engine              transfer engine
+ * @param[in,out]  segment             connection finished
+ * @param[in]      curl_result         result of the connection
+ */
+static IOT_SECTION void tr50_transfer_end(
+	tr50_transfer_engine_t *engine,
+	struct tr50_transfer_segment *segment,
+	CURLcode curl_result );
+
+/**
+ * @brief reads a file being uploaded (curl callback)
+ *
+ * @param[out]     ptr                 buffer to fill
+ * @param[in]      size                size of an item
+ * @param[in]      nmemb               number of items
+ * @param[in,out]  user_data           connection uploading the file
+ *
+ * @return amount of data read, CURL_READFUNC_PAUSE if the rate limits don't
+ *         allow more data now
+ */
+static IOT_SECTION size_t tr50_transfer_file_read(
+	char *ptr,
+	size_t size,
+	size_t nmemb,
+	void *user_data );
+
+/**
+ * @brief verifies & moves a downloaded file into place, or removes an
+ *        uploaded archive
+ *
+ * The checksum of a download is calculated as the data is received, so the
+ * file is not read again.
+ *
+ * @param[in]      engine              transfer engine
+ * @param[in]      transfer            transfer completed successfully
+ *
+ * @retval IOT_STATUS_FAILURE          checksum of the download does not match
+ * @retval IOT_STATUS_SUCCESS          on success
+ */
+static IOT_SECTION iot_status_t tr50_transfer_finish(
+	const tr50_transfer_engine_t *engine,
+	const struct tr50_transfer *transfer );
+
+/**
+ * @brief releases a transfer
+ *
+ * @param[in,out]  engine              transfer engine
+ * @param[in,out]  transfer            transfer to release
+ */
+static IOT_SECTION void tr50_transfer_free(
+	tr50_transfer_engine_t *engine,
+	struct tr50_transfer *transfer );
+
+/**
+ * @brief prepares the ".part" file of a ranged download, resuming from the
+ *        chunks completed earlier
+ *
+ * The ".part" file is preallocated (sparse) to the size of the download, so
+ * the chunks can be written in any order.
+ *
+ * @param[in]      engine              transfer engine
+ * @param[in,out]  transfer            ranged download
+ *
+ * @retval IOT_STATUS_FAILURE          failed to preallocate the ".part" file
+ * @retval IOT_STATUS_NO_MEMORY        not enough memory for the chunk bitmap
+ * @retval IOT_STATUS_SUCCESS          on success
+ */
+static IOT_SECTION iot_status_t tr50_transfer_map_load(
+	const tr50_transfer_engine_t *engine,
+	struct tr50_transfer *transfer );
+
+/**
+ * @brief records the progress of a download, to resume it
+ *
+ * @param[in]      engine              transfer engine
+ * @param[in]      transfer            ranged download
+ */
+static IOT_SECTION void tr50_transfer_map_save(
+	const tr50_transfer_engine_t *engine,
+	const struct tr50_transfer *transfer );
+
+/**
+ * @brief prepares the ".part" file of a single stream download, resuming
+ *        from the data downloaded earlier
+ *
+ * Only the data not covered by the checksum recorded with the download is
+ * read, to bring the checksum up to date.
+ *
+ * @param[in]      engine              transfer engine
+ * @param[in,out]  transfer            single stream download
+ */
+static IOT_SECTION void tr50_transfer_part_load(
+	const tr50_transfer_engine_t *engine,
+	struct tr50_transfer *transfer );
+
+/**
+ * @brief builds the path of the temporary files of a download
+ *
+ * @param[out]     dest                destination buffer (PATH_MAX + 1 bytes)
+ * @param[in]      transfer            download
+ * @param[in]      map                 whether to build the path of the file
+ *                                     recording the progress
+ */
+static IOT_SECTION void tr50_transfer_part_path(
+	char *dest,
+	const struct tr50_transfer *transfer,
+	iot_bool_t map );
+
+/**
+ * @brief Callback called for progress updates (and to cancel transfers)
+ *
+ * @param[in]      user_data           pointer to the connection
+ * @param[in]      down_total          total number of bytes to download
+ * @param[in]      down_now            current number of bytes downloaded
+ * @param[in]      up_total            total number of bytes to upload
+ * @param[in]      up_now              current number of bytes uploaded
+ *
+ * @retval 0 continue the transfer
+ * @retval 1 cancel the transfer
+ */
+static IOT_SECTION int tr50_transfer_progress( void *user_data,
+	curl_off_t down_total, curl_off_t down_now,
+	curl_off_t up_total, curl_off_t up_now );
+
+/**
+ * @brief Callback called for progress updates (and to cancel transfers)
+ *        for older versions of libcurl
+ *
+ * @param[in]      user_data           pointer to the connection
+ * @param[in]      down_total          total number of bytes to download
+ * @param[in]      down_now            current number of bytes downloaded
+ * @param[in]      up_total            total number of bytes to upload
+ * @param[in]      up_now              current number of bytes uploaded
+ *
+ * @retval 0 continue the transfer
+ * @retval 1 cancel the transfer
+ */
+static IOT_SECTION int tr50_transfer_progress_old(
+	void *user_data,
+	double down_total, double down_now,
+	double up_total, double up_now );
+
+/**
+ * @brief reads a range of a file, to update its checksums
+ *
+ * @param[in]      file                file to read
+ * @param[in]      offset              start of the range
+ * @param[in]      length              size of the range
+ * @param[in,out]  crc32               crc32 checksum to update (optional)
+ * @param[in,out]  checksum            checksum to update (optional)
+ *
+ * @retval IOT_STATUS_FAILURE          failed to read the range
+ * @retval IOT_STATUS_NO_MEMORY        not enough memory to read the file
+ * @retval IOT_STATUS_SUCCESS          on success
+ */
+static IOT_SECTION iot_status_t tr50_transfer_read(
+	os_file_t file,
+	iot_uint64_t offset,
+	iot_uint64_t length,
+	iot_uint32_t *crc32,
+	iot_checksum_ctx_t *checksum );
+
+/**
+ * @brief resumes the connections of a transfer paused by its rate limits,
+ *        once the limits allow more data
+ *
+ * @note the caller must hold the lock protecting the transfers
+ *
+ * @param[in,out]  engine              transfer engine
+ * @param[in,out]  transfer            active transfer
+ * @param[in]      now                 current time
+ *
+ * @return time to check the connections still paused again (0 = none)
+ */
+static IOT_SECTION iot_timestamp_t tr50_transfer_resume(
+	tr50_transfer_engine_t *engine,
+	struct tr50_transfer *transfer,
+	iot_timestamp_t now );
+
+/**
+ * @brief starts the transfers that can be started & expires the ones the
+ *        cloud never replied for
+ *
+ * @note the caller must hold the lock protecting the transfers
+ *
+ * @param[in,out]  engine              transfer engine
+ */
+static IOT_SECTION void tr50_transfer_schedule(
+	tr50_transfer_engine_t *engine );
+
+/**
+ * @brief starts a connection of a transfer, with the next missing chunk for
+ *        a ranged download
+ *
+ * @param[in,out]  engine              transfer engine
+ * @param[in,out]  segment             connection to start
+ *
+ * @retval IOT_STATUS_FAILURE          failed to open the file or set up curl
+ * @retval IOT_STATUS_NOT_FOUND        no chunk left to download
+ * @retval IOT_STATUS_SUCCESS          on success
+ */
+static IOT_SECTION iot_status_t tr50_transfer_segment_start(
+	tr50_transfer_engine_t *engine,
+	struct tr50_transfer_segment *segment );
+
+/**
+ * @brief services the file transfers once
+ *
+ * @param[in,out]  engine              transfer engine
+ * @param[in]      max_time_out        maximum time to wait for activity
+ */
+static IOT_SECTION void tr50_transfer_service(
+	tr50_transfer_engine_t *engine,
+	iot_millisecond_t max_time_out );
+
+#ifdef IOT_THREAD_SUPPORT
+/**
+ * @brief locks data shared by the curl handles (curl callback)
+ *
+ * @param[in]      handle              curl handle using the data
+ * @param[in]      data                data to lock
+ * @param[in]      access              type of access to the data
+ * @param[in,out]  user_data           transfer engine
+ */
+static IOT_SECTION void tr50_transfer_share_lock(
+	CURL *handle,
+	curl_lock_data data,
+	curl_lock_access access,
+	void *user_data );
+
+/**
+ * @brief unlocks data shared by the curl handles (curl callback)
+ *
+ * @param[in]      handle              curl handle using the data
+ * @param[in]      data                data to unlock
+ * @param[in,out]  user_data           transfer engine
+ */
+static IOT_SECTION void tr50_transfer_share_unlock(
+	CURL *handle,
+	curl_lock_data data,
+	void *user_data );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+
+/**
+ * @brief Callback called by curl for the archive to upload, built as it is
+ *        sent
+ *
+ * @param[out]     buffer              buffer to fill
+ * @param[in]      size                size of an item
+ * @param[in]      nitems              number of items to fill
+ * @param[in]      user_data           connection uploading
+ *
+ * @return the number of bytes filled (0 at the end of the archive),
+ *         CURL_READFUNC_ABORT on failure
+ */
+static IOT_SECTION size_t tr50_transfer_stream_read(
+	char *buffer,
+	size_t size,
+	size_t nitems,
+	void *user_data );
+
+/**
+ * @brief takes data about to be transferred from the rate limits of a
+ *        connection, or pauses it if the limits don't allow more data now
+ *
+ * @param[in,out]  segment             connection transferring the data
+ * @param[in]      len                 size of the data
+ *
+ * @retval IOT_FALSE                   data can be transferred
+ * @retval IOT_TRUE                    connection is paused
+ */
+static IOT_SECTION iot_bool_t tr50_transfer_throttle(
+	struct tr50_transfer_segment *segment,
+	size_t len );
+
+/**
+ * @brief wakes the engine, after a change to the transfers
+ *
+ * @param[in,out]  engine              transfer engine
+ */
+static IOT_SECTION void tr50_transfer_wake(
+	tr50_transfer_engine_t *engine );
+
+/**
+ * @brief Callback called by curl with downloaded data
+ *
+ * @param[in]      ptr                 data received
+ * @param[in]      size                size of each item received
+ * @param[in]      nmemb               number of items received
+ * @param[in,out]  user_data           pointer to the connection
+ *
+ * @return the number of bytes written, anything else fails the connection
+ */
+static IOT_SECTION size_t tr50_transfer_write(
+	char *ptr,
+	size_t size,
+	size_t nmemb,
+	void *user_data );
+
+#ifdef IOT_THREAD_SUPPORT
+/**
+ * @brief thread servicing the file transfers
+ *
+ * @param[in,out]  arg                 transfer engine
+ *
+ * @retval 0                           on thread exit
+ */
+static IOT_SECTION OS_THREAD_DECL tr50_transfer_thread(
+	void *arg );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+
+void tr50_transfer_adapt(
+	tr50_transfer_engine_t *engine,
+	iot_timestamp_t now )
+{
+	if ( now >= engine->rate_time + TR50_TRANSFER_ADAPT_INTERVAL )
+	{
+		const iot_uint64_t rate = engine->rate_bytes *
+			IOT_MILLISECONDS_IN_SECOND /
+			( now - engine->rate_time );
+		if ( engine->latency > TR50_TRANSFER_LATENCY_MAX && rate > 0u )
+		{
+			/* messages are waiting: yield half of the bandwidth
+			 * the transfers used */
+			engine->bucket.rate = rate / 2u;
+			if ( engine->bucket.rate < TR50_TRANSFER_RATE_MIN )
+				engine->bucket.rate = TR50_TRANSFER_RATE_MIN;
+			engine->rate_adapted = IOT_TRUE;
+		}
+		else if ( engine->rate_adapted != IOT_FALSE )
+		{
+			/* then take it back gradually, until it no longer
+			 * limits the transfers */
+			engine->bucket.rate += engine->bucket.rate / 4u +
+				TR50_TRANSFER_RATE_MIN;
+			if ( engine->bucket.rate > 2u * rate ||
+				( engine->bandwidth > 0u &&
+				engine->bucket.rate >= engine->bandwidth ) )
+				engine->rate_adapted = IOT_FALSE;
+		}
+		engine->rate_bytes = 0u;
+		engine->rate_time = now;
+	}
+
+	if ( engine->rate_adapted == IOT_FALSE || ( engine->bandwidth > 0u &&
+		engine->bucket.rate > engine->bandwidth ) )
+		engine->bucket.rate = engine->bandwidth;
+}
+
+iot_status_t tr50_transfer_add(
+	tr50_transfer_engine_t *engine,
+	iot_operation_t op,
+	const iot_file_transfer_t *file_transfer,
+	iot_uint32_t *id )
+{
+	iot_status_t result = IOT_STATUS_BAD_PARAMETER;
+	if ( engine && file_transfer && file_transfer->path && id )
+	{
+		const size_t path_len = os_strlen( file_transfer->path );
+		struct tr50_transfer *const transfer = (struct tr50_transfer *)
+			os_malloc( sizeof( struct tr50_transfer ) + path_len + 1u );
+		result = IOT_STATUS_NO_MEMORY;
+		if ( transfer )
+		{
+			os_memzero( transfer, sizeof( struct tr50_transfer ) );
+			transfer->path = (char *)( transfer + 1 );
+			os_memcpy( transfer->path, file_transfer->path, path_len );
+			transfer->path[path_len] = '\0';
+			transfer->archive = file_transfer->archive;
+			transfer->callback = file_transfer->callback;
+			transfer->compression = file_transfer->compression;
+			transfer->user_data = file_transfer->user_data;
+			transfer->engine = engine;
+			transfer->op = op;
+			transfer->notify = IOT_TRUE;
+			transfer->state = TR50_TRANSFER_REQUESTED;
+			transfer->expiry_time = iot_timestamp_now() +
+				TR50_FILE_TRANSFER_EXPIRY_TIME;
+
+#ifdef IOT_THREAD_SUPPORT
+			os_thread_mutex_lock( &engine->lock );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+			transfer->id = engine->next_id;
+			engine->next_id = ( engine->next_id + 1u ) &
+				TR50_TRANSFER_ID_MAX;
+			if ( engine->tail )
+				engine->tail->next = transfer;
+			else
+				engine->head = transfer;
+			engine->tail = transfer;
+			if ( engine->next_time == 0u ||
+				transfer->expiry_time < engine->next_time )
+				engine->next_time = transfer->expiry_time;
+			*id = transfer->id;
+			result = IOT_STATUS_SUCCESS;
+#ifdef IOT_THREAD_SUPPORT
+			/* thread is only started once there is something to do */
+			if ( engine->thread_started == IOT_FALSE )
+			{
+				size_t stack_size = 0u;
+#if defined( __VXWORKS__ )
+				stack_size = deviceCloudStackSizeGet();
+#endif /* if defined( __VXWORKS__ ) */
+				if ( os_thread_create( &engine->thread,
+					tr50_transfer_thread, engine,
+					stack_size ) == OS_STATUS_SUCCESS )
+					engine->thread_started = IOT_TRUE;
+				else
+					IOT_LOG( engine->lib, IOT_LOG_ERROR, "%s",
+						"Failed to create a thread to "
+						"transfer files" );
+			}
+			os_thread_mutex_unlock( &engine->lock );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+		}
+	}
+	return result;
+}
+
+void tr50_transfer_attempt_end(
+	tr50_transfer_engine_t *engine,
+	struct tr50_transfer *transfer )
+{
+	enum tr50_transfer_state state = TR50_TRANSFER_DONE;
+	iot_status_t status = IOT_STATUS_FAILURE;
+	iot_timestamp_t retry_delay = TR50_TRANSFER_RETRY_DELAY;
+	const CURLcode curl_result = transfer->curl_result;
+
+	os_free_null( (void **)&transfer->segments );
+	transfer->segment_max = 0u;
+
+	if ( curl_result == CURLE_OK )
+		status = tr50_transfer_finish( engine, transfer );
+	else if ( transfer->cancel != IOT_FALSE )
+		IOT_LOG( engine->lib, IOT_LOG_INFO,
+			"File transfer of %s cancelled", transfer->path );
+	else if ( transfer->ranged != IOT_FALSE &&
+		transfer->no_ranges != IOT_FALSE )
+	{
+		char file_path[ PATH_MAX + 1u ];
+
+		/* start again, without splitting the download */
+		IOT_LOG( engine->lib, IOT_LOG_INFO,
+			"Server does not support ranges, downloading %s "
+			"in a single stream", transfer->path );
+		tr50_transfer_part_path( file_path, transfer, IOT_TRUE );
+		os_file_delete( file_path );
+		tr50_transfer_part_path( file_path, transfer, IOT_FALSE );
+		os_file_delete( file_path );
+		os_free_null( (void **)&transfer->chunks );
+		os_free_null( (void **)&transfer->chunk_crc32 );
+		state = TR50_TRANSFER_READY;
+		retry_delay = 0u;
+	}
+	/* need to handle errors 400 * without retrying */
+	else if ( curl_result == CURLE_HTTP_RETURNED_ERROR ||
+	     curl_result == CURLE_SSL_CACERT )
+		IOT_LOG( engine->lib, IOT_LOG_ERROR,
+			"File transfer not recoverable(%d) exiting.\nReason: %s",
+			curl_result, curl_easy_strerror( curl_result ) );
+	else if ( transfer->max_retries < 0 ||
+		transfer->retries < transfer->max_retries )
+	{
+		IOT_LOG( engine->lib, IOT_LOG_TRACE,
+			"curl result %d, retry count=%ld", curl_result,
+			(long)( transfer->retries + 1 ) );
+		++transfer->retries;
+		transfer->fresh_connect =
+			tr50_transfer_connection_bad( curl_result );
+		state = TR50_TRANSFER_READY;
+	}
+	else
+		IOT_LOG( engine->lib, IOT_LOG_ERROR,
+			"File transfer failed: %s",
+			curl_easy_strerror( curl_result ) );
+
+#ifdef IOT_THREAD_SUPPORT
+	os_thread_mutex_lock( &engine->lock );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+	if ( status == IOT_STATUS_SUCCESS &&
+		transfer->op == IOT_OPERATION_FILE_DOWNLOAD &&
+		engine->cache_max > 0u )
+		tr50_transfer_cache_add( engine, transfer );
+	--engine->active;
+	transfer->state = state;
+	transfer->status = status;
+	if ( state == TR50_TRANSFER_READY )
+	{
+		/* add a delay before trying again */
+		transfer->retry_time = iot_timestamp_now() + retry_delay;
+		if ( engine->next_time == 0u ||
+			transfer->retry_time < engine->next_time )
+			engine->next_time = transfer->retry_time;
+	}
+#ifdef IOT_THREAD_SUPPORT
+	os_thread_mutex_unlock( &engine->lock );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+}
+
+void tr50_transfer_bandwidth_set(
+	tr50_transfer_engine_t *engine,
+	iot_uint64_t bandwidth )
+{
+	if ( engine )
+	{
+#ifdef IOT_THREAD_SUPPORT
+		os_thread_mutex_lock( &engine->lock );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+		engine->bandwidth = bandwidth;
+#ifdef IOT_THREAD_SUPPORT
+		os_thread_mutex_unlock( &engine->lock );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+		tr50_transfer_wake( engine );
+	}
+}
+
+iot_status_t tr50_transfer_begin(
+	tr50_transfer_engine_t *engine,
+	struct tr50_transfer *transfer )
+{
+	iot_status_t result = IOT_STATUS_NO_MEMORY;
+	const unsigned int segments = engine->segments;
+	unsigned int count = 1u;
+
+	/* busy while the earlier progress is read, without the lock */
+	transfer->state = TR50_TRANSFER_ACTIVE;
+#ifdef IOT_THREAD_SUPPORT
+	os_thread_mutex_unlock( &engine->lock );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+
+	/* large downloads are split into chunks, fetched in parallel */
+	transfer->ranged = IOT_FALSE;
+	transfer->prev_byte = 0;
+	if ( transfer->op == IOT_OPERATION_FILE_DOWNLOAD &&
+		segments > 1u && transfer->no_ranges == IOT_FALSE &&
+		transfer->size >= 2u * TR50_TRANSFER_CHUNK_SIZE &&
+		tr50_transfer_map_load( engine, transfer ) ==
+			IOT_STATUS_SUCCESS )
+	{
+		transfer->ranged = IOT_TRUE;
+		count = segments;
+	}
+	else if ( transfer->op == IOT_OPERATION_FILE_DOWNLOAD )
+	{
+		tr50_transfer_part_load( engine, transfer );
+		if ( transfer->checksum_offset > (iot_uint64_t)transfer->prev_byte )
+			tr50_transfer_checksum_reset( transfer );
+	}
+
+	/* data received in order is added to the checksum as it arrives,
+	 * catch up with what is already in the file */
+	if ( transfer->op == IOT_OPERATION_FILE_DOWNLOAD )
+		tr50_transfer_checksum_read( engine, transfer );
+#ifdef IOT_THREAD_SUPPORT
+	os_thread_mutex_lock( &engine->lock );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+	transfer->state = TR50_TRANSFER_READY;
+
+	transfer->segments = (struct tr50_transfer_segment *)os_malloc(
+		sizeof( struct tr50_transfer_segment ) * count );
+	if ( transfer->segments )
+	{
+		unsigned int i;
+		os_memzero( transfer->segments,
+			sizeof( struct tr50_transfer_segment ) * count );
+		transfer->segment_max = count;
+		transfer->segment_count = 0u;
+		transfer->chunk_next = 0u;
+		transfer->curl_result = CURLE_OK;
+		result = IOT_STATUS_FAILURE;
+		for ( i = 0u; i < count; ++i )
+		{
+			transfer->segments[i].transfer = transfer;
+			if ( tr50_transfer_segment_start( engine,
+				&transfer->segments[i] ) == IOT_STATUS_SUCCESS )
+				++transfer->segment_count;
+		}
+
+		if ( transfer->segment_count > 0u )
+		{
+			transfer->last_update_time = iot_timestamp_now();
+			transfer->state = TR50_TRANSFER_ACTIVE;
+			++engine->active;
+			result = IOT_STATUS_SUCCESS;
+		}
+		else
+		{
+			os_free_null( (void **)&transfer->segments );
+			transfer->segment_max = 0u;
+		}
+	}
+	return result;
+}
+
+iot_millisecond_t tr50_transfer_bucket_wait(
+	struct tr50_transfer_bucket *bucket,
+	iot_timestamp_t now )
+{
+	iot_millisecond_t result = 0u;
+	if ( bucket->rate > 0u )
+	{
+		/* room for at least one write from curl */
+		const iot_int64_t burst = (iot_int64_t)( bucket->rate *
+			TR50_TRANSFER_BURST_TIME / IOT_MILLISECONDS_IN_SECOND ) +
+			CURL_MAX_WRITE_SIZE;
+		if ( now > bucket->time )
+		{
+			iot_timestamp_t elapsed = now - bucket->time;
+			iot_uint64_t earned;
+			if ( elapsed > IOT_MILLISECONDS_IN_SECOND )
+				elapsed = IOT_MILLISECONDS_IN_SECOND;
+			earned = bucket->rate * elapsed /
+				IOT_MILLISECONDS_IN_SECOND;
+
+			/* time is only taken once it earned tokens, so
+			 * frequent calls don't lose them */
+			if ( earned > 0u || elapsed == IOT_MILLISECONDS_IN_SECOND )
+			{
+				bucket->tokens += (iot_int64_t)earned;
+				bucket->time = now;
+			}
+		}
+		if ( bucket->tokens > burst )
+			bucket->tokens = burst;
+		if ( bucket->tokens <= 0 )
+			result = (iot_millisecond_t)( (iot_uint64_t)(
+				1 - bucket->tokens ) * IOT_MILLISECONDS_IN_SECOND /
+				bucket->rate ) + 1u;
+	}
+	return result;
+}
+
+void tr50_transfer_cache_add(
+	tr50_transfer_engine_t *engine,
+	const struct tr50_transfer *transfer )
+{
+	const iot_uint64_t max_size = engine->cache_max;
+	if ( transfer->cache_name[0] != '\0' && transfer->size > 0u &&
+		transfer->size <= max_size &&
+		tr50_transfer_cache_load( engine ) == IOT_STATUS_SUCCESS )
+	{
+		const unsigned int i = tr50_transfer_cache_find( engine,
+			transfer->cache_name );
+		if ( i < engine->cache_count )
+			tr50_transfer_cache_use( engine, i );
+		else
+		{
+			struct tr50_transfer_cache_entry *const cache =
+				(struct tr50_transfer_cache_entry *)os_realloc(
+					engine->cache,
+					sizeof( struct tr50_transfer_cache_entry ) *
+					( engine->cache_count + 1u ) );
+			if ( cache )
+			{
+				char entry_path[ PATH_MAX + 1u ];
+				char new_path[ PATH_MAX + 1u ];
+
+				/* written under another name, so an entry in the
+				 * cache is always complete */
+				engine->cache = cache;
+				tr50_transfer_cache_path( entry_path, engine,
+					transfer->cache_name, "" );
+				tr50_transfer_cache_path( new_path, engine,
+					transfer->cache_name,
+					TR50_TRANSFER_CACHE_NEW_EXTENSION );
+#ifdef IOT_THREAD_SUPPORT
+				os_thread_mutex_unlock( &engine->lock );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+				if ( os_file_copy( transfer->path, new_path ) ==
+					OS_STATUS_SUCCESS &&
+					os_file_move( new_path, entry_path ) ==
+					OS_STATUS_SUCCESS )
+				{
+					struct tr50_transfer_cache_entry *const entry =
+						&cache[engine->cache_count];
+					os_memcpy( entry->name, transfer->cache_name,
+						sizeof( entry->name ) );
+					entry->size = transfer->size;
+					++engine->cache_count;
+					engine->cache_size += transfer->size;
+
+					/* least recently used files make room */
+					while ( engine->cache_size > max_size &&
+						engine->cache_count > 1u )
+						tr50_transfer_cache_remove( engine,
+							0u );
+					tr50_transfer_cache_save( engine );
+				}
+				else
+				{
+					IOT_LOG( engine->lib, IOT_LOG_WARNING,
+						"Failed to add %s to the download "
+						"cache", transfer->path );
+					os_file_delete( new_path );
+				}
+#ifdef IOT_THREAD_SUPPORT
+				os_thread_mutex_lock( &engine->lock );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+			}
+		}
+	}
+}
+
+unsigned int tr50_transfer_cache_find(
+	const tr50_transfer_engine_t *engine,
+	const char *name )
+{
+	unsigned int result = 0u;
+	while ( result < engine->cache_count &&
+		os_strcmp( engine->cache[result].name, name ) != 0 )
+		++result;
+	return result;
+}
+
+iot_status_t tr50_transfer_cache_get(
+	tr50_transfer_engine_t *engine,
+	struct tr50_transfer *transfer )
+{
+	iot_status_t result = IOT_STATUS_NOT_FOUND;
+	if ( transfer->op == IOT_OPERATION_FILE_DOWNLOAD &&
+		transfer->cache_name[0] != '\0' && engine->cache_max > 0u &&
+		tr50_transfer_cache_load( engine ) == IOT_STATUS_SUCCESS )
+	{
+		const unsigned int i = tr50_transfer_cache_find( engine,
+			transfer->cache_name );
+		if ( i < engine->cache_count )
+		{
+			char entry_path[ PATH_MAX + 1u ];
+			char file_path[ PATH_MAX + 1u ];
+			os_file_t file = NULL;
+			iot_uint32_t crc32 = 0u;
+
+			result = IOT_STATUS_FAILURE;
+			tr50_transfer_cache_path( entry_path, engine,
+				transfer->cache_name, "" );
+			tr50_transfer_part_path( file_path, transfer, IOT_FALSE );
+
+			/* busy until the copy is verified, without the lock */
+			transfer->state = TR50_TRANSFER_ACTIVE;
+#ifdef IOT_THREAD_SUPPORT
+			os_thread_mutex_unlock( &engine->lock );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+			if ( os_file_copy( entry_path, file_path ) ==
+				OS_STATUS_SUCCESS )
+				file = os_file_open( file_path, OS_READ );
+			if ( file )
+			{
+				tr50_transfer_checksum_reset( transfer );
+				result = tr50_transfer_read( file, 0u,
+					transfer->size, &crc32,
+					( transfer->checksum_size > 0u ) ?
+					&transfer->checksum : NULL );
+				os_file_close( file );
+			}
+
+			if ( result == IOT_STATUS_SUCCESS )
+			{
+				transfer->ranged = IOT_FALSE;
+				transfer->part_crc32 = crc32;
+				transfer->prev_byte = (long)transfer->size;
+				if ( transfer->checksum_size > 0u )
+					transfer->checksum_offset =
+						transfer->size;
+				result = tr50_transfer_finish( engine,
+					transfer );
+			}
+			else
+			{
+				/* the progress of an earlier download no
+				 * longer matches the ".part" file */
+				os_file_delete( file_path );
+				tr50_transfer_part_path( file_path, transfer,
+					IOT_TRUE );
+				os_file_delete( file_path );
+			}
+
+			if ( result == IOT_STATUS_SUCCESS )
+			{
+				IOT_LOG( engine->lib, IOT_LOG_INFO,
+					"File %s found in the download cache",
+					transfer->path );
+				tr50_transfer_cache_use( engine, i );
+			}
+			else
+			{
+				IOT_LOG( engine->lib, IOT_LOG_WARNING,
+					"Failed to use the cached copy of %s, "
+					"downloading it", transfer->path );
+				tr50_transfer_cache_remove( engine, i );
+				transfer->prev_byte = 0;
+				tr50_transfer_checksum_reset( transfer );
+			}
+			tr50_transfer_cache_save( engine );
+#ifdef IOT_THREAD_SUPPORT
+			os_thread_mutex_lock( &engine->lock );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+			transfer->state = TR50_TRANSFER_READY;
+		}
+	}
+	return result;
+}
+
+iot_status_t tr50_transfer_cache_load(
+	tr50_transfer_engine_t *engine )
+{
+	if ( engine->cache_loaded == IOT_FALSE )
+	{
+		const size_t dir_len = iot_directory_name_get(
+			IOT_DIR_RUNTIME, engine->cache_dir, PATH_MAX );
+
+		engine->cache_loaded = IOT_TRUE;
+		engine->cache_dir[ PATH_MAX ] = '\0';
+		if ( dir_len > 0u && dir_len < PATH_MAX )
+			os_snprintf( &engine->cache_dir[dir_len],
+				PATH_MAX - dir_len, "%c%s", OS_DIR_SEP,
+				TR50_TRANSFER_CACHE_DIR );
+		else
+			engine->cache_dir[0] = '\0';
+		if ( engine->cache_dir[0] != '\0' &&
+			!os_directory_exists( engine->cache_dir ) &&
+			os_directory_create_nowait( engine->cache_dir ) !=
+				OS_STATUS_SUCCESS )
+		{
+			IOT_LOG( engine->lib, IOT_LOG_WARNING,
+				"Failed to create the download cache %s",
+				engine->cache_dir );
+			engine->cache_dir[0] = '\0';
+		}
+
+		if ( engine->cache_dir[0] != '\0' )
+		{
+			char file_path[ PATH_MAX + 1u ];
+			os_dir_t *dir;
+			os_file_t file;
+
+			tr50_transfer_cache_path( file_path, engine,
+				TR50_TRANSFER_CACHE_INDEX, "" );
+			file = os_file_open( file_path, OS_READ );
+			if ( file )
+			{
+				/* one name per line */
+				struct tr50_transfer_cache_entry entry;
+				while ( os_file_read( entry.name, 1u,
+					TR50_TRANSFER_CACHE_NAME_LEN + 1u, file ) ==
+					TR50_TRANSFER_CACHE_NAME_LEN + 1u &&
+					entry.name[TR50_TRANSFER_CACHE_NAME_LEN] ==
+					'\n' )
+				{
+					struct tr50_transfer_cache_entry *cache = NULL;
+					long size = 0;
+
+					entry.name[TR50_TRANSFER_CACHE_NAME_LEN] =
+						'\0';
+					tr50_transfer_cache_path( file_path, engine,
+						entry.name, "" );
+					if ( os_file_exists( file_path ) )
+						size = os_file_size( file_path );
+					if ( size > 0 &&
+						tr50_transfer_cache_find( engine,
+						entry.name ) == engine->cache_count )
+						cache = (struct tr50_transfer_cache_entry *)
+							os_realloc( engine->cache,
+							sizeof( struct tr50_transfer_cache_entry ) *
+							( engine->cache_count + 1u ) );
+					if ( cache )
+					{
+						entry.size = (iot_uint64_t)size;
+						cache[engine->cache_count] = entry;
+						engine->cache = cache;
+						++engine->cache_count;
+						engine->cache_size += entry.size;
+					}
+				}
+				os_file_close( file );
+			}
+
+			dir = os_directory_open( engine->cache_dir );
+			if ( dir )
+			{
+				while ( os_directory_next( dir, IOT_TRUE,
+					file_path, PATH_MAX ) == OS_STATUS_SUCCESS )
+				{
+					const char *name;
+					file_path[ PATH_MAX ] = '\0';
+					name = os_strrchr( file_path, OS_DIR_SEP );
+					if ( name )
+						++name;
+					else
+						name = file_path;
+					if ( os_strcmp( name,
+						TR50_TRANSFER_CACHE_INDEX ) != 0 &&
+						tr50_transfer_cache_find( engine,
+						name ) == engine->cache_count )
+						os_file_delete( file_path );
+				}
+				os_directory_close( dir );
+			}
+
+			/* largest size may have been reduced */
+			while ( engine->cache_size > engine->cache_max &&
+				engine->cache_count > 0u )
+				tr50_transfer_cache_remove( engine, 0u );
+			tr50_transfer_cache_save( engine );
+		}
+	}
+	return ( engine->cache_dir[0] != '\0' ) ?
+		IOT_STATUS_SUCCESS : IOT_STATUS_FAILURE;
+}
+
+void tr50_transfer_cache_path(
+	char *dest,
+	const tr50_transfer_engine_t *engine,
+	const char *name,
+	const char *extension )
+{
+	os_snprintf( dest, PATH_MAX, "%s%c%s%s", engine->cache_dir,
+		OS_DIR_SEP, name, extension );
+	dest[ PATH_MAX ] = '\0';
+}
+
+void tr50_transfer_cache_remove(
+	tr50_transfer_engine_t *engine,
+	unsigned int i )
+{
+	char file_path[ PATH_MAX + 1u ];
+	tr50_transfer_cache_path( file_path, engine,
+		engine->cache[i].name, "" );
+	os_file_delete( file_path );
+	engine->cache_size -= engine->cache[i].size;
+	--engine->cache_count;
+	os_memmove( &engine->cache[i], &engine->cache[i + 1u],
+		sizeof( struct tr50_transfer_cache_entry ) *
+		( engine->cache_count - i ) );
+}
+
+void tr50_transfer_cache_set(
+	tr50_transfer_engine_t *engine,
+	iot_uint64_t max_size )
+{
+	if ( engine )
+	{
+#ifdef IOT_THREAD_SUPPORT
+		os_thread_mutex_lock( &engine->lock );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+		engine->cache_max = max_size;
+#ifdef IOT_THREAD_SUPPORT
+		os_thread_mutex_unlock( &engine->lock );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+	}
+}
+
+void tr50_transfer_cache_save(
+	const tr50_transfer_engine_t *engine )
+{
+	char file_path[ PATH_MAX + 1u ];
+	char new_path[ PATH_MAX + 1u ];
+	os_file_t file;
+
+	/* replaced whole, so an interruption leaves the previous index */
+	tr50_transfer_cache_path( file_path, engine,
+		TR50_TRANSFER_CACHE_INDEX, "" );
+	tr50_transfer_cache_path( new_path, engine,
+		TR50_TRANSFER_CACHE_INDEX, TR50_TRANSFER_CACHE_NEW_EXTENSION );
+	file = os_file_open( new_path, OS_WRITE | OS_CREATE );
+	if ( file )
+	{
+		unsigned int i;
+		iot_bool_t written = IOT_TRUE;
+		for ( i = 0u; i < engine->cache_count && written; ++i )
+		{
+			if ( os_file_write( engine->cache[i].name, 1u,
+				TR50_TRANSFER_CACHE_NAME_LEN, file ) !=
+				TR50_TRANSFER_CACHE_NAME_LEN ||
+				os_file_write( "\n", 1u, 1u, file ) != 1u )
+				written = IOT_FALSE;
+		}
+		os_file_close( file );
+		if ( written == IOT_FALSE ||
+			os_file_move( new_path, file_path ) != OS_STATUS_SUCCESS )
+			os_file_delete( new_path );
+	}
+}
+
+void tr50_transfer_cache_use(
+	tr50_transfer_engine_t *engine,
+	unsigned int i )
+{
+	const struct tr50_transfer_cache_entry entry = engine->cache[i];
+	os_memmove( &engine->cache[i], &engine->cache[i + 1u],
+		sizeof( struct tr50_transfer_cache_entry ) *
+		( engine->cache_count - i - 1u ) );
+	engine->cache[engine->cache_count - 1u] = entry;
+}
+
+iot_status_t tr50_transfer_cancel(
+	tr50_transfer_engine_t *engine,
+	iot_uint32_t id,
+	iot_bool_t notify )
+{
+	iot_status_t result = IOT_STATUS_BAD_PARAMETER;
+	if ( engine )
+	{
+		struct tr50_transfer *transfer;
+		result = IOT_STATUS_NOT_FOUND;
+#ifdef IOT_THREAD_SUPPORT
+		os_thread_mutex_lock( &engine->lock );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+		for ( transfer = engine->head; transfer &&
+			result == IOT_STATUS_NOT_FOUND;
+			transfer = transfer->next )
+		{
+			if ( transfer->id == id &&
+				transfer->state != TR50_TRANSFER_DONE )
+			{
+				/* an active transfer is aborted from the
+				 * progress callback */
+				transfer->cancel = IOT_TRUE;
+				transfer->notify = notify;
+				result = IOT_STATUS_SUCCESS;
+			}
+		}
+#ifdef IOT_THREAD_SUPPORT
+		os_thread_mutex_unlock( &engine->lock );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+		if ( result == IOT_STATUS_SUCCESS )
+			tr50_transfer_wake( engine );
+	}
+	return result;
+}
+
+void tr50_transfer_checksum_add(
+	struct tr50_transfer *transfer,
+	iot_uint64_t offset,
+	const void *data,
+	size_t len )
+{
+	if ( transfer->checksum_size > 0u &&
+		offset <= transfer->checksum_offset &&
+		transfer->checksum_offset < offset + len )
+	{
+		/* part of the data may have been added by an earlier attempt */
+		const size_t skip = (size_t)( transfer->checksum_offset - offset );
+		iot_checksum_update( &transfer->checksum,
+			(const unsigned char *)data + skip, len - skip );
+		transfer->checksum_offset += len - skip;
+	}
+}
+
+void tr50_transfer_checksum_read(
+	const tr50_transfer_engine_t *engine,
+	struct tr50_transfer *transfer )
+{
+	iot_uint64_t end = (iot_uint64_t)transfer->prev_byte;
+	if ( transfer->ranged != IOT_FALSE )
+	{
+		/* completed chunks following the data added so far */
+		unsigned int chunk = (unsigned int)( transfer->checksum_offset /
+			TR50_TRANSFER_CHUNK_SIZE );
+		while ( chunk < transfer->chunk_count &&
+			( transfer->chunks[chunk / 8u] & ( 1u << ( chunk % 8u ) ) ) )
+			++chunk;
+		end = (iot_uint64_t)chunk * TR50_TRANSFER_CHUNK_SIZE;
+		if ( end > transfer->size )
+			end = transfer->size;
+	}
+
+	if ( transfer->checksum_size > 0u && end > transfer->checksum_offset )
+	{
+		char file_path[ PATH_MAX + 1u ];
+		os_file_t file;
+		iot_status_t status = IOT_STATUS_FAILURE;
+
+		tr50_transfer_part_path( file_path, transfer, IOT_FALSE );
+		file = os_file_open( file_path, OS_READ );
+		if ( file )
+		{
+			status = tr50_transfer_read( file,
+				transfer->checksum_offset,
+				end - transfer->checksum_offset, NULL,
+				&transfer->checksum );
+			os_file_close( file );
+		}
+		if ( status == IOT_STATUS_SUCCESS )
+			transfer->checksum_offset = end;
+		else
+		{
+			/* the download is verified once complete, so it fails
+			 * if the data can't be read to be checksummed */
+			IOT_LOG( engine->lib, IOT_LOG_WARNING,
+				"Failed to read %s to checksum it", file_path );
+			tr50_transfer_checksum_reset( transfer );
+		}
+	}
+}
+
+void tr50_transfer_checksum_reset(
+	struct tr50_transfer *transfer )
+{
+	if ( transfer->checksum_size > 0u )
+	{
+		iot_checksum_initialize( &transfer->checksum,
+			transfer->checksum.type );
+		transfer->checksum_offset = 0u;
+	}
+}
+
+iot_status_t tr50_transfer_checksum_set(
+	tr50_transfer_engine_t *engine,
+	iot_uint32_t id,
+	iot_checksum_type_t type,
+	const char *checksum )
+{
+	iot_status_t result = IOT_STATUS_BAD_PARAMETER;
+	const size_t size = iot_checksum_size( type );
+	if ( engine && checksum && size > 0u &&
+		os_strlen( checksum ) == size * 2u )
+	{
+		iot_uint8_t expected[ IOT_CHECKSUM_SIZE_MAX ];
+		size_t i;
+
+		/* hexadecimal, in the usual byte order of the algorithm */
+		result = IOT_STATUS_SUCCESS;
+		os_memzero( expected, sizeof( expected ) );
+		for ( i = 0u; i < size * 2u && result == IOT_STATUS_SUCCESS; ++i )
+		{
+			const char c = checksum[i];
+			unsigned int nibble = 0u;
+			if ( c >= '0' && c <= '9' )
+				nibble = (unsigned int)( c - '0' );
+			else if ( c >= 'a' && c <= 'f' )
+				nibble = (unsigned int)( c - 'a' ) + 10u;
+			else if ( c >= 'A' && c <= 'F' )
+				nibble = (unsigned int)( c - 'A' ) + 10u;
+			else
+				result = IOT_STATUS_BAD_PARAMETER;
+			expected[i / 2u] = (iot_uint8_t)(
+				expected[i / 2u] | ( nibble << ( ( i % 2u ) ?
+					0u : 4u ) ) );
+		}
+
+		if ( result == IOT_STATUS_SUCCESS )
+		{
+			struct tr50_transfer *transfer;
+			result = IOT_STATUS_NOT_FOUND;
+#ifdef IOT_THREAD_SUPPORT
+			os_thread_mutex_lock( &engine->lock );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+			for ( transfer = engine->head; transfer &&
+				result == IOT_STATUS_NOT_FOUND;
+				transfer = transfer->next )
+			{
+				if ( transfer->id == id &&
+					transfer->op == IOT_OPERATION_FILE_DOWNLOAD &&
+					transfer->state == TR50_TRANSFER_REQUESTED )
+				{
+					iot_checksum_initialize(
+						&transfer->checksum, type );
+					os_memcpy( transfer->checksum_expected,
+						expected, size );
+					transfer->checksum_offset = 0u;
+					transfer->checksum_size = size;
+					result = IOT_STATUS_SUCCESS;
+				}
+			}
+#ifdef IOT_THREAD_SUPPORT
+			os_thread_mutex_unlock( &engine->lock );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+		}
+	}
+	return result;
+}
+
+void tr50_transfer_concurrency_set(
+	tr50_transfer_engine_t *engine,
+	unsigned int concurrency )
+{
+	if ( engine )
+	{
+		if ( concurrency == 0u )
+			concurrency = TR50_TRANSFER_CONCURRENCY;
+#ifdef IOT_THREAD_SUPPORT
+		os_thread_mutex_lock( &engine->lock );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+		engine->concurrency = concurrency;
+#ifdef IOT_THREAD_SUPPORT
+		os_thread_mutex_unlock( &engine->lock );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+		tr50_transfer_wake( engine );
+	}
+}
+
+iot_bool_t tr50_transfer_connection_bad(
+	CURLcode curl_result )
+{
+	iot_bool_t result = IOT_FALSE;
+	if ( curl_result == CURLE_COULDNT_RESOLVE_PROXY ||
+	     curl_result == CURLE_COULDNT_RESOLVE_HOST ||
+	     curl_result == CURLE_COULDNT_CONNECT ||
+	     curl_result == CURLE_PARTIAL_FILE ||
+	     curl_result == CURLE_OPERATION_TIMEDOUT ||
+	     curl_result == CURLE_SSL_CONNECT_ERROR ||
+	     curl_result == CURLE_GOT_NOTHING ||
+	     curl_result == CURLE_SEND_ERROR ||
+	     curl_result == CURLE_RECV_ERROR )
+		result = IOT_TRUE;
+	return result;
+}
+
+CURL *tr50_transfer_curl(
+	tr50_transfer_engine_t *engine,
+	struct tr50_transfer_segment *segment )
+{
+	CURL *result;
+	if ( engine->handle_count > 0u )
+	{
+		result = engine->handles[--engine->handle_count];
+		curl_easy_reset( result );
+	}
+	else
+		result = curl_easy_init();
+	if ( result )
+	{
+		const struct tr50_transfer *const transfer = segment->transfer;
+		const char *ca_bundle_file = NULL;
+		iot_bool_t validate_cert = IOT_FALSE;
+		const struct iot_proxy *const proxy = engine->proxy;
+
+#ifdef __clang__
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wdisabled-macro-expansion"
+#endif /* ifdef __clang__ */
+		curl_easy_setopt( result, CURLOPT_PRIVATE, segment );
+		if ( engine->share )
+			curl_easy_setopt( result, CURLOPT_SHARE, engine->share );
+		curl_easy_setopt( result, CURLOPT_URL, transfer->url );
+		curl_easy_setopt( result, CURLOPT_VERBOSE, 1L );
+		curl_easy_setopt( result, CURLOPT_NOSIGNAL, 1L );
+		curl_easy_setopt( result, CURLOPT_FAILONERROR, 1L );
+		/* ranges are of the file, not of an encoded version of it */
+		if ( transfer->ranged == IOT_FALSE )
+			curl_easy_setopt( result, CURLOPT_ACCEPT_ENCODING, "" );
+		curl_easy_setopt( result, CURLOPT_NOPROGRESS, 0L );
+		curl_easy_setopt( result, CURLOPT_PROGRESSFUNCTION,
+			tr50_transfer_progress_old );
+		curl_easy_setopt( result, CURLOPT_PROGRESSDATA, segment );
+#if LIBCURL_VERSION_NUM >= 0x072000
+		curl_easy_setopt( result, CURLOPT_XFERINFOFUNCTION,
+			tr50_transfer_progress );
+		curl_easy_setopt( result, CURLOPT_XFERINFODATA, segment );
+#endif /* LIBCURL_VERSION_NUM >= 0x072000 */
+		iot_config_get( engine->lib, "ca_bundle_file", IOT_FALSE,
+			IOT_TYPE_STRING, &ca_bundle_file );
+		iot_config_get( engine->lib, "validate_cloud_cert", IOT_FALSE,
+			IOT_TYPE_BOOL, &validate_cert );
+		if ( !ca_bundle_file )
+			ca_bundle_file = IOT_DEFAULT_CERT_PATH;
+		curl_easy_setopt( result, CURLOPT_CAINFO, ca_bundle_file );
+
+		/* SSL verification */
+		if ( validate_cert != IOT_FALSE )
+		{
+			curl_easy_setopt( result, CURLOPT_SSL_VERIFYHOST,
+				TR50_DEFAULT_SSL_VERIFY_HOST );
+			curl_easy_setopt( result, CURLOPT_SSL_VERIFYPEER,
+				TR50_DEFAULT_SSL_VERIFY_PEER );
+		}
+		else
+		{
+			curl_easy_setopt( result, CURLOPT_SSL_VERIFYHOST, 0L );
+			curl_easy_setopt( result, CURLOPT_SSL_VERIFYPEER, 0L );
+		}
+
+		/* Proxy settings */
+		if ( proxy && proxy->type != IOT_PROXY_UNKNOWN &&
+		     proxy->host && *proxy->host != '\0' )
+		{
+			long proxy_type = CURLPROXY_HTTP;
+			if ( proxy->type == IOT_PROXY_SOCKS5 )
+				proxy_type = CURLPROXY_SOCKS5_HOSTNAME;
+
+			curl_easy_setopt( result, CURLOPT_PROXY, proxy->host );
+			curl_easy_setopt( result, CURLOPT_PROXYPORT,
+				(long)proxy->port );
+			curl_easy_setopt( result, CURLOPT_PROXYTYPE, proxy_type );
+			if ( proxy->username && proxy->username[0] != '\0' )
+				curl_easy_setopt( result, CURLOPT_PROXYUSERNAME,
+					proxy->username );
+			if ( proxy->password && proxy->password[0] != '\0' )
+				curl_easy_setopt( result, CURLOPT_PROXYPASSWORD,
+					proxy->password );
+		}
+
+		/* Force a timeout when speed is less than the low speed limit
+		 * for certain period of time so libcurl will stop trying for
+		 * nothing and wait until network gets better */
+		curl_easy_setopt( result, CURLOPT_LOW_SPEED_LIMIT,
+			IOT_TRANSFER_LOW_SPEED_LIMIT );
+		curl_easy_setopt( result, CURLOPT_LOW_SPEED_TIME,
+			IOT_TRANSFER_LOW_SPEED_TIMEOUT );
+
+		if ( transfer->fresh_connect != IOT_FALSE )
+		{
+			/* the connection failed, retry on a fresh connection
+			 * & name lookup (others are reused, skipping their
+			 * set up & TLS handshake) */
+			curl_easy_setopt( result, CURLOPT_FRESH_CONNECT, 1L );
+			curl_easy_setopt( result, CURLOPT_DNS_CACHE_TIMEOUT, 0L );
+		}
+#ifdef __clang__
+#pragma clang diagnostic pop
+#endif /* ifdef __clang__ */
+	}
+	return result;
+}
+
+void tr50_transfer_curl_release(
+	tr50_transfer_engine_t *engine,
+	CURL *curl )
+{
+	curl_multi_remove_handle( engine->multi, curl );
+	if ( engine->handle_count < TR50_TRANSFER_HANDLES_MAX )
+		engine->handles[engine->handle_count++] = curl;
+	else
+		curl_easy_cleanup( curl );
+}
+
+void tr50_transfer_end(
+	tr50_transfer_engine_t *engine,
+	struct tr50_transfer_segment *segment,
+	CURLcode curl_result )
+{
+	struct tr50_transfer *const transfer = segment->transfer;
+	iot_bool_t restarted = IOT_FALSE;
+
+	tr50_transfer_curl_release( engine, segment->curl );
+	segment->curl = NULL;
+	if ( segment->file )
+		os_file_close( segment->file );
+	segment->file = NULL;
+	if ( segment->stream )
+		iot_archive_stream_close( segment->stream );
+	segment->stream = NULL;
+
+	if ( transfer->ranged != IOT_FALSE && curl_result == CURLE_OK &&
+		segment->now != segment->length )
+		curl_result = CURLE_PARTIAL_FILE;
+
+	if ( transfer->ranged == IOT_FALSE &&
+		transfer->op == IOT_OPERATION_FILE_DOWNLOAD )
+	{
+		/* keep the checksum of the data received, to resume */
+		transfer->part_crc32 = segment->crc32;
+		transfer->prev_byte += (long)segment->now;
+		if ( curl_result != CURLE_OK && transfer->prev_byte > 0 )
+			tr50_transfer_map_save( engine, transfer );
+	}
+
+	if ( transfer->ranged != IOT_FALSE && curl_result == CURLE_OK )
+	{
+		transfer->chunks[segment->chunk / 8u] |=
+			(iot_uint8_t)( 1u << ( segment->chunk % 8u ) );
+		transfer->chunk_crc32[segment->chunk] = segment->crc32;
+		transfer->done_bytes += segment->length;
+		tr50_transfer_map_save( engine, transfer );
+		tr50_transfer_checksum_read( engine, transfer );
+
+		/* keep the connection busy with the next chunk */
+		if ( transfer->curl_result == CURLE_OK &&
+			transfer->cancel == IOT_FALSE &&
+			tr50_transfer_segment_start( engine, segment ) ==
+				IOT_STATUS_SUCCESS )
+			restarted = IOT_TRUE;
+	}
+	else if ( curl_result != CURLE_OK &&
+		transfer->curl_result == CURLE_OK )
+		/* no more chunks are started, the ones in progress are
+		 * completed & kept for the retry */
+		transfer->curl_result = curl_result;
+
+	if ( restarted == IOT_FALSE )
+	{
+		--transfer->segment_count;
+		if ( transfer->segment_count == 0u )
+			tr50_transfer_attempt_end( engine, transfer );
+	}
+}
+
+tr50_transfer_engine_t *tr50_transfer_engine_create(
+	iot_t *lib,
+	const struct iot_proxy *proxy )
+{
+	tr50_transfer_engine_t *result = (tr50_transfer_engine_t *)
+		os_malloc( sizeof( tr50_transfer_engine_t ) );
+	if ( result )
+	{
+#ifdef IOT_THREAD_SUPPORT
+		unsigned int i;
+#endif /* ifdef IOT_THREAD_SUPPORT */
+		os_memzero( result, sizeof( tr50_transfer_engine_t ) );
+		result->lib = lib;
+		result->proxy = proxy;
+		result->concurrency = TR50_TRANSFER_CONCURRENCY;
+		result->segments = TR50_TRANSFER_SEGMENTS;
+		result->multi = curl_multi_init();
+#ifdef IOT_THREAD_SUPPORT
+		if ( result->multi &&
+			os_thread_mutex_create( &result->lock ) ==
+				OS_STATUS_SUCCESS )
+		{
+			if ( os_thread_condition_create( &result->signal ) !=
+				OS_STATUS_SUCCESS )
+			{
+				os_thread_mutex_destroy( &result->lock );
+				curl_multi_cleanup( result->multi );
+				result->multi = NULL;
+			}
+		}
+		else if ( result->multi )
+		{
+			curl_multi_cleanup( result->multi );
+			result->multi = NULL;
+		}
+#endif /* ifdef IOT_THREAD_SUPPORT */
+		if ( result->multi )
+		{
+			/* name lookups, TLS sessions & connections are kept
+			 * across transfers, instead of each one paying for
+			 * them (transfers work without, if not supported) */
+			result->share = curl_share_init();
+#ifdef IOT_THREAD_SUPPORT
+			for ( i = 0u; result->share &&
+				i < (unsigned int)CURL_LOCK_DATA_LAST; ++i )
+			{
+				if ( os_thread_mutex_create(
+					&result->share_lock[i] ) !=
+					OS_STATUS_SUCCESS )
+				{
+					while ( i > 0u )
+						os_thread_mutex_destroy(
+							&result->share_lock[--i] );
+					curl_share_cleanup( result->share );
+					result->share = NULL;
+				}
+			}
+			if ( result->share )
+			{
+				curl_share_setopt( result->share,
+					CURLSHOPT_LOCKFUNC,
+					tr50_transfer_share_lock );
+				curl_share_setopt( result->share,
+					CURLSHOPT_UNLOCKFUNC,
+					tr50_transfer_share_unlock );
+				curl_share_setopt( result->share,
+					CURLSHOPT_USERDATA, result );
+			}
+#endif /* ifdef IOT_THREAD_SUPPORT */
+			if ( result->share )
+			{
+				curl_share_setopt( result->share,
+					CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS );
+				curl_share_setopt( result->share,
+					CURLSHOPT_SHARE,
+					CURL_LOCK_DATA_SSL_SESSION );
+#if LIBCURL_VERSION_NUM >= 0x073900
+				curl_share_setopt( result->share,
+					CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT );
+#endif /* LIBCURL_VERSION_NUM >= 0x073900 */
+			}
+		}
+		else
+			os_free_null( (void **)&result );
+	}
+	return result;
+}
+
+iot_status_t tr50_transfer_engine_destroy(
+	tr50_transfer_engine_t *engine )
+{
+	iot_status_t result = IOT_STATUS_BAD_PARAMETER;
+	if ( engine )
+	{
+#ifdef IOT_THREAD_SUPPORT
+		if ( engine->thread_started != IOT_FALSE )
+		{
+			os_thread_mutex_lock( &engine->lock );
+			engine->to_quit = IOT_TRUE;
+			os_thread_mutex_unlock( &engine->lock );
+			tr50_transfer_wake( engine );
+			os_thread_wait( &engine->thread );
+			os_thread_destroy( &engine->thread );
+		}
+#endif /* ifdef IOT_THREAD_SUPPORT */
+		while ( engine->head )
+		{
+			struct tr50_transfer *const transfer = engine->head;
+			engine->head = transfer->next;
+			tr50_transfer_free( engine, transfer );
+		}
+		engine->tail = NULL;
+		while ( engine->handle_count > 0u )
+			curl_easy_cleanup(
+				engine->handles[--engine->handle_count] );
+		curl_multi_cleanup( engine->multi );
+		os_free_null( (void **)&engine->cache );
+
+		/* once no handle uses it */
+		if ( engine->share )
+		{
+#ifdef IOT_THREAD_SUPPORT
+			unsigned int i;
+#endif /* ifdef IOT_THREAD_SUPPORT */
+			curl_share_cleanup( engine->share );
+#ifdef IOT_THREAD_SUPPORT
+			for ( i = 0u; i < (unsigned int)CURL_LOCK_DATA_LAST;
+				++i )
+				os_thread_mutex_destroy( &engine->share_lock[i] );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+		}
+#ifdef IOT_THREAD_SUPPORT
+		os_thread_condition_destroy( &engine->signal );
+		os_thread_mutex_destroy( &engine->lock );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+		os_free( engine );
+		result = IOT_STATUS_SUCCESS;
+	}
+	return result;
+}
+
+size_t tr50_transfer_file_read(
+	char *ptr,
+	size_t size,
+	size_t nmemb,
+	void *user_data )
+{
+	size_t result = CURL_READFUNC_PAUSE;
+	struct tr50_transfer_segment *const segment =
+		(struct tr50_transfer_segment *)user_data;
+	if ( tr50_transfer_throttle( segment, size * nmemb ) == IOT_FALSE )
+		result = os_file_read( ptr, size, nmemb, segment->file ) * size;
+	return result;
+}
+
+iot_status_t tr50_transfer_finish(
+	const tr50_transfer_engine_t *engine,
+	const struct tr50_transfer *transfer )
+{
+	iot_status_t result = IOT_STATUS_SUCCESS;
+	if ( transfer->op == IOT_OPERATION_FILE_DOWNLOAD )
+	{
+		char file_path[ PATH_MAX + 1u ];
+		iot_uint32_t crc32 = transfer->part_crc32;
+
+		/* download is complete, no need to record its progress */
+		tr50_transfer_part_path( file_path, transfer, IOT_TRUE );
+		if ( os_file_exists( file_path ) )
+			os_file_delete( file_path );
+
+		if ( transfer->ranged != IOT_FALSE )
+		{
+			unsigned int i;
+			crc32 = 0u;
+			for ( i = 0u; i < transfer->chunk_count; ++i )
+			{
+				iot_uint64_t length = TR50_TRANSFER_CHUNK_SIZE;
+				if ( i + 1u == transfer->chunk_count )
+					length = transfer->size -
+						(iot_uint64_t)i *
+						TR50_TRANSFER_CHUNK_SIZE;
+				crc32 = iot_checksum_crc32_combine( crc32,
+					transfer->chunk_crc32[i], length );
+			}
+		}
+
+		if ( (iot_uint64_t)crc32 != transfer->crc32 )
+		{
+			IOT_LOG( engine->lib, IOT_LOG_ERROR,
+				"Checksum for %s does not match. "
+				"Expected: 0x%lX, calculated: 0x%lX",
+				transfer->path,
+				(unsigned long)transfer->crc32,
+				(unsigned long)crc32 );
+			result = IOT_STATUS_FAILURE;
+		}
+
+		if ( result == IOT_STATUS_SUCCESS && transfer->checksum_size > 0u )
+		{
+			iot_checksum_ctx_t checksum = transfer->checksum;
+			iot_uint8_t calculated[ IOT_CHECKSUM_SIZE_MAX ];
+			iot_uint8_t diff = 1u;
+			size_t i;
+
+			/* all of the file must have been added */
+			os_memzero( calculated, sizeof( calculated ) );
+			if ( transfer->checksum_offset == transfer->size &&
+				iot_checksum_final( &checksum, calculated,
+					sizeof( calculated ) ) == IOT_STATUS_SUCCESS )
+			{
+				diff = 0u;
+				for ( i = 0u; i < transfer->checksum_size; ++i )
+					diff |= (iot_uint8_t)( calculated[i] ^
+						transfer->checksum_expected[i] );
+			}
+
+			if ( diff != 0u )
+			{
+				char expected_hex[ IOT_CHECKSUM_SIZE_MAX * 2u + 1u ];
+				char calculated_hex[ IOT_CHECKSUM_SIZE_MAX * 2u + 1u ];
+				for ( i = 0u; i < transfer->checksum_size; ++i )
+				{
+					os_snprintf( &expected_hex[i * 2u], 3u,
+						"%02x", transfer->checksum_expected[i] );
+					os_snprintf( &calculated_hex[i * 2u], 3u,
+						"%02x", calculated[i] );
+				}
+				expected_hex[i * 2u] = '\0';
+				calculated_hex[i * 2u] = '\0';
+				IOT_LOG( engine->lib, IOT_LOG_ERROR,
+					"Checksum for %s does not match. "
+					"Expected: %s, calculated: %s",
+					transfer->path, expected_hex,
+					calculated_hex );
+				result = IOT_STATUS_FAILURE;
+			}
+		}
+
+		tr50_transfer_part_path( file_path, transfer, IOT_FALSE );
+		if ( result == IOT_STATUS_SUCCESS )
+			os_file_move( file_path, transfer->path );
+		else
+			os_file_delete( file_path );
+	}
+	else if ( transfer->archive == IOT_FALSE &&
+		os_strlen( transfer->path ) > 4u  &&
+		os_strncmp( transfer->path + os_strlen( transfer->path ) - 4u,
+			".tar", 4u ) == 0 )
+		os_file_delete( transfer->path );
+	return result;
+}
+
+void tr50_transfer_free(
+	tr50_transfer_engine_t *engine,
+	struct tr50_transfer *transfer )
+{
+	unsigned int i;
+	for ( i = 0u; i < transfer->segment_max; ++i )
+	{
+		struct tr50_transfer_segment *const segment =
+			&transfer->segments[i];
+		if ( segment->curl )
+			tr50_transfer_curl_release( engine, segment->curl );
+		if ( segment->file )
+			os_file_close( segment->file );
+		if ( segment->stream )
+			iot_archive_stream_close( segment->stream );
+	}
+	os_free_null( (void **)&transfer->segments );
+	os_free_null( (void **)&transfer->chunk_crc32 );
+	os_free_null( (void **)&transfer->chunks );
+	os_free_null( (void **)&transfer->url );
+	os_free( transfer );
+}
+
+void tr50_transfer_latency_set(
+	tr50_transfer_engine_t *engine,
+	iot_millisecond_t latency )
+{
+	if ( engine )
+	{
+#ifdef IOT_THREAD_SUPPORT
+		os_thread_mutex_lock( &engine->lock );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+		engine->latency = latency;
+#ifdef IOT_THREAD_SUPPORT
+		os_thread_mutex_unlock( &engine->lock );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+	}
+}
+
+iot_status_t tr50_transfer_loop(
+	tr50_transfer_engine_t *engine )
+{
+	iot_status_t result = IOT_STATUS_BAD_PARAMETER;
+	if ( engine )
+	{
+#ifndef IOT_THREAD_SUPPORT
+		/* the application already waited for activity */
+		if ( engine->head )
+			tr50_transfer_service( engine, 0u );
+#endif /* ifndef IOT_THREAD_SUPPORT */
+		result = IOT_STATUS_SUCCESS;
+	}
+	return result;
+}
+
+void tr50_transfer_loop_poll(
+	tr50_transfer_engine_t *engine,
+	struct iot_loop_poll *poll )
+{
+#ifdef IOT_THREAD_SUPPORT
+	(void)engine;
+	(void)poll;
+#else /* ifdef IOT_THREAD_SUPPORT */
+	if ( engine && poll && engine->head )
+	{
+		iot_timestamp_t wait = 0u;
+		long curl_time_out = -1;
+
+		if ( engine->active > 0u )
+		{
+			fd_set fd_read;
+			fd_set fd_write;
+			fd_set fd_except;
+			int fd_max = -1;
+			int fd;
+
+			FD_ZERO( &fd_read );
+			FD_ZERO( &fd_write );
+			FD_ZERO( &fd_except );
+			curl_multi_fdset( engine->multi, &fd_read, &fd_write,
+				&fd_except, &fd_max );
+			for ( fd = 0; fd <= fd_max; ++fd )
+			{
+				unsigned int events = 0u;
+				if ( FD_ISSET( fd, &fd_read ) )
+					events |= IOT_LOOP_EVENT_READ;
+				if ( FD_ISSET( fd, &fd_write ) )
+					events |= IOT_LOOP_EVENT_WRITE;
+				if ( events )
+				{
+					if ( poll->fds_count < poll->fds_max )
+					{
+						poll->fds[poll->fds_count].fd = fd;
+						poll->fds[poll->fds_count].events =
+							events;
+					}
+					++poll->fds_count;
+				}
+			}
+
+			/* curl has no socket yet (i.e. resolving a name) */
+			curl_multi_timeout( engine->multi, &curl_time_out );
+			if ( fd_max < 0 && ( curl_time_out < 0 ||
+				curl_time_out > (long)TR50_TRANSFER_WAIT_MAX ) )
+				curl_time_out = (long)TR50_TRANSFER_WAIT_MAX;
+			if ( curl_time_out >= 0 )
+				wait = (iot_timestamp_t)curl_time_out + 1u;
+		}
+
+		if ( engine->next_time > 0u )
+		{
+			const iot_timestamp_t now = iot_timestamp_now();
+			iot_timestamp_t next = 1u;
+			if ( engine->next_time > now )
+				next = engine->next_time - now;
+			if ( wait == 0u || next < wait )
+				wait = next;
+		}
+		if ( wait > 0u && ( poll->time_out == 0u ||
+			wait < (iot_timestamp_t)poll->time_out ) )
+			poll->time_out = (iot_millisecond_t)wait;
+	}
+#endif /* else IOT_THREAD_SUPPORT */
+}
+
+iot_status_t tr50_transfer_map_load(
+	const tr50_transfer_engine_t *engine,
+	struct tr50_transfer *transfer )
+{
+	iot_status_t result = IOT_STATUS_NO_MEMORY;
+	const unsigned int chunk_count = (unsigned int)(
+		( transfer->size + TR50_TRANSFER_CHUNK_SIZE - 1u ) /
+		TR50_TRANSFER_CHUNK_SIZE );
+	const size_t map_len = ( chunk_count + 7u ) / 8u;
+	const size_t crc_len = sizeof( iot_uint32_t ) * chunk_count;
+	char file_path[ PATH_MAX + 1u ];
+	char map_path[ PATH_MAX + 1u ];
+
+	tr50_transfer_part_path( file_path, transfer, IOT_FALSE );
+	tr50_transfer_part_path( map_path, transfer, IOT_TRUE );
+	if ( transfer->chunks == NULL || transfer->chunk_crc32 == NULL ||
+		transfer->chunk_count != chunk_count )
+	{
+		os_free_null( (void **)&transfer->chunks );
+		os_free_null( (void **)&transfer->chunk_crc32 );
+		transfer->chunks = (iot_uint8_t *)os_malloc( map_len );
+		transfer->chunk_crc32 = (iot_uint32_t *)os_malloc( crc_len );
+	}
+
+	if ( transfer->chunks && transfer->chunk_crc32 )
+	{
+		struct tr50_transfer_map header;
+		iot_bool_t resume = IOT_FALSE;
+		iot_uint64_t part_size = 0u;
+		os_file_t file;
+		unsigned int i;
+
+		transfer->chunk_count = chunk_count;
+		transfer->done_bytes = 0u;
+		if ( os_file_exists( file_path ) )
+			part_size = (iot_uint64_t)os_file_size( file_path );
+
+		/* chunks completed by an earlier attempt */
+		file = os_file_open( map_path, OS_READ );
+		if ( file )
+		{
+			if ( os_file_read( &header, sizeof( header ), 1u, file ) == 1u &&
+				header.magic == TR50_DOWNLOAD_MAP_MAGIC &&
+				header.chunk_size == TR50_TRANSFER_CHUNK_SIZE &&
+				header.crc32 == transfer->crc32 &&
+				header.size == transfer->size &&
+				part_size == transfer->size &&
+				os_file_read( transfer->chunks, 1u, map_len, file ) ==
+					map_len &&
+				os_file_read( transfer->chunk_crc32, 1u, crc_len,
+					file ) == crc_len )
+				resume = IOT_TRUE;
+			os_file_close( file );
+		}
+
+		if ( resume == IOT_FALSE )
+		{
+			os_memzero( transfer->chunks, map_len );
+			os_memzero( transfer->chunk_crc32, crc_len );
+		}
+
+		/* the start of an earlier single stream download */
+		if ( resume == IOT_FALSE && part_size > 0u &&
+			part_size < transfer->size )
+		{
+			file = os_file_open( file_path, OS_READ );
+			if ( file )
+			{
+				for ( i = 0u; (iot_uint64_t)( i + 1u ) *
+					TR50_TRANSFER_CHUNK_SIZE <= part_size &&
+					tr50_transfer_read( file,
+						(iot_uint64_t)i *
+						TR50_TRANSFER_CHUNK_SIZE,
+						TR50_TRANSFER_CHUNK_SIZE,
+						&transfer->chunk_crc32[i],
+						NULL ) ==
+						IOT_STATUS_SUCCESS; ++i )
+					transfer->chunks[i / 8u] |=
+						(iot_uint8_t)( 1u << ( i % 8u ) );
+				os_file_close( file );
+				resume = IOT_TRUE;
+			}
+		}
+
+		for ( i = 0u; i < chunk_count; ++i )
+		{
+			if ( transfer->chunks[i / 8u] & ( 1u << ( i % 8u ) ) )
+			{
+				if ( i + 1u < chunk_count )
+					transfer->done_bytes += TR50_TRANSFER_CHUNK_SIZE;
+				else
+					transfer->done_bytes += transfer->size -
+						(iot_uint64_t)i * TR50_TRANSFER_CHUNK_SIZE;
+			}
+		}
+
+		/* nothing left to fetch, but it never verified */
+		if ( transfer->done_bytes >= transfer->size )
+			resume = IOT_FALSE;
+		if ( resume == IOT_FALSE )
+		{
+			os_memzero( transfer->chunks, map_len );
+			os_memzero( transfer->chunk_crc32, crc_len );
+			transfer->done_bytes = 0u;
+			part_size = 0u;
+			tr50_transfer_checksum_reset( transfer );
+		}
+		else if ( transfer->done_bytes > 0u )
+			IOT_LOG( engine->lib, IOT_LOG_DEBUG,
+				"File exists %s, resume xfer with %lu of %lu bytes",
+				file_path, (unsigned long)transfer->done_bytes,
+				(unsigned long)transfer->size );
+
+		/* preallocate (sparse), so chunks can be written in any order */
+		result = IOT_STATUS_SUCCESS;
+		if ( part_size != transfer->size )
+		{
+			const char zero = '\0';
+			result = IOT_STATUS_FAILURE;
+			file = os_file_open( file_path, ( resume == IOT_FALSE )?
+				OS_READ_WRITE | OS_CREATE : OS_READ_WRITE );
+			if ( file )
+			{
+				if ( os_file_seek( file, (long)( transfer->size - 1u ),
+					SEEK_SET ) == 0 &&
+					os_file_write( &zero, 1u, 1u, file ) == 1u )
+					result = IOT_STATUS_SUCCESS;
+				os_file_close( file );
+			}
+		}
+		if ( result == IOT_STATUS_SUCCESS )
+			tr50_transfer_map_save( engine, transfer );
+		else
+		{
+			IOT_LOG( engine->lib, IOT_LOG_ERROR,
+				"Failed to preallocate %s", file_path );
+			os_free_null( (void **)&transfer->chunks );
+			os_free_null( (void **)&transfer->chunk_crc32 );
+			os_file_delete( map_path );
+		}
+	}
+	return result;
+}
+
+void tr50_transfer_map_save(
+	const tr50_transfer_engine_t *engine,
+	const struct tr50_transfer *transfer )
+{
+	char map_path[ PATH_MAX + 1u ];
+	os_file_t file;
+
+	tr50_transfer_part_path( map_path, transfer, IOT_TRUE );
+	file = os_file_open( map_path, OS_WRITE | OS_CREATE );
+	if ( file )
+	{
+		struct tr50_transfer_map header;
+		os_memzero( &header, sizeof( header ) );
+		header.magic = TR50_DOWNLOAD_MAP_MAGIC;
+		header.crc32 = transfer->crc32;
+		header.size = transfer->size;
+		if ( transfer->ranged != IOT_FALSE )
+			header.chunk_size = TR50_TRANSFER_CHUNK_SIZE;
+		else
+		{
+			header.length = (iot_uint64_t)transfer->prev_byte;
+			header.checksum = transfer->part_crc32;
+		}
+		os_file_write( &header, sizeof( header ), 1u, file );
+		if ( transfer->ranged != IOT_FALSE )
+		{
+			os_file_write( transfer->chunks, 1u,
+				( transfer->chunk_count + 7u ) / 8u, file );
+			os_file_write( transfer->chunk_crc32,
+				sizeof( iot_uint32_t ), transfer->chunk_count,
+				file );
+		}
+		os_file_close( file );
+	}
+	else
+		IOT_LOG( engine->lib, IOT_LOG_WARNING,
+			"Failed to record progress in %s", map_path );
+}
+
+void tr50_transfer_part_load(
+	const tr50_transfer_engine_t *engine,
+	struct tr50_transfer *transfer )
+{
+	char file_path[ PATH_MAX + 1u ];
+	char map_path[ PATH_MAX + 1u ];
+	struct tr50_transfer_map header;
+	iot_bool_t recorded = IOT_FALSE;
+	iot_uint64_t part_size = 0u;
+	os_file_t file;
+
+	tr50_transfer_part_path( file_path, transfer, IOT_FALSE );
+	tr50_transfer_part_path( map_path, transfer, IOT_TRUE );
+	transfer->part_crc32 = 0u;
+
+	file = os_file_open( map_path, OS_READ );
+	if ( file )
+	{
+		if ( os_file_read( &header, sizeof( header ), 1u, file ) == 1u &&
+			header.magic == TR50_DOWNLOAD_MAP_MAGIC &&
+			header.chunk_size == 0u &&
+			header.crc32 == transfer->crc32 &&
+			header.size == transfer->size )
+			recorded = IOT_TRUE;
+		os_file_close( file );
+
+		/* a partial ranged download has holes (or is of another
+		 * file), it can't be resumed in a single stream */
+		if ( recorded == IOT_FALSE )
+		{
+			os_file_delete( map_path );
+			os_file_delete( file_path );
+		}
+	}
+
+	if ( os_file_exists( file_path ) )
+		part_size = (iot_uint64_t)os_file_size( file_path );
+	if ( part_size > 0u )
+	{
+		iot_uint64_t offset = 0u;
+		iot_status_t status = IOT_STATUS_FAILURE;
+
+		/* only the data received after the checksum was recorded
+		 * (if any) is read */
+		if ( recorded != IOT_FALSE && header.length <= part_size )
+		{
+			offset = header.length;
+			transfer->part_crc32 = (iot_uint32_t)header.checksum;
+		}
+		file = os_file_open( file_path, OS_READ );
+		if ( file )
+		{
+			status = tr50_transfer_read( file, offset,
+				part_size - offset, &transfer->part_crc32,
+				NULL );
+			os_file_close( file );
+		}
+
+		if ( status == IOT_STATUS_SUCCESS )
+			IOT_LOG( engine->lib, IOT_LOG_DEBUG,
+				"File exists %s, resume xfer from %lu bytes",
+				file_path, (unsigned long)part_size );
+		else
+		{
+			os_file_delete( file_path );
+			transfer->part_crc32 = 0u;
+			part_size = 0u;
+		}
+	}
+	transfer->prev_byte = (long)part_size;
+}
+
+void tr50_transfer_part_path(
+	char *dest,
+	const struct tr50_transfer *transfer,
+	iot_bool_t map )
+{
+	os_snprintf( dest, PATH_MAX, "%s%s%s", transfer->path,
+		TR50_DOWNLOAD_EXTENSION,
+		( map != IOT_FALSE )? TR50_DOWNLOAD_MAP_EXTENSION : "" );
+	dest[ PATH_MAX ] = '\0';
+}
+
+int tr50_transfer_progress( void *user_data,
+	curl_off_t UNUSED(down_total), curl_off_t UNUSED(down_now),
+	curl_off_t up_total, curl_off_t up_now )
+{
+	int result = 0;
+	const struct tr50_transfer_segment *const segment =
+		(const struct tr50_transfer_segment *)user_data;
+
+	if ( segment && segment->transfer )
+	{
+		struct tr50_transfer *const transfer = segment->transfer;
+		if ( transfer->cancel )
+			result = 1;
+		else
+		{
+			/* Compare the time to the last time the progress is
+			 * updated. This is done to minimize printing in the logs.
+			 * The end of the transfer will still be printed to show some
+			 * progress for small files. */
+			const iot_timestamp_t cur_time = iot_timestamp_now();
+			long now = 0, total = 0;
+			const char *transfer_type = NULL;
+
+			if ( transfer->op == IOT_OPERATION_FILE_UPLOAD )
+			{
+				now = (long)up_now;
+				total = (long)up_total;
+				transfer_type = "Upload";
+			}
+			else
+			{
+				unsigned int i;
+
+				/* For larger files, cloud does not specify total
+				 * size, so use the file size given in the beginning */
+				now = transfer->prev_byte +
+					(long)transfer->done_bytes;
+				for ( i = 0u; i < transfer->segment_max; ++i )
+					if ( transfer->segments[i].curl )
+						now += (long)transfer->segments[i].now;
+				total = (long)transfer->size;
+				transfer_type = "Download";
+			}
+
+			if ( total > 0 && (now == total ||
+				cur_time - transfer->last_update_time >=
+				TR50_FILE_TRANSFER_PROGRESS_INTERVAL) )
+			{
+				double progress = (double)( 100.0 * now / total );
+				transfer->last_update_time = cur_time;
+
+				if ( transfer->callback )
+				{
+					iot_file_progress_t transfer_progress;
+					os_memzero( &transfer_progress, sizeof(transfer_progress) );
+					transfer_progress.percentage = (iot_float32_t)progress;
+					transfer_progress.status = IOT_STATUS_INVOKED;
+					transfer_progress.completed = IOT_FALSE;
+
+					transfer->callback( &transfer_progress, transfer->user_data );
+				}
+				else
+					IOT_LOG( transfer->engine->lib, IOT_LOG_TRACE,
+						"%sing %s: %.1f%% (%ld/%ld bytes)\n",
+						transfer_type, transfer->path,
+						progress, now, total );
+			}
+		}
+	}
+	return result;
+}
+
+int tr50_transfer_progress_old(
+	void *user_data,
+	double down_total, double down_now,
+	double up_total, double up_now )
+{
+	return tr50_transfer_progress( user_data,
+		(curl_off_t)down_total, (curl_off_t)down_now,
+		(curl_off_t)up_total, (curl_off_t)up_now );
+}
+
+iot_status_t tr50_transfer_rate_set(
+	tr50_transfer_engine_t *engine,
+	iot_uint32_t id,
+	iot_uint64_t rate )
+{
+	iot_status_t result = IOT_STATUS_BAD_PARAMETER;
+	if ( engine )
+	{
+		struct tr50_transfer *transfer;
+		result = IOT_STATUS_NOT_FOUND;
+#ifdef IOT_THREAD_SUPPORT
+		os_thread_mutex_lock( &engine->lock );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+		for ( transfer = engine->head; transfer &&
+			result == IOT_STATUS_NOT_FOUND;
+			transfer = transfer->next )
+		{
+			if ( transfer->id == id &&
+				transfer->state == TR50_TRANSFER_REQUESTED )
+			{
+				transfer->bucket.rate = rate;
+				result = IOT_STATUS_SUCCESS;
+			}
+		}
+#ifdef IOT_THREAD_SUPPORT
+		os_thread_mutex_unlock( &engine->lock );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+	}
+	return result;
+}
+
+iot_status_t tr50_transfer_read(
+	os_file_t file,
+	iot_uint64_t offset,
+	iot_uint64_t length,
+	iot_uint32_t *crc32,
+	iot_checksum_ctx_t *checksum )
+{
+	iot_status_t result = IOT_STATUS_NO_MEMORY;
+	unsigned char *const buf =
+		(unsigned char *)os_malloc( TR50_TRANSFER_READ_SIZE );
+	if ( buf )
+	{
+		result = IOT_STATUS_FAILURE;
+		if ( os_file_seek( file, (long)offset, SEEK_SET ) == 0 )
+		{
+			size_t bytes = 1u;
+			while ( length > 0u && bytes > 0u )
+			{
+				size_t len = TR50_TRANSFER_READ_SIZE;
+				if ( length < len )
+					len = (size_t)length;
+				bytes = os_file_read( buf, 1u, len, file );
+				if ( crc32 )
+					*crc32 = iot_checksum_crc32_update(
+						*crc32, buf, bytes );
+				if ( checksum )
+					iot_checksum_update( checksum, buf,
+						bytes );
+				length -= bytes;
+			}
+			if ( length == 0u )
+				result = IOT_STATUS_SUCCESS;
+		}
+		os_free( buf );
+	}
+	return result;
+}
+
+iot_timestamp_t tr50_transfer_resume(
+	tr50_transfer_engine_t *engine,
+	struct tr50_transfer *transfer,
+	iot_timestamp_t now )
+{
+	iot_timestamp_t result = 0u;
+	unsigned int i;
+	for ( i = 0u; i < transfer->segment_max; ++i )
+	{
+		struct tr50_transfer_segment *const segment =
+			&transfer->segments[i];
+		if ( segment->paused != IOT_FALSE )
+		{
+			iot_millisecond_t wait = tr50_transfer_bucket_wait(
+				&engine->bucket, now );
+			const iot_millisecond_t wait_transfer =
+				tr50_transfer_bucket_wait( &transfer->bucket,
+					now );
+			if ( wait < wait_transfer )
+				wait = wait_transfer;
+
+			/* a cancelled transfer is resumed to be aborted */
+			if ( wait == 0u || transfer->cancel != IOT_FALSE )
+			{
+				segment->paused = IOT_FALSE;
+				curl_easy_pause( segment->curl, CURLPAUSE_CONT );
+			}
+			else if ( result == 0u || now + wait < result )
+				result = now + wait;
+		}
+	}
+	return result;
+}
+
+void tr50_transfer_schedule(
+	tr50_transfer_engine_t *engine )
+{
+	const iot_timestamp_t now = iot_timestamp_now();
+	struct tr50_transfer *transfer;
+
+	tr50_transfer_adapt( engine, now );
+	engine->next_time = 0u;
+	for ( transfer = engine->head; transfer; transfer = transfer->next )
+	{
+		iot_timestamp_t timer = 0u;
+		if ( transfer->state == TR50_TRANSFER_DONE )
+			continue;
+
+		if ( transfer->state == TR50_TRANSFER_ACTIVE )
+			timer = tr50_transfer_resume( engine, transfer, now );
+		else if ( transfer->cancel != IOT_FALSE )
+		{
+			transfer->status = IOT_STATUS_FAILURE;
+			transfer->state = TR50_TRANSFER_DONE;
+		}
+		else if ( transfer->state == TR50_TRANSFER_REQUESTED )
+		{
+			if ( transfer->expiry_time <= now )
+			{
+				IOT_LOG( engine->lib, IOT_LOG_ERROR,
+					"No reply from cloud to transfer %s",
+					transfer->path );
+				transfer->status = IOT_STATUS_TIMED_OUT;
+				transfer->state = TR50_TRANSFER_DONE;
+			}
+			else
+				timer = transfer->expiry_time;
+		}
+		else if ( transfer->retry_time > now )
+			timer = transfer->retry_time;
+		else if ( tr50_transfer_cache_get( engine, transfer ) ==
+			IOT_STATUS_SUCCESS )
+		{
+			transfer->status = IOT_STATUS_SUCCESS;
+			transfer->state = TR50_TRANSFER_DONE;
+		}
+		else if ( engine->active < engine->concurrency &&
+			tr50_transfer_begin( engine, transfer ) !=
+				IOT_STATUS_SUCCESS )
+		{
+			transfer->status = IOT_STATUS_FAILURE;
+			transfer->state = TR50_TRANSFER_DONE;
+		}
+
+		if ( timer > 0u && ( engine->next_time == 0u ||
+			timer < engine->next_time ) )
+			engine->next_time = timer;
+	}
+}
+
+iot_status_t tr50_transfer_segment_start(
+	tr50_transfer_engine_t *engine,
+	struct tr50_transfer_segment *segment )
+{
+	struct tr50_transfer *const transfer = segment->transfer;
+	iot_status_t result = IOT_STATUS_FAILURE;
+	char file_path[ PATH_MAX + 1u ];
+	int flags = OS_READ;
+
+	segment->now = 0u;
+	segment->crc32 = 0u;
+	segment->paused = IOT_FALSE;
+	if ( transfer->ranged != IOT_FALSE )
+	{
+		/* next chunk not downloaded yet */
+		while ( transfer->chunk_next < transfer->chunk_count &&
+			( transfer->chunks[transfer->chunk_next / 8u] &
+			( 1u << ( transfer->chunk_next % 8u ) ) ) )
+			++transfer->chunk_next;
+		result = IOT_STATUS_NOT_FOUND;
+		if ( transfer->chunk_next < transfer->chunk_count )
+		{
+			segment->chunk = transfer->chunk_next++;
+			segment->length = TR50_TRANSFER_CHUNK_SIZE;
+			if ( segment->chunk + 1u == transfer->chunk_count )
+				segment->length = transfer->size -
+					(iot_uint64_t)segment->chunk *
+					TR50_TRANSFER_CHUNK_SIZE;
+			flags = OS_READ_WRITE;
+			result = IOT_STATUS_FAILURE;
+		}
+	}
+	else if ( transfer->op == IOT_OPERATION_FILE_DOWNLOAD )
+	{
+		/* continues the checksum of the data already received */
+		segment->crc32 = transfer->part_crc32;
+		flags = OS_READ_WRITE | OS_CREATE;
+		if ( transfer->prev_byte > 0 )
+			flags = OS_READ_WRITE | OS_APPEND;
+	}
+
+	if ( result == IOT_STATUS_FAILURE )
+	{
+		if ( transfer->op == IOT_OPERATION_FILE_UPLOAD )
+			os_strncpy( file_path, transfer->path, PATH_MAX );
+		else
+			tr50_transfer_part_path( file_path, transfer,
+				IOT_FALSE );
+		file_path[ PATH_MAX ] = '\0';
+
+		if ( transfer->archive != IOT_FALSE )
+			segment->stream = iot_archive_stream_open(
+				transfer->path, transfer->compression );
+		else
+			segment->file = os_file_open( file_path, flags );
+		if ( segment->file && transfer->ranged != IOT_FALSE &&
+			os_file_seek( segment->file, (long)(
+				(iot_uint64_t)segment->chunk *
+				TR50_TRANSFER_CHUNK_SIZE ), SEEK_SET ) != 0 )
+		{
+			os_file_close( segment->file );
+			segment->file = NULL;
+		}
+		if ( segment->file || segment->stream )
+			segment->curl = tr50_transfer_curl( engine, segment );
+
+		if ( segment->curl )
+		{
+			CURL *const curl = segment->curl;
+#ifdef __clang__
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wdisabled-macro-expansion"
+#endif /* ifdef __clang__ */
+			if ( segment->stream )
+			{
+				/* size is unknown until the archive is built,
+				 * so it is sent chunked */
+				transfer->size = 0u;
+				curl_easy_setopt( curl, CURLOPT_POST, 1L );
+				curl_easy_setopt( curl, CURLOPT_READDATA,
+					segment );
+				curl_easy_setopt( curl, CURLOPT_READFUNCTION,
+					tr50_transfer_stream_read );
+			}
+			else if ( transfer->op == IOT_OPERATION_FILE_UPLOAD )
+			{
+				transfer->size =
+					(iot_uint64_t)os_file_size( transfer->path );
+				curl_easy_setopt( curl, CURLOPT_POST, 1L );
+				curl_easy_setopt( curl, CURLOPT_READDATA,
+					segment );
+				curl_easy_setopt( curl, CURLOPT_READFUNCTION,
+					tr50_transfer_file_read );
+				curl_easy_setopt( curl, CURLOPT_POSTFIELDSIZE,
+					(long)transfer->size );
+			}
+			else
+			{
+				if ( transfer->ranged != IOT_FALSE )
+				{
+					char range[ 48u ];
+					const iot_uint64_t start =
+						(iot_uint64_t)segment->chunk *
+						TR50_TRANSFER_CHUNK_SIZE;
+					os_snprintf( range, sizeof( range ),
+						"%lu-%lu", (unsigned long)start,
+						(unsigned long)( start +
+						segment->length - 1u ) );
+					/* string is copied by curl */
+					curl_easy_setopt( curl, CURLOPT_RANGE,
+						range );
+				}
+				else if ( transfer->prev_byte > 0 )
+					/* resume a previous (partial) download */
+					curl_easy_setopt( curl, CURLOPT_RESUME_FROM,
+						transfer->prev_byte );
+				curl_easy_setopt( curl, CURLOPT_WRITEFUNCTION,
+					tr50_transfer_write );
+				curl_easy_setopt( curl, CURLOPT_WRITEDATA, segment );
+			}
+#ifdef __clang__
+#pragma clang diagnostic pop
+#endif /* ifdef __clang__ */
+
+			if ( curl_multi_add_handle( engine->multi, curl ) ==
+				CURLM_OK )
+				result = IOT_STATUS_SUCCESS;
+		}
+		else if ( segment->file || segment->stream )
+			IOT_LOG( engine->lib, IOT_LOG_ERROR, "%s",
+				"Failed to initialize libcurl" );
+		else if ( transfer->archive != IOT_FALSE )
+			IOT_LOG( engine->lib, IOT_LOG_ERROR,
+				"Failed to archive %s", transfer->path );
+		else
+			IOT_LOG( engine->lib, IOT_LOG_ERROR,
+				"Failed to open %s", file_path );
+
+		if ( result != IOT_STATUS_SUCCESS )
+		{
+			if ( segment->curl )
+				tr50_transfer_curl_release( engine,
+					segment->curl );
+			segment->curl = NULL;
+			if ( segment->file )
+				os_file_close( segment->file );
+			segment->file = NULL;
+			if ( segment->stream )
+				iot_archive_stream_close( segment->stream );
+			segment->stream = NULL;
+		}
+	}
+	return result;
+}
+
+void tr50_transfer_segments_set(
+	tr50_transfer_engine_t *engine,
+	unsigned int segments )
+{
+	if ( engine )
+	{
+		if ( segments == 0u )
+			segments = TR50_TRANSFER_SEGMENTS;
+		if ( segments > TR50_TRANSFER_SEGMENT_MAX )
+			segments = TR50_TRANSFER_SEGMENT_MAX;
+#ifdef IOT_THREAD_SUPPORT
+		os_thread_mutex_lock( &engine->lock );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+		engine->segments = segments;
+#ifdef IOT_THREAD_SUPPORT
+		os_thread_mutex_unlock( &engine->lock );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+	}
+}
+
+void tr50_transfer_service(
+	tr50_transfer_engine_t *engine,
+	iot_millisecond_t max_time_out )
+{
+	struct tr50_transfer *done = NULL;
+	struct tr50_transfer *done_tail = NULL;
+	struct tr50_transfer *prev = NULL;
+	struct tr50_transfer *transfer;
+
+#ifdef IOT_THREAD_SUPPORT
+	os_thread_mutex_lock( &engine->lock );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+	tr50_transfer_schedule( engine );
+	if ( engine->next_time > 0u )
+	{
+		const iot_timestamp_t now = iot_timestamp_now();
+		if ( engine->next_time <= now )
+			max_time_out = 0u;
+		else if ( engine->next_time - now < max_time_out )
+			max_time_out = (iot_millisecond_t)
+				( engine->next_time - now );
+	}
+#ifdef IOT_THREAD_SUPPORT
+	/* nothing being transferred, so wait for something to do */
+	if ( engine->active == 0u && engine->to_quit == IOT_FALSE &&
+		max_time_out > 0u )
+		os_thread_condition_timed_wait( &engine->signal,
+			&engine->lock, max_time_out );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+	for ( transfer = engine->head; transfer; transfer = transfer->next )
+		if ( transfer->state == TR50_TRANSFER_DONE )
+			break;
+#ifdef IOT_THREAD_SUPPORT
+	os_thread_mutex_unlock( &engine->lock );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+
+	if ( engine->active > 0u )
+	{
+		CURLMsg *msg;
+		int running = 0;
+		int msg_left = 0;
+
+		/* finished transfers are reported without waiting */
+		if ( transfer )
+			max_time_out = 0u;
+		if ( max_time_out > 0u )
+			curl_multi_wait( engine->multi, NULL, 0u,
+				(int)max_time_out, NULL );
+		curl_multi_perform( engine->multi, &running );
+		while ( ( msg = curl_multi_info_read( engine->multi,
+			&msg_left ) ) != NULL )
+		{
+			if ( msg->msg == CURLMSG_DONE )
+			{
+				char *priv = NULL;
+#ifdef __clang__
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wdisabled-macro-expansion"
+#endif /* ifdef __clang__ */
+				curl_easy_getinfo( msg->easy_handle,
+					CURLINFO_PRIVATE, &priv );
+#ifdef __clang__
+#pragma clang diagnostic pop
+#endif /* ifdef __clang__ */
+				if ( priv )
+					tr50_transfer_end( engine,
+						(struct tr50_transfer_segment *)priv,
+						msg->data.result );
+			}
+		}
+	}
+
+	/* take the finished transfers out, to report them without the lock */
+#ifdef IOT_THREAD_SUPPORT
+	os_thread_mutex_lock( &engine->lock );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+	transfer = engine->head;
+	while ( transfer )
+	{
+		struct tr50_transfer *const next = transfer->next;
+		if ( transfer->state == TR50_TRANSFER_DONE )
+		{
+			if ( prev )
+				prev->next = next;
+			else
+				engine->head = next;
+			if ( engine->tail == transfer )
+				engine->tail = prev;
+			transfer->next = NULL;
+			if ( done_tail )
+				done_tail->next = transfer;
+			else
+				done = transfer;
+			done_tail = transfer;
+		}
+		else
+			prev = transfer;
+		transfer = next;
+	}
+#ifdef IOT_THREAD_SUPPORT
+	os_thread_mutex_unlock( &engine->lock );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+
+	while ( done )
+	{
+		transfer = done;
+		done = transfer->next;
+		if ( transfer->callback && transfer->notify != IOT_FALSE )
+		{
+			iot_file_progress_t transfer_progress;
+			os_memzero( &transfer_progress, sizeof(transfer_progress) );
+			if ( transfer->status == IOT_STATUS_SUCCESS )
+				transfer_progress.percentage = 100.0f;
+			else if ( transfer->size > 0u )
+				transfer_progress.percentage = (iot_float32_t)
+					( 100.0 * ( (double)transfer->prev_byte +
+					(double)transfer->done_bytes ) /
+					(double)transfer->size );
+			transfer_progress.status = transfer->status;
+			transfer_progress.completed = IOT_TRUE;
+
+			transfer->callback( &transfer_progress, transfer->user_data );
+		}
+		tr50_transfer_free( engine, transfer );
+	}
+}
+
+iot_status_t tr50_transfer_start(
+	tr50_transfer_engine_t *engine,
+	iot_uint32_t id,
+	const char *url,
+	const char *file_id,
+	iot_uint64_t crc32,
+	iot_uint64_t size,
+	iot_int64_t max_retries )
+{
+	iot_status_t result = IOT_STATUS_BAD_PARAMETER;
+	if ( engine && url && *url != '\0' )
+	{
+		const size_t url_len = os_strlen( url );
+		char *const url_copy = (char *)os_malloc( url_len + 1u );
+		result = IOT_STATUS_NO_MEMORY;
+		if ( url_copy )
+		{
+			struct tr50_transfer *transfer;
+			os_memcpy( url_copy, url, url_len );
+			url_copy[url_len] = '\0';
+			result = IOT_STATUS_NOT_FOUND;
+#ifdef IOT_THREAD_SUPPORT
+			os_thread_mutex_lock( &engine->lock );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+			for ( transfer = engine->head; transfer &&
+				result == IOT_STATUS_NOT_FOUND;
+				transfer = transfer->next )
+			{
+				if ( transfer->id == id &&
+					transfer->state == TR50_TRANSFER_REQUESTED )
+				{
+					transfer->url = url_copy;
+					transfer->crc32 = crc32;
+					transfer->size = size;
+
+					/* a download is cached under its content
+					 * & the file it is in the cloud */
+					if ( transfer->op ==
+						IOT_OPERATION_FILE_DOWNLOAD &&
+						file_id && *file_id != '\0' &&
+						size > 0u )
+						os_snprintf( transfer->cache_name,
+							TR50_TRANSFER_CACHE_NAME_LEN + 1u,
+							"%08lx-%08lx%08lx-%08lx",
+							(unsigned long)( crc32 &
+								0xFFFFFFFFu ),
+							(unsigned long)( size >> 32 ),
+							(unsigned long)( size &
+								0xFFFFFFFFu ),
+							(unsigned long)
+							iot_checksum_crc32_update( 0u,
+								file_id,
+								os_strlen( file_id ) ) );
+					transfer->max_retries = max_retries;
+					transfer->retry_time = 0u;
+					transfer->state = TR50_TRANSFER_READY;
+					result = IOT_STATUS_SUCCESS;
+				}
+			}
+#ifdef IOT_THREAD_SUPPORT
+			os_thread_mutex_unlock( &engine->lock );
+#endif /* ifdef IOT_THREAD_SUPPORT */
+			if ( result == IOT_STATUS_SUCCESS )
+				tr50_transfer_wake( engine );
+			else
+				os_free( url_copy );
+		}
+	}
+	return result;
+}
+
+#ifdef IOT_THREAD_SUPPORT
+OS_THREAD_DECL tr50_transfer_thread(
+	void *arg )
+{
+	tr50_transfer_engine_t *const engine = (tr50_transfer_engine_t *)arg;
+	while ( engine->to_quit == IOT_FALSE )
+		tr50_transfer_service( engine, TR50_TRANSFER_WAIT_MAX );
+	return (OS_THREAD_RETURN)0;
+}
+#endif /* ifdef IOT_THREAD_SUPPORT */
+
+#ifdef IOT_THREAD_SUPPORT
+void tr50_transfer_share_lock(
+	CURL *UNUSED(handle),
+	curl_lock_data data,
+	curl_lock_access UNUSED(access),
+	void *user_data )
+{
+	tr50_transfer_engine_t *const engine =
+		(tr50_transfer_engine_t *)user_data;
+	if ( (unsigned int)data < (unsigned int)CURL_LOCK_DATA_LAST )
+		os_thread_mutex_lock( &engine->share_lock[data] );
+}
+
+void tr50_transfer_share_unlock(
+	CURL *UNUSED(handle),
+	curl_lock_data data,
+	void *user_data )
+{
+	tr50_transfer_engine_t *const engine =
+		(tr50_transfer_engine_t *)user_data;
+	if ( (unsigned int)data < (unsigned int)CURL_LOCK_DATA_LAST )
+		os_thread_mutex_unlock( &engine->share_lock[data] );
+}
+#endif /* ifdef IOT_THREAD_SUPPORT */
+
+size_t tr50_transfer_stream_read(
+	char *buffer,
+	size_t size,
+	size_t nitems,
+	void *user_data )
+{
+	size_t result = CURL_READFUNC_ABORT;
+	struct tr50_transfer_segment *const segment =
+		(struct tr50_transfer_segment *)user_data;
+	size_t len = 0u;
+
+	if ( tr50_transfer_throttle( segment, size * nitems ) != IOT_FALSE )
+		result = CURL_READFUNC_PAUSE;
+	else if ( iot_archive_stream_read( segment->stream, buffer,
+		size * nitems, &len ) == IOT_STATUS_SUCCESS )
+		result = len;
+	else
+		IOT_LOG( segment->transfer->engine->lib, IOT_LOG_ERROR,
+			"Failed to archive %s", segment->transfer->path );
+	return result;
+}
+
+iot_bool_t tr50_transfer_throttle(
+	struct tr50_transfer_segment *segment,
+	size_t len )
+{
+	iot_bool_t result = IOT_FALSE;
+	struct tr50_transfer *const transfer = segment->transfer;
+	tr50_transfer_engine_t *const engine = transfer->engine;
+	const iot_timestamp_t now = iot_timestamp_now();
+
+	/* data goes through while there are tokens, even into debt, then
+	 * the connection waits for the debt to be repaid */
+	if ( tr50_transfer_bucket_wait( &engine->bucket, now ) > 0u ||
+		tr50_transfer_bucket_wait( &transfer->bucket, now ) > 0u )
+	{
+		segment->paused = IOT_TRUE;
+		result = IOT_TRUE;
+	}
+	else
+	{
+		if ( engine->bucket.rate > 0u )
+			engine->bucket.tokens -= (iot_int64_t)len;
+		if ( transfer->bucket.rate > 0u )
+			transfer->bucket.tokens -= (iot_int64_t)len;
+		engine->rate_bytes += len;
+	}
+	return result;
+}
+
+void tr50_transfer_wake(
+	tr50_transfer_engine_t *engine )
+{
+#ifdef IOT_THREAD_SUPPORT
+	os_thread_condition_signal( &engine->signal, &engine->lock );
+#if LIBCURL_VERSION_NUM >= 0x074400
+	/* wake curl_multi_wait, while transfers are in progress */
+	curl_multi_wakeup( engine->multi );
+#endif /* if LIBCURL_VERSION_NUM >= 0x074400 */
+#else /* ifdef IOT_THREAD_SUPPORT */
+	(void)engine;
+#endif /* else IOT_THREAD_SUPPORT */
+}
+
+size_t tr50_transfer_write(
+	char *ptr,
+	size_t size,
+	size_t nmemb,
+	void *user_data )
+{
+	size_t result = 0u;
+	struct tr50_transfer_segment *const segment =
+		(struct tr50_transfer_segment *)user_data;
+	struct tr50_transfer *const transfer = segment->transfer;
+	iot_bool_t accept = IOT_TRUE;
+
+	if ( tr50_transfer_throttle( segment, size * nmemb ) != IOT_FALSE )
+	{
+		accept = IOT_FALSE;
+		result = CURL_WRITEFUNC_PAUSE;
+	}
+	else if ( transfer->ranged != IOT_FALSE )
+	{
+		/* a server ignoring the range sends the whole file */
+		if ( segment->now == 0u )
+		{
+			long response_code = 0;
+#ifdef __clang__
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wdisabled-macro-expansion"
+#endif /* ifdef __clang__ */
+			curl_easy_getinfo( segment->curl,
+				CURLINFO_RESPONSE_CODE, &response_code );
+#ifdef __clang__
+#pragma clang diagnostic pop
+#endif /* ifdef __clang__ */
+			if ( response_code != TR50_HTTP_PARTIAL_CONTENT )
+			{
+				transfer->no_ranges = IOT_TRUE;
+				accept = IOT_FALSE;
+			}
+		}
+		if ( segment->now + size * nmemb > segment->length )
+			accept = IOT_FALSE;
+	}
+
+	if ( accept != IOT_FALSE )
+	{
+		iot_uint64_t offset = (iot_uint64_t)transfer->prev_byte;
+		if ( transfer->ranged != IOT_FALSE )
+			offset = (iot_uint64_t)segment->chunk *
+				TR50_TRANSFER_CHUNK_SIZE;
+		result = os_file_write( ptr, size, nmemb, segment->file ) * size;
+		segment->crc32 = iot_checksum_crc32_update( segment->crc32,
+			ptr, result );
+		tr50_transfer_checksum_add( transfer, offset + segment->now,
+			ptr, result );
+		segment->now += result;
+	}
+	return result;
+}
@@ -0,0 +1,274 @@
+/**
+ * @file
+ * @brief header file for the engine performing file transfers to & from the
+ *        cloud
+ *
+ * All transfers are driven by a single libcurl multi handle, so the number of
+ * threads & the stack memory used stay the same however many transfers are
+ * queued.  A transfer is added once the request for it is sent to the cloud,
+ * and started once the cloud replies with where to transfer the file.
+ *
+ * Large downloads are split into chunks fetched over several connections into
+ * a preallocated ".part" file.  The completed chunks are recorded next to it,
+ * in a ".part.map" file, so an interrupted download resumes with the missing
+ * chunks only.  Servers not supporting ranges are downloaded from in a single
+ * stream instead.
+ *
+ * The checksum of a download is calculated as the data is received (per chunk,
+ * combined at the end) and recorded with its progress, so verifying it does
+ * not read the file again.  A stronger checksum (MD5 or SHA-256) can also be
+ * verified; it is calculated over the data received in order, with the chunks
+ * completed ahead of it read back from the ".part" file.
+ *
+ * Transfers can be rate limited, each one and all together, by token buckets:
+ * a connection is paused once it used its tokens, and resumed when it earned
+ * more.  The bandwidth of all transfers is also halved while messages wait to
+ * be sent, and restored gradually once they don't.
+ *
+ * Completed downloads can be kept in a cache in the runtime directory, named
+ * by their checksum, size & identifier in the cloud, so a file downloaded
+ * again is copied from it without any data transferred.
+ *
+ * @copyright Copyright (C) 2018 Wind River Systems, Inc. All Rights Reserved.
+ *
+ * @license Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied."
+ */
+#ifndef TR50_TRANSFER_H
+#define TR50_TRANSFER_H
+
+#include "../../shared/iot_types.h"
+
+#include <iot_checksum.h>
+#include <iot_mqtt.h>
+#include <iot_plugin.h>
+
+/** @brief Default number of files transferred at the same time */
+#define TR50_TRANSFER_CONCURRENCY           4u
+/** @brief Default number of connections used for a large download */
+#define TR50_TRANSFER_SEGMENTS              4u
+/** @brief Maximum number of connections used for a large download */
+#define TR50_TRANSFER_SEGMENT_MAX           16u
+
+/** @brief engine performing file transfers */
+typedef struct tr50_transfer_engine tr50_transfer_engine_t;
+
+/**
+ * @brief adds a file transfer, waiting for the cloud to provide its location
+ *
+ * @param[in,out]  engine              transfer engine
+ * @param[in]      op                  file operation (upload or download)
+ * @param[in]      file_transfer       file to transfer
+ * @param[out]     id                  identifier of the transfer
+ *
+ * @retval IOT_STATUS_BAD_PARAMETER    invalid parameter passed to the function
+ * @retval IOT_STATUS_NO_MEMORY        not enough memory to add the transfer
+ * @retval IOT_STATUS_SUCCESS          on success
+ *
+ * @see tr50_transfer_cancel
+ * @see tr50_transfer_start
+ */
+IOT_SECTION iot_status_t tr50_transfer_add(
+	tr50_transfer_engine_t *engine,
+	iot_operation_t op,
+	const iot_file_transfer_t *file_transfer,
+	iot_uint32_t *id );
+
+/**
+ * @brief sets the bandwidth shared by all transfers
+ *
+ * The bandwidth is also reduced while messages wait to be sent (see
+ * tr50_transfer_latency_set), so transfers yield to them.
+ *
+ * @param[in,out]  engine              transfer engine
+ * @param[in]      bandwidth           bytes per second (0 = no limit)
+ */
+IOT_SECTION void tr50_transfer_bandwidth_set(
+	tr50_transfer_engine_t *engine,
+	iot_uint64_t bandwidth );
+
+/**
+ * @brief sets the largest size of the cache of downloaded files
+ *
+ * A download found in the cache, by its checksum, size & identifier in the
+ * cloud, is copied from it instead of downloaded.  Once full, the least
+ * recently used files are removed to make room for new ones.
+ *
+ * @param[in,out]  engine              transfer engine
+ * @param[in]      max_size            largest size in bytes (0 = no cache)
+ */
+IOT_SECTION void tr50_transfer_cache_set(
+	tr50_transfer_engine_t *engine,
+	iot_uint64_t max_size );
+
+/**
+ * @brief cancels a file transfer
+ *
+ * @param[in,out]  engine              transfer engine
+ * @param[in]      id                  identifier of the transfer
+ * @param[in]      notify              whether to report the failure to the
+ *                                     progress callback of the transfer
+ *
+ * @retval IOT_STATUS_BAD_PARAMETER    invalid parameter passed to the function
+ * @retval IOT_STATUS_NOT_FOUND        no transfer with the identifier
+ * @retval IOT_STATUS_SUCCESS          on success
+ */
+IOT_SECTION iot_status_t tr50_transfer_cancel(
+	tr50_transfer_engine_t *engine,
+	iot_uint32_t id,
+	iot_bool_t notify );
+
+/**
+ * @brief sets a checksum a download is to be verified with, in addition to
+ *        the crc32 checksum provided by the cloud
+ *
+ * @param[in,out]  engine              transfer engine
+ * @param[in]      id                  identifier of the transfer
+ * @param[in]      type                checksum algorithm
+ * @param[in]      checksum            expected checksum, in hexadecimal
+ *
+ * @retval IOT_STATUS_BAD_PARAMETER    invalid parameter passed to the function
+ * @retval IOT_STATUS_NOT_FOUND        no download waiting with the identifier
+ * @retval IOT_STATUS_SUCCESS          on success
+ */
+IOT_SECTION iot_status_t tr50_transfer_checksum_set(
+	tr50_transfer_engine_t *engine,
+	iot_uint32_t id,
+	iot_checksum_type_t type,
+	const char *checksum );
+
+/**
+ * @brief sets the maximum number of files transferred at the same time
+ *
+ * @param[in,out]  engine              transfer engine
+ * @param[in]      concurrency         maximum number of transfers
+ *                                     (0 = default)
+ */
+IOT_SECTION void tr50_transfer_concurrency_set(
+	tr50_transfer_engine_t *engine,
+	unsigned int concurrency );
+
+/**
+ * @brief creates a file transfer engine
+ *
+ * @param[in]      lib                 library handle
+ * @param[in]      proxy               proxy settings to use (must remain valid
+ *                                     for the life of the engine)
+ *
+ * @return a new transfer engine, NULL on failure
+ *
+ * @see tr50_transfer_engine_destroy
+ */
+IOT_SECTION tr50_transfer_engine_t *tr50_transfer_engine_create(
+	iot_t *lib,
+	const struct iot_proxy *proxy );
+
+/**
+ * @brief destroys a file transfer engine, abandoning any transfers
+ *
+ * @param[in,out]  engine              transfer engine to destroy
+ *
+ * @retval IOT_STATUS_BAD_PARAMETER    invalid parameter passed to the function
+ * @retval IOT_STATUS_SUCCESS          on success
+ */
+IOT_SECTION iot_status_t tr50_transfer_engine_destroy(
+	tr50_transfer_engine_t *engine );
+
+/**
+ * @brief reports how long the oldest message waiting to be sent has waited,
+ *        to adapt the bandwidth of the transfers
+ *
+ * @param[in,out]  engine              transfer engine
+ * @param[in]      latency             time waited (0 = no message waiting)
+ */
+IOT_SECTION void tr50_transfer_latency_set(
+	tr50_transfer_engine_t *engine,
+	iot_millisecond_t latency );
+
+/**
+ * @brief services the file transfers
+ *
+ * @note with thread support the transfers are serviced by a thread owned by
+ *       the engine and this function returns immediately
+ *
+ * @param[in,out]  engine              transfer engine
+ *
+ * @retval IOT_STATUS_BAD_PARAMETER    invalid parameter passed to the function
+ * @retval IOT_STATUS_SUCCESS          on success
+ */
+IOT_SECTION iot_status_t tr50_transfer_loop(
+	tr50_transfer_engine_t *engine );
+
+/**
+ * @brief adds the transfer sockets & timers for an external event loop to
+ *        wait on
+ *
+ * @param[in]      engine              transfer engine
+ * @param[in,out]  poll                descriptors to wait on
+ */
+IOT_SECTION void tr50_transfer_loop_poll(
+	tr50_transfer_engine_t *engine,
+	struct iot_loop_poll *poll );
+
+/**
+ * @brief sets the rate limit of a transfer, before it starts
+ *
+ * @param[in,out]  engine              transfer engine
+ * @param[in]      id                  identifier of the transfer
+ * @param[in]      rate                bytes per second (0 = no limit)
+ *
+ * @retval IOT_STATUS_BAD_PARAMETER    invalid parameter passed to the function
+ * @retval IOT_STATUS_NOT_FOUND        no transfer waiting with the identifier
+ * @retval IOT_STATUS_SUCCESS          on success
+ */
+IOT_SECTION iot_status_t tr50_transfer_rate_set(
+	tr50_transfer_engine_t *engine,
+	iot_uint32_t id,
+	iot_uint64_t rate );
+
+/**
+ * @brief sets the number of connections used to download a large file
+ *
+ * @param[in,out]  engine              transfer engine
+ * @param[in]      segments            number of connections, 1 downloads
+ *                                     files in a single stream (0 = default)
+ */
+IOT_SECTION void tr50_transfer_segments_set(
+	tr50_transfer_engine_t *engine,
+	unsigned int segments );
+
+/**
+ * @brief starts a file transfer, once the cloud provided its location
+ *
+ * @param[in,out]  engine              transfer engine
+ * @param[in]      id                  identifier of the transfer
+ * @param[in]      url                 location to transfer the file to or from
+ * @param[in]      file_id             identifier of the file in the cloud, to
+ *                                     cache a download under (optional)
+ * @param[in]      crc32               expected checksum of a download
+ * @param[in]      size                size of a download
+ * @param[in]      max_retries         number of times to retry a failed
+ *                                     transfer (negative = no limit)
+ *
+ * @retval IOT_STATUS_BAD_PARAMETER    invalid parameter passed to the function
+ * @retval IOT_STATUS_NO_MEMORY        not enough memory to start the transfer
+ * @retval IOT_STATUS_NOT_FOUND        no transfer waiting with the identifier
+ * @retval IOT_STATUS_SUCCESS          on success
+ */
+IOT_SECTION iot_status_t tr50_transfer_start(
+	tr50_transfer_engine_t *engine,
+	iot_uint32_t id,
+	const char *url,
+	const char *file_id,
+	iot_uint64_t crc32,
+	iot_uint64_t size,
+	iot_int64_t max_retries );
+
+#endif /* ifndef TR50_TRANSFER_H */
@@ -113,6 +113,16 @@ extern "C" {
 /** @brief True */
 #define IOT_TRUE                                 (iot_bool_t)(1 == 1)
 
+/* Flags */
+/** @brief Run in a single thread (main loop is driven by the application) */
+#define IOT_FLAG_SINGLE_THREAD                   0x01
+
+/* Loop events */
+/** @brief descriptor is waiting to be read from */
+#define IOT_LOOP_EVENT_READ                      0x1u
+/** @brief descriptor is waiting to be written to */
+#define IOT_LOOP_EVENT_WRITE                     0x2u
+
 #ifdef __clang__
 #pragma clang diagnostic pop
 #endif /* ifdef __clang__ */
@@ -364,6 +374,15 @@ typedef struct iot_log_source
 	unsigned int line_number;
 } iot_log_source_t;
 
+/** @brief Descriptor for an external event loop to wait on */
+typedef struct iot_loop_fd
+{
+	/** @brief Descriptor to wait on */
+	int fd;
+	/** @brief Events to wait for, or that occurred (IOT_LOOP_EVENT_*) */
+	unsigned int events;
+} iot_loop_fd_t;
+
 /**
  * @brief Type for a callback function called when an internal action is
  *        requested
@@ -544,6 +563,78 @@ IOT_API IOT_SECTION iot_status_t iot_log_level_set(
 	iot_t *lib,
 	iot_log_level_t level );
 
+/**
+ * @brief Performs the work for descriptors reported ready by an external
+ *        event loop, along with any timers that have expired
+ *
+ * @note this call never blocks, it is intended for applications initializing
+ *       the library with @p IOT_FLAG_SINGLE_THREAD
+ *
+ * @param[in,out]  lib                 library handle
+ * @param[in]      ready               descriptors that are ready, with the
+ *                                     events that occurred (optional)
+ * @param[in]      ready_count         number of items in @p ready
+ *
+ * @retval IOT_STATUS_BAD_PARAMETER    invalid parameter passed to function
+ * @retval IOT_STATUS_FAILURE          internal system failure
+ * @retval IOT_STATUS_NOT_SUPPORTED    library is running its own main loop
+ * @retval IOT_STATUS_SUCCESS          on success
+ *
+ * @see iot_loop_fd
+ * @see iot_loop_next_deadline
+ */
+IOT_API IOT_SECTION iot_status_t iot_loop_dispatch(
+	iot_t *lib,
+	const iot_loop_fd_t *ready,
+	size_t ready_count );
+
+/**
+ * @brief Obtains the descriptors an external event loop must wait on
+ *
+ * The descriptors are the connection to the cloud (when it is not serviced
+ * by a thread internal to the library) and a descriptor that wakes the
+ * event loop when work is queued from another thread.  The list can change
+ * after connecting or reconnecting, so it should be obtained again before
+ * each wait.
+ *
+ * @param[in,out]  lib                 library handle
+ * @param[out]     fds                 descriptors to wait on
+ * @param[in]      fds_max             maximum number of items in @p fds
+ * @param[out]     fds_count           number of items set in @p fds
+ *
+ * @retval IOT_STATUS_BAD_PARAMETER    invalid parameter passed to function
+ * @retval IOT_STATUS_FULL             more descriptors than @p fds_max
+ * @retval IOT_STATUS_NOT_SUPPORTED    library is running its own main loop
+ * @retval IOT_STATUS_SUCCESS          on success
+ *
+ * @see iot_loop_dispatch
+ * @see iot_loop_next_deadline
+ */
+IOT_API IOT_SECTION iot_status_t iot_loop_fd(
+	iot_t *lib,
+	iot_loop_fd_t *fds,
+	size_t fds_max,
+	size_t *fds_count );
+
+/**
+ * @brief Obtains the maximum time an external event loop can wait before
+ *        calling @p iot_loop_dispatch
+ *
+ * @param[in]      lib                 library handle
+ * @param[out]     time_out            time until the next timer expires in
+ *                                     milliseconds (0 = wait indefinitely)
+ *
+ * @retval IOT_STATUS_BAD_PARAMETER    invalid parameter passed to function
+ * @retval IOT_STATUS_NOT_SUPPORTED    library is running its own main loop
+ * @retval IOT_STATUS_SUCCESS          on success
+ *
+ * @see iot_loop_dispatch
+ * @see iot_loop_fd
+ */
+IOT_API IOT_SECTION iot_status_t iot_loop_next_deadline(
+	iot_t *lib,
+	iot_millisecond_t *time_out );
+
 /**
  * @brief Destroys memory associated with the library
  *
@@ -1380,6 +1471,15 @@ IOT_API IOT_SECTION iot_status_t iot_event_publish(
 /**
  * @brief Download a file from the cloud
  *
+ * The download is verified with the crc32 checksum provided by the cloud.  A
+ * stronger checksum can also be verified, given in hexadecimal with the
+ * "sha256" or "md5" string option.  The "rate_limit" integer option limits
+ * the download to that many bytes per second.
+ *
+ * When "cloud.file_transfer.cache_size" is configured, downloaded files are
+ * kept in a cache in the runtime directory, so a file downloaded again (with
+ * the same checksum, size & identifier in the cloud) is copied from it.
+ *
  * @param[in]      lib                 library handle
  * @param[out]     txn                 transaction status (optional)
  * @param[in]      options             options for file download (optional)
@@ -1440,6 +1540,12 @@ IOT_API IOT_SECTION iot_status_t iot_file_progress_get(
 /**
  * @brief Upload a file or directory to the cloud
  *
+ * A directory is archived to a temporary ".tar" file before it is sent.  With
+ * the "compression" string option ("gzip", "zstd" or "none") it is instead
+ * archived as it is sent, compressed, so no temporary disk space is needed.
+ * The "rate_limit" integer option limits the upload to that many bytes per
+ * second.
+ *
  * @param[in]      lib                 library handle
  * @param[out]     txn                 transaction status (optional)
  * @param[in]      options             options for file upload (optional)
@@ -21,6 +21,15 @@
 #include <iot.h>
 #include <os.h>
 
+/** @brief Size of a CRC32 checksum, in bytes */
+#define IOT_CHECKSUM_CRC32_SIZE             4u
+/** @brief Size of a MD5 checksum, in bytes */
+#define IOT_CHECKSUM_MD5_SIZE               16u
+/** @brief Size of a SHA256 checksum, in bytes */
+#define IOT_CHECKSUM_SHA256_SIZE            32u
+/** @brief Size of the largest checksum supported, in bytes */
+#define IOT_CHECKSUM_SIZE_MAX               IOT_CHECKSUM_SHA256_SIZE
+
 /** @brief type checksum algorithm supported */
 typedef enum iot_checksum_type
 {
@@ -32,15 +41,100 @@ typedef enum iot_checksum_type
 	IOT_CHECKSUM_TYPE_SHA256
 } iot_checksum_type_t;
 
+/**
+ * @brief State of a checksum being calculated over several pieces of data
+ *
+ * @see iot_checksum_final
+ * @see iot_checksum_initialize
+ * @see iot_checksum_update
+ */
+typedef struct iot_checksum_ctx
+{
+	/** @brief data waiting for a full block (MD5 & SHA256) */
+	iot_uint8_t block[64u];
+	/** @brief number of bytes added so far */
+	iot_uint64_t length;
+	/** @brief intermediate value of the checksum */
+	iot_uint32_t state[8u];
+	/** @brief checksum algorithm */
+	iot_checksum_type_t type;
+} iot_checksum_ctx_t;
+
+/**
+ * @brief Combines the CRC32 checksums of two consecutive blocks of data
+ *
+ * Allows blocks of a file, received out of order, to be checksummed
+ * separately and the checksum of the whole file to be obtained without
+ * reading it again.
+ *
+ * @param[in]      crc32_1             checksum of the first block
+ * @param[in]      crc32_2             checksum of the second block
+ * @param[in]      len_2               size of the second block
+ *
+ * @return the CRC32 checksum of the two blocks, one after the other
+ */
+iot_uint32_t iot_checksum_crc32_combine(
+	iot_uint32_t crc32_1,
+	iot_uint32_t crc32_2,
+	iot_uint64_t len_2 );
+
+/**
+ * @brief Updates a running CRC32 checksum with more data
+ *
+ * Data can be checksummed as it is received, the checksum returned is passed
+ * in with the next piece of data (start with 0).
+ *
+ * @param[in]      crc32               checksum of the data so far
+ * @param[in]      data                data to add
+ * @param[in]      len                 size of the data
+ *
+ * @return the CRC32 checksum of the data so far, including @p data
+ */
+iot_uint32_t iot_checksum_crc32_update(
+	iot_uint32_t crc32,
+	const void *data,
+	size_t len );
+
+/**
+ * @brief Calculates the checksum of a file, of any algorithm
+ *
+ * The checksum is written in its usual byte order, i.e. as it is printed in
+ * hexadecimal (CRC32 is written most significant byte first).
+ *
+ * @param[in]      lib                 library handle
+ * @param[in]      file                handle to an open file
+ * @param[in]      type                checksum algorithm to use
+ * @param[out]     checksum            checksum output
+ * @param[in]      checksum_len        size of @p checksum (at least the
+ *                                     size of the checksum algorithm)
+ *
+ * @retval IOT_STATUS_BAD_PARAMETER    invalid parameter passed to function
+ * @retval IOT_STATUS_FAILURE          failed to read the file
+ * @retval IOT_STATUS_NO_MEMORY        not enough memory to read the file
+ * @retval IOT_STATUS_SUCCESS          on success
+ *
+ * @see iot_checksum_size
+ */
+iot_status_t iot_checksum_file_digest(
+	iot_t *lib,
+	os_file_t file,
+	iot_checksum_type_t type,
+	void *checksum,
+	size_t checksum_len );
+
 /**
  * @brief Calculates the checksum of a file
  *
+ * @note MD5 & SHA256 checksums do not fit in @p checksum, they are obtained
+ *       with iot_checksum_file_digest instead
+ *
  * @param[in]      lib                 library handle
  * @param[in]      file                handle to an open file
  * @param[in]      type                checksum algorithm to use
  * @param[out]     checksum            checksum output
  *
  * @retval IOT_STATUS_BAD_PARAMETER    invalid parameter passed to function
+ * @retval IOT_STATUS_NOT_SUPPORTED    checksum algorithm does not fit
  * @retval IOT_STATUS_SUCCESS          on success
  */
 iot_status_t iot_checksum_file_get(
@@ -49,4 +143,72 @@ iot_status_t iot_checksum_file_get(
 	iot_checksum_type_t type,
 	iot_uint64_t *checksum );
 
+/**
+ * @brief Completes a checksum calculated over several pieces of data
+ *
+ * The checksum is written in its usual byte order, i.e. as it is printed in
+ * hexadecimal (CRC32 is written most significant byte first).
+ *
+ * @param[in,out]  ctx                 checksum being calculated
+ * @param[out]     checksum            checksum output
+ * @param[in]      checksum_len        size of @p checksum (at least the
+ *                                     size of the checksum algorithm)
+ *
+ * @retval IOT_STATUS_BAD_PARAMETER    invalid parameter passed to function
+ * @retval IOT_STATUS_SUCCESS          on success
+ *
+ * @see iot_checksum_initialize
+ * @see iot_checksum_size
+ */
+iot_status_t iot_checksum_final(
+	iot_checksum_ctx_t *ctx,
+	void *checksum,
+	size_t checksum_len );
+
+/**
+ * @brief Starts a checksum calculated over several pieces of data
+ *
+ * @param[out]     ctx                 checksum to start
+ * @param[in]      type                checksum algorithm to use
+ *
+ * @retval IOT_STATUS_BAD_PARAMETER    invalid parameter passed to function
+ * @retval IOT_STATUS_SUCCESS          on success
+ *
+ * @see iot_checksum_final
+ * @see iot_checksum_update
+ */
+iot_status_t iot_checksum_initialize(
+	iot_checksum_ctx_t *ctx,
+	iot_checksum_type_t type );
+
+/**
+ * @brief Returns the size of the checksum of an algorithm
+ *
+ * @param[in]      type                checksum algorithm
+ *
+ * @return the size of the checksum in bytes, 0 for an unknown algorithm
+ */
+size_t iot_checksum_size(
+	iot_checksum_type_t type );
+
+/**
+ * @brief Adds data to a checksum calculated over several pieces of data
+ *
+ * Data can be checksummed as it is received, without keeping it.
+ *
+ * @param[in,out]  ctx                 checksum being calculated
+ * @param[in]      data                data to add
+ * @param[in]      len                 size of the data
+ *
+ * @retval IOT_STATUS_BAD_PARAMETER    invalid parameter passed to function
+ * @retval IOT_STATUS_SUCCESS          on success
+ *
+ * @see iot_checksum_final
+ * @see iot_checksum_initialize
+ */
+iot_status_t iot_checksum_update(
+	iot_checksum_ctx_t *ctx,
+	const void *data,
+	size_t len );
+
 #endif /* IOT_CHECKSUM_H */
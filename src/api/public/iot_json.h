@@ -52,6 +52,15 @@ typedef enum iot_json_type
  */
 #define IOT_JSON_FLAG_DYNAMIC          (IOT_JSON_FLAG_EXPAND << 1)
 #endif /* ifndef IOT_STACK_ONLY */
+/**
+ * @brief Encode output in a compact binary form (CBOR, RFC 7049) instead of
+ *        JSON text
+ *
+ * Binary output is only produced by the built-in encoder; formatting flags
+ * (expand & indent) are ignored.  Use iot_json_encode_dump_len to obtain the
+ * length of the output as it may contain null characters.
+ */
+#define IOT_JSON_FLAG_BINARY           (~( ~0u >> 1 ))
 /**
  * @brief Internal macro used for bit-shifting, number of bits to shift by
  */
@@ -61,7 +70,8 @@ typedef enum iot_json_type
  *        each item
  *
  * @note must be less than or equal to:
- *       sizeof( unsigned int ) * 8 - JSON_INDENT_OFFSET
+ *       sizeof( unsigned int ) * 8 - JSON_INDENT_OFFSET - 1 (the highest bit
+ *       is IOT_JSON_FLAG_BINARY)
  */
 #define IOT_JSON_FLAG_INDENT(x)        ((x) << IOT_JSON_INDENT_OFFSET)
 
@@ -111,6 +121,49 @@ typedef void iot_json_item_t;
 typedef void iot_json_array_iterator_t;
 /** @brief Represents an object for iterating through items in a JSON object */
 typedef void iot_json_object_iterator_t;
+/** @brief Represents a streaming (push-style) JSON decoder object */
+typedef struct iot_json_feed iot_json_feed_t;
+
+/** @brief events reported by a streaming JSON decoder */
+typedef enum iot_json_event
+{
+	IOT_JSON_EVENT_ARRAY_END = 0,  /**< @brief end of an array */
+	IOT_JSON_EVENT_ARRAY_START,    /**< @brief start of an array */
+	IOT_JSON_EVENT_OBJECT_END,     /**< @brief end of an object */
+	IOT_JSON_EVENT_OBJECT_START,   /**< @brief start of an object */
+	IOT_JSON_EVENT_VALUE           /**< @brief bool, number, string or null */
+} iot_json_event_t;
+
+/**
+ * @brief Signature of the function called for each event found by a
+ *        streaming JSON decoder
+ *
+ * @note The @c key and @c value buffers are only valid for the duration of the
+ * call.  Strings are returned without the surrounding quotes and escape
+ * sequences are not translated (as with iot_json_decode_string).
+ *
+ * @param[in]      user_data           user data passed on initialization
+ * @param[in]      event               event that occurred
+ * @param[in]      key                 key of the item if it is part of an
+ *                                     object, NULL otherwise
+ * @param[in]      key_len             length of the key
+ * @param[in]      type                type of the item
+ * @param[in]      value               text of the value
+ *                                     (IOT_JSON_EVENT_VALUE only)
+ * @param[in]      value_len           length of the value text
+ *
+ * @retval IOT_STATUS_SUCCESS          continue decoding
+ * @retval other                       stop decoding, status is returned to the
+ *                                     caller of iot_json_decode_feed
+ */
+typedef iot_status_t (iot_json_event_callback_t)(
+	void *user_data,
+	iot_json_event_t event,
+	const char *key,
+	size_t key_len,
+	iot_json_type_t type,
+	const char *value,
+	size_t value_len );
 
 /**
  * @brief Returns the element in array at position index.
@@ -232,6 +285,75 @@ IOT_API IOT_SECTION iot_status_t iot_json_decode_bool(
 	const iot_json_item_t *item,
 	iot_bool_t *value );
 
+/**
+ * @brief Passes the next chunk of a JSON document to a streaming decoder
+ *
+ * Events are reported through the callback as soon as each item is complete,
+ * items split across chunks are held by the decoder until they are finished.
+ * This allows large documents to be processed without holding the whole
+ * document in memory.
+ *
+ * @note call this function with a @c len of 0 to indicate the end of the
+ * document
+ *
+ * @param[in,out]  feed                streaming JSON decoder object
+ * @param[in]      js                  next chunk of JSON text
+ * @param[in]      len                 length of the chunk (0 = end of document)
+ * @param[in,out]  error               error text on failure (optional)
+ * @param[in]      error_len           size of the error string buffer
+ *                                     (optional)
+ *
+ * @retval IOT_STATUS_BAD_PARAMETER    invalid parameter passed to the function
+ * @retval IOT_STATUS_NO_MEMORY        item is too large for the decoder buffer
+ * @retval IOT_STATUS_PARSE_ERROR      invalid (or incomplete) JSON text
+ * @retval IOT_STATUS_SUCCESS          on success
+ *
+ * @see iot_json_decode_feed_initialize
+ */
+IOT_API IOT_SECTION iot_status_t iot_json_decode_feed(
+	iot_json_feed_t *feed,
+	const char *js,
+	size_t len,
+	char *error,
+	size_t error_len );
+
+/**
+ * @brief Initializes a streaming (push-style) JSON decoder
+ *
+ * @note memory after the decoder object in @c buf is used to hold items that
+ * are split between chunks, this limits the maximum size of a single item.
+ * Specifying the flag IOT_JSON_FLAG_DYNAMIC indicates to use dynamic memory
+ * on the heap instead, in this case, the parameters @c buf and @c len are
+ * ignored.
+ *
+ * @param[in,out]  buf                 memory to use for the decoder
+ * @param[in]      len                 amount of memory in the buf parameter
+ * @param[in]      flags               flags for indicating parsing support
+ * @param[in]      callback            function to call for each event
+ * @param[in]      user_data           user data to pass to the callback
+ *
+ * @return a valid streaming JSON decoder object, NULL on failure
+ *
+ * @see iot_json_decode_feed
+ * @see iot_json_decode_feed_terminate
+ */
+IOT_API IOT_SECTION iot_json_feed_t *iot_json_decode_feed_initialize(
+	void *buf,
+	size_t len,
+	unsigned int flags,
+	iot_json_event_callback_t *callback,
+	void *user_data );
+
+/**
+ * @brief Frees memory assocated with a streaming JSON decoder
+ *
+ * @param[in]      feed                streaming JSON decoder object
+ *
+ * @see iot_json_decode_feed_initialize
+ */
+IOT_API IOT_SECTION void iot_json_decode_feed_terminate(
+	iot_json_feed_t *feed );
+
 /**
  * @brief Initializes the JSON decoding system
  *
@@ -493,6 +615,22 @@ IOT_API IOT_SECTION iot_status_t iot_json_decode_real(
 	const iot_json_item_t *item,
 	iot_float64_t *value );
 
+/**
+ * @brief Resets a JSON decoder so that it can be used to parse another string
+ *
+ * @note Any memory allocated for tokens is kept, this allows a decoder to be
+ * reused for many JSON strings without further allocations once the token
+ * buffer has grown large enough.  All items previously returned by the
+ * decoder are invalid after this call.
+ *
+ * @param[in,out]  decoder             JSON decoder object
+ *
+ * @see iot_json_decode_parse
+ * @see iot_json_decode_terminate
+ */
+IOT_API IOT_SECTION void iot_json_decode_reset(
+	iot_json_decoder_t *decoder );
+
 /**
  * @brief Returns the associated string value
  *
@@ -633,6 +771,25 @@ IOT_API IOT_SECTION iot_status_t iot_json_encode_bool(
 IOT_API IOT_SECTION const char *iot_json_encode_dump(
 	iot_json_encoder_t *encoder );
 
+/**
+ * @brief Outputs the encoded data produced by the JSON encoder along with its
+ *        length
+ *
+ * @note This function is required to obtain the output of an encoder
+ * initialized with the flag IOT_JSON_FLAG_BINARY, as binary output is not
+ * null-terminated.
+ *
+ * @param[in]      encoder             JSON encoder object
+ * @param[out]     len                 (optional) length of the output in bytes
+ *
+ * @return the encoded output, NULL if there is nothing to output
+ *
+ * @see iot_json_encode_dump
+ */
+IOT_API IOT_SECTION const char *iot_json_encode_dump_len(
+	iot_json_encoder_t *encoder,
+	size_t *len );
+
 /**
  * @brief Initializes the JSON encoding system
  *
@@ -688,6 +845,7 @@ IOT_API IOT_SECTION iot_status_t iot_json_encode_integer(
  *
  * @retval IOT_STATUS_BAD_PARAMETER    bad parameter passed to the function
  * @retval IOT_STATUS_BAD_REQUEST      not inside an JSON array object
+ * @retval IOT_STATUS_NOT_SUPPORTED    encoder is producing binary output
  * @retval IOS_STATUS_SUCCESS          on success
  *
  * @see iot_json_encode_object_end
@@ -703,6 +861,7 @@ IOT_API IOT_SECTION iot_status_t iot_json_encode_object_cancel(
  *
  * @retval IOT_STATUS_BAD_PARAMETER    bad parameter passed to the function
  * @retval IOT_STATUS_BAD_REQUEST      not inside an JSON array object
+ * @retval IOT_STATUS_NOT_SUPPORTED    encoder is producing binary output
  * @retval IOS_STATUS_SUCCESS          on success
  *
  * @see iot_json_encode_object_end
@@ -779,6 +938,22 @@ IOT_API IOT_SECTION iot_status_t iot_json_encode_real(
 	const char *key,
 	iot_float64_t value );
 
+/**
+ * @brief Resets a JSON encoder so that it can be used to build another string
+ *
+ * @note Any memory allocated for the output is kept, this allows an encoder to
+ * be reused for many JSON strings without further allocations once the output
+ * buffer has grown large enough.  Any string previously returned by the
+ * encoder is invalid after this call.
+ *
+ * @param[in,out]  encoder             JSON encoder object
+ *
+ * @see iot_json_encode_initialize
+ * @see iot_json_encode_terminate
+ */
+IOT_API IOT_SECTION void iot_json_encode_reset(
+	iot_json_encoder_t *encoder );
+
 /**
  * @brief Encodes a string
  *
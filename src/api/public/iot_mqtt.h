@@ -34,6 +34,13 @@ typedef enum iot_mqtt_version
 	IOT_MQTT_VERSION_3_1 = 3,
 	/** @brief Use MQTT Version 3.1.1 */
 	IOT_MQTT_VERSION_3_1_1 = 4,
+	/**
+	 * @brief Use MQTT Version 5
+	 *
+	 * @note falls back to version 3.1.1 if the broker (or the client
+	 * library) does not support it
+	 */
+	IOT_MQTT_VERSION_5 = 5,
 } iot_mqtt_version_t;
 
 /**
@@ -122,13 +129,53 @@ typedef struct iot_mqtt_connect_options
 	iot_mqtt_version_t version;
 	/** @brief HTTP to request if using websockets (optional, if NULL: don't use websockets) */
 	const char *websocket_path;
+	/**
+	 * @brief maximum number of QoS 1 & 2 messages awaiting
+	 *        acknowledgement (optional, if 0: client default)
+	 *
+	 * @note Once reached, publishing a QoS 1 or 2 message fails with
+	 * @p IOT_STATUS_FULL until an acknowledgement is received.  QoS 0
+	 * messages are not limited.
+	 */
+	iot_uint16_t max_inflight;
+	/**
+	 * @brief seconds the broker keeps the session after a disconnection
+	 *        (optional, if 0: session ends on disconnection)
+	 *
+	 * @note This field is only applicable to clients that connect using
+	 * MQTT version 5 protocol.  Subscriptions are kept by the broker on
+	 * reconnection if the session is present.  When built with the
+	 * mosquitto client, a non-zero value only asks the broker to keep the
+	 * session (any protocol version); how long is up to the broker.
+	 *
+	 * @see iot_mqtt_session_status
+	 */
+	iot_uint32_t session_expiry;
+	/**
+	 * @brief maximum number of QoS 1 & 2 messages the broker may send
+	 *        before they are acknowledged (optional, if 0: broker default)
+	 *
+	 * @note This field is only applicable to clients that connect using
+	 * MQTT version 5 protocol.
+	 */
+	iot_uint16_t receive_max;
+	/**
+	 * @brief maximum number of topic aliases to use when publishing
+	 *        (optional, if 0: topic aliases are not used)
+	 *
+	 * @note This field is only applicable to clients that connect using
+	 * MQTT version 5 protocol, the broker may allow fewer aliases.  Only
+	 * QoS 0 messages are published using an alias, as QoS 1 & 2 messages
+	 * may be resent on a new connection where the alias is unknown.
+	 */
+	iot_uint16_t topic_alias_max;
 } iot_mqtt_connect_options_t;
 
 /**
  * @brief Initializes the @p iot_mqtt_connection_options_t structure
  */
 #define IOT_MQTT_CONNECT_OPTIONS_INIT \
-	{ NULL, NULL, 0u, 0u, NULL, NULL, NULL, NULL, IOT_MQTT_VERSION_DEFAULT, NULL }
+	{ NULL, NULL, 0u, 0u, NULL, NULL, NULL, NULL, IOT_MQTT_VERSION_DEFAULT, NULL, 0u, 0u, 0u, 0u }
 
 /**
  * @brief internal MQTT structure
@@ -235,6 +282,46 @@ IOT_API IOT_SECTION iot_status_t iot_mqtt_initialize( void );
 IOT_API IOT_SECTION iot_status_t iot_mqtt_loop( iot_mqtt_t *mqtt,
 	iot_millisecond_t max_time_out );
 
+/**
+ * @brief Services the connection after its socket was reported ready by an
+ *        external event loop
+ *
+ * @param[in]      mqtt                MQTT object to service
+ * @param[in]      readable            socket has data waiting to be read
+ * @param[in]      writable            socket can accept data to be written
+ *
+ * @retval IOT_STATUS_BAD_PARAMETER    invalid parameter passed to the function
+ * @retval IOT_STATUS_FAILURE          connection error while servicing
+ * @retval IOT_STATUS_SUCCESS          on success
+ *
+ * @see iot_mqtt_loop_socket
+ */
+IOT_API IOT_SECTION iot_status_t iot_mqtt_loop_dispatch( iot_mqtt_t *mqtt,
+	iot_bool_t readable, iot_bool_t writable );
+
+/**
+ * @brief Obtains the socket of the connection, for waiting on it in an
+ *        external event loop
+ *
+ * @param[in]      mqtt                MQTT object to obtain the socket for
+ * @param[out]     fd                  socket descriptor
+ * @param[out]     want_write          whether there is data waiting to be
+ *                                     written (optional)
+ * @param[in,out]  time_out            lowered to the maximum time before the
+ *                                     connection must be serviced again
+ *                                     (optional)
+ *
+ * @retval IOT_STATUS_BAD_PARAMETER    invalid parameter passed to the function
+ * @retval IOT_STATUS_NOT_INITIALIZED  not connected
+ * @retval IOT_STATUS_NOT_SUPPORTED    the connection is serviced by a thread
+ *                                     within the mqtt library
+ * @retval IOT_STATUS_SUCCESS          on success
+ *
+ * @see iot_mqtt_loop_dispatch
+ */
+IOT_API IOT_SECTION iot_status_t iot_mqtt_loop_socket( const iot_mqtt_t *mqtt,
+	int *fd, iot_bool_t *want_write, iot_millisecond_t *time_out );
+
 /**
  * @brief publishes a message to the mqtt connection to a specified topic
  *
@@ -242,11 +329,13 @@ IOT_API IOT_SECTION iot_status_t iot_mqtt_loop( iot_mqtt_t *mqtt,
  * @param[in]      topic               topic to transmit on
  * @param[in]      payload             message to transmit
  * @param[in]      payload_len         size of message
- * @param[in]      qos                 MQTT QOS level to use (0, 1 or 3)
+ * @param[in]      qos                 MQTT QOS level to use (0, 1 or 2)
  * @param[in]      retain              retain the message
  * @param[out]     msg_id              message id assigned to the message
  *
  * @retval IOT_STATUS_BAD_PARAMETER    invalid parameter passed to the function
+ * @retval IOT_STATUS_FULL             maximum number of messages awaiting
+ *                                     acknowledgement reached
  * @retval IOT_STATUS_IO_ERROR         not connected or failed to publish
  * @retval IOT_STATUS_SUCCESS          operation successful
  */
@@ -347,6 +436,26 @@ IOT_API IOT_SECTION iot_status_t iot_mqtt_reconnect(
 	const iot_mqtt_connect_options_t *opts,
 	iot_millisecond_t max_time_out );
 
+/**
+ * @brief state of the session negotiated on the last connection
+ *
+ * @param[in]      mqtt                MQTT object to query
+ * @param[out]     version             (optional) MQTT protocol version in use
+ * @param[out]     session_present     (optional) whether the broker resumed
+ *                                     an existing session, keeping the
+ *                                     subscriptions from before
+ *
+ * @retval IOT_STATUS_BAD_PARAMETER    invalid parameter passed to the function
+ * @retval IOT_STATUS_SUCCESS          operation successful
+ *
+ * @see iot_mqtt_connect
+ * @see iot_mqtt_reconnect
+ */
+IOT_API IOT_SECTION iot_status_t iot_mqtt_session_status(
+	const iot_mqtt_t *mqtt,
+	iot_mqtt_version_t *version,
+	iot_bool_t *session_present );
+
 /**
  * @brief subscribes for messages on an MQTT topic
  *
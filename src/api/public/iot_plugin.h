@@ -77,11 +77,38 @@ enum iot_operation
 	IOT_OPERATION_TELEMETRY_REGISTER,
 	/** @brief ( up ) obtain the transaction status */
 	IOT_OPERATION_TRANSACTION_STATUS,
+	/* operations below are appended to keep existing values unchanged */
+	/** @brief ( up ) descriptors ready in an external event loop */
+	IOT_OPERATION_LOOP_DISPATCH,
+	/** @brief ( up ) descriptors & deadline for an external event loop */
+	IOT_OPERATION_LOOP_POLL,
 };
 
 /** @brief current operation being performed */
 typedef enum iot_operation iot_operation_t;
 
+/**
+ * @brief descriptors passed to plug-ins for the IOT_OPERATION_LOOP_DISPATCH
+ *        and IOT_OPERATION_LOOP_POLL operations
+ */
+struct iot_loop_poll
+{
+	/** @brief descriptors to wait on (poll) */
+	iot_loop_fd_t *fds;
+	/** @brief number of descriptors required, plug-ins only set items
+	 * below @p fds_max but count all of them (poll) */
+	size_t fds_count;
+	/** @brief maximum number of descriptors in @p fds (poll) */
+	size_t fds_max;
+	/** @brief descriptors that are ready (dispatch) */
+	const iot_loop_fd_t *ready;
+	/** @brief number of descriptors in @p ready (dispatch) */
+	size_t ready_count;
+	/** @brief time until a plug-in timer expires (0 = none), plug-ins
+	 * only lower this value (poll) */
+	iot_millisecond_t time_out;
+};
+
 /** @brief typedef to simply function signatures */
 typedef struct iot_plugin iot_plugin_t;
 
@@ -0,0 +1,122 @@
+/**
+ * @file
+ * @brief Contains definitions for building archives from directories
+ *
+ * An archive is either written to a file, or produced as it is read
+ * (streamed), so an upload needs no temporary disk space.  A streamed archive
+ * is built a block at a time by the reads, through a small buffer that only
+ * holds the output of the latest block, so no thread is needed to produce it.
+ *
+ * With thread support, a compressed archive is cut in blocks compressed in
+ * parallel by IOT_WORKER_THREADS threads, started with the archive.  Each
+ * block is a complete gzip member or zstd frame: one after the other, they are
+ * still a standard gzip or zstd stream.
+ *
+ * @copyright Copyright (C) 2018 Wind River Systems, Inc. All Rights Reserved.
+ *
+ * @license Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied."
+ */
+
+#ifndef IOT_ARCHIVE_H
+#define IOT_ARCHIVE_H
+
+#include "iot.h"        /* for IOT_API, IOT_SECTION definitions */
+#include "iot_types.h"  /* for iot_archive_compression_t */
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* ifdef __cplusplus */
+
+/** @brief archive produced as it is read */
+typedef struct iot_archive_stream iot_archive_stream_t;
+
+/**
+ * @brief Build an archive file from the files in a directory
+ *
+ * @param[in]      archive_path        name of the archive file to produce
+ * @param[in]      path                path to the directory to archive
+ * @param[in]      compression         compression of the archive
+ *
+ * @retval IOT_STATUS_BAD_PARAMETER    invalid parameter passed
+ * @retval IOT_STATUS_FAILURE          internal system failure
+ * @retval IOT_STATUS_NO_MEMORY        not enough memory to build the archive
+ * @retval IOT_STATUS_NOT_SUPPORTED    compression not supported
+ * @retval IOT_STATUS_SUCCESS          operation successful
+ */
+IOT_API IOT_SECTION iot_status_t iot_archive_directory(
+	const char *archive_path,
+	const char *path,
+	iot_archive_compression_t compression );
+
+/**
+ * @brief Extension of the name of an archive
+ *
+ * @param[in]      compression         compression of the archive
+ *
+ * @return extension, including the leading dot (i.e. ".tar.gz")
+ */
+IOT_API IOT_SECTION const char *iot_archive_extension(
+	iot_archive_compression_t compression );
+
+/**
+ * @brief Stop reading an archive of a directory
+ *
+ * @param[in,out]  stream              archive to close
+ *
+ * @retval IOT_STATUS_BAD_PARAMETER    invalid parameter passed
+ * @retval IOT_STATUS_SUCCESS          operation successful
+ *
+ * @see iot_archive_stream_open
+ */
+IOT_API IOT_SECTION iot_status_t iot_archive_stream_close(
+	iot_archive_stream_t *stream );
+
+/**
+ * @brief Start reading an archive of the files in a directory, built as it is
+ *        read
+ *
+ * @param[in]      path                path to the directory to archive
+ * @param[in]      compression         compression of the archive
+ *
+ * @return archive to read, NULL on failure
+ *
+ * @see iot_archive_stream_close
+ * @see iot_archive_stream_read
+ */
+IOT_API IOT_SECTION iot_archive_stream_t *iot_archive_stream_open(
+	const char *path,
+	iot_archive_compression_t compression );
+
+/**
+ * @brief Read the next part of an archive of a directory
+ *
+ * @param[in,out]  stream              archive to read
+ * @param[out]     buf                 destination buffer
+ * @param[in]      len                 size of the destination buffer
+ * @param[out]     read_len            amount read (0 at the end of the
+ *                                     archive)
+ *
+ * @retval IOT_STATUS_BAD_PARAMETER    invalid parameter passed
+ * @retval IOT_STATUS_FAILURE          failed to build the archive
+ * @retval IOT_STATUS_NO_MEMORY        not enough memory to build the archive
+ * @retval IOT_STATUS_SUCCESS          operation successful
+ */
+IOT_API IOT_SECTION iot_status_t iot_archive_stream_read(
+	iot_archive_stream_t *stream,
+	void *buf,
+	size_t len,
+	size_t *read_len );
+
+#ifdef __cplusplus
+}
+#endif /* ifdef __cplusplus */
+
+#endif /* ifndef IOT_ARCHIVE_H */
@@ -22,9 +22,10 @@
 #include "iot_defs.h"
 #include "iot_plugin.h"
 
-/* Flags */
-/** @brief Run in a single thread */
-#define IOT_FLAG_SINGLE_THREAD                   0x01
+#ifndef _WIN32
+/** @brief external event loops can be woken through a pipe */
+#	define IOT_LOOP_WAKEUP_SUPPORT
+#endif /* ifndef _WIN32 */
 
 /** @brief Type containing information required for file transfer */
 typedef struct iot_file_transfer                 iot_file_transfer_t;
@@ -368,11 +369,26 @@ struct iot_telemetry
 #endif /* else IOT_STACK_ONLY */
 };
 
+/** @brief compression of an archive built from a directory */
+typedef enum iot_archive_compression
+{
+	/** @brief uncompressed tar archive */
+	IOT_ARCHIVE_COMPRESSION_NONE = 0,
+	/** @brief tar archive compressed with gzip */
+	IOT_ARCHIVE_COMPRESSION_GZIP,
+	/** @brief tar archive compressed with zstd */
+	IOT_ARCHIVE_COMPRESSION_ZSTD
+} iot_archive_compression_t;
+
 /** @brief structure containing informaiton about a file upload or download */
 struct iot_file_transfer
 {
+	/** @brief local path is a directory, archived as it is uploaded */
+	iot_bool_t archive;
 	/** @brief progress function callback */
 	iot_file_progress_callback_t *callback;
+	/** @brief compression of the archive (if @p archive is set) */
+	iot_archive_compression_t compression;
 	/** @brief cloud's file name */
 	const char *name;
 	/** @brief local file path */
@@ -490,6 +506,10 @@ struct iot
 
 	/** @brief about to disconnect & quit */
 	iot_bool_t                  to_quit;
+#ifdef IOT_LOOP_WAKEUP_SUPPORT
+	/** @brief pipe waking an external event loop (-1: not created) */
+	int                         loop_wakeup[2u];
+#endif /* ifdef IOT_LOOP_WAKEUP_SUPPORT */
 
 	/* incoming actions to execute */
 	/**
@@ -1073,6 +1093,17 @@ IOT_SECTION iot_status_t iot_loop_stop(
 	iot_t *lib,
 	iot_bool_t force );
 
+/**
+ * @brief Wakes an external event loop waiting on the library, after work was
+ *        queued from another thread
+ *
+ * @param[in]      lib                 library handle
+ *
+ * @see iot_loop_fd
+ */
+IOT_SECTION void iot_loop_wakeup(
+	iot_t *lib );
+
 /* helper function for log level setting */
 /**
  * @brief Sets a log level for the service based on a string
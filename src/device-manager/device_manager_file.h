@@ -32,11 +32,8 @@
 
 #include "os.h"
 #include "api/shared/iot_types.h"      /* for iot_proxy structure */
+#include "iot_checksum.h"
 
-#ifndef _WRS_KERNEL
-#	include "device_manager_md5.h"
-#	include "device_manager_sha256.h"
-#endif /* ifndef _WRS_KERNEL */
 #include "device_manager_ota.h"
 
 /** @brief Maximum length of a token from the web */
@@ -44,9 +41,7 @@
 /** @brief Maximum length of "x-access-token: " */
 #define DEVICE_MANAGER_FILE_HEADER_TOKEN_KEY_LENGTH 16u
 /** @brief Maximum length of checksum */
-#define DEVICE_MANAGER_CHECKSUM_LENGTH \
-	((DEVICE_MANAGER_SHA256_DIGEST_HEX_LENGTH) >= ( DEVICE_MANAGER_MD5_DIGEST_HEX_LENGTH ) \
-	? ( DEVICE_MANAGER_SHA256_DIGEST_HEX_LENGTH ) : ( DEVICE_MANAGER_MD5_DIGEST_HEX_LENGTH ) )
+#define DEVICE_MANAGER_CHECKSUM_LENGTH ( IOT_CHECKSUM_SIZE_MAX * 2u )
 
 struct device_manager_info;
 
@@ -30,8 +30,7 @@
 
 #include "os.h"
 #include "iot.h"
-#include "device_manager_md5.h"
-#include "device_manager_sha256.h"
+#include "iot_checksum.h"
 /** @brief Maximum length of field in manifest */
 #define DEVICE_MANAGER_OTA_PKG_STRING_MAX_LENGTH 255
 struct device_manager_info;
@@ -48,9 +47,9 @@ struct device_manager_ota_manifest
 	/** @brief Manifest version */
 	char version [ DEVICE_MANAGER_OTA_PKG_STRING_MAX_LENGTH + 1u ];
 	/** @brief Expected sh256 checksum for a downloaded file */
-	char checksum_sh256[ DEVICE_MANAGER_SHA256_DIGEST_HEX_LENGTH + 1u ];
+	char checksum_sh256[ IOT_CHECKSUM_SHA256_SIZE * 2u + 1u ];
 	/** @brief Expected md5 checksum for a downloaded file */
-	char checksum_md5[ DEVICE_MANAGER_MD5_DIGEST_HEX_LENGTH + 1u ];
+	char checksum_md5[ IOT_CHECKSUM_MD5_SIZE * 2u + 1u ];
 	/** @brief Token for response URL */
 	char jwt[ DEVICE_MANAGER_OTA_PKG_STRING_MAX_LENGTH + 1u ];
 	/** @brief Path to excute the script */
@@ -23,6 +23,9 @@
 #include "iot_build.h"
 
 #include <string.h>
+#ifdef IOT_LOOP_WAKEUP_SUPPORT
+#include <unistd.h> /* for close */
+#endif /* ifdef IOT_LOOP_WAKEUP_SUPPORT */
 
 static void test_log_callback( iot_log_level_t log_level,
                                const iot_log_source_t *log_source,
@@ -2111,6 +2114,102 @@ static void test_iot_log_level_set_string_valid( void **state )
 	}
 }
 
+/* iot_loop_dispatch */
+static void test_iot_loop_dispatch_null_lib( void **state )
+{
+	iot_status_t result;
+	result = iot_loop_dispatch( NULL, NULL, 0u );
+	assert_int_equal( result, IOT_STATUS_BAD_PARAMETER );
+}
+
+static void test_iot_loop_dispatch_null_ready( void **state )
+{
+	struct iot lib;
+	iot_status_t result;
+
+	bzero( &lib, sizeof( struct iot ) );
+	lib.flags = IOT_FLAG_SINGLE_THREAD;
+	result = iot_loop_dispatch( &lib, NULL, 1u );
+	assert_int_equal( result, IOT_STATUS_BAD_PARAMETER );
+}
+
+static void test_iot_loop_dispatch_single_thread( void **state )
+{
+	struct iot lib;
+	iot_status_t result;
+
+	bzero( &lib, sizeof( struct iot ) );
+	lib.flags = IOT_FLAG_SINGLE_THREAD;
+	lib.request_queue_wait_count = 1u;
+	will_return( __wrap_iot_plugin_perform, IOT_STATUS_SUCCESS );
+	/* mock never removes the request, so processing stops at the limit */
+	will_return_count( __wrap_iot_action_process, IOT_STATUS_SUCCESS,
+		IOT_ACTION_QUEUE_MAX );
+	result = iot_loop_dispatch( &lib, NULL, 0u );
+	assert_int_equal( result, IOT_STATUS_SUCCESS );
+}
+
+static void test_iot_loop_dispatch_threads( void **state )
+{
+	struct iot lib;
+	iot_status_t result;
+
+	bzero( &lib, sizeof( struct iot ) );
+	result = iot_loop_dispatch( &lib, NULL, 0u );
+	assert_int_equal( result, IOT_STATUS_NOT_SUPPORTED );
+}
+
+/* iot_loop_fd */
+static void test_iot_loop_fd_null_count( void **state )
+{
+	struct iot lib;
+	iot_loop_fd_t fds[2u];
+	iot_status_t result;
+
+	bzero( &lib, sizeof( struct iot ) );
+	lib.flags = IOT_FLAG_SINGLE_THREAD;
+	result = iot_loop_fd( &lib, fds, 2u, NULL );
+	assert_int_equal( result, IOT_STATUS_BAD_PARAMETER );
+}
+
+static void test_iot_loop_fd_null_lib( void **state )
+{
+	iot_loop_fd_t fds[2u];
+	size_t fds_count = 1u;
+	iot_status_t result;
+
+	result = iot_loop_fd( NULL, fds, 2u, &fds_count );
+	assert_int_equal( result, IOT_STATUS_BAD_PARAMETER );
+	assert_int_equal( fds_count, 1u );
+}
+
+static void test_iot_loop_fd_single_thread( void **state )
+{
+	struct iot lib;
+	iot_loop_fd_t fds[2u];
+	size_t fds_count = 0u;
+	iot_status_t result;
+
+	bzero( &lib, sizeof( struct iot ) );
+	lib.flags = IOT_FLAG_SINGLE_THREAD;
+#ifdef IOT_LOOP_WAKEUP_SUPPORT
+	lib.loop_wakeup[0] = -1;
+	lib.loop_wakeup[1] = -1;
+#endif /* ifdef IOT_LOOP_WAKEUP_SUPPORT */
+	will_return( __wrap_iot_plugin_perform, IOT_STATUS_SUCCESS );
+	result = iot_loop_fd( &lib, fds, 2u, &fds_count );
+	assert_int_equal( result, IOT_STATUS_SUCCESS );
+#ifdef IOT_LOOP_WAKEUP_SUPPORT
+	assert_int_equal( fds_count, 1u );
+	assert_int_equal( fds[0].fd, lib.loop_wakeup[0] );
+	assert_int_equal( fds[0].events, IOT_LOOP_EVENT_READ );
+	close( lib.loop_wakeup[0] );
+	close( lib.loop_wakeup[1] );
+#else /* ifdef IOT_LOOP_WAKEUP_SUPPORT */
+	assert_int_equal( fds_count, 0u );
+#endif /* else ifdef IOT_LOOP_WAKEUP_SUPPORT */
+}
+
 /* iot_loop_forever */
 static void test_iot_loop_forever_null_lib( void **state )
 {
@@ -2168,6 +2267,46 @@ static void test_iot_loop_iteration_threads( void **state )
 	assert_int_equal( result, IOT_STATUS_SUCCESS );
 }
 
+/* iot_loop_next_deadline */
+static void test_iot_loop_next_deadline_null_lib( void **state )
+{
+	iot_millisecond_t time_out = 5u;
+	iot_status_t result;
+
+	result = iot_loop_next_deadline( NULL, &time_out );
+	assert_int_equal( result, IOT_STATUS_BAD_PARAMETER );
+	assert_int_equal( time_out, 5u );
+}
+
+static void test_iot_loop_next_deadline_request_waiting( void **state )
+{
+	struct iot lib;
+	iot_millisecond_t time_out = 0u;
+	iot_status_t result;
+
+	bzero( &lib, sizeof( struct iot ) );
+	lib.flags = IOT_FLAG_SINGLE_THREAD;
+	lib.request_queue_wait_count = 1u;
+	will_return( __wrap_iot_plugin_perform, IOT_STATUS_SUCCESS );
+	result = iot_loop_next_deadline( &lib, &time_out );
+	assert_int_equal( result, IOT_STATUS_SUCCESS );
+	assert_int_equal( time_out, 1u );
+}
+
+static void test_iot_loop_next_deadline_single_thread( void **state )
+{
+	struct iot lib;
+	iot_millisecond_t time_out = 5u;
+	iot_status_t result;
+
+	bzero( &lib, sizeof( struct iot ) );
+	lib.flags = IOT_FLAG_SINGLE_THREAD;
+	will_return( __wrap_iot_plugin_perform, IOT_STATUS_SUCCESS );
+	result = iot_loop_next_deadline( &lib, &time_out );
+	assert_int_equal( result, IOT_STATUS_SUCCESS );
+	assert_int_equal( time_out, 0u );
+}
+
 /* iot_loop_start */
 static void test_iot_loop_start_null_lib( void **state )
 {
@@ -2651,11 +2790,21 @@ int main( int argc, char *argv[] )
 		cmocka_unit_test( test_iot_log_level_set_string_null_lib ),
 		cmocka_unit_test( test_iot_log_level_set_string_null_str ),
 		cmocka_unit_test( test_iot_log_level_set_string_valid ),
+		cmocka_unit_test( test_iot_loop_dispatch_null_lib ),
+		cmocka_unit_test( test_iot_loop_dispatch_null_ready ),
+		cmocka_unit_test( test_iot_loop_dispatch_single_thread ),
+		cmocka_unit_test( test_iot_loop_dispatch_threads ),
+		cmocka_unit_test( test_iot_loop_fd_null_count ),
+		cmocka_unit_test( test_iot_loop_fd_null_lib ),
+		cmocka_unit_test( test_iot_loop_fd_single_thread ),
 		cmocka_unit_test( test_iot_loop_forever_null_lib ),
 		cmocka_unit_test( test_iot_loop_forever_single_thread ),
 		cmocka_unit_test( test_iot_loop_iteration_null_lib ),
 		cmocka_unit_test( test_iot_loop_iteration_single_thread ),
 		cmocka_unit_test( test_iot_loop_iteration_threads ),
+		cmocka_unit_test( test_iot_loop_next_deadline_null_lib ),
+		cmocka_unit_test( test_iot_loop_next_deadline_request_waiting ),
+		cmocka_unit_test( test_iot_loop_next_deadline_single_thread ),
 		cmocka_unit_test( test_iot_loop_start_null_lib ),
 		cmocka_unit_test( test_iot_loop_start_single_thread ),
 		cmocka_unit_test( test_iot_loop_start_threads_fail ),
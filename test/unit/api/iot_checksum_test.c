@@ -0,0 +1,339 @@
+/**
+ * @file
+ * @brief unit testing for IoT library (checksum source file)
+ *
+ * @copyright Copyright (C) 2018 Wind River Systems, Inc. All Rights Reserved.
+ *
+ * @license Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at:
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied."
+ */
+
+#include "test_support.h"
+
+#include "api/public/iot.h"
+#include "api/public/iot_checksum.h"
+#include "api/shared/iot_types.h"
+#include "iot_build.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/** @brief Standard check value of CRC32 (checksum of "123456789") */
+#define IOT_CHECKSUM_CRC32_CHECK 0xCBF43926u
+
+/** @brief MD5 checksum of "abc" (RFC 1321) */
+static const iot_uint8_t IOT_CHECKSUM_MD5_ABC[] = {
+	0x90, 0x01, 0x50, 0x98, 0x3c, 0xd2, 0x4f, 0xb0,
+	0xd6, 0x96, 0x3f, 0x7d, 0x28, 0xe1, 0x7f, 0x72 };
+/** @brief MD5 checksum of "" (RFC 1321) */
+static const iot_uint8_t IOT_CHECKSUM_MD5_EMPTY[] = {
+	0xd4, 0x1d, 0x8c, 0xd9, 0x8f, 0x00, 0xb2, 0x04,
+	0xe9, 0x80, 0x09, 0x98, 0xec, 0xf8, 0x42, 0x7e };
+/** @brief SHA-256 checksum of "abc" (FIPS 180-2) */
+static const iot_uint8_t IOT_CHECKSUM_SHA256_ABC[] = {
+	0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea,
+	0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+	0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c,
+	0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad };
+/** @brief SHA-256 checksum of the 448 bit message of FIPS 180-2 (two
+ *         blocks once padded) */
+static const iot_uint8_t IOT_CHECKSUM_SHA256_TWO_BLOCKS[] = {
+	0x24, 0x8d, 0x6a, 0x61, 0xd2, 0x06, 0x38, 0xb8,
+	0xe5, 0xc0, 0x26, 0x93, 0x0c, 0x3e, 0x60, 0x39,
+	0xa3, 0x3c, 0xe4, 0x59, 0x64, 0xff, 0x21, 0x67,
+	0xf6, 0xec, 0xed, 0xd4, 0x19, 0xdb, 0x06, 0xc1 };
+
+/* iot_checksum_crc32_combine */
+static void test_iot_checksum_crc32_combine( void **state )
+{
+	const char *const data = "123456789";
+	size_t i;
+
+	for ( i = 0u; i <= 9u; ++i )
+	{
+		iot_uint32_t crc32_1;
+		iot_uint32_t crc32_2;
+
+		crc32_1 = iot_checksum_crc32_update( 0u, data, i );
+		crc32_2 = iot_checksum_crc32_update( 0u, data + i, 9u - i );
+		assert_int_equal( iot_checksum_crc32_combine( crc32_1,
+			crc32_2, 9u - i ), IOT_CHECKSUM_CRC32_CHECK );
+	}
+}
+
+static void test_iot_checksum_crc32_combine_large( void **state )
+{
+	const size_t len = 100000u;
+	unsigned char *data;
+	iot_uint32_t crc32_1;
+	iot_uint32_t crc32_2;
+	iot_uint32_t expected;
+	size_t i;
+
+	data = malloc( len );
+	assert_non_null( data );
+	for ( i = 0u; i < len; ++i )
+		data[i] = (unsigned char)( i * 31u + 7u );
+
+	expected = iot_checksum_crc32_update( 0u, data, len );
+	crc32_1 = iot_checksum_crc32_update( 0u, data, 4097u );
+	crc32_2 = iot_checksum_crc32_update( 0u, data + 4097u, len - 4097u );
+	assert_int_equal( iot_checksum_crc32_combine( crc32_1, crc32_2,
+		len - 4097u ), expected );
+
+	free( data );
+}
+
+static void test_iot_checksum_crc32_combine_zero_length( void **state )
+{
+	assert_int_equal( iot_checksum_crc32_combine(
+		IOT_CHECKSUM_CRC32_CHECK, 0u, 0u ), IOT_CHECKSUM_CRC32_CHECK );
+}
+
+/* iot_checksum_crc32_update */
+static void test_iot_checksum_crc32_update( void **state )
+{
+	const char *const data = "123456789";
+	iot_uint32_t result;
+
+	result = iot_checksum_crc32_update( 0u, data, 9u );
+	assert_int_equal( result, IOT_CHECKSUM_CRC32_CHECK );
+}
+
+static void test_iot_checksum_crc32_update_large( void **state )
+{
+	const size_t len = 100000u;
+	unsigned char *data;
+	size_t offset;
+	size_t i;
+
+	data = malloc( len + 16u );
+	assert_non_null( data );
+	for ( i = 0u; i < len + 16u; ++i )
+		data[i] = (unsigned char)( i * 131u + 17u );
+
+	/* bulk updates (any alignment & length) match byte by byte updates */
+	for ( offset = 0u; offset < 16u; offset += 5u )
+	{
+		iot_uint32_t expected = 0u;
+		for ( i = 0u; i < len - offset; ++i )
+			expected = iot_checksum_crc32_update( expected,
+				data + offset + i, 1u );
+		assert_int_equal( iot_checksum_crc32_update( 0u,
+			data + offset, len - offset ), expected );
+	}
+
+	free( data );
+}
+
+static void test_iot_checksum_crc32_update_pieces( void **state )
+{
+	const char *const data = "123456789";
+	iot_uint32_t result;
+
+	result = iot_checksum_crc32_update( 0u, data, 2u );
+	result = iot_checksum_crc32_update( result, data + 2u, 0u );
+	result = iot_checksum_crc32_update( result, data + 2u, 5u );
+	result = iot_checksum_crc32_update( result, data + 7u, 2u );
+	assert_int_equal( result, IOT_CHECKSUM_CRC32_CHECK );
+}
+
+static void test_iot_checksum_crc32_update_zero_length( void **state )
+{
+	iot_uint32_t result;
+
+	result = iot_checksum_crc32_update( 0u, NULL, 0u );
+	assert_int_equal( result, 0u );
+}
+
+/* iot_checksum_final */
+static void test_iot_checksum_final_buffer_too_small( void **state )
+{
+	iot_checksum_ctx_t ctx;
+	iot_uint8_t checksum[ IOT_CHECKSUM_SHA256_SIZE ];
+	iot_status_t result;
+
+	iot_checksum_initialize( &ctx, IOT_CHECKSUM_TYPE_SHA256 );
+	result = iot_checksum_final( &ctx, checksum,
+		IOT_CHECKSUM_SHA256_SIZE - 1u );
+	assert_int_equal( result, IOT_STATUS_BAD_PARAMETER );
+}
+
+static void test_iot_checksum_final_crc32( void **state )
+{
+	const iot_uint8_t expected[] = { 0xcb, 0xf4, 0x39, 0x26 };
+	iot_checksum_ctx_t ctx;
+	iot_uint8_t checksum[ IOT_CHECKSUM_CRC32_SIZE ];
+	iot_status_t result;
+
+	iot_checksum_initialize( &ctx, IOT_CHECKSUM_TYPE_CRC32 );
+	iot_checksum_update( &ctx, "123456789", 9u );
+	result = iot_checksum_final( &ctx, checksum, sizeof( checksum ) );
+	assert_int_equal( result, IOT_STATUS_SUCCESS );
+	assert_memory_equal( checksum, expected, sizeof( expected ) );
+}
+
+static void test_iot_checksum_final_md5( void **state )
+{
+	iot_checksum_ctx_t ctx;
+	iot_uint8_t checksum[ IOT_CHECKSUM_MD5_SIZE ];
+	iot_status_t result;
+
+	iot_checksum_initialize( &ctx, IOT_CHECKSUM_TYPE_MD5 );
+	iot_checksum_update( &ctx, "abc", 3u );
+	result = iot_checksum_final( &ctx, checksum, sizeof( checksum ) );
+	assert_int_equal( result, IOT_STATUS_SUCCESS );
+	assert_memory_equal( checksum, IOT_CHECKSUM_MD5_ABC,
+		IOT_CHECKSUM_MD5_SIZE );
+
+	iot_checksum_initialize( &ctx, IOT_CHECKSUM_TYPE_MD5 );
+	result = iot_checksum_final( &ctx, checksum, sizeof( checksum ) );
+	assert_int_equal( result, IOT_STATUS_SUCCESS );
+	assert_memory_equal( checksum, IOT_CHECKSUM_MD5_EMPTY,
+		IOT_CHECKSUM_MD5_SIZE );
+}
+
+static void test_iot_checksum_final_sha256( void **state )
+{
+	const char *const data =
+		"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+	iot_checksum_ctx_t ctx;
+	iot_uint8_t checksum[ IOT_CHECKSUM_SIZE_MAX ];
+	iot_status_t result;
+
+	iot_checksum_initialize( &ctx, IOT_CHECKSUM_TYPE_SHA256 );
+	iot_checksum_update( &ctx, "abc", 3u );
+	result = iot_checksum_final( &ctx, checksum, sizeof( checksum ) );
+	assert_int_equal( result, IOT_STATUS_SUCCESS );
+	assert_memory_equal( checksum, IOT_CHECKSUM_SHA256_ABC,
+		IOT_CHECKSUM_SHA256_SIZE );
+
+	iot_checksum_initialize( &ctx, IOT_CHECKSUM_TYPE_SHA256 );
+	iot_checksum_update( &ctx, data, strlen( data ) );
+	result = iot_checksum_final( &ctx, checksum, sizeof( checksum ) );
+	assert_int_equal( result, IOT_STATUS_SUCCESS );
+	assert_memory_equal( checksum, IOT_CHECKSUM_SHA256_TWO_BLOCKS,
+		IOT_CHECKSUM_SHA256_SIZE );
+}
+
+/* iot_checksum_initialize */
+static void test_iot_checksum_initialize_bad_type( void **state )
+{
+	iot_checksum_ctx_t ctx;
+	iot_status_t result;
+
+	result = iot_checksum_initialize( &ctx, (iot_checksum_type_t)100 );
+	assert_int_equal( result, IOT_STATUS_BAD_PARAMETER );
+}
+
+static void test_iot_checksum_initialize_null_ctx( void **state )
+{
+	iot_status_t result;
+
+	result = iot_checksum_initialize( NULL, IOT_CHECKSUM_TYPE_MD5 );
+	assert_int_equal( result, IOT_STATUS_BAD_PARAMETER );
+}
+
+/* iot_checksum_size */
+static void test_iot_checksum_size( void **state )
+{
+	assert_int_equal( iot_checksum_size( IOT_CHECKSUM_TYPE_CRC32 ),
+		IOT_CHECKSUM_CRC32_SIZE );
+	assert_int_equal( iot_checksum_size( IOT_CHECKSUM_TYPE_MD5 ),
+		IOT_CHECKSUM_MD5_SIZE );
+	assert_int_equal( iot_checksum_size( IOT_CHECKSUM_TYPE_SHA256 ),
+		IOT_CHECKSUM_SHA256_SIZE );
+	assert_int_equal( iot_checksum_size( (iot_checksum_type_t)100 ),
+		0u );
+}
+
+/* iot_checksum_update */
+static void test_iot_checksum_update_pieces( void **state )
+{
+	const size_t len = 300u;
+	const iot_checksum_type_t types[] = {
+		IOT_CHECKSUM_TYPE_MD5, IOT_CHECKSUM_TYPE_SHA256 };
+	unsigned char *data;
+	size_t i;
+	size_t t;
+
+	data = malloc( len );
+	assert_non_null( data );
+	for ( i = 0u; i < len; ++i )
+		data[i] = (unsigned char)( i * 131u + 17u );
+
+	/* updates split anywhere (across & inside blocks) match a single
+	 * update */
+	for ( t = 0u; t < sizeof( types ) / sizeof( types[0] ); ++t )
+	{
+		iot_checksum_ctx_t ctx;
+		iot_uint8_t expected[ IOT_CHECKSUM_SIZE_MAX ];
+		iot_uint8_t checksum[ IOT_CHECKSUM_SIZE_MAX ];
+
+		iot_checksum_initialize( &ctx, types[t] );
+		iot_checksum_update( &ctx, data, len );
+		iot_checksum_final( &ctx, expected, sizeof( expected ) );
+		for ( i = 0u; i <= len; i += 7u )
+		{
+			iot_checksum_initialize( &ctx, types[t] );
+			iot_checksum_update( &ctx, data, i );
+			iot_checksum_update( &ctx, data + i, 0u );
+			iot_checksum_update( &ctx, data + i, ( len - i ) / 2u );
+			iot_checksum_update( &ctx, data + i + ( len - i ) / 2u,
+				len - i - ( len - i ) / 2u );
+			iot_checksum_final( &ctx, checksum,
+				sizeof( checksum ) );
+			assert_memory_equal( checksum, expected,
+				iot_checksum_size( types[t] ) );
+		}
+	}
+
+	free( data );
+}
+
+static void test_iot_checksum_update_null_data( void **state )
+{
+	iot_checksum_ctx_t ctx;
+	iot_status_t result;
+
+	iot_checksum_initialize( &ctx, IOT_CHECKSUM_TYPE_SHA256 );
+	result = iot_checksum_update( &ctx, NULL, 1u );
+	assert_int_equal( result, IOT_STATUS_BAD_PARAMETER );
+	result = iot_checksum_update( &ctx, NULL, 0u );
+	assert_int_equal( result, IOT_STATUS_SUCCESS );
+}
+
+/* main */
+int main( int argc, char *argv[] )
+{
+	int result;
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test( test_iot_checksum_crc32_combine ),
+		cmocka_unit_test( test_iot_checksum_crc32_combine_large ),
+		cmocka_unit_test( test_iot_checksum_crc32_combine_zero_length ),
+		cmocka_unit_test( test_iot_checksum_crc32_update ),
+		cmocka_unit_test( test_iot_checksum_crc32_update_large ),
+		cmocka_unit_test( test_iot_checksum_crc32_update_pieces ),
+		cmocka_unit_test( test_iot_checksum_crc32_update_zero_length ),
+		cmocka_unit_test( test_iot_checksum_final_buffer_too_small ),
+		cmocka_unit_test( test_iot_checksum_final_crc32 ),
+		cmocka_unit_test( test_iot_checksum_final_md5 ),
+		cmocka_unit_test( test_iot_checksum_final_sha256 ),
+		cmocka_unit_test( test_iot_checksum_initialize_bad_type ),
+		cmocka_unit_test( test_iot_checksum_initialize_null_ctx ),
+		cmocka_unit_test( test_iot_checksum_size ),
+		cmocka_unit_test( test_iot_checksum_update_pieces ),
+		cmocka_unit_test( test_iot_checksum_update_null_data )
+	};
+	test_initialize( argc, argv );
+	result = cmocka_run_group_tests( tests, NULL, NULL );
+	test_finalize( argc, argv );
+	return result;
+}
@@ -536,6 +536,163 @@ static void test_iot_json_decode_bool_valid( void **state )
 	iot_json_decode_terminate( decoder );
 }
 
+/* helper for recording events from a streaming decoder */
+struct test_feed_events
+{
+	unsigned int count;
+	unsigned int values;
+	iot_json_event_t last_event;
+	iot_json_type_t last_type;
+	char last_key[32u];
+	char last_value[32u];
+};
+
+static iot_status_t test_feed_callback(
+	void *user_data,
+	iot_json_event_t event,
+	const char *key,
+	size_t key_len,
+	iot_json_type_t type,
+	const char *value,
+	size_t value_len )
+{
+	struct test_feed_events *const ev =
+		(struct test_feed_events *)user_data;
+	++ev->count;
+	ev->last_event = event;
+	if ( event == IOT_JSON_EVENT_VALUE )
+	{
+		++ev->values;
+		ev->last_type = type;
+		snprintf( ev->last_key, 32u, "%.*s", (int)key_len,
+			key ? key : "" );
+		snprintf( ev->last_value, 32u, "%.*s", (int)value_len,
+			value ? value : "" );
+	}
+	return IOT_STATUS_SUCCESS;
+}
+
+static void test_iot_json_decode_feed_chunked( void **state )
+{
+	char buf[512u];
+	char json[256u];
+	iot_json_feed_t *feed;
+	iot_status_t result = IOT_STATUS_SUCCESS;
+	struct test_feed_events ev;
+	size_t i, json_len;
+
+	memset( &ev, 0, sizeof( struct test_feed_events ) );
+	snprintf( json, 256u, "{\"obj\":{\"str\":\"value\",\"arr\":[1,2.5,true,null]},"
+		"\"item\":-12345}" );
+	json_len = strlen( json );
+	feed = iot_json_decode_feed_initialize( buf, 512u, 0u,
+		test_feed_callback, &ev );
+	assert_non_null( feed );
+
+	/* one character at a time */
+	for ( i = 0u; i < json_len && result == IOT_STATUS_SUCCESS; ++i )
+		result = iot_json_decode_feed( feed, &json[i], 1u, NULL, 0u );
+	assert_int_equal( result, IOT_STATUS_SUCCESS );
+	assert_int_equal( ev.count, 12u );
+	assert_int_equal( ev.values, 6u );
+	assert_int_equal( ev.last_event, IOT_JSON_EVENT_OBJECT_END );
+	assert_int_equal( ev.last_type, IOT_JSON_TYPE_INTEGER );
+	assert_string_equal( ev.last_key, "item" );
+	assert_string_equal( ev.last_value, "-12345" );
+
+	/* end of document */
+	result = iot_json_decode_feed( feed, NULL, 0u, NULL, 0u );
+	assert_int_equal( result, IOT_STATUS_SUCCESS );
+	assert_int_equal( ev.count, 12u );
+
+	iot_json_decode_feed_terminate( feed );
+}
+
+static void test_iot_json_decode_feed_incomplete( void **state )
+{
+	char buf[512u];
+	char err_msg[32u];
+	char json[256u];
+	iot_json_feed_t *feed;
+	iot_status_t result;
+	struct test_feed_events ev;
+
+	memset( &ev, 0, sizeof( struct test_feed_events ) );
+	snprintf( json, 256u, "{\"item1\":[1,2" );
+	feed = iot_json_decode_feed_initialize( buf, 512u, 0u,
+		test_feed_callback, &ev );
+	assert_non_null( feed );
+	result = iot_json_decode_feed( feed, json, strlen( json ), NULL, 0u );
+	assert_int_equal( result, IOT_STATUS_SUCCESS );
+	result = iot_json_decode_feed( feed, NULL, 0u, err_msg, 32u );
+	assert_int_equal( result, IOT_STATUS_PARSE_ERROR );
+	assert_string_equal( err_msg, "incomplete json string" );
+
+	iot_json_decode_feed_terminate( feed );
+}
+
+static void test_iot_json_decode_feed_invalid_character( void **state )
+{
+	char buf[512u];
+	char err_msg[32u];
+	char json[256u];
+	iot_json_feed_t *feed;
+	iot_status_t result;
+
+	snprintf( json, 256u, "{\"item1\" 1}" );
+	feed = iot_json_decode_feed_initialize( buf, 512u, 0u, NULL, NULL );
+	assert_non_null( feed );
+	result = iot_json_decode_feed( feed, json, strlen( json ),
+		err_msg, 32u );
+	assert_int_equal( result, IOT_STATUS_PARSE_ERROR );
+	assert_string_equal( err_msg, "invalid character" );
+
+	iot_json_decode_feed_terminate( feed );
+}
+
+static void test_iot_json_decode_feed_null_feed( void **state )
+{
+	iot_status_t result;
+
+	result = iot_json_decode_feed( NULL, "{}", 2u, NULL, 0u );
+	assert_int_equal( result, IOT_STATUS_BAD_PARAMETER );
+}
+
+static void test_iot_json_decode_feed_too_large( void **state )
+{
+	char buf[sizeof( void * ) * 64u + 300u];
+	char json[256u];
+	iot_json_feed_t *feed;
+	iot_status_t result = IOT_STATUS_SUCCESS;
+	size_t i, json_len;
+
+	/* key is longer than supported */
+	json[0] = '{';
+	json[1] = '"';
+	for ( i = 2u; i < 200u; ++i )
+		json[i] = 'a';
+	snprintf( &json[200u], 56u, "\":1}" );
+	json_len = strlen( json );
+	feed = iot_json_decode_feed_initialize( buf, sizeof( buf ), 0u,
+		NULL, NULL );
+	assert_non_null( feed );
+	for ( i = 0u; i < json_len && result == IOT_STATUS_SUCCESS; i += 16u )
+		result = iot_json_decode_feed( feed, &json[i],
+			json_len - i < 16u ? json_len - i : 16u, NULL, 0u );
+	assert_int_equal( result, IOT_STATUS_NO_MEMORY );
+
+	iot_json_decode_feed_terminate( feed );
+}
+
+static void test_iot_json_decode_feed_initialize_too_small( void **state )
+{
+	char buf[4u];
+	iot_json_feed_t *feed;
+
+	feed = iot_json_decode_feed_initialize( buf, 4u, 0u, NULL, NULL );
+	assert_null( feed );
+}
+
 static void test_iot_json_decode_initialize_null( void **state )
 {
 	iot_json_decoder_t *result;
@@ -1661,6 +1818,86 @@ static void test_iot_json_decode_real_valid( void **state )
 	iot_json_decode_terminate( decoder );
 }
 
+static void test_iot_json_decode_reset_dynamic( void **state )
+{
+	char json[256u];
+	iot_json_decoder_t *decoder;
+#ifndef IOT_STACK_ONLY
+	iot_status_t result;
+	const iot_json_item_t *item;
+	const iot_json_item_t *root = NULL;
+	const char *value = NULL;
+	size_t value_len = 0u;
+
+	/* decoder object, first token & one token buffer growth */
+	will_return_count( __wrap_os_realloc, 1, 3 );
+#endif
+
+	snprintf( json, 256u, "{\"item1\":\"value1\"}" );
+#ifdef IOT_STACK_ONLY
+	decoder = iot_json_decode_initialize( NULL, 0u, 0u );
+	assert_null( decoder );
+#else
+	decoder = iot_json_decode_initialize( NULL, 0u, IOT_JSON_FLAG_DYNAMIC );
+	assert_non_null( decoder );
+	result = iot_json_decode_parse( decoder, json, strlen(json), &root, NULL, 0u );
+	assert_int_equal( result, IOT_STATUS_SUCCESS );
+	assert_non_null( root );
+
+	/* token buffer is kept, no further allocations expected */
+	iot_json_decode_reset( decoder );
+	snprintf( json, 256u, "{\"item2\":\"value2\"}" );
+	result = iot_json_decode_parse( decoder, json, strlen(json), &root, NULL, 0u );
+	assert_int_equal( result, IOT_STATUS_SUCCESS );
+	assert_non_null( root );
+	item = iot_json_decode_object_find( decoder, root, "item2" );
+	assert_non_null( item );
+	result = iot_json_decode_string( decoder, item, &value, &value_len );
+	assert_int_equal( result, IOT_STATUS_SUCCESS );
+	assert_int_equal( value_len, 6u );
+	assert_memory_equal( value, "value2", 6u );
+
+	iot_json_decode_terminate( decoder );
+#endif
+}
+
+static void test_iot_json_decode_reset_null( void **state )
+{
+	iot_json_decode_reset( NULL );
+}
+
+static void test_iot_json_decode_reset_valid( void **state )
+{
+	char buf[256u];
+	char json[256u];
+	iot_json_decoder_t *decoder;
+	iot_status_t result;
+	const iot_json_item_t *item;
+	const iot_json_item_t *root = NULL;
+
+	snprintf( json, 256u, "{\"item1\":\"value1\"}" );
+	decoder = iot_json_decode_initialize( buf, 256u, 0u );
+	assert_non_null( decoder );
+	result = iot_json_decode_parse( decoder, json, strlen(json), &root, NULL, 0u );
+	assert_int_equal( result, IOT_STATUS_SUCCESS );
+	assert_non_null( root );
+
+	iot_json_decode_reset( decoder );
+	snprintf( json, 256u, "{\"item2\":2,\"item3\":true}" );
+	result = iot_json_decode_parse( decoder, json, strlen(json), &root, NULL, 0u );
+	assert_int_equal( result, IOT_STATUS_SUCCESS );
+	assert_non_null( root );
+	assert_int_equal( iot_json_decode_object_size( decoder, root ), 2u );
+	item = iot_json_decode_object_find( decoder, root, "item1" );
+	assert_null( item );
+	item = iot_json_decode_object_find( decoder, root, "item3" );
+	assert_non_null( item );
+	assert_int_equal( iot_json_decode_type( decoder, item ),
+		IOT_JSON_TYPE_BOOL );
+
+	iot_json_decode_terminate( decoder );
+}
+
 static void test_iot_json_decode_string_null_item( void **state )
 {
 	iot_json_decoder_t *json = (iot_json_decoder_t*)0x1;
@@ -1844,6 +2081,12 @@ int main( int argc, char *argv[] )
 		cmocka_unit_test( test_iot_json_decode_bool_null_item ),
 		cmocka_unit_test( test_iot_json_decode_bool_null_json ),
 		cmocka_unit_test( test_iot_json_decode_bool_valid ),
+		cmocka_unit_test( test_iot_json_decode_feed_chunked ),
+		cmocka_unit_test( test_iot_json_decode_feed_incomplete ),
+		cmocka_unit_test( test_iot_json_decode_feed_invalid_character ),
+		cmocka_unit_test( test_iot_json_decode_feed_null_feed ),
+		cmocka_unit_test( test_iot_json_decode_feed_too_large ),
+		cmocka_unit_test( test_iot_json_decode_feed_initialize_too_small ),
 		cmocka_unit_test( test_iot_json_decode_initialize_null ),
 		cmocka_unit_test( test_iot_json_decode_initialize_too_small ),
 		cmocka_unit_test( test_iot_json_decode_initialize_valid ),
@@ -1890,6 +2133,9 @@ int main( int argc, char *argv[] )
 		cmocka_unit_test( test_iot_json_decode_real_null_item ),
 		cmocka_unit_test( test_iot_json_decode_real_null_json ),
 		cmocka_unit_test( test_iot_json_decode_real_valid ),
+		cmocka_unit_test( test_iot_json_decode_reset_dynamic ),
+		cmocka_unit_test( test_iot_json_decode_reset_null ),
+		cmocka_unit_test( test_iot_json_decode_reset_valid ),
 		cmocka_unit_test( test_iot_json_decode_string_null_item ),
 		cmocka_unit_test( test_iot_json_decode_string_null_json ),
 		cmocka_unit_test( test_iot_json_decode_string_valid ),
@@ -22,9 +22,132 @@
 
 #include <float.h> /* for DBL_MIN */
 #include <math.h> /* for fabs */
+#include <stdio.h> /* for snprintf */
 #include <stdlib.h>
 #include <string.h>
 
+#if !defined( IOT_JSON_JANSSON ) && !defined( IOT_JSON_JSONC )
+/**
+ * @brief decodes a binary (CBOR) item produced by the encoder into compact
+ *        JSON text, used to verify binary output
+ *
+ * @note only the subset of CBOR produced by the encoder is supported
+ *
+ * @param[in]      in                  binary item to decode
+ * @param[in]      in_len              number of bytes available in @p in
+ * @param[out]     out                 destination for the JSON text
+ * @param[in]      out_len             size of the destination
+ * @param[in,out]  pos                 current position in the destination
+ *
+ * @return the number of bytes decoded, 0 on error
+ */
+static size_t test_binary_decode( const unsigned char *in, size_t in_len,
+	char *out, size_t out_len, size_t *pos )
+{
+	size_t result = 0u;
+	if ( in_len > 0u && *pos < out_len )
+	{
+		const unsigned int major = in[0] >> 5;
+		const unsigned int info = in[0] & 0x1Fu;
+		unsigned long long arg = info;
+		size_t used = 1u;
+		int ok = 1;
+
+		if ( info >= 24u && info <= 27u )
+		{
+			const size_t bytes = (size_t)1u << ( info - 24u );
+			size_t i;
+			arg = 0u;
+			if ( in_len < 1u + bytes )
+				ok = 0;
+			for ( i = 0u; ok && i < bytes; ++i )
+				arg = ( arg << 8 ) | in[1u + i];
+			used += bytes;
+		}
+
+		switch ( ok ? major : 8u )
+		{
+		case 0u: /* unsigned integer */
+			*pos += (size_t)snprintf( &out[*pos], out_len - *pos,
+				"%llu", arg );
+			break;
+		case 1u: /* negative integer */
+			*pos += (size_t)snprintf( &out[*pos], out_len - *pos,
+				"-%llu", arg + 1u );
+			break;
+		case 3u: /* text string */
+			if ( used + arg <= in_len )
+			{
+				*pos += (size_t)snprintf( &out[*pos], out_len - *pos,
+					"\"%.*s\"", (int)arg, (const char *)&in[used] );
+				used += (size_t)arg;
+			}
+			else
+				ok = 0;
+			break;
+		case 4u: /* indefinite-length array */
+		case 5u: /* indefinite-length map */
+		{
+			size_t count = 0u;
+			ok = ( info == 31u );
+			out[(*pos)++] = ( major == 4u ? '[' : '{' );
+			while ( ok && used < in_len && in[used] != 0xFFu )
+			{
+				size_t len;
+				if ( count > 0u )
+					out[(*pos)++] = ( major == 5u && count % 2u ? ':' : ',' );
+				len = test_binary_decode( &in[used], in_len - used,
+					out, out_len, pos );
+				if ( len == 0u )
+					ok = 0;
+				used += len;
+				++count;
+			}
+			if ( ok && used < in_len )
+			{
+				out[(*pos)++] = ( major == 4u ? ']' : '}' );
+				++used;
+			}
+			else
+				ok = 0;
+			break;
+		}
+		case 7u: /* simple values & floating-point numbers */
+			if ( info == 20u || info == 21u )
+				*pos += (size_t)snprintf( &out[*pos], out_len - *pos,
+					"%s", info == 21u ? "true" : "false" );
+			else if ( info == 26u )
+			{
+				const unsigned int bits = (unsigned int)arg;
+				float f;
+				memcpy( &f, &bits, sizeof( f ) );
+				*pos += (size_t)snprintf( &out[*pos], out_len - *pos,
+					"%g", (double)f );
+			}
+			else if ( info == 27u )
+			{
+				double d;
+				memcpy( &d, &arg, sizeof( d ) );
+				*pos += (size_t)snprintf( &out[*pos], out_len - *pos,
+					"%.10g", d );
+			}
+			else
+				ok = 0;
+			break;
+		default:
+			ok = 0;
+		}
+
+		if ( ok && *pos < out_len )
+		{
+			out[*pos] = '\0';
+			result = used;
+		}
+	}
+	return result;
+}
+#endif /* if !defined( IOT_JSON_JANSSON ) && !defined( IOT_JSON_JSONC ) */
+
 static void test_iot_json_encode_array_end_at_root( void **state )
 {
 	iot_json_encoder_t *e;
@@ -553,6 +676,135 @@ static void test_iot_json_encode_dump_expand( void **state )
 	iot_json_encode_terminate( e );
 }
 
+#if !defined( IOT_JSON_JANSSON ) && !defined( IOT_JSON_JSONC )
+static void test_iot_json_encode_dump_len_binary( void **state )
+{
+	iot_json_encoder_t *e;
+	const char *out;
+	size_t out_len = 0u;
+	iot_status_t result;
+	const unsigned char expected[] =
+		{ 0xBF, 0x61, 'a', 0x01, 0x61, 'b', 0x9F, 0x38, 0x63, 0xF5, 0xFF, 0xFF };
+
+#ifdef IOT_STACK_ONLY
+	char buffer[ 128u ];
+	e = iot_json_encode_initialize( buffer, sizeof( buffer ),
+		IOT_JSON_FLAG_BINARY );
+#else
+	will_return_always( __wrap_os_realloc, 1 );
+	e = iot_json_encode_initialize( NULL, 0u, IOT_JSON_FLAG_BINARY );
+#endif
+	assert_non_null( e );
+
+	result = iot_json_encode_integer( e, "a", 1 );
+	assert_int_equal( result, IOT_STATUS_SUCCESS );
+	result = iot_json_encode_array_start( e, "b" );
+	assert_int_equal( result, IOT_STATUS_SUCCESS );
+	result = iot_json_encode_integer( e, NULL, -100 );
+	assert_int_equal( result, IOT_STATUS_SUCCESS );
+	result = iot_json_encode_bool( e, NULL, IOT_TRUE );
+	assert_int_equal( result, IOT_STATUS_SUCCESS );
+
+	/* open structures are closed in the output */
+	out = iot_json_encode_dump_len( e, &out_len );
+	assert_non_null( out );
+	assert_int_equal( out_len, sizeof( expected ) );
+	assert_memory_equal( out, expected, sizeof( expected ) );
+
+	iot_json_encode_terminate( e );
+}
+
+static void test_iot_json_encode_dump_len_binary_decode( void **state )
+{
+	iot_json_encoder_t *e;
+	char json_str[ 256u ];
+	const char *out;
+	size_t out_len = 0u;
+	size_t pos = 0u;
+	iot_status_t result;
+
+#ifdef IOT_STACK_ONLY
+	char buffer[ 256u ];
+	e = iot_json_encode_initialize( buffer, sizeof( buffer ),
+		IOT_JSON_FLAG_BINARY );
+#else
+	will_return_always( __wrap_os_realloc, 1 );
+	e = iot_json_encode_initialize( NULL, 0u, IOT_JSON_FLAG_BINARY );
+#endif
+	assert_non_null( e );
+
+	result = iot_json_encode_object_start( e, "cmd" );
+	assert_int_equal( result, IOT_STATUS_SUCCESS );
+	result = iot_json_encode_string( e, "command", "property.publish" );
+	assert_int_equal( result, IOT_STATUS_SUCCESS );
+	result = iot_json_encode_object_start( e, "params" );
+	assert_int_equal( result, IOT_STATUS_SUCCESS );
+	result = iot_json_encode_string( e, "key", "temp" );
+	assert_int_equal( result, IOT_STATUS_SUCCESS );
+	result = iot_json_encode_real( e, "value", 21.5 );
+	assert_int_equal( result, IOT_STATUS_SUCCESS );
+	result = iot_json_encode_real( e, "exact", 0.1 );
+	assert_int_equal( result, IOT_STATUS_SUCCESS );
+	result = iot_json_encode_integer( e, "big", 70000 );
+	assert_int_equal( result, IOT_STATUS_SUCCESS );
+	result = iot_json_encode_bool( e, "republish", IOT_FALSE );
+	assert_int_equal( result, IOT_STATUS_SUCCESS );
+	result = iot_json_encode_object_end( e );
+	assert_int_equal( result, IOT_STATUS_SUCCESS );
+	result = iot_json_encode_object_end( e );
+	assert_int_equal( result, IOT_STATUS_SUCCESS );
+
+	out = iot_json_encode_dump_len( e, &out_len );
+	assert_non_null( out );
+	assert_int_equal( test_binary_decode( (const unsigned char *)out,
+		out_len, json_str, sizeof( json_str ), &pos ), out_len );
+	assert_string_equal( json_str, "{\"cmd\":{\"command\":\"property.publish\","
+		"\"params\":{\"key\":\"temp\",\"value\":21.5,\"exact\":0.1,"
+		"\"big\":70000,\"republish\":false}}}" );
+
+	/* output is smaller than the equivalent JSON text */
+	assert_true( out_len < strlen( json_str ) );
+
+	iot_json_encode_terminate( e );
+}
+#endif /* if !defined( IOT_JSON_JANSSON ) && !defined( IOT_JSON_JSONC ) */
+
+static void test_iot_json_encode_dump_len_null_item( void **state )
+{
+	const char *result;
+	size_t len = 1u;
+	result = iot_json_encode_dump_len( NULL, &len );
+	assert_null( result );
+	assert_int_equal( len, 0u );
+}
+
+static void test_iot_json_encode_dump_len_text( void **state )
+{
+	iot_json_encoder_t *e;
+	const char *json_str;
+	size_t json_len = 0u;
+	iot_status_t result;
+
+#ifdef IOT_STACK_ONLY
+	char buffer[ 128u ];
+	e = iot_json_encode_initialize( buffer, sizeof( buffer ), 0u );
+#else
+	will_return_always( __wrap_os_realloc, 1 );
+	e = iot_json_encode_initialize( NULL, 0u, IOT_JSON_FLAG_DYNAMIC );
+#endif
+	assert_non_null( e );
+
+	result = iot_json_encode_string( e, "key", "value" );
+	assert_int_equal( result, IOT_STATUS_SUCCESS );
+
+	json_str = iot_json_encode_dump_len( e, &json_len );
+	assert_non_null( json_str );
+	assert_string_equal( json_str, "{\"key\":\"value\"}" );
+	assert_int_equal( json_len, strlen( json_str ) );
+
+	iot_json_encode_terminate( e );
+}
+
 static void test_iot_json_encode_dump_indent_0( void **state )
 {
 	iot_json_encoder_t *e;
@@ -1083,6 +1335,33 @@ static void test_iot_json_encode_object_cancel_at_root( void **state )
 	iot_json_encode_terminate( e );
 }
 
+#if !defined( IOT_JSON_JANSSON ) && !defined( IOT_JSON_JSONC )
+static void test_iot_json_encode_object_cancel_binary( void **state )
+{
+	iot_json_encoder_t *e;
+	iot_status_t result;
+
+#ifdef IOT_STACK_ONLY
+	char buffer[ 128u ];
+	e = iot_json_encode_initialize( buffer, sizeof( buffer ),
+		IOT_JSON_FLAG_BINARY );
+#else
+	will_return_always( __wrap_os_realloc, 1 );
+	e = iot_json_encode_initialize( NULL, 0u, IOT_JSON_FLAG_BINARY );
+#endif
+	assert_non_null( e );
+
+	result = iot_json_encode_object_start( e, "obj" );
+	assert_int_equal( result, IOT_STATUS_SUCCESS );
+	result = iot_json_encode_object_cancel( e );
+	assert_int_equal( result, IOT_STATUS_NOT_SUPPORTED );
+	result = iot_json_encode_object_clear( e );
+	assert_int_equal( result, IOT_STATUS_NOT_SUPPORTED );
+
+	iot_json_encode_terminate( e );
+}
+#endif /* if !defined( IOT_JSON_JANSSON ) && !defined( IOT_JSON_JSONC ) */
+
 static void test_iot_json_encode_object_cancel_in_array( void **state )
 {
 	iot_json_encoder_t *e;
@@ -1885,6 +2164,53 @@ static void test_iot_json_encode_real_outside_object( void **state )
 	iot_json_encode_terminate( e );
 }
 
+static void test_iot_json_encode_reset_null_item( void **state )
+{
+	iot_json_encode_reset( NULL );
+}
+
+static void test_iot_json_encode_reset_reuse( void **state )
+{
+	iot_json_encoder_t *e;
+	const char *json_str;
+	iot_status_t result;
+
+#ifdef IOT_STACK_ONLY
+	char buffer[ 128u ];
+	e = iot_json_encode_initialize( buffer, sizeof( buffer ), 0u );
+#else
+	will_return_always( __wrap_os_realloc, 1 );
+	e = iot_json_encode_initialize( NULL, 0u, IOT_JSON_FLAG_DYNAMIC );
+#endif
+	assert_non_null( e );
+
+	result = iot_json_encode_object_start( e, NULL );
+	assert_int_equal( result, IOT_STATUS_SUCCESS );
+	result = iot_json_encode_object_start( e, "obj" );
+	assert_int_equal( result, IOT_STATUS_SUCCESS );
+	result = iot_json_encode_string( e, "key", "a long value" );
+	assert_int_equal( result, IOT_STATUS_SUCCESS );
+
+	json_str = iot_json_encode_dump( e );
+	assert_non_null( json_str );
+	assert_string_equal( json_str, "{\"obj\":{\"key\":\"a long value\"}}" );
+
+	iot_json_encode_reset( e );
+
+	result = iot_json_encode_object_start( e, NULL );
+	assert_int_equal( result, IOT_STATUS_SUCCESS );
+	result = iot_json_encode_integer( e, "id", 2 );
+	assert_int_equal( result, IOT_STATUS_SUCCESS );
+	result = iot_json_encode_object_end( e );
+	assert_int_equal( result, IOT_STATUS_SUCCESS );
+
+	json_str = iot_json_encode_dump( e );
+	assert_non_null( json_str );
+	assert_string_equal( json_str, "{\"id\":2}" );
+
+	iot_json_encode_terminate( e );
+}
+
 static void test_iot_json_encode_string_as_root_item( void **state )
 {
 	iot_json_encoder_t *e;
@@ -1905,6 +2231,38 @@ static void test_iot_json_encode_string_as_root_item( void **state )
 	iot_json_encode_terminate( e );
 }
 
+#if !defined( IOT_JSON_JANSSON ) && !defined( IOT_JSON_JSONC )
+static void test_iot_json_encode_string_binary_no_memory( void **state )
+{
+	iot_json_encoder_t *e;
+	char buffer[ 64u ];
+	const char *out;
+	size_t out_len = 0u;
+	size_t pos = 0u;
+	char json_str[ 64u ];
+	iot_status_t result;
+
+	e = iot_json_encode_initialize( buffer, sizeof( buffer ),
+		IOT_JSON_FLAG_BINARY );
+	assert_non_null( e );
+
+	result = iot_json_encode_string( e, "key", "value" );
+	assert_int_equal( result, IOT_STATUS_SUCCESS );
+	result = iot_json_encode_string( e, "long",
+		"this value is far too long to fit in the buffer provided" );
+	assert_int_equal( result, IOT_STATUS_NO_MEMORY );
+
+	/* output remains valid */
+	out = iot_json_encode_dump_len( e, &out_len );
+	assert_non_null( out );
+	assert_int_equal( test_binary_decode( (const unsigned char *)out,
+		out_len, json_str, sizeof( json_str ), &pos ), out_len );
+	assert_string_equal( json_str, "{\"key\":\"value\"}" );
+
+	iot_json_encode_terminate( e );
+}
+#endif /* if !defined( IOT_JSON_JANSSON ) && !defined( IOT_JSON_JSONC ) */
+
 static void test_iot_json_encode_string_escape_chars( void **state )
 {
 	iot_json_encoder_t *e;
@@ -2133,6 +2491,12 @@ int main( int argc, char *argv[] )
 		cmocka_unit_test( test_iot_json_encode_dump_no_items ),
 		cmocka_unit_test( test_iot_json_encode_dump_null_item ),
 		cmocka_unit_test( test_iot_json_encode_dump_expand ),
+#if !defined( IOT_JSON_JANSSON ) && !defined( IOT_JSON_JSONC )
+		cmocka_unit_test( test_iot_json_encode_dump_len_binary ),
+		cmocka_unit_test( test_iot_json_encode_dump_len_binary_decode ),
+#endif
+		cmocka_unit_test( test_iot_json_encode_dump_len_null_item ),
+		cmocka_unit_test( test_iot_json_encode_dump_len_text ),
 		cmocka_unit_test( test_iot_json_encode_dump_indent_0 ),
 #ifndef IOT_JSON_JSONC
 		cmocka_unit_test( test_iot_json_encode_dump_indent_1 ),
@@ -2150,6 +2514,9 @@ int main( int argc, char *argv[] )
 		cmocka_unit_test( test_iot_json_encode_integer_null_item ),
 		cmocka_unit_test( test_iot_json_encode_integer_outside_object ),
 		cmocka_unit_test( test_iot_json_encode_object_cancel_at_root ),
+#if !defined( IOT_JSON_JANSSON ) && !defined( IOT_JSON_JSONC )
+		cmocka_unit_test( test_iot_json_encode_object_cancel_binary ),
+#endif
 		cmocka_unit_test( test_iot_json_encode_object_cancel_in_array ),
 		cmocka_unit_test( test_iot_json_encode_object_cancel_in_object ),
 		cmocka_unit_test( test_iot_json_encode_object_cancel_in_root_object ),
@@ -2179,7 +2546,12 @@ int main( int argc, char *argv[] )
 		cmocka_unit_test( test_iot_json_encode_real_inside_object_blank_key ),
 		cmocka_unit_test( test_iot_json_encode_real_null_item ),
 		cmocka_unit_test( test_iot_json_encode_real_outside_object ),
+		cmocka_unit_test( test_iot_json_encode_reset_null_item ),
+		cmocka_unit_test( test_iot_json_encode_reset_reuse ),
 		cmocka_unit_test( test_iot_json_encode_string_as_root_item ),
+#if !defined( IOT_JSON_JANSSON ) && !defined( IOT_JSON_JSONC )
+		cmocka_unit_test( test_iot_json_encode_string_binary_no_memory ),
+#endif
 		cmocka_unit_test( test_iot_json_encode_string_escape_chars ),
 		cmocka_unit_test( test_iot_json_encode_string_inside_array_null_key ),
 		cmocka_unit_test( test_iot_json_encode_string_inside_array_valid_key ),
@@ -40,6 +40,7 @@ iot_status_t __wrap_iot_log( iot_t *handle,
                              unsigned int line_number,
                              const char *log_msg_fmt,
                              ... );
+void __wrap_iot_loop_wakeup( iot_t *lib );
 
 /* plug-in support */
 iot_status_t __wrap_iot_plugin_perform( iot_t *lib,
@@ -98,6 +99,8 @@ iot_status_t __wrap_iot_json_decode_real(
 	const iot_json_decoder_t *json,
 	const iot_json_item_t *item,
 	iot_float64_t *value );
+void __wrap_iot_json_decode_reset(
+	iot_json_decoder_t *json );
 iot_status_t __wrap_iot_json_decode_string(
 	const iot_json_decoder_t *json,
 	const iot_json_item_t *item,
@@ -163,6 +166,10 @@ iot_status_t __wrap_iot_log( iot_t *handle,
 	return IOT_STATUS_FAILURE;
 }
 
+void __wrap_iot_loop_wakeup( iot_t *lib )
+{
+}
+
 iot_status_t __wrap_iot_plugin_perform( iot_t *lib,
                                         iot_transaction_t *txn,
                                         iot_operation_t op,
@@ -298,6 +305,11 @@ iot_status_t __wrap_iot_json_decode_real(
 	return IOT_STATUS_SUCCESS;
 }
 
+void __wrap_iot_json_decode_reset(
+	iot_json_decoder_t *json )
+{
+}
+
 iot_status_t __wrap_iot_json_decode_string(
 	const iot_json_decoder_t *json,
 	const iot_json_item_t *item,
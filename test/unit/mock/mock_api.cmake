@@ -22,6 +22,7 @@ set( MOCK_API_FUNC
 	"iot_base64_encode_size"
 	"iot_error"
 	"iot_log"
+	"iot_loop_wakeup"
 	"iot_protocol"
 	"iot_log"
 	"iot_plugin_perform"
@@ -39,6 +40,9 @@ set( MOCK_API_FUNC
 	"iot_json_decode_array_iterator_value"
 	"iot_json_decode_array_size"
 	"iot_json_decode_bool"
+	"iot_json_decode_feed"
+	"iot_json_decode_feed_initialize"
+	"iot_json_decode_feed_terminate"
 	"iot_json_decode_initialize"
 	"iot_json_decode_integer"
 	"iot_json_decode_number"
@@ -50,6 +54,7 @@ set( MOCK_API_FUNC
 	"iot_json_decode_object_size"
 	"iot_json_decode_parse"
 	"iot_json_decode_real"
+	"iot_json_decode_reset"
 	"iot_json_decode_string"
 	"iot_json_decode_terminate"
 	"iot_json_decode_type"